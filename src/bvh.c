@@ -0,0 +1,215 @@
+#include <math.h>
+#include <string.h>
+
+#include "bvh.h"
+#include "rtalloc.h"
+
+
+// The SAH cost of traversing a BVH node, relative to the cost of a ray/primitive test.
+#define BVH_TRAVERSAL_COST      1.0
+
+
+typedef struct BuildBin_s       BuildBin;
+
+struct BuildBin_s {
+    float       min[3];
+    float       max[3];
+    uint32_t    count;
+};
+
+
+static void build_node(BVH *bvh, BVHBounds *bounds, uint32_t *order, uint32_t nodeIdx, uint32_t first, uint32_t count, uint32_t depth);
+static bool find_sah_split(BVHBounds *bounds, uint32_t first, uint32_t count, float *cmin, float *cmax, double nodeArea,
+    uint32_t *splitAxis, float *splitPos);
+static inline void swap_primitives(BVHBounds *bounds, uint32_t *order, uint32_t a, uint32_t b);
+
+
+void bvh_init(BVH *bvh)
+{
+    bvh->nodes = NULL;
+    bvh->nodesLength = 0;
+}
+
+void bvh_free(BVH *bvh)
+{
+    rtfree(bvh->nodes);
+    bvh->nodes = NULL;
+    bvh->nodesLength = 0;
+}
+
+void bvh_build(BVH *bvh, BVHBounds *bounds, uint32_t *order, uint32_t count)
+{
+    bvh_free(bvh);
+    if (count == 0) {
+        return;
+    }
+
+    // A binary tree with `count` leaves (at most) has 2*count - 1 nodes.
+    bvh->nodes = rtalloc(sizeof(BVHNode) * (2 * (size_t)count - 1));
+    bvh->nodesLength = 1;
+    build_node(bvh, bounds, order, 0, 0, count, 0);
+    bvh->nodes = rtrealloc(bvh->nodes, sizeof(BVHNode) * bvh->nodesLength);
+}
+
+void bvh_bounds_set(BVHBounds *bounds, Vector3 *min, Vector3 *max)
+{
+    bounds->min[0] = bvh_float_down(min->x);
+    bounds->min[1] = bvh_float_down(min->y);
+    bounds->min[2] = bvh_float_down(min->z);
+    bounds->max[0] = bvh_float_up(max->x);
+    bounds->max[1] = bvh_float_up(max->y);
+    bounds->max[2] = bvh_float_up(max->z);
+}
+
+/**
+ * Sets the bounds of the node `nodeIdx` to the bounds of the primitives [first, first + count) and splits it (recursively), or makes it a
+ * leaf.
+ */
+static void build_node(BVH *bvh, BVHBounds *bounds, uint32_t *order, uint32_t nodeIdx, uint32_t first, uint32_t count, uint32_t depth)
+{
+    BVHNode *node = &bvh->nodes[nodeIdx];
+    float cmin[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    float cmax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for (uint32_t a = 0; a < 3; a++) {
+        node->min[a] = FLT_MAX;
+        node->max[a] = -FLT_MAX;
+    }
+    for (uint32_t i = first; i < first + count; i++) {
+        BVHBounds *b = &bounds[i];
+        for (uint32_t a = 0; a < 3; a++) {
+            node->min[a] = fminf(node->min[a], b->min[a]);
+            node->max[a] = fmaxf(node->max[a], b->max[a]);
+            float c = (b->min[a] + b->max[a]) * 0.5f;
+            cmin[a] = fminf(cmin[a], c);
+            cmax[a] = fmaxf(cmax[a], c);
+        }
+    }
+    node->first = first;
+    node->count = count;
+
+    if (count == 1 || depth >= BVH_DEPTH_MAX) {
+        return;
+    }
+
+    uint32_t axis;
+    float splitPos;
+    uint32_t mid;
+    if (find_sah_split(bounds, first, count, cmin, cmax, bvh_box_area(node->min, node->max), &axis, &splitPos)) {
+        // Partition the primitives by the side of the split that their centroid is on.
+        uint32_t i = first;
+        uint32_t j = first + count;
+        while (i < j) {
+            if ((bounds[i].min[axis] + bounds[i].max[axis]) * 0.5f < splitPos) {
+                i++;
+            } else {
+                swap_primitives(bounds, order, i, --j);
+            }
+        }
+        mid = i;
+    } else if (count > BVH_LEAF_MAX) {
+        // Splitting doesn't pay off (or all the centroids are at the same point), but the leaf would be too big: split it in half.
+        mid = first + count / 2;
+    } else {
+        return;
+    }
+    if (mid == first || mid == first + count) {
+        mid = first + count / 2;
+    }
+
+    uint32_t children = bvh->nodesLength;
+    bvh->nodesLength += 2;
+    node->first = children;
+    node->count = 0;
+    build_node(bvh, bounds, order, children, first, mid - first, depth + 1);
+    build_node(bvh, bounds, order, children + 1, mid, first + count - mid, depth + 1);
+}
+
+/**
+ * Finds the split of the primitives [first, first + count) (with the centroid bounds `cmin`, `cmax`) with the lowest SAH cost, among the
+ * bin boundaries of each axis. Returns false if it is cheaper to keep them in a leaf (or if they can't be split by their centroids).
+ */
+static bool find_sah_split(BVHBounds *bounds, uint32_t first, uint32_t count, float *cmin, float *cmax, double nodeArea,
+    uint32_t *splitAxis, float *splitPos)
+{
+    double bestCost = DBL_MAX;
+    for (uint32_t a = 0; a < 3; a++) {
+        float extent = cmax[a] - cmin[a];
+        if (! (extent > 0)) {
+            continue;
+        }
+
+        BuildBin bins[BVH_BINS];
+        for (uint32_t b = 0; b < BVH_BINS; b++) {
+            bins[b] = (BuildBin){.min = {FLT_MAX, FLT_MAX, FLT_MAX}, .max = {-FLT_MAX, -FLT_MAX, -FLT_MAX}, .count = 0};
+        }
+        float scale = BVH_BINS / extent;
+        for (uint32_t i = first; i < first + count; i++) {
+            BVHBounds *pb = &bounds[i];
+            uint32_t b = (uint32_t)(((pb->min[a] + pb->max[a]) * 0.5f - cmin[a]) * scale);
+            BuildBin *bin = &bins[b < BVH_BINS ? b : BVH_BINS - 1];
+            bin->count++;
+            for (uint32_t k = 0; k < 3; k++) {
+                bin->min[k] = fminf(bin->min[k], pb->min[k]);
+                bin->max[k] = fmaxf(bin->max[k], pb->max[k]);
+            }
+        }
+
+        // The area and the amount of primitives on the left side of each bin boundary (sweeping from the left)...
+        double leftArea[BVH_BINS - 1];
+        uint32_t leftCount[BVH_BINS - 1];
+        BuildBin acc = bins[0];
+        for (uint32_t b = 0; b < BVH_BINS - 1; b++) {
+            if (b > 0) {
+                acc.count += bins[b].count;
+                for (uint32_t k = 0; k < 3; k++) {
+                    acc.min[k] = fminf(acc.min[k], bins[b].min[k]);
+                    acc.max[k] = fmaxf(acc.max[k], bins[b].max[k]);
+                }
+            }
+            leftArea[b] = acc.count > 0 ? bvh_box_area(acc.min, acc.max) : 0;
+            leftCount[b] = acc.count;
+        }
+
+        // ... and then on the right side (sweeping from the right).
+        acc = bins[BVH_BINS - 1];
+        for (uint32_t b = BVH_BINS - 1; b > 0; b--) {
+            if (b < BVH_BINS - 1) {
+                acc.count += bins[b].count;
+                for (uint32_t k = 0; k < 3; k++) {
+                    acc.min[k] = fminf(acc.min[k], bins[b].min[k]);
+                    acc.max[k] = fmaxf(acc.max[k], bins[b].max[k]);
+                }
+            }
+            if (leftCount[b - 1] == 0 || acc.count == 0) {
+                continue;
+            }
+            double cost = leftArea[b - 1] * leftCount[b - 1] + bvh_box_area(acc.min, acc.max) * acc.count;
+            if (cost < bestCost) {
+                bestCost = cost;
+                *splitAxis = a;
+                *splitPos = cmin[a] + b / scale;
+            }
+        }
+    }
+
+    if (bestCost == DBL_MAX) {
+        return false;
+    }
+    if (count > BVH_LEAF_MAX) {
+        return true;
+    }
+    // Splitting costs a node traversal plus the tests of the children's primitives (weighted by the probability of a ray hitting them).
+    // A node with a zero area (e.g. of points) is always split.
+    return ! (nodeArea > 0) || BVH_TRAVERSAL_COST + bestCost / nodeArea < count;
+}
+
+static inline void swap_primitives(BVHBounds *bounds, uint32_t *order, uint32_t a, uint32_t b)
+{
+    BVHBounds tb = bounds[a];
+    bounds[a] = bounds[b];
+    bounds[b] = tb;
+
+    uint32_t to = order[a];
+    order[a] = order[b];
+    order[b] = to;
+}
@@ -0,0 +1,278 @@
+#ifndef __BVH_H__
+#define __BVH_H__
+
+/**
+ * A bounding volume hierarchy (BVH): a binary tree of axis-aligned boxes over a set of primitives (the triangles of a mesh, the spheres of
+ * a prototype, the instances of a scene), so that a ray is only tested against the few primitives near its path (about log2(primitives)
+ * nodes, instead of every primitive).
+ *
+ * The BVH is built with the surface area heuristic (SAH) over binned primitive centroids (see bvh_build()). Its nodes are compact (32
+ * bytes: float bounds, rounded outwards), so two of them fit into a cache line. The BVH doesn't know what its primitives are: the leaves
+ * refer to ranges of primitive indexes, bvh_build() reorders the primitives so that each leaf's primitives are consecutive and
+ * bvh_intersect() calls back to test them. bvh_occluded() is the any-hit variant (for shadow and visibility rays): it stops at the first
+ * leaf with a hit.
+ */
+
+typedef struct BVH_s            BVH;
+typedef struct BVHNode_s        BVHNode;
+typedef struct BVHBounds_s      BVHBounds;
+
+
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "vector.h"
+
+
+// The amount of bins along each axis that the SAH cost of the splits is evaluated for, when building the BVH.
+#define BVH_BINS                16
+
+// The maximum amount of primitives in a BVH leaf (nodes with more primitives are always split, if they can be).
+#define BVH_LEAF_MAX            8
+
+// The maximum depth of the BVH (nodes at this depth become leaves, regardless of the amount of their primitives).
+#define BVH_DEPTH_MAX           64
+
+
+struct BVHNode_s {
+    float           min[3];
+    float           max[3];
+
+    // For leaves (count > 0): the primitives [first, first + count). For inner nodes (count == 0): the index of the first of the two
+    // children (the second one follows it).
+    uint32_t        first;
+    uint32_t        count;
+};
+
+struct BVH_s {
+    BVHNode        *nodes;              // NULL if the BVH is empty. nodes[0] is the root.
+    uint32_t        nodesLength;
+};
+
+// The bounds of a primitive (the input of bvh_build()).
+struct BVHBounds_s {
+    float           min[3];
+    float           max[3];
+};
+
+// Tests the ray against the primitives [first, first + count) of a leaf. If it hits one closer than `*dist` - stores the distance to it in
+// `*dist` and its index in `*primitive` and returns true.
+typedef bool (*BVHLeafFn)(void *data, uint32_t first, uint32_t count, double *dist, uint32_t *primitive);
+
+
+// Included after the structs: ray.h includes mesh.h (through scene.h), which needs the complete BVH type. bvh_intersect() takes the ray
+// origin and direction (instead of a Ray), because the Ray type may be incomplete here.
+#include "ray.h"
+
+
+/**
+ * Initializes `bvh` as an empty BVH.
+ */
+void bvh_init(BVH *bvh);
+
+/**
+ * Frees the nodes of `bvh` (it becomes empty).
+ */
+void bvh_free(BVH *bvh);
+
+/**
+ * (Re-)builds `bvh` over `count` primitives with `bounds`. Reorders `bounds` and `order` together, so that the primitives of each leaf are
+ * consecutive: the caller has to reorder its primitives the same way (e.g. fill `order` with 0, 1, 2, ... and move primitive order[i] to
+ * index i afterwards).
+ */
+void bvh_build(BVH *bvh, BVHBounds *bounds, uint32_t *order, uint32_t count);
+
+/**
+ * Sets `bounds` to the box [min, max], rounded outwards to floats (so the float box never misses a part of the primitive).
+ */
+void bvh_bounds_set(BVHBounds *bounds, Vector3 *min, Vector3 *max);
+
+/**
+ * Finds the closest primitive of `bvh` that the ray from `rayOrigin` in `rayDirection` hits closer than `*dist` (and not closer than
+ * RAY_DISTANCE_MIN), testing the leaves that the ray goes through with `leaf_fn` (closer leaves first). If there is one - stores the
+ * distance to it in `*dist` and its index in `*primitive` and returns true. Otherwise returns false (and leaves them unchanged).
+ *
+ * This function is inlined into its callers, so that `leaf_fn` (a constant) is inlined too.
+ */
+static inline bool bvh_intersect(BVH *bvh, Vector3 *rayOrigin, Vector3 *rayDirection, BVHLeafFn leaf_fn, void *data, double *dist,
+    uint32_t *primitive);
+
+/**
+ * Returns true if the ray from `rayOrigin` in `rayDirection` hits any primitive of `bvh` closer than `dist` (and not closer than
+ * RAY_DISTANCE_MIN), testing the leaves that the ray goes through with `leaf_fn` (in no particular order), until one of them returns
+ * true. `leaf_fn` may return as soon as it finds any hit (instead of the closest one).
+ *
+ * This function is inlined into its callers, so that `leaf_fn` (a constant) is inlined too.
+ */
+static inline bool bvh_occluded(BVH *bvh, Vector3 *rayOrigin, Vector3 *rayDirection, BVHLeafFn leaf_fn, void *data, double dist);
+
+/**
+ * Returns true if the ray (with `origin` and the inverted direction `invDir`) hits the bounds of `node` at a distance
+ * [RAY_DISTANCE_MIN, maxDist] and stores the distance where it enters them in `nearDist`.
+ */
+static inline bool bvh_ray_hits_node(BVHNode *node, double *origin, double *invDir, double maxDist, double *nearDist);
+
+/**
+ * Returns the surface area of the box [min, max] (for the SAH costs of the BVHs, see bvh_build() and wide_bvh.h).
+ */
+static inline double bvh_box_area(float *min, float *max);
+
+/**
+ * Returns the largest float <= `x` (bvh_float_up(): the smallest float >= `x`), so that float bounds never shrink.
+ */
+static inline float bvh_float_down(double x);
+static inline float bvh_float_up(double x);
+
+
+static inline bool bvh_intersect(BVH *bvh, Vector3 *rayOrigin, Vector3 *rayDirection, BVHLeafFn leaf_fn, void *data, double *dist,
+    uint32_t *primitive)
+{
+    if (bvh->nodesLength == 0) {
+        return false;
+    }
+
+    double origin[3] = {rayOrigin->x, rayOrigin->y, rayOrigin->z};
+    double invDir[3] = {1.0 / rayDirection->x, 1.0 / rayDirection->y, 1.0 / rayDirection->z};
+
+    double nearDist;
+    if (! bvh_ray_hits_node(&bvh->nodes[0], origin, invDir, *dist, &nearDist)) {
+        return false;
+    }
+
+    bool hit = false;
+    uint32_t stack[BVH_DEPTH_MAX + 1];
+    uint32_t stackLength = 0;
+    uint32_t nodeIdx = 0;
+    while (true) {
+        BVHNode *node = &bvh->nodes[nodeIdx];
+        if (node->count > 0) {
+            hit |= leaf_fn(data, node->first, node->count, dist, primitive);
+        } else {
+            // Visit the closer child first (and skip the farther one later, if a closer primitive was found by then).
+            double nearA = 0, nearB = 0;
+            bool hitA = bvh_ray_hits_node(&bvh->nodes[node->first], origin, invDir, *dist, &nearA);
+            bool hitB = bvh_ray_hits_node(&bvh->nodes[node->first + 1], origin, invDir, *dist, &nearB);
+            if (hitA && hitB) {
+                if (nearA <= nearB) {
+                    stack[stackLength++] = node->first + 1;
+                    nodeIdx = node->first;
+                } else {
+                    stack[stackLength++] = node->first;
+                    nodeIdx = node->first + 1;
+                }
+                continue;
+            } else if (hitA) {
+                nodeIdx = node->first;
+                continue;
+            } else if (hitB) {
+                nodeIdx = node->first + 1;
+                continue;
+            }
+        }
+
+        // Pop the next node, skipping the ones that are farther than the closest hit found since they were pushed.
+        do {
+            if (stackLength == 0) {
+                return hit;
+            }
+            nodeIdx = stack[--stackLength];
+        } while (hit && ! bvh_ray_hits_node(&bvh->nodes[nodeIdx], origin, invDir, *dist, &nearDist));
+    }
+}
+
+static inline bool bvh_occluded(BVH *bvh, Vector3 *rayOrigin, Vector3 *rayDirection, BVHLeafFn leaf_fn, void *data, double dist)
+{
+    if (bvh->nodesLength == 0) {
+        return false;
+    }
+
+    double origin[3] = {rayOrigin->x, rayOrigin->y, rayOrigin->z};
+    double invDir[3] = {1.0 / rayDirection->x, 1.0 / rayDirection->y, 1.0 / rayDirection->z};
+
+    double nearDist;
+    if (! bvh_ray_hits_node(&bvh->nodes[0], origin, invDir, dist, &nearDist)) {
+        return false;
+    }
+
+    // Any hit will do, so the children are not sorted by distance and `dist` never shrinks.
+    uint32_t stack[BVH_DEPTH_MAX + 1];
+    uint32_t stackLength = 0;
+    uint32_t nodeIdx = 0;
+    while (true) {
+        BVHNode *node = &bvh->nodes[nodeIdx];
+        if (node->count > 0) {
+            double leafDist = dist;
+            uint32_t primitive;
+            if (leaf_fn(data, node->first, node->count, &leafDist, &primitive)) {
+                return true;
+            }
+        } else {
+            bool hitA = bvh_ray_hits_node(&bvh->nodes[node->first], origin, invDir, dist, &nearDist);
+            bool hitB = bvh_ray_hits_node(&bvh->nodes[node->first + 1], origin, invDir, dist, &nearDist);
+            if (hitA) {
+                if (hitB) {
+                    stack[stackLength++] = node->first + 1;
+                }
+                nodeIdx = node->first;
+                continue;
+            } else if (hitB) {
+                nodeIdx = node->first + 1;
+                continue;
+            }
+        }
+
+        if (stackLength == 0) {
+            return false;
+        }
+        nodeIdx = stack[--stackLength];
+    }
+}
+
+static inline bool bvh_ray_hits_node(BVHNode *node, double *origin, double *invDir, double maxDist, double *nearDist)
+{
+    double tNear = RAY_DISTANCE_MIN;
+    double tFar = maxDist;
+    for (uint32_t a = 0; a < 3; a++) {
+        if (invDir[a] > DBL_MAX || invDir[a] < -DBL_MAX) {
+            // The ray is parallel to the slab (0 * infinity would be NaN for an origin on its boundary): it is inside it everywhere or
+            // nowhere.
+            if (origin[a] < node->min[a] || origin[a] > node->max[a]) {
+                return false;
+            }
+            continue;
+        }
+        // (Written as conditional expressions, which compile to branchless min/max instructions.)
+        double t0 = (node->min[a] - origin[a]) * invDir[a];
+        double t1 = (node->max[a] - origin[a]) * invDir[a];
+        double tEnter = t0 < t1 ? t0 : t1;
+        double tExit = t0 < t1 ? t1 : t0;
+        tNear = tEnter > tNear ? tEnter : tNear;
+        tFar = tExit < tFar ? tExit : tFar;
+    }
+    *nearDist = tNear;
+    return tNear <= tFar;
+}
+
+static inline double bvh_box_area(float *min, float *max)
+{
+    double dx = max[0] - min[0];
+    double dy = max[1] - min[1];
+    double dz = max[2] - min[2];
+    return 2.0 * (dx*dy + dy*dz + dz*dx);
+}
+
+static inline float bvh_float_down(double x)
+{
+    float f = (float)x;
+    return (double)f > x ? nextafterf(f, -INFINITY) : f;
+}
+
+static inline float bvh_float_up(double x)
+{
+    float f = (float)x;
+    return (double)f < x ? nextafterf(f, INFINITY) : f;
+}
+
+#endif // __BVH_H__
@@ -1,7 +1,7 @@
 #include <stdint.h>
 #include <stdio.h>
 
-#include "main.h"
+#include "rtcommon.h"
 
 #include "camera.h"
 #include "ray.h"
@@ -19,9 +19,11 @@
  * Result: the spheres are skewed towards the sides of the image - they are "eggs" (i.e. reverse of being "blunt"). They are skewed towards
  * each side (top/left/right/bottom). This is visible with FOV 90. With FOV 40 - it is barely noticeable.
  */
-void cam_set(Camera *cam, Ray *centerRay)
+void cam_set(Camera *cam, Ray *centerRay, uint32_t imgHeight, uint32_t imgWidth)
 {
     cam->camCenterRay = *centerRay;
+    cam->imgHeight = imgHeight;
+    cam->imgWidth = imgWidth;
 
     Vector3 *dir = &centerRay->direction;
     double dirVectorLen = vector3_length(dir);      // This should be 1.0.
@@ -32,7 +34,7 @@ void cam_set(Camera *cam, Ray *centerRay)
     double fovHorizDeg = FOV_HORIZONTAL;
     double fovHorizRad = ((double)fovHorizDeg / 180) * M_PI;
     double planeWidth  = tan(fovHorizRad/2) * dirVectorLen * 2;
-    double planeHeight = planeWidth * ((double)WINDOW_HEIGHT / WINDOW_WIDTH);
+    double planeHeight = planeWidth * ((double)imgHeight / imgWidth);
 
     Vector3 dirReverse = *dir;
     vector3_to_unit(&dirReverse);
@@ -68,7 +70,7 @@ void cam_set(Camera *cam, Ray *centerRay)
     vector3_add_to(dirToViewPlaneBottomLeft, viewPlaneHorizRightToLeftHalf, dirToViewPlaneBottomLeft);
 }
 
-void cam_frame_init(App *app, CameraFrameContext *cfc, uint32_t imgHeight, uint32_t imgWidth)
+void cam_frame_init(Camera *cam, CameraFrameContext *cfc, uint32_t imgHeight, uint32_t imgWidth)
 {
     double verRandForPixel = random_double_0_1_exc() / imgHeight;
     double horRandForPixel = random_double_0_1_exc() / imgWidth;
@@ -76,7 +78,6 @@ void cam_frame_init(App *app, CameraFrameContext *cfc, uint32_t imgHeight, uint3
     cfc->viewPlaneVertUpwardsPartArr        = rtalloc(sizeof(Vector3) * imgHeight);
     cfc->viewPlaneHorizLeftToRightPartArr   = rtalloc(sizeof(Vector3) * imgWidth);
 
-    Camera *cam = &app->camera;
     Vector3 *dirToViewPlaneBottomLeft = &cam->dirToViewPlaneBottomLeft;
 
     // Generate `Ray.direction` vectors for the left-most pixel of each row of pixels in a rendered image.
@@ -100,3 +101,9 @@ void cam_frame_init(App *app, CameraFrameContext *cfc, uint32_t imgHeight, uint3
         cfc->viewPlaneHorizLeftToRightPartArr[u] = viewPlaneHorizLeftToRightPart;
     }
 }
+
+void cam_frame_free(CameraFrameContext *cfc)
+{
+    rtfree(cfc->viewPlaneVertUpwardsPartArr);
+    rtfree(cfc->viewPlaneHorizLeftToRightPartArr);
+}
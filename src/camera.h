@@ -24,8 +24,8 @@ struct Camera_s {
     // This is stored for debugging purposes only (this value is not used by raytracing, after initial camera initialization).
     Ray camCenterRay;
 
-    uint16_t imgHeight;
-    uint16_t imgWidth;
+    uint32_t imgHeight;
+    uint32_t imgWidth;
 
     Vector3 viewPlaneHorizLeftToRight;
     Vector3 viewPlaneHorizRightToLeftHalf;
@@ -53,10 +53,11 @@ struct CameraFrameContext_s {
 
 /**
  * Initializes FOV variables and `cam->camRays` (based on FOV and the given `centerRay`, which is a ray that is pointing in the direction
- * that should be displayed at the center of the rendered image).
+ * that should be displayed at the center of the rendered image). `imgHeight` and `imgWidth` are the dimensions of the rendered image
+ * (they determine the aspect ratio of the view plane).
  * IMPORTANT: this requires for `centerRay->direction` to be a unit vector.
  */
-void cam_set(Camera *cam, Ray *centerRay);
+void cam_set(Camera *cam, Ray *centerRay, uint32_t imgHeight, uint32_t imgWidth);
 
 /**
  * Initializes a CameraFrameContext for rendering a single frame.
@@ -73,7 +74,12 @@ void cam_set(Camera *cam, Ray *centerRay);
  * * this gives us cheap and good anti-aliasing.
  * For each frame - different random offsets are generated, so this function is called at the beginning of rendering each frame.
  */
-void cam_frame_init(App *app, CameraFrameContext *cfc, uint32_t imgHeight, uint32_t imgWidth);
+void cam_frame_init(Camera *cam, CameraFrameContext *cfc, uint32_t imgHeight, uint32_t imgWidth);
+
+/**
+ * Frees the memory allocated by cam_frame_init(). Must be called once the frame is rendered.
+ */
+void cam_frame_free(CameraFrameContext *cfc);
 
 /**
  * Calculates a camera ray direction for the u (vertical), v (horizontal) coordinates of the image for a frame (with context `cfc`) and
@@ -0,0 +1,285 @@
+#include <inttypes.h>
+#include <math.h>
+#include <string.h>
+
+#include "camera_path.h"
+#include "frame_times.h"
+#include "image_metrics.h"
+#include "pfm.h"
+#include "rtalloc.h"
+#include "rtcommon.h"
+#include "tracer.h"
+
+
+#define CAMERA_PATH_INITIAL_CAPACITY    16
+#define CAMERA_PATH_LINE_MAX            512
+#define CAMERA_PATH_PATH_MAX            1024
+
+
+static void finish_keyframe_result(CameraPathPlayback *pb, Color *summedFrames, Color *lastFrame, uint32_t accumulatedFrames,
+    uint32_t height, uint32_t width);
+static inline double seconds_since(struct timespec *start);
+
+
+void camera_path_init(CameraPath *path)
+{
+    path->keyframes         = rtalloc(sizeof(CameraKeyframe) * CAMERA_PATH_INITIAL_CAPACITY);
+    path->keyframesLength   = 0;
+    path->keyframesCapacity = CAMERA_PATH_INITIAL_CAPACITY;
+}
+
+void camera_path_free(CameraPath *path)
+{
+    rtfree(path->keyframes);
+    path->keyframes = NULL;
+    path->keyframesLength = 0;
+    path->keyframesCapacity = 0;
+}
+
+void camera_path_add(CameraPath *path, double seconds, CameraKeyframeType type, Ray *centerRay)
+{
+    if (path->keyframesLength == path->keyframesCapacity) {
+        path->keyframesCapacity *= 2;
+        path->keyframes = rtrealloc(path->keyframes, sizeof(CameraKeyframe) * path->keyframesCapacity);
+    }
+
+    CameraKeyframe *k = &path->keyframes[path->keyframesLength++];
+    k->seconds = seconds;
+    k->type = type;
+    if (type == CK_camera) {
+        k->centerRay = *centerRay;
+    } else {
+        memset(&k->centerRay, 0, sizeof(Ray));
+    }
+}
+
+bool camera_path_load(CameraPath *path, const char *filePath)
+{
+    FILE *f = fopen(filePath, "r");
+    if (f == NULL) {
+        log_err("Could not open the camera path file: %s\n", filePath);
+        return false;
+    }
+
+    char line[CAMERA_PATH_LINE_MAX];
+    uint32_t lineNum = 0;
+    bool ok = true;
+    bool ended = false;
+    while (ok && fgets(line, sizeof(line), f) != NULL) {
+        lineNum++;
+        char *p = line + strspn(line, " \t");
+        if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0') {
+            continue;
+        }
+
+        double seconds;
+        char type[16];
+        Ray ray;
+        int consumed = 0;
+        if (ended || sscanf(p, "%lf %15s %n", &seconds, type, &consumed) < 2 || ! (seconds >= 0)
+            || (path->keyframesLength > 0 && seconds < path->keyframes[path->keyframesLength - 1].seconds)) {
+            ok = false;
+        } else if (strcmp(type, "camera") == 0) {
+            ok = sscanf(p + consumed, "%lf %lf %lf %lf %lf %lf", &ray.origin.x, &ray.origin.y, &ray.origin.z, &ray.direction.x,
+                &ray.direction.y, &ray.direction.z) == 6 && vector3_length(&ray.direction) > 0;
+            if (ok) {
+                vector3_to_unit(&ray.direction);
+                camera_path_add(path, seconds, CK_camera, &ray);
+            }
+        } else if (strcmp(type, "reset") == 0) {
+            camera_path_add(path, seconds, CK_reset, NULL);
+        } else if (strcmp(type, "end") == 0) {
+            camera_path_add(path, seconds, CK_end, NULL);
+            ended = true;
+        } else {
+            ok = false;
+        }
+
+        if (! ok) {
+            log_err("Invalid camera path keyframe (%s:%" PRIu32 "): %s", filePath, lineNum, line);
+        }
+    }
+    fclose(f);
+
+    if (ok && ! ended) {
+        log_err("The camera path %s has no \"end\" keyframe.\n", filePath);
+        ok = false;
+    }
+    return ok;
+}
+
+bool camera_path_save(CameraPath *path, const char *filePath)
+{
+    FILE *f = fopen(filePath, "w");
+    if (f == NULL) {
+        log_err("Could not open the camera path file for writing: %s\n", filePath);
+        return false;
+    }
+
+    fprintf(f, "# toyraytracer camera path: <seconds> camera <origin x y z> <direction x y z> | <seconds> reset | <seconds> end\n");
+    for (uint32_t i = 0; i < path->keyframesLength; i++) {
+        CameraKeyframe *k = &path->keyframes[i];
+        switch (k->type) {
+            case CK_camera:
+                fprintf(f, "%.6f camera %.17g %.17g %.17g %.17g %.17g %.17g\n", k->seconds, k->centerRay.origin.x, k->centerRay.origin.y,
+                    k->centerRay.origin.z, k->centerRay.direction.x, k->centerRay.direction.y, k->centerRay.direction.z);
+                break;
+            case CK_reset:
+                fprintf(f, "%.6f reset\n", k->seconds);
+                break;
+            case CK_end:
+                fprintf(f, "%.6f end\n", k->seconds);
+                break;
+        }
+    }
+
+    bool ok = ! ferror(f);
+    ok = (fclose(f) == 0) && ok;
+    if (! ok) {
+        log_err("Could not write the camera path file: %s\n", filePath);
+    }
+    return ok;
+}
+
+void camera_path_playback_start(CameraPathPlayback *pb, CameraPath *path, const char *snapshotDir)
+{
+    pb->path            = path;
+    pb->snapshotDir     = snapshotDir;
+    pb->nextKeyframe    = 0;
+    pb->ended           = false;
+    pb->results         = rtalloc(sizeof(KeyframeResult) * path->keyframesLength);
+    pb->frameMsCapacity = CAMERA_PATH_INITIAL_CAPACITY;
+    pb->frameMs         = rtalloc(sizeof(double) * pb->frameMsCapacity);
+    pb->frameMsLength   = 0;
+    clock_gettime(CLOCK_MONOTONIC, &pb->tstart);
+}
+
+bool camera_path_playback_update(CameraPathPlayback *pb, Color *summedFrames, Color *lastFrame, uint32_t accumulatedFrames,
+    uint32_t height, uint32_t width, Ray *centerRay, bool *cameraChanged, bool *reset)
+{
+    *cameraChanged = false;
+    *reset = false;
+    if (pb->ended) {
+        return false;
+    }
+
+    double seconds = seconds_since(&pb->tstart);
+    CameraPath *path = pb->path;
+    while (pb->nextKeyframe < path->keyframesLength && path->keyframes[pb->nextKeyframe].seconds <= seconds) {
+        // The image reached since the previous keyframe is finished now.
+        if (pb->nextKeyframe > 0) {
+            finish_keyframe_result(pb, summedFrames, lastFrame, accumulatedFrames, height, width);
+        }
+
+        CameraKeyframe *k = &path->keyframes[pb->nextKeyframe];
+        if (k->type == CK_end) {
+            pb->ended = true;
+            return false;
+        }
+
+        if (k->type == CK_camera) {
+            *centerRay = k->centerRay;
+            *cameraChanged = true;
+        }
+        *reset = true;
+
+        KeyframeResult *res = &pb->results[pb->nextKeyframe];
+        memset(res, 0, sizeof(KeyframeResult));
+        res->appliedSeconds = seconds;
+        res->noiseEstimate = NAN;
+        pb->nextKeyframe++;
+
+        // Keyframes that are due at the same time are applied together, so nothing is accumulated for the earlier ones.
+        accumulatedFrames = 0;
+    }
+
+    if (pb->nextKeyframe > 0) {
+        pb->results[pb->nextKeyframe - 1].frames++;
+    }
+    return true;
+}
+
+void camera_path_playback_add_frame(CameraPathPlayback *pb, double ms)
+{
+    if (pb->frameMsLength == pb->frameMsCapacity) {
+        pb->frameMsCapacity *= 2;
+        pb->frameMs = rtrealloc(pb->frameMs, sizeof(double) * pb->frameMsCapacity);
+    }
+    pb->frameMs[pb->frameMsLength++] = ms;
+}
+
+void camera_path_playback_write_json(CameraPathPlayback *pb, FILE *f)
+{
+    double *sorted = rtalloc(sizeof(double) * (pb->frameMsLength > 0 ? pb->frameMsLength : 1));
+    memcpy(sorted, pb->frameMs, sizeof(double) * pb->frameMsLength);
+    FramePercentiles fp;
+    frame_percentiles_sort(sorted, pb->frameMsLength, &fp);
+    rtfree(sorted);
+
+    fprintf(f, "{\n  \"frameTimesMs\": {\"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f, \"samples\": %u},\n", fp.p50, fp.p90,
+        fp.p99, fp.max, fp.samples);
+
+    fprintf(f, "  \"keyframes\": [");
+    uint32_t keyframes = pb->nextKeyframe;
+    for (uint32_t i = 0; i < keyframes && pb->path->keyframes[i].type != CK_end; i++) {
+        CameraKeyframe *k = &pb->path->keyframes[i];
+        KeyframeResult *res = &pb->results[i];
+        fprintf(f, "%s\n    {\"index\": %" PRIu32 ", \"type\": \"%s\", \"seconds\": %.6f, \"appliedSeconds\": %.6f, \"frames\": %" PRIu32
+            ", \"samplesPerPixel\": %" PRIu32 ", \"noiseEstimate\": ", i > 0 ? "," : "", i, k->type == CK_camera ? "camera" : "reset",
+            k->seconds, res->appliedSeconds, res->frames, res->samplesPerPixel);
+        if (isnan(res->noiseEstimate)) {
+            fprintf(f, "null}");
+        } else {
+            fprintf(f, "%.6g}", res->noiseEstimate);
+        }
+    }
+
+    fprintf(f, "\n  ],\n  \"frameMs\": [");
+    for (uint32_t i = 0; i < pb->frameMsLength; i++) {
+        fprintf(f, "%s%.3f", i > 0 ? ", " : "", pb->frameMs[i]);
+    }
+    fprintf(f, "]\n}\n");
+}
+
+void camera_path_playback_free(CameraPathPlayback *pb)
+{
+    rtfree(pb->results);
+    rtfree(pb->frameMs);
+    pb->results = NULL;
+    pb->frameMs = NULL;
+}
+
+/**
+ * Stores what the image reached since the last applied keyframe (and saves its snapshot, if enabled).
+ */
+static void finish_keyframe_result(CameraPathPlayback *pb, Color *summedFrames, Color *lastFrame, uint32_t accumulatedFrames,
+    uint32_t height, uint32_t width)
+{
+    uint32_t idx = pb->nextKeyframe - 1;
+    KeyframeResult *res = &pb->results[idx];
+    uint32_t pixels = height * width;
+    res->samplesPerPixel = accumulatedFrames * ANTIALIAS_FACTOR * ANTIALIAS_FACTOR;
+    res->noiseEstimate = accumulatedFrames > 0 ? image_noise_estimate(lastFrame, summedFrames, accumulatedFrames, pixels) : NAN;
+
+    if (pb->snapshotDir == NULL || accumulatedFrames == 0) {
+        return;
+    }
+
+    Color *img = rtalloc(sizeof(Color) * pixels);
+    for (uint32_t p = 0; p < pixels; p++) {
+        img[p].red = summedFrames[p].red / accumulatedFrames;
+        img[p].green = summedFrames[p].green / accumulatedFrames;
+        img[p].blue = summedFrames[p].blue / accumulatedFrames;
+    }
+    char path[CAMERA_PATH_PATH_MAX];
+    snprintf(path, sizeof(path), "%s/keyframe_%" PRIu32 ".pfm", pb->snapshotDir, idx);
+    pfm_write_color(path, img, width, height);
+    rtfree(img);
+}
+
+static inline double seconds_since(struct timespec *start)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (t.tv_sec - start->tv_sec) + (t.tv_nsec - start->tv_nsec) / 1000000000.0;
+}
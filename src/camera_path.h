@@ -0,0 +1,128 @@
+#ifndef __CAMERA_PATH_H__
+#define __CAMERA_PATH_H__
+
+/**
+ * Camera paths: recorded, timestamped camera movements (and resets of the accumulated image), that can be played back - in the app (see
+ * CAMERA_PATH_PLAYBACK_PATH) or headless (see src/tools/campath.c) - to make interactive rendering a repeatable benchmark.
+ *
+ * A camera path is stored as a text file, one keyframe per line (lines starting with '#' are comments):
+ *
+ *     <seconds> camera <origin x> <origin y> <origin z> <direction x> <direction y> <direction z>
+ *     <seconds> reset
+ *     <seconds> end
+ *
+ * `seconds` is the time since the start of the path (non-decreasing). A "camera" keyframe sets the camera (its center ray, see cam_set()),
+ * which also restarts accumulating the image. A "reset" keyframe only restarts accumulating it. The "end" keyframe (the last one) marks
+ * the end of the path.
+ *
+ * Playback is done in real (wall-clock) time: each keyframe is applied before the first frame that starts after its time. So how many
+ * samples per pixel are accumulated before the next keyframe (and how converged the image gets) shows how responsive rendering is.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "color.h"
+#include "ray.h"
+
+
+typedef enum {
+    CK_camera,
+    CK_reset,
+    CK_end,
+} CameraKeyframeType;
+
+
+typedef struct CameraKeyframe_s     CameraKeyframe;
+typedef struct CameraPath_s         CameraPath;
+typedef struct KeyframeResult_s     KeyframeResult;
+typedef struct CameraPathPlayback_s CameraPathPlayback;
+
+struct CameraKeyframe_s {
+    double              seconds;
+    CameraKeyframeType  type;
+    Ray                 centerRay;          // Only for CK_camera. The direction is a unit vector.
+};
+
+struct CameraPath_s {
+    CameraKeyframe     *keyframes;
+    uint32_t            keyframesLength;
+    uint32_t            keyframesCapacity;
+};
+
+// What the image reached, from a keyframe until the next one was applied (or until the end of the path).
+struct KeyframeResult_s {
+    double              appliedSeconds;     // When the keyframe was applied (since the start of the playback).
+    uint32_t            frames;             // The amount of frames rendered until the next keyframe.
+    uint32_t            samplesPerPixel;    // The samples per pixel accumulated into the image when the next keyframe was applied.
+    double              noiseEstimate;      // The estimated RMSE of that image (see image_noise_estimate()).
+};
+
+struct CameraPathPlayback_s {
+    CameraPath         *path;
+    const char         *snapshotDir;        // If not NULL, the image reached at each keyframe is saved into it (as a PFM image).
+
+    struct timespec     tstart;
+    uint32_t            nextKeyframe;
+    bool                ended;
+
+    KeyframeResult     *results;            // One per keyframe (except for the CK_end keyframe).
+
+    // The duration (in milliseconds) of each frame rendered during the playback.
+    double             *frameMs;
+    uint32_t            frameMsLength;
+    uint32_t            frameMsCapacity;
+};
+
+
+void camera_path_init(CameraPath *path);
+void camera_path_free(CameraPath *path);
+
+/**
+ * Appends a keyframe to `path`. `centerRay` is only used by CK_camera keyframes (can be NULL otherwise).
+ */
+void camera_path_add(CameraPath *path, double seconds, CameraKeyframeType type, Ray *centerRay);
+
+/**
+ * Loads the camera path file at `filePath` into `path` (which must be initialized and empty). Returns false (and logs the error) if the
+ * file could not be read or is not a valid camera path (e.g. has no "end" keyframe).
+ */
+bool camera_path_load(CameraPath *path, const char *filePath);
+
+/**
+ * Saves `path` into the camera path file at `filePath`. Returns false (and logs the error) if it could not be written.
+ */
+bool camera_path_save(CameraPath *path, const char *filePath);
+
+/**
+ * Starts playing back `path` (which must end with a CK_end keyframe) now. If `snapshotDir` is not NULL, the image reached at each keyframe
+ * is saved into it as "keyframe_<index>.pfm".
+ */
+void camera_path_playback_start(CameraPathPlayback *pb, CameraPath *path, const char *snapshotDir);
+
+/**
+ * Applies the keyframes whose time has come. Must be called before rendering each frame: `summedFrames` is the sum of the
+ * `accumulatedFrames` frames of the (`height` x `width`) image rendered so far, and `lastFrame` is the last of them.
+ *
+ * If the camera changed, stores the new center ray in `centerRay` and sets `*cameraChanged`. If the accumulated image has to be restarted
+ * (after a camera change, or a reset), sets `*reset`. Returns false once the end of the path is reached (nothing is changed then).
+ */
+bool camera_path_playback_update(CameraPathPlayback *pb, Color *summedFrames, Color *lastFrame, uint32_t accumulatedFrames,
+    uint32_t height, uint32_t width, Ray *centerRay, bool *cameraChanged, bool *reset);
+
+/**
+ * Adds the duration of a frame rendered during the playback.
+ */
+void camera_path_playback_add_frame(CameraPathPlayback *pb, double ms);
+
+/**
+ * Writes the results of the (ended) playback into `f` as JSON: the frame time percentiles, the duration of every frame and what the image
+ * reached at each keyframe.
+ */
+void camera_path_playback_write_json(CameraPathPlayback *pb, FILE *f);
+
+void camera_path_playback_free(CameraPathPlayback *pb);
+
+#endif // __CAMERA_PATH_H__
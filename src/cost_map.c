@@ -0,0 +1,171 @@
+#include <string.h>
+
+#include "cost_map.h"
+#include "pfm.h"
+#include "rtalloc.h"
+#include "rtcommon.h"
+
+
+// The amount of histogram bins used to find the heatmap's percentile (see COST_MAP_HEATMAP_PERCENTILE).
+#define COST_MAP_HISTOGRAM_BINS     1024
+
+#define HEATMAP_COLORS_COUNT        6
+
+
+static const char *costMetricNames[COST_METRICS_COUNT] = {
+    [CM_time]               = "time",
+    [CM_rays]               = "rays",
+    [CM_intersection_tests] = "intersection tests",
+};
+
+static const char *costMetricUnits[COST_METRICS_COUNT] = {
+#if defined(__x86_64__) || defined(__i386__)
+    [CM_time]               = "cycles",
+#else
+    [CM_time]               = "ns",
+#endif
+    [CM_rays]               = "rays",
+    [CM_intersection_tests] = "tests",
+};
+
+// The color scale of the heatmap (evenly spaced, from cheap to expensive).
+static Color heatmapColors[HEATMAP_COLORS_COUNT] = {
+    {   0,    0,    0},
+    {0.10, 0.05, 0.60},
+    {0.70, 0.10, 0.60},
+    {1.00, 0.45, 0.10},
+    {1.00, 0.90, 0.10},
+    {1.00, 1.00, 1.00},
+};
+
+
+static double heatmap_scale(CostMap *cm, double *avgCost);
+static inline Color heatmap_color(double v);
+
+
+void cost_map_init(CostMap *cm, CostMetric metric, uint32_t width, uint32_t height)
+{
+    cm->metric = metric;
+    cm->width = width;
+    cm->height = height;
+    cm->cost = rtalloc(sizeof(double) * width * height);
+    cost_map_reset(cm);
+}
+
+void cost_map_free(CostMap *cm)
+{
+    rtfree(cm->cost);
+    cm->cost = NULL;
+}
+
+void cost_map_reset(CostMap *cm)
+{
+    memset(cm->cost, 0, sizeof(double) * cm->width * cm->height);
+    cm->frames = 0;
+}
+
+void cost_map_set_metric(CostMap *cm, CostMetric metric)
+{
+    cm->metric = metric;
+    cost_map_reset(cm);
+}
+
+const char * cost_metric_name(CostMetric metric)
+{
+    return costMetricNames[metric];
+}
+
+const char * cost_metric_unit(CostMetric metric)
+{
+    return costMetricUnits[metric];
+}
+
+void cost_map_get_average(CostMap *cm, double *avgCost)
+{
+    double div = cm->frames > 0 ? cm->frames : 1;
+    uint32_t pixels = cm->width * cm->height;
+    for (uint32_t p = 0; p < pixels; p++) {
+        avgCost[p] = cm->cost[p] / div;
+    }
+}
+
+double cost_map_to_heatmap(CostMap *cm, Color *img)
+{
+    uint32_t pixels = cm->width * cm->height;
+    double *avgCost = rtalloc(sizeof(double) * pixels);
+    cost_map_get_average(cm, avgCost);
+
+    double scale = heatmap_scale(cm, avgCost);
+    for (uint32_t p = 0; p < pixels; p++) {
+        img[p] = heatmap_color(scale > 0 ? avgCost[p] / scale : 0);
+    }
+
+    rtfree(avgCost);
+    return scale;
+}
+
+bool cost_map_save_pfm(CostMap *cm, const char *path)
+{
+    uint32_t pixels = cm->width * cm->height;
+    double *avgCost = rtalloc(sizeof(double) * pixels);
+    cost_map_get_average(cm, avgCost);
+    float *data = rtalloc(sizeof(float) * pixels);
+    for (uint32_t p = 0; p < pixels; p++) {
+        data[p] = (float)avgCost[p];
+    }
+
+    bool ok = pfm_write(path, data, cm->width, cm->height, 1);
+    rtfree(data);
+    rtfree(avgCost);
+    return ok;
+}
+
+/**
+ * Returns the COST_MAP_HEATMAP_PERCENTILE percentile of the average pixel costs `avgCost` (approximated with a histogram).
+ */
+static double heatmap_scale(CostMap *cm, double *avgCost)
+{
+    uint32_t pixels = cm->width * cm->height;
+    double maxCost = 0;
+    for (uint32_t p = 0; p < pixels; p++) {
+        if (avgCost[p] > maxCost) {
+            maxCost = avgCost[p];
+        }
+    }
+    if (maxCost <= 0) {
+        return 0;
+    }
+
+    uint32_t histogram[COST_MAP_HISTOGRAM_BINS] = {0};
+    for (uint32_t p = 0; p < pixels; p++) {
+        uint32_t bin = (uint32_t)(avgCost[p] / maxCost * (COST_MAP_HISTOGRAM_BINS - 1));
+        histogram[bin]++;
+    }
+
+    uint64_t target = (uint64_t)(pixels * COST_MAP_HEATMAP_PERCENTILE);
+    uint64_t count = 0;
+    for (uint32_t bin = 0; bin < COST_MAP_HISTOGRAM_BINS; bin++) {
+        count += histogram[bin];
+        if (count >= target) {
+            return maxCost * (bin + 1) / COST_MAP_HISTOGRAM_BINS;
+        }
+    }
+    return maxCost;
+}
+
+/**
+ * Returns the color of the heatmap for the (normalized) cost `v` (values outside [0, 1] are clamped).
+ */
+static inline Color heatmap_color(double v)
+{
+    if (v <= 0) {
+        return heatmapColors[0];
+    }
+    if (v >= 1) {
+        return heatmapColors[HEATMAP_COLORS_COUNT - 1];
+    }
+
+    double pos = v * (HEATMAP_COLORS_COUNT - 1);
+    uint32_t i = (uint32_t)pos;
+    return gradient(&heatmapColors[i], &heatmapColors[i + 1], i, i + 1, pos);
+}
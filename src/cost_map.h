@@ -0,0 +1,113 @@
+#ifndef __COST_MAP_H__
+#define __COST_MAP_H__
+
+/**
+ * Per-pixel rendering cost maps: how much work the rendering of each pixel took (time, rays traced or ray-primitive intersection tests),
+ * summed over the rendered frames. Used to visualise which regions of the image are expensive (as a false-color heatmap, see
+ * cost_map_to_heatmap()) and exported as a float image (see cost_map_save_pfm()).
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "color.h"
+
+
+typedef enum {
+    // Time spent rendering the pixel: CPU cycles (the time stamp counter) on x86, nanoseconds elsewhere.
+    CM_time,
+
+    // Rays traced for the pixel (every bounce is a ray).
+    CM_rays,
+
+    // Ray-primitive intersection tests performed for the pixel.
+    CM_intersection_tests,
+
+    COST_METRICS_COUNT,
+} CostMetric;
+
+// The heatmap maps costs in [0, <this percentile of the pixel costs>] to the whole color scale, so that a few extremely expensive pixels
+// don't make the rest of the heatmap black.
+#define COST_MAP_HEATMAP_PERCENTILE     0.99
+
+
+typedef struct CostMap_s        CostMap;
+
+struct CostMap_s {
+    CostMetric  metric;
+    uint32_t    width;
+    uint32_t    height;
+
+    double     *cost;           // The cost of each pixel, summed over `frames` frames. Rows from top to bottom.
+    uint32_t    frames;
+};
+
+
+/**
+ * Initializes a cost map of `width` x `height` pixels, measuring `metric`.
+ */
+void cost_map_init(CostMap *cm, CostMetric metric, uint32_t width, uint32_t height);
+
+/**
+ * Frees the memory owned by the cost map.
+ */
+void cost_map_free(CostMap *cm);
+
+/**
+ * Clears the summed costs (e.g. after the scene changes).
+ */
+void cost_map_reset(CostMap *cm);
+
+/**
+ * Changes the measured metric (and clears the summed costs).
+ */
+void cost_map_set_metric(CostMap *cm, CostMetric metric);
+
+/**
+ * Returns the name of `metric` (e.g. "time").
+ */
+const char * cost_metric_name(CostMetric metric);
+
+/**
+ * Returns the unit of `metric` (e.g. "cycles").
+ */
+const char * cost_metric_unit(CostMetric metric);
+
+/**
+ * Stores the average cost per frame of each pixel in `avgCost` (width * height values).
+ */
+void cost_map_get_average(CostMap *cm, double *avgCost);
+
+/**
+ * Renders the cost map as a false-color heatmap image (black -> blue -> magenta -> orange -> yellow -> white, for cheap -> expensive)
+ * into `img` (width * height pixels). Returns the average cost per frame that maps to the top of the color scale (see
+ * COST_MAP_HEATMAP_PERCENTILE).
+ */
+double cost_map_to_heatmap(CostMap *cm, Color *img);
+
+/**
+ * Saves the average cost per frame of each pixel into a (grayscale) PFM (portable float map) image at `path`. Returns false (and logs
+ * the error) if the file could not be written.
+ */
+bool cost_map_save_pfm(CostMap *cm, const char *path);
+
+/**
+ * Returns the current value of the clock that is used for the CM_time metric.
+ */
+static inline uint64_t cost_clock_now()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+#endif
+}
+
+#endif // __COST_MAP_H__
@@ -0,0 +1,113 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "frame_times.h"
+
+
+static const char *frameStageNames[FRAME_STAGES_COUNT] = {
+    [FS_frame]          = "frame",
+    [FS_trace]          = "trace",
+    [FS_blend]          = "blend",
+    [FS_present]        = "present",
+    [FS_input_latency]  = "inputLatency",
+};
+
+
+static int compare_doubles(const void *a, const void *b);
+static inline double sorted_percentile(double *sorted, uint32_t length, double p);
+
+
+void frame_times_reset(FrameTimes *ft)
+{
+    memset(ft, 0, sizeof(FrameTimes));
+}
+
+void frame_times_add(FrameTimes *ft, FrameStage stage, double ms)
+{
+    ft->samples[stage][ft->counts[stage] % FRAME_TIMES_WINDOW] = ms;
+    ft->counts[stage]++;
+    ft->totalMs[stage] += ms;
+}
+
+void frame_times_percentiles(FrameTimes *ft, FrameStage stage, FramePercentiles *res)
+{
+    uint32_t length = ft->counts[stage] < FRAME_TIMES_WINDOW ? ft->counts[stage] : FRAME_TIMES_WINDOW;
+    double sorted[FRAME_TIMES_WINDOW];
+    memcpy(sorted, ft->samples[stage], sizeof(double) * length);
+    frame_percentiles_sort(sorted, length, res);
+}
+
+void frame_percentiles_sort(double *samples, uint32_t length, FramePercentiles *res)
+{
+    memset(res, 0, sizeof(FramePercentiles));
+    res->samples = length;
+    if (length == 0) {
+        return;
+    }
+
+    qsort(samples, length, sizeof(double), compare_doubles);
+    res->p50 = sorted_percentile(samples, length, 0.50);
+    res->p90 = sorted_percentile(samples, length, 0.90);
+    res->p99 = sorted_percentile(samples, length, 0.99);
+    res->max = samples[length - 1];
+}
+
+const char * frame_stage_name(FrameStage stage)
+{
+    return frameStageNames[stage];
+}
+
+void frame_times_print(FILE *f, FrameTimes *ft)
+{
+    FramePercentiles fp;
+
+    fprintf(f, "Frame times ms (p50/p90/p99/max):");
+    for (uint32_t s = FS_frame; s <= FS_present; s++) {
+        frame_times_percentiles(ft, s, &fp);
+        fprintf(f, " %s %.1f/%.1f/%.1f/%.1f", frame_stage_name(s), fp.p50, fp.p90, fp.p99, fp.max);
+    }
+    fprintf(f, "\n");
+
+    frame_times_percentiles(ft, FS_input_latency, &fp);
+    if (fp.samples == 0) {
+        fprintf(f, "Input latency ms (p50/p90/p99/max): no input yet\n");
+    } else {
+        fprintf(f, "Input latency ms (p50/p90/p99/max): %.1f/%.1f/%.1f/%.1f (%u inputs)\n", fp.p50, fp.p90, fp.p99, fp.max,
+            fp.samples);
+    }
+}
+
+void frame_times_write_json(FILE *f, FrameTimes *ft)
+{
+    bool first = true;
+    fprintf(f, "{");
+    for (uint32_t s = 0; s < FRAME_STAGES_COUNT; s++) {
+        FramePercentiles fp;
+        frame_times_percentiles(ft, s, &fp);
+        if (fp.samples == 0) {
+            continue;
+        }
+        fprintf(f, "%s\"%s\": {\"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f, \"samples\": %u}", first ? "" : ", ",
+            frame_stage_name(s), fp.p50, fp.p90, fp.p99, fp.max, fp.samples);
+        first = false;
+    }
+    fprintf(f, "}");
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double da = *(const double *)a;
+    double db = *(const double *)b;
+    return (da > db) - (da < db);
+}
+
+/**
+ * Returns the percentile `p` (in [0, 1]) of the `sorted` values (the nearest rank).
+ */
+static inline double sorted_percentile(double *sorted, uint32_t length, double p)
+{
+    uint32_t rank = (uint32_t)ceil(p * length);
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
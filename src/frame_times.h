@@ -0,0 +1,95 @@
+#ifndef __FRAME_TIMES_H__
+#define __FRAME_TIMES_H__
+
+/**
+ * Rolling frame time statistics: the durations of the last FRAME_TIMES_WINDOW frames of each frame stage (and the last input-to-display
+ * latencies), and their percentiles. Unlike the average FPS, the percentiles show hitches (slow frames) too.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+
+// The amount of (most recent) samples of each stage that the percentiles are calculated from.
+#define FRAME_TIMES_WINDOW      256
+
+typedef enum {
+    FS_frame,               // The whole frame (from the start of rendering, to the start of the next frame's rendering).
+    FS_trace,               // Ray tracing the frame (render_frame_img()).
+    FS_blend,               // Blending it with the previous frames (blend_frame()).
+    FS_present,             // Displaying the blended image (draw_img_to_screen(), including presenting it).
+
+    // The latency from an input event to the end of the presentation of the first frame that reflects it. Only has samples for the
+    // frames that follow an input.
+    FS_input_latency,
+
+    FRAME_STAGES_COUNT,
+} FrameStage;
+
+
+typedef struct FrameTimes_s     FrameTimes;
+typedef struct FramePercentiles_s FramePercentiles;
+
+struct FrameTimes_s {
+    double      samples[FRAME_STAGES_COUNT][FRAME_TIMES_WINDOW];    // In milliseconds. A ring buffer of each stage's samples.
+    uint64_t    counts[FRAME_STAGES_COUNT];                         // The amount of samples ever added to each stage.
+    double      totalMs[FRAME_STAGES_COUNT];                        // The sum of all samples ever added to each stage.
+};
+
+// The percentiles (in milliseconds) of a stage's samples.
+struct FramePercentiles_s {
+    uint32_t    samples;                // The amount of samples the percentiles were calculated from (0 if there are none).
+    double      p50;
+    double      p90;
+    double      p99;
+    double      max;
+};
+
+
+/**
+ * Removes all samples.
+ */
+void frame_times_reset(FrameTimes *ft);
+
+/**
+ * Adds a sample of `stage` that took `ms` milliseconds (replacing the oldest one, if there are FRAME_TIMES_WINDOW samples already).
+ */
+void frame_times_add(FrameTimes *ft, FrameStage stage, double ms);
+
+/**
+ * Calculates the percentiles of the samples of `stage`.
+ */
+void frame_times_percentiles(FrameTimes *ft, FrameStage stage, FramePercentiles *res);
+
+/**
+ * Calculates the percentiles of the `length` values of `samples` (in any order). Sorts `samples` in place.
+ */
+void frame_percentiles_sort(double *samples, uint32_t length, FramePercentiles *res);
+
+/**
+ * Returns the name of `stage` (e.g. "trace").
+ */
+const char * frame_stage_name(FrameStage stage);
+
+/**
+ * Prints a (2 lines long) human readable summary of the percentiles of the frame stages and of the input latency.
+ */
+void frame_times_print(FILE *f, FrameTimes *ft);
+
+/**
+ * Writes the percentiles of all stages (that have samples) into `f` as a single line JSON object.
+ */
+void frame_times_write_json(FILE *f, FrameTimes *ft);
+
+/**
+ * Returns the time in milliseconds from `start` to now (of the CLOCK_MONOTONIC clock).
+ */
+static inline double frame_times_ms_since(struct timespec *start)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (t.tv_sec - start->tv_sec) * 1000.0 + (t.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+#endif // __FRAME_TIMES_H__
@@ -0,0 +1,168 @@
+#include <math.h>
+
+#include "image_metrics.h"
+#include "rtalloc.h"
+
+
+// FLIP raises the color distances to this power (compressing the large ones), before normalizing them into [0, 1].
+#define FLIP_DISTANCE_EXPONENT  0.7
+
+
+typedef struct Lab_s            Lab;
+
+struct Lab_s {
+    double  l;
+    double  a;
+    double  b;
+};
+
+
+static void display_to_lab(ToneMap *tm, Color *img, uint32_t height, uint32_t width, Lab *lab);
+static inline Lab linear_srgb_to_lab(Color *c);
+static inline double lab_f(double t);
+static inline double hyab(Lab *x, Lab *y);
+
+
+double image_rmse(Color *img, Color *ref, uint32_t pixels)
+{
+    double sum = 0;
+    for (uint32_t p = 0; p < pixels; p++) {
+        double dr = img[p].red - ref[p].red;
+        double dg = img[p].green - ref[p].green;
+        double db = img[p].blue - ref[p].blue;
+        sum += dr * dr + dg * dg + db * db;
+    }
+    return sqrt(sum / (pixels * 3.0));
+}
+
+double image_rel_mse(Color *img, Color *ref, uint32_t pixels)
+{
+    double sum = 0;
+    for (uint32_t p = 0; p < pixels; p++) {
+        double dr = img[p].red - ref[p].red;
+        double dg = img[p].green - ref[p].green;
+        double db = img[p].blue - ref[p].blue;
+        sum += dr * dr / (ref[p].red * ref[p].red + IMAGE_REL_MSE_EPSILON);
+        sum += dg * dg / (ref[p].green * ref[p].green + IMAGE_REL_MSE_EPSILON);
+        sum += db * db / (ref[p].blue * ref[p].blue + IMAGE_REL_MSE_EPSILON);
+    }
+    return sum / (pixels * 3.0);
+}
+
+double image_noise_estimate(Color *sample, Color *summed, uint32_t samples, uint32_t pixels)
+{
+    if (samples < 2) {
+        return NAN;
+    }
+
+    double sum = 0;
+    for (uint32_t p = 0; p < pixels; p++) {
+        double dr = sample[p].red - summed[p].red / samples;
+        double dg = sample[p].green - summed[p].green / samples;
+        double db = sample[p].blue - summed[p].blue / samples;
+        sum += dr * dr + dg * dg + db * db;
+    }
+    return sqrt(sum / (pixels * 3.0) / samples);
+}
+
+double image_flip_like(ToneMap *tm, Color *img, Color *ref, uint32_t height, uint32_t width)
+{
+    uint32_t pixels = height * width;
+    Lab *imgLab = rtalloc(sizeof(Lab) * pixels);
+    Lab *refLab = rtalloc(sizeof(Lab) * pixels);
+    display_to_lab(tm, img, height, width, imgLab);
+    display_to_lab(tm, ref, height, width, refLab);
+
+    // Errors are normalized by the largest possible distance, that of pure green and pure blue (same as in FLIP).
+    Color green = COLOR_GREEN, blue = COLOR_BLUE;
+    Lab greenLab = linear_srgb_to_lab(&green), blueLab = linear_srgb_to_lab(&blue);
+    double maxDistance = pow(hyab(&greenLab, &blueLab), FLIP_DISTANCE_EXPONENT);
+
+    double sum = 0;
+    for (uint32_t p = 0; p < pixels; p++) {
+        double e = pow(hyab(&imgLab[p], &refLab[p]), FLIP_DISTANCE_EXPONENT) / maxDistance;
+        sum += e < 1 ? e : 1;
+    }
+
+    rtfree(refLab);
+    rtfree(imgLab);
+    return sum / pixels;
+}
+
+/**
+ * Converts `img` into the displayed 8 bit sRGB pixels (with the tone mapping `tm`), blurs them (in linear RGB) and stores them in `lab`.
+ */
+static void display_to_lab(ToneMap *tm, Color *img, uint32_t height, uint32_t width, Lab *lab)
+{
+    uint32_t pixels = height * width;
+    uint8_t *rgb24 = rtalloc(pixels * 3);
+    tonemap_rows_to_rgb24(tm, img, width, 0, height, rgb24, width * 3);
+
+    // The displayed values are interpreted as sRGB encoded (as monitors do), so they are decoded back into linear values.
+    double decode[256];
+    for (uint32_t i = 0; i < 256; i++) {
+        double v = i / 255.0;
+        decode[i] = v <= 0.04045 ? v / 12.92 : pow((v + 0.055) / 1.055, 2.4);
+    }
+    Color *linear = rtalloc(sizeof(Color) * pixels);
+    for (uint32_t p = 0; p < pixels; p++) {
+        linear[p] = (Color){decode[rgb24[p * 3]], decode[rgb24[p * 3 + 1]], decode[rgb24[p * 3 + 2]]};
+    }
+
+    // A 3x3 binomial blur (weights 1-2-1 in both directions), clamped at the image edges.
+    static const double weights[3] = {0.25, 0.5, 0.25};
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            Color c = COLOR_BLACK;
+            for (int dy = -1; dy <= 1; dy++) {
+                uint32_t sy = (y == 0 && dy < 0) || (y == height - 1 && dy > 0) ? y : y + dy;
+                for (int dx = -1; dx <= 1; dx++) {
+                    uint32_t sx = (x == 0 && dx < 0) || (x == width - 1 && dx > 0) ? x : x + dx;
+                    double w = weights[dy + 1] * weights[dx + 1];
+                    Color *s = &linear[sy * width + sx];
+                    c.red += s->red * w;
+                    c.green += s->green * w;
+                    c.blue += s->blue * w;
+                }
+            }
+            lab[y * width + x] = linear_srgb_to_lab(&c);
+        }
+    }
+
+    rtfree(linear);
+    rtfree(rgb24);
+}
+
+/**
+ * Converts the linear sRGB color `c` into CIELAB (with the D65 white point).
+ */
+static inline Lab linear_srgb_to_lab(Color *c)
+{
+    double x = 0.4124 * c->red + 0.3576 * c->green + 0.1805 * c->blue;
+    double y = 0.2126 * c->red + 0.7152 * c->green + 0.0722 * c->blue;
+    double z = 0.0193 * c->red + 0.1192 * c->green + 0.9505 * c->blue;
+
+    double fx = lab_f(x / 0.9505);
+    double fy = lab_f(y);
+    double fz = lab_f(z / 1.0890);
+    return (Lab){
+        .l = 116 * fy - 16,
+        .a = 500 * (fx - fy),
+        .b = 200 * (fy - fz),
+    };
+}
+
+static inline double lab_f(double t)
+{
+    return t > 0.008856 ? cbrt(t) : 7.787 * t + 16.0 / 116.0;
+}
+
+/**
+ * Returns the HyAB distance of two CIELAB colors: the absolute lightness difference plus the Euclidean chroma (a, b) distance.
+ */
+static inline double hyab(Lab *x, Lab *y)
+{
+    double da = x->a - y->a;
+    double db = x->b - y->b;
+    return fabs(x->l - y->l) + sqrt(da * da + db * db);
+}
@@ -0,0 +1,45 @@
+#ifndef __IMAGE_METRICS_H__
+#define __IMAGE_METRICS_H__
+
+/**
+ * Error metrics of a rendered image against a reference image (e.g. a high sample count render of the same scene), for measuring how
+ * quickly renders converge.
+ */
+
+#include <stdint.h>
+
+#include "color.h"
+#include "tonemap.h"
+
+
+// The (small) value that is added to the squared reference value in image_rel_mse(), so that black reference pixels don't dominate it.
+#define IMAGE_REL_MSE_EPSILON   0.01
+
+
+/**
+ * Returns the root mean squared error of the linear color components of `img` against `ref` (both of `pixels` pixels).
+ */
+double image_rmse(Color *img, Color *ref, uint32_t pixels);
+
+/**
+ * Returns the relative mean squared error: the mean of (img - ref)^2 / (ref^2 + IMAGE_REL_MSE_EPSILON), over all color components.
+ * Unlike the RMSE, it weights the errors of dark and bright regions similarly.
+ */
+double image_rel_mse(Color *img, Color *ref, uint32_t pixels);
+
+/**
+ * Estimates the RMSE of an accumulated image against the (unknown) fully converged image, without a reference: the RMS difference of its
+ * newest sample `sample` from the average `summed / samples` (the per-sample noise), divided by sqrt(samples). `summed` is the sum of
+ * `samples` samples, with or without `sample` (with many samples it makes no difference). Returns NAN if `samples` < 2.
+ */
+double image_noise_estimate(Color *sample, Color *summed, uint32_t samples, uint32_t pixels);
+
+/**
+ * Returns a perceptual error in [0, 1] (0 is identical), modeled after the color pipeline of NVIDIA's FLIP: both images are displayed
+ * with the tone mapping `tm` (as 8 bit sRGB values), converted to the CIELAB color space, filtered spatially (a small blur, mimicking how
+ * the eye doesn't see per-pixel noise at a normal viewing distance) and compared with the HyAB color distance. FLIP's feature (edge and
+ * point) detection is not modeled. Returns the mean of the per-pixel errors.
+ */
+double image_flip_like(ToneMap *tm, Color *img, Color *ref, uint32_t height, uint32_t width);
+
+#endif // __IMAGE_METRICS_H__
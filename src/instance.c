@@ -0,0 +1,400 @@
+#include <math.h>
+#include <string.h>
+
+#include "instance.h"
+#include "material.h"
+#include "ray.h"
+#include "ray_inline_fns.h"
+#include "rtalloc.h"
+
+
+#define PROTOTYPE_SPHERES_INITIAL_CAPACITY  16
+
+
+typedef struct SpheresRayContext_s  SpheresRayContext;
+typedef struct InstancesRayContext_s InstancesRayContext;
+
+// The data of the BVH leaf callbacks of the sphere cluster prototypes (see test_spheres_leaf(), test_spheres_leaf_any()).
+struct SpheresRayContext_s {
+    Prototype      *prototype;
+    Ray             ray;            // In the object space of the prototype.
+    uint32_t        tests;
+    bool            ignoreLights;   // Only for test_spheres_leaf_any() (see instances_occluded()).
+};
+
+// The data of the top-level BVH leaf callbacks (see test_instances_leaf(), test_instances_leaf_any()).
+struct InstancesRayContext_s {
+    Scene          *scene;
+    Ray            *ray;
+    InstanceHit    *hit;
+    bool            ignoreLights;   // Only for test_instances_leaf_any() (see instances_occluded()).
+};
+
+
+static bool prototype_intersect(Prototype *prototype, Ray *objectRay, double *dist, uint32_t *primitive, InstanceHit *stats);
+static bool prototype_occluded(Prototype *prototype, Ray *objectRay, double dist, bool ignoreLights, InstanceHit *stats);
+static bool test_spheres_leaf(void *data, uint32_t first, uint32_t count, double *dist, uint32_t *sphere);
+static bool test_spheres_leaf_any(void *data, uint32_t first, uint32_t count, double *dist, uint32_t *sphere);
+static bool test_instances_leaf(void *data, uint32_t first, uint32_t count, double *dist, uint32_t *instance);
+static bool test_instances_leaf_any(void *data, uint32_t first, uint32_t count, double *dist, uint32_t *instance);
+static inline void extend_bounds(Prototype *prototype, Vector3 *min, Vector3 *max);
+static inline void transform_point(Transform *transform, Vector3 *point, Vector3 *res);
+static inline void transform_vector(Transform *transform, Vector3 *vector, Vector3 *res);
+
+
+Transform * transform_init(Transform *transform, Vector3 *translation, Vector3 *axis, double angle, double scale)
+{
+    if (! (scale > 0)) {
+        return NULL;
+    }
+
+    // The rotation matrix (Rodrigues' rotation formula).
+    Vector3 u = {.x = 0, .y = 0, .z = 1};
+    if (angle != 0) {
+        if (! (vector3_length(axis) > 0)) {
+            return NULL;
+        }
+        u = *axis;
+        vector3_to_unit(&u);
+    }
+    double c = cos(angle);
+    double s = sin(angle);
+    double t = 1 - c;
+    double r[3][3] = {
+        {t*u.x*u.x + c,     t*u.x*u.y - s*u.z,  t*u.x*u.z + s*u.y},
+        {t*u.x*u.y + s*u.z, t*u.y*u.y + c,      t*u.y*u.z - s*u.x},
+        {t*u.x*u.z - s*u.y, t*u.y*u.z + s*u.x,  t*u.z*u.z + c},
+    };
+
+    double tr[3] = {translation->x, translation->y, translation->z};
+    for (uint32_t i = 0; i < 3; i++) {
+        for (uint32_t j = 0; j < 3; j++) {
+            transform->m[i][j] = scale * r[i][j];
+        }
+        transform->m[i][3] = tr[i];
+    }
+    return transform;
+}
+
+bool transform_invert(Transform *transform, Transform *inverse)
+{
+    double (*m)[4] = transform->m;
+
+    // The inverse of the 3x3 (linear) part is its adjugate divided by its determinant.
+    double cof00 = m[1][1]*m[2][2] - m[1][2]*m[2][1];
+    double cof01 = m[1][2]*m[2][0] - m[1][0]*m[2][2];
+    double cof02 = m[1][0]*m[2][1] - m[1][1]*m[2][0];
+    double det = m[0][0]*cof00 + m[0][1]*cof01 + m[0][2]*cof02;
+    if (det == 0 || ! isfinite(det)) {
+        return false;
+    }
+
+    double invDet = 1.0 / det;
+    double (*inv)[4] = inverse->m;
+    inv[0][0] = cof00 * invDet;
+    inv[0][1] = (m[0][2]*m[2][1] - m[0][1]*m[2][2]) * invDet;
+    inv[0][2] = (m[0][1]*m[1][2] - m[0][2]*m[1][1]) * invDet;
+    inv[1][0] = cof01 * invDet;
+    inv[1][1] = (m[0][0]*m[2][2] - m[0][2]*m[2][0]) * invDet;
+    inv[1][2] = (m[0][2]*m[1][0] - m[0][0]*m[1][2]) * invDet;
+    inv[2][0] = cof02 * invDet;
+    inv[2][1] = (m[0][1]*m[2][0] - m[0][0]*m[2][1]) * invDet;
+    inv[2][2] = (m[0][0]*m[1][1] - m[0][1]*m[1][0]) * invDet;
+
+    // The inverse translation: -inv * translation.
+    for (uint32_t i = 0; i < 3; i++) {
+        inv[i][3] = -(inv[i][0]*m[0][3] + inv[i][1]*m[1][3] + inv[i][2]*m[2][3]);
+    }
+    return true;
+}
+
+void prototype_init_spheres(Prototype *prototype)
+{
+    memset(prototype, 0, sizeof(Prototype));
+    prototype->type = PRT_spheres;
+    prototype->spheres = rtalloc(sizeof(Sphere) * PROTOTYPE_SPHERES_INITIAL_CAPACITY);
+    prototype->spheresCapacity = PROTOTYPE_SPHERES_INITIAL_CAPACITY;
+    bvh_init(&prototype->bvh);
+}
+
+void prototype_add_sphere(Prototype *prototype, Sphere *sphere)
+{
+    if (prototype->spheresLength == prototype->spheresCapacity) {
+        prototype->spheresCapacity *= 2;
+        prototype->spheres = rtrealloc(prototype->spheres, sizeof(Sphere) * prototype->spheresCapacity);
+    }
+    prototype->spheres[prototype->spheresLength++] = *sphere;
+}
+
+void prototype_init_mesh(Prototype *prototype, Mesh *mesh)
+{
+    memset(prototype, 0, sizeof(Prototype));
+    prototype->type = PRT_mesh;
+    prototype->mesh = rtalloc(sizeof(Mesh));
+    *prototype->mesh = *mesh;
+    bvh_init(&prototype->bvh);
+}
+
+void prototype_build(Prototype *prototype)
+{
+    prototype->min = (Vector3){.x = INFINITY, .y = INFINITY, .z = INFINITY};
+    prototype->max = (Vector3){.x = -INFINITY, .y = -INFINITY, .z = -INFINITY};
+
+    if (prototype->type == PRT_mesh) {
+        Mesh *mesh = prototype->mesh;
+        for (uint32_t v = 0; v < mesh->verticesLength; v++) {
+            extend_bounds(prototype, &mesh->vertices[v], &mesh->vertices[v]);
+        }
+        return;
+    }
+
+    uint32_t count = prototype->spheresLength;
+    BVHBounds *bounds = rtalloc(sizeof(BVHBounds) * (count > 0 ? count : 1));
+    uint32_t *order = rtalloc(sizeof(uint32_t) * (count > 0 ? count : 1));
+    for (uint32_t i = 0; i < count; i++) {
+        Sphere *sphere = &prototype->spheres[i];
+        Vector3 r = {.x = sphere->radius, .y = sphere->radius, .z = sphere->radius};
+        Vector3 min, max;
+        vector3_subtract(&sphere->center, &r, &min);
+        vector3_add_to(&sphere->center, &r, &max);
+        bvh_bounds_set(&bounds[i], &min, &max);
+        order[i] = i;
+        extend_bounds(prototype, &min, &max);
+    }
+
+    bvh_build(&prototype->bvh, bounds, order, count);
+
+    // Reorder the spheres the same way as the BVH build reordered their bounds.
+    Sphere *spheres = rtalloc(sizeof(Sphere) * prototype->spheresCapacity);
+    for (uint32_t i = 0; i < count; i++) {
+        spheres[i] = prototype->spheres[order[i]];
+    }
+    rtfree(prototype->spheres);
+    prototype->spheres = spheres;
+
+    rtfree(order);
+    rtfree(bounds);
+}
+
+void prototype_free(Prototype *prototype)
+{
+    if (prototype->type == PRT_mesh) {
+        mesh_free(prototype->mesh);
+        rtfree(prototype->mesh);
+        prototype->mesh = NULL;
+    }
+    rtfree(prototype->spheres);
+    prototype->spheres = NULL;
+    prototype->spheresLength = 0;
+    prototype->spheresCapacity = 0;
+    bvh_free(&prototype->bvh);
+}
+
+bool instances_intersect(Scene *scene, Ray *ray, double *dist, InstanceHit *hit)
+{
+    hit->instanceTests = 0;
+    hit->sphereTests = 0;
+    hit->triangleTests = 0;
+
+    InstancesRayContext ctx = {.scene = scene, .ray = ray, .hit = hit, .ignoreLights = false};
+    return bvh_intersect(&scene->instancesBVH, &ray->origin, &ray->direction, test_instances_leaf, &ctx, dist, &hit->instance);
+}
+
+bool instances_occluded(Scene *scene, Ray *ray, double dist, bool ignoreLights, InstanceHit *stats)
+{
+    stats->instanceTests = 0;
+    stats->sphereTests = 0;
+    stats->triangleTests = 0;
+
+    InstancesRayContext ctx = {.scene = scene, .ray = ray, .hit = stats, .ignoreLights = ignoreLights};
+    return bvh_occluded(&scene->instancesBVH, &ray->origin, &ray->direction, test_instances_leaf_any, &ctx, dist);
+}
+
+Material * instances_hit(Scene *scene, InstanceHit *ih, double dist, Hit *hit)
+{
+    Instance *instance = &scene->instances[ih->instance];
+    Prototype *prototype = &scene->prototypes[instance->prototype];
+
+    Material *material;
+    Vector3 normal;
+    if (prototype->type == PRT_mesh) {
+        Mesh *mesh = prototype->mesh;
+        mesh_triangle_normal(mesh, ih->primitive, &normal);
+        material = mesh->material;
+        hit->matData = mesh->matData;
+        hit->color = &mesh->color;
+    } else {
+        Sphere *sphere = &prototype->spheres[ih->primitive];
+        Vector3 objectPos = ih->objectDirection;
+        vector3_multiply_length(&objectPos, dist);
+        vector3_add_to(&objectPos, &ih->objectOrigin, &objectPos);
+        vector3_subtract(&objectPos, &sphere->center, &normal);
+        material = sphere->material;
+        hit->matData = sphere->matData;
+        hit->color = &sphere->color;
+    }
+
+    // Normals are transformed into the world space with the transpose of the inverse transform (so that they stay perpendicular to the
+    // surface also under non-uniform scaling).
+    double (*w)[4] = instance->worldToObject.m;
+    hit->normal = (Vector3){
+        .x = w[0][0]*normal.x + w[1][0]*normal.y + w[2][0]*normal.z,
+        .y = w[0][1]*normal.x + w[1][1]*normal.y + w[2][1]*normal.z,
+        .z = w[0][2]*normal.x + w[1][2]*normal.y + w[2][2]*normal.z,
+    };
+    vector3_to_unit(&hit->normal);
+    return material;
+}
+
+/**
+ * Finds the closest primitive of `prototype` that `objectRay` (in its object space) hits closer than `*dist` (like mesh_intersect()).
+ * Adds the amount of the tested primitives to `stats`.
+ */
+static bool prototype_intersect(Prototype *prototype, Ray *objectRay, double *dist, uint32_t *primitive, InstanceHit *stats)
+{
+    if (prototype->type == PRT_mesh) {
+        return mesh_intersect(prototype->mesh, objectRay, dist, primitive, &stats->triangleTests);
+    }
+
+    SpheresRayContext ctx = {.prototype = prototype, .ray = *objectRay, .tests = 0, .ignoreLights = false};
+    bool hit = bvh_intersect(&prototype->bvh, &objectRay->origin, &objectRay->direction, test_spheres_leaf, &ctx, dist, primitive);
+    stats->sphereTests += ctx.tests;
+    return hit;
+}
+
+/**
+ * Returns true if `objectRay` (in the object space of `prototype`) hits any of its primitives closer than `dist` (like mesh_occluded()),
+ * skipping the ones that emit light if `ignoreLights`. Adds the amount of the tested primitives to `stats`.
+ */
+static bool prototype_occluded(Prototype *prototype, Ray *objectRay, double dist, bool ignoreLights, InstanceHit *stats)
+{
+    if (prototype->type == PRT_mesh) {
+        if (ignoreLights && mat_is_emitter(prototype->mesh->material)) {
+            return false;
+        }
+        return mesh_occluded(prototype->mesh, objectRay, dist, &stats->triangleTests);
+    }
+
+    SpheresRayContext ctx = {.prototype = prototype, .ray = *objectRay, .tests = 0, .ignoreLights = ignoreLights};
+    bool hit = bvh_occluded(&prototype->bvh, &objectRay->origin, &objectRay->direction, test_spheres_leaf_any, &ctx, dist);
+    stats->sphereTests += ctx.tests;
+    return hit;
+}
+
+/**
+ * The BVH leaf callback of the sphere cluster prototypes: tests the spheres [first, first + count).
+ */
+static bool test_spheres_leaf(void *data, uint32_t first, uint32_t count, double *dist, uint32_t *sphere)
+{
+    SpheresRayContext *ctx = data;
+    bool hit = false;
+    for (uint32_t i = first; i < first + count; i++) {
+        double d = calc_ray_distance_to_sphere(&ctx->ray, &ctx->prototype->spheres[i]);
+        if (d >= RAY_DISTANCE_MIN && d < *dist) {
+            *dist = d;
+            *sphere = i;
+            hit = true;
+        }
+    }
+    ctx->tests += count;
+    return hit;
+}
+
+/**
+ * The BVH leaf callback of prototype_occluded(): returns at the first of the spheres [first, first + count) that the ray hits (and that
+ * doesn't emit light, if SpheresRayContext.ignoreLights).
+ */
+static bool test_spheres_leaf_any(void *data, uint32_t first, uint32_t count, double *dist, uint32_t *sphere)
+{
+    SpheresRayContext *ctx = data;
+    for (uint32_t i = first; i < first + count; i++) {
+        Sphere *s = &ctx->prototype->spheres[i];
+        double d = calc_ray_distance_to_sphere(&ctx->ray, s);
+        if (d >= RAY_DISTANCE_MIN && d < *dist && ! (ctx->ignoreLights && mat_is_emitter(s->material))) {
+            ctx->tests += i - first + 1;
+            *sphere = i;
+            return true;
+        }
+    }
+    ctx->tests += count;
+    return false;
+}
+
+/**
+ * The top-level BVH leaf callback: transforms the ray into the object space of each of the instances [first, first + count) (of
+ * Scene.instancesBVHOrder) and traces it through the instance's prototype.
+ */
+static bool test_instances_leaf(void *data, uint32_t first, uint32_t count, double *dist, uint32_t *instance)
+{
+    InstancesRayContext *ctx = data;
+    Scene *scene = ctx->scene;
+    bool hit = false;
+    for (uint32_t i = first; i < first + count; i++) {
+        uint32_t idx = scene->instancesBVHOrder[i];
+        Instance *inst = &scene->instances[idx];
+
+        Ray objectRay;
+        transform_point(&inst->worldToObject, &ctx->ray->origin, &objectRay.origin);
+        transform_vector(&inst->worldToObject, &ctx->ray->direction, &objectRay.direction);
+
+        uint32_t primitive;
+        if (prototype_intersect(&scene->prototypes[inst->prototype], &objectRay, dist, &primitive, ctx->hit)) {
+            *instance = idx;
+            ctx->hit->primitive = primitive;
+            ctx->hit->objectOrigin = objectRay.origin;
+            ctx->hit->objectDirection = objectRay.direction;
+            hit = true;
+        }
+    }
+    ctx->hit->instanceTests += count;
+    return hit;
+}
+
+/**
+ * The top-level BVH leaf callback of instances_occluded(): like test_instances_leaf(), but returns at the first instance that the ray hits.
+ */
+static bool test_instances_leaf_any(void *data, uint32_t first, uint32_t count, double *dist, uint32_t *instance)
+{
+    InstancesRayContext *ctx = data;
+    Scene *scene = ctx->scene;
+    for (uint32_t i = first; i < first + count; i++) {
+        uint32_t idx = scene->instancesBVHOrder[i];
+        Instance *inst = &scene->instances[idx];
+
+        Ray objectRay;
+        transform_point(&inst->worldToObject, &ctx->ray->origin, &objectRay.origin);
+        transform_vector(&inst->worldToObject, &ctx->ray->direction, &objectRay.direction);
+
+        if (prototype_occluded(&scene->prototypes[inst->prototype], &objectRay, *dist, ctx->ignoreLights, ctx->hit)) {
+            ctx->hit->instanceTests += i - first + 1;
+            *instance = idx;
+            return true;
+        }
+    }
+    ctx->hit->instanceTests += count;
+    return false;
+}
+
+static inline void extend_bounds(Prototype *prototype, Vector3 *min, Vector3 *max)
+{
+    Vector3 *pmin = &prototype->min;
+    Vector3 *pmax = &prototype->max;
+    *pmin = (Vector3){.x = fmin(pmin->x, min->x), .y = fmin(pmin->y, min->y), .z = fmin(pmin->z, min->z)};
+    *pmax = (Vector3){.x = fmax(pmax->x, max->x), .y = fmax(pmax->y, max->y), .z = fmax(pmax->z, max->z)};
+}
+
+static inline void transform_point(Transform *transform, Vector3 *point, Vector3 *res)
+{
+    double (*m)[4] = transform->m;
+    res->x = m[0][0]*point->x + m[0][1]*point->y + m[0][2]*point->z + m[0][3];
+    res->y = m[1][0]*point->x + m[1][1]*point->y + m[1][2]*point->z + m[1][3];
+    res->z = m[2][0]*point->x + m[2][1]*point->y + m[2][2]*point->z + m[2][3];
+}
+
+static inline void transform_vector(Transform *transform, Vector3 *vector, Vector3 *res)
+{
+    double (*m)[4] = transform->m;
+    res->x = m[0][0]*vector->x + m[0][1]*vector->y + m[0][2]*vector->z;
+    res->y = m[1][0]*vector->x + m[1][1]*vector->y + m[1][2]*vector->z;
+    res->z = m[2][0]*vector->x + m[2][1]*vector->y + m[2][2]*vector->z;
+}
@@ -0,0 +1,141 @@
+#ifndef __INSTANCE_H__
+#define __INSTANCE_H__
+
+/**
+ * Instancing: a scene can contain many copies (instances) of the same sub-assembly (a prototype: a cluster of spheres or a mesh), without
+ * duplicating its geometry. Each instance is just a transform and a reference to a shared prototype (see Scene.prototypes,
+ * Scene.instances).
+ *
+ * This is a two-level acceleration structure: each prototype has its own (bottom-level) BVH over its primitives, built once, in its own
+ * (object) space. The scene has a (top-level) BVH over the world bounds of the instances (see scene_build_instances_bvh()). A ray is
+ * tested against the instances whose bounds it goes through: it is transformed into the object space of each of them and traced through
+ * the prototype's BVH there. The transformed ray direction is not normalized, so distances along it are the same in both spaces.
+ */
+
+typedef struct Transform_s      Transform;
+typedef struct Prototype_s      Prototype;
+typedef struct Instance_s       Instance;
+typedef struct InstanceHit_s    InstanceHit;
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bvh.h"
+#include "mesh.h"
+#include "sphere.h"
+#include "vector.h"
+
+
+typedef enum {
+    PRT_spheres,            // A cluster of spheres (Prototype.spheres).
+    PRT_mesh,               // A triangle mesh (Prototype.mesh).
+} PrototypeType;
+
+// An affine transform: p' = m * [p.x, p.y, p.z, 1].
+struct Transform_s {
+    double          m[3][4];
+};
+
+struct Prototype_s {
+    PrototypeType   type;
+
+    // PRT_spheres only. prototype_build() reorders the spheres (for the BVH).
+    Sphere         *spheres;
+    uint32_t        spheresLength;
+    uint32_t        spheresCapacity;
+    BVH             bvh;
+
+    // PRT_mesh only. (A pointer: the Mesh type may be incomplete here, because of the mesh.h -> ray.h -> scene.h -> instance.h include
+    // cycle.)
+    Mesh           *mesh;
+
+    // The bounds of the prototype (in its object space, set by prototype_build()).
+    Vector3         min;
+    Vector3         max;
+};
+
+struct Instance_s {
+    // The inverse of the instance's (object to world) transform. It is all that is needed when tracing: rays are transformed with it
+    // into the object space and normals are transformed back with its transpose.
+    Transform       worldToObject;
+
+    BVHBounds       bounds;         // The bounds of the instance in the world space.
+    uint32_t        prototype;      // The index of the prototype in Scene.prototypes.
+};
+
+// The closest instance hit by a ray (see instances_intersect()), and the statistics of the tests it took to find it.
+struct InstanceHit_s {
+    uint32_t        instance;
+    uint32_t        primitive;      // The index of the sphere or the triangle of the prototype.
+
+    // The ray, in the object space of `instance`.
+    Vector3         objectOrigin;
+    Vector3         objectDirection;
+
+    // The amount of tests: of the instances (transforms of the ray), of the spheres and of the triangles of their prototypes.
+    uint32_t        instanceTests;
+    uint32_t        sphereTests;
+    uint32_t        triangleTests;
+};
+
+
+/**
+ * Initializes `transform` as a rotation by `angle` (radians, counter-clockwise when looking against `axis`) around `axis` (any length,
+ * ignored if `angle` is 0), followed by scaling by `scale` and then by a translation by `translation`. Returns the same `transform`
+ * pointer, or NULL if `scale` is not positive or `axis` is zero (with a non-zero angle).
+ */
+Transform * transform_init(Transform *transform, Vector3 *translation, Vector3 *axis, double angle, double scale);
+
+/**
+ * Stores the inverse of `transform` in `inverse`. Returns false if `transform` is not invertible.
+ */
+bool transform_invert(Transform *transform, Transform *inverse);
+
+/**
+ * Initializes `prototype` as an empty cluster of spheres.
+ */
+void prototype_init_spheres(Prototype *prototype);
+
+/**
+ * Adds a copy of `sphere` (in the object space of the prototype) to the sphere cluster `prototype`.
+ */
+void prototype_add_sphere(Prototype *prototype, Sphere *sphere);
+
+/**
+ * Initializes `prototype` as the triangle mesh `mesh` (with its BVH built), which it takes over (it is freed by prototype_free(), `mesh`
+ * must not be freed by the caller).
+ */
+void prototype_init_mesh(Prototype *prototype, Mesh *mesh);
+
+/**
+ * Builds the BVH of `prototype` and computes its bounds. Must be called after adding spheres (scene_add_prototype() calls it).
+ */
+void prototype_build(Prototype *prototype);
+
+/**
+ * Frees the memory of the geometry of `prototype` (but not its material data, which may be shared).
+ */
+void prototype_free(Prototype *prototype);
+
+/**
+ * Finds the closest instance of `scene` (see Scene.instances) that `ray` hits closer than `*dist`, using the top-level BVH (which must be
+ * up to date, see scene_build_instances_bvh()). If there is one - stores the distance to it in `*dist`, and what was hit in `hit` and
+ * returns true. Otherwise returns false. Always sets the test counters of `hit`.
+ */
+bool instances_intersect(Scene *scene, Ray *ray, double *dist, InstanceHit *hit);
+
+/**
+ * Returns true if `ray` hits any instance of `scene` closer than `dist` (and not closer than RAY_DISTANCE_MIN), skipping the primitives
+ * that emit light (see mat_is_emitter()) if `ignoreLights`: stops at the first hit it finds (see bvh_occluded()). Sets only the test
+ * counters of `stats`.
+ */
+bool instances_occluded(Scene *scene, Ray *ray, double dist, bool ignoreLights, InstanceHit *stats);
+
+/**
+ * Sets the normal (in the world space), the material data and the color of `hit` to the ones of the primitive of the instance hit `ih`
+ * at the distance `dist`. Returns the material of the primitive.
+ */
+Material * instances_hit(Scene *scene, InstanceHit *ih, double dist, Hit *hit);
+
+#endif // __INSTANCE_H__
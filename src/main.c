@@ -1,21 +1,43 @@
 #include <locale.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <time.h>
 
 #include "main.h"
+#include "image_metrics.h"
+#include "perf_counters.h"
+#include "prom_metrics.h"
 #include "random.h"
+#include "ray_stats.h"
 #include "renderer.h"
 #include "scene.h"
+#include "scene_file.h"
+#include "shm_export.h"
+#include "timeline.h"
+#include "tracer.h"
 #include "vector.h"
 
 
+// The amount of lines output by output_stats() (they are overwritten by the next frame's stats).
+#define STATS_OUTPUT_LINES  (4 + (RAY_STATS_ENABLED ? 4 : 0) + (PERF_COUNTERS_ENABLED ? PERF_PHASES_COUNT + 1 : 0))
+
+
 static void init_app(App *app);
 static void init_screen(App *app);
 static void init_world(App *app);
 static void run_render_loop(App *app);
-static void output_stats(App *app, struct timespec *tstart, uint64_t frames);
-static bool keyboard_esc_pressed();
+static bool reload_scene(App *app);
+static void move_camera(App *app, double forward, double sideways, double yawDegrees, double pitchDegrees);
+static void toggle_recording(App *app);
+static void finish_playback(App *app);
+static void output_stats(App *app, struct timespec *tstart, uint64_t frames, RayStats *frameRayStats, PerfStats *framePerfStats);
+static void write_prom_metrics(App *app, struct timespec *tstart, uint64_t frames, uint64_t raysTraced, Color *frameImg, Color *allFrames,
+    uint32_t accumulatedFrames, uint32_t frameTasks);
+static void output_clear_stats();
+static void output_skip_stats_lines();
+static bool process_events(App *app);
+static void output_message(const char *message);
 static inline void output_clear_current_line();
 static inline void output_go_up_one_line();
 
@@ -34,6 +56,17 @@ int WinMain()
 
     run_render_loop(&app);  // The main rendering loop (infinite, until user presses any key).
 
+    if (app.recording) {
+        toggle_recording(&app);
+    }
+    if (app.playing) {
+        camera_path_playback_free(&app.playback);
+    }
+    camera_path_free(&app.playbackPath);
+    scene_watch_close(&app.sceneWatch);
+    cost_map_free(&app.costMap);
+    shm_export_close(&app.shmExport);
+
     return 0;
 }
 
@@ -41,16 +74,36 @@ static void init_app(App *app)
 {
     setbuf(stdout, NULL);   // Disable stdout buffering.
 
+    if (TIMELINE_ENABLED) {
+        timeline_set_thread_name("main");
+    }
+
     setlocale(LC_NUMERIC, "");  // Set numeric locale, to get printf("%'f") to separate thousands in numbers with commas ","
 
-    // Seed the random number generator.
+    // Seed the random number generator (with RENDER_SEED, each frame is seeded separately in the main loop).
     struct timespec tnow;
     clock_gettime(CLOCK_MONOTONIC, &tnow);
-    random_seed(tnow.tv_nsec);
+    random_seed(RENDER_SEED != 0 ? RENDER_SEED : (uint64_t)tnow.tv_nsec);
 
     app->sdlWindow = NULL;
     app->sdlRenderer = NULL;
     app->sdlTexture = NULL;
+    app->shmExport.enabled = false;
+    app->sceneWatch.enabled = false;
+
+    workers_init(&app->workers, WORKER_THREADS);
+    tonemap_init(&app->toneMap, TONE_MAP_OPERATOR, TONE_MAP_EXPOSURE, TONE_MAP_SRGB);
+    tonemap_init(&app->heatmapToneMap, TM_clamp, 1.0, false);
+    app->displayMode = DISPLAY_MODE;
+
+    frame_times_reset(&app->frameTimes);
+    app->inputPending = false;
+    app->inputTicks = 0;
+
+    app->resetPending = false;
+    app->recording = false;
+    app->playing = false;
+    camera_path_init(&app->playbackPath);
 }
 
 static void init_screen(App *app)
@@ -59,48 +112,31 @@ static void init_screen(App *app)
     app->windowHeight   = WINDOW_HEIGHT;
 
     renderer_init(app);
+    cost_map_init(&app->costMap, COST_MAP_METRIC, app->windowWidth, app->windowHeight);
 }
 
 static void init_world(App *app)
 {
-    Vector3 camOrigin;
-    Vector3 camDirection;
-
-    // Choose one of the available camera configurations.
-    CameraConfig cc = CAMERA_CONFIG;
-    switch (CAMERA_CONFIG) {
-        case CC_z_0:
-            // Camera is centered at [0, 0, 0] and looking towards the y axis.
-            camOrigin       = (Vector3){.x = 0, .y = 0, .z = 0};
-            camDirection    = (Vector3){.x = 0, .y = 1, .z = 0};
-            break;
-
-        case CC_z_15_downwards:
-            // Camera is slightly above ground (z=15) and looking towards the y axis, at a slightly downward angle.
-            camOrigin       = (Vector3){.x = 0, .y = 0, .z = 15};
-            camDirection    = (Vector3){.x = 0, .y = 1, .z = -0.2};
-            break;
-
-        case CC_down__fov_40:
-            // Camera is high up above ground and looking straight down onto the scene.
-            camOrigin       = (Vector3){.x = 0, .y = 80, .z = 200};
-            camDirection    = (Vector3){.x = 0, .y = 0.001, .z = -1};
-            break;
-
-        default:
-            log_err("Fatal error: unknown camera configuration used: %d", cc);
-            exit(1);
-    }
+    Ray camCenterRay;
+    init_camera_ray(CAMERA_CONFIG, &camCenterRay);
+    cam_set(&app->camera, &camCenterRay, app->windowHeight, app->windowWidth);
 
-    vector3_to_unit(&camDirection);     // Camera direction vector must be a unit (normalized to length 1) vector.
+    init_scene(&app->scene, SCENE_CONFIG, SKY_CONFIG);
 
-    Ray camCenterRay = {
-        .origin     = camOrigin,
-        .direction  = camDirection,
-    };
-    cam_set(&app->camera, &camCenterRay);
+    SceneConfig sc = SCENE_CONFIG;
+    if (SCENE_HOT_RELOAD && sc == SC_file) {
+        scene_watch_init(&app->sceneWatch, SCENE_FILE_PATH);
+    }
 
-    init_scene(&app->scene);
+    const char *playbackPath = CAMERA_PATH_PLAYBACK_PATH;
+    if (playbackPath != NULL) {
+        if (! camera_path_load(&app->playbackPath, playbackPath)) {
+            log_err("Fatal error: could not load the camera path to play back. Exiting.\n");
+            exit(1);
+        }
+        camera_path_playback_start(&app->playback, &app->playbackPath, CAMERA_PATH_SNAPSHOT_DIR);
+        app->playing = true;
+    }
 }
 
 static void run_render_loop(App *app)
@@ -117,31 +153,161 @@ static void run_render_loop(App *app)
 
     Color frameImg[app->windowHeight * app->windowWidth];
     Color blendedImg[app->windowHeight * app->windowWidth];
+
+    // The amount of frames accumulated in allFrames (restarted when the scene changes).
+    uint32_t accumulatedFrames = 0;
+    uint64_t raysTraced = 0;
+    uint32_t frameTasks = 0;                // The amount of tasks that the last frame was split into (see render_frame_img()).
+    struct timespec tmetrics = tstart;      // When the metrics file was last written (see PROM_METRICS_ENABLED).
     for (uint32_t frames = 1; ; frames++) {
+        if (app->playing) {
+            Ray centerRay;
+            bool cameraChanged, reset;
+            if (! camera_path_playback_update(&app->playback, allFrames, frameImg, accumulatedFrames, app->windowHeight, app->windowWidth,
+                    &centerRay, &cameraChanged, &reset)) {
+                finish_playback(app);
+                return;
+            }
+            if (cameraChanged) {
+                cam_set(&app->camera, &centerRay, app->windowHeight, app->windowWidth);
+            }
+            if (reset) {
+                memset(&allFrames, 0, sizeof(Color) * app->windowHeight * app->windowWidth);
+                accumulatedFrames = 0;
+                cost_map_reset(&app->costMap);
+            }
+        }
+        accumulatedFrames++;
+
+        struct timespec tframe, tstage;
+        clock_gettime(CLOCK_MONOTONIC, &tframe);
+
+        if (TIMELINE_ENABLED && frames == TIMELINE_FIRST_FRAME) {
+            timeline_set_recording(true);
+        }
+        TIMELINE_BEGIN(tlFrame);
+
+        RayStats frameRayStats;
+        ray_stats_reset(&frameRayStats);
+        PerfStats framePerfStats[app->workers.threadsCount];
+        memset(framePerfStats, 0, sizeof(PerfStats) * app->workers.threadsCount);
+        TIMELINE_BEGIN(tlRender);
+        clock_gettime(CLOCK_MONOTONIC, &tstage);
+        if (RENDER_SEED != 0) {
+            random_seed(random_hash2(RENDER_SEED, accumulatedFrames));
+        }
         if (ANTIALIAS_FACTOR > 1) {
-            render_frame_img_antialiased(app, frameImg, app->windowHeight, app->windowWidth);
+            raysTraced += render_frame_img_antialiased(
+                &app->camera, &app->scene, &app->workers, frameImg, app->windowHeight, app->windowWidth, &frameRayStats, framePerfStats,
+                NULL, &frameTasks);
         } else {
-            render_frame_img(app, frameImg, app->windowHeight, app->windowWidth);
+            raysTraced += render_frame_img(
+                &app->camera, &app->scene, &app->workers, frameImg, app->windowHeight, app->windowWidth, &frameRayStats, framePerfStats,
+                &app->costMap, &frameTasks);
         }
+        frame_times_add(&app->frameTimes, FS_trace, frame_times_ms_since(&tstage));
+        TIMELINE_END(tlRender, "render_frame_img", frames);
 
         // (void)blendedImg;
-        // draw_img_to_screen(app, frameImg, app->windowHeight, app->windowWidth);
-
-        blend_frame(allFrames, frames, frameImg, blendedImg, app->windowHeight, app->windowWidth);
-        draw_img_to_screen(app, blendedImg, app->windowHeight, app->windowWidth);
+        // draw_img_to_screen(app, frameImg, 1, app->windowHeight, app->windowWidth);
+
+        TIMELINE_BEGIN(tlBlend);
+        PERF_PHASE_BEGIN(perfBlend);
+        clock_gettime(CLOCK_MONOTONIC, &tstage);
+        blend_frame(allFrames, accumulatedFrames, frameImg, blendedImg, app->windowHeight, app->windowWidth);
+        if (app->displayMode == DM_cost_heatmap) {
+            cost_map_to_heatmap(&app->costMap, blendedImg);
+        }
+        frame_times_add(&app->frameTimes, FS_blend, frame_times_ms_since(&tstage));
+        PERF_PHASE_END(perfBlend, PP_blend);
+        TIMELINE_END(tlBlend, "blend_frame", frames);
+
+        TIMELINE_BEGIN(tlDraw);
+        PERF_PHASE_BEGIN(perfDraw);
+        clock_gettime(CLOCK_MONOTONIC, &tstage);
+        draw_img_to_screen(app, blendedImg, accumulatedFrames, app->windowHeight, app->windowWidth);
+        frame_times_add(&app->frameTimes, FS_present, frame_times_ms_since(&tstage));
+        PERF_PHASE_END(perfDraw, PP_display);
+
+        // This is the first presented frame since the pending input was handled (at the end of the previous frame), so it reflects it.
+        if (app->inputPending) {
+            frame_times_add(&app->frameTimes, FS_input_latency, SDL_GetTicks() - app->inputTicks);
+            app->inputPending = false;
+        }
+        TIMELINE_END(tlDraw, "draw_img_to_screen", frames);
 
         // Calculate & output performance stats
-        output_stats(app, &tstart, frames);
+        perf_stats_collect_thread(&framePerfStats[0]);
+        output_stats(app, &tstart, frames, &frameRayStats, framePerfStats);
 
         // Run rendering until the user presses the Esc key.
-        if (keyboard_esc_pressed()) {
+        TIMELINE_BEGIN(tlEvents);
+        bool quit = process_events(app);
+        TIMELINE_END(tlEvents, "process_events", frames);
+        TIMELINE_END(tlFrame, "frame", frames);
+        frame_times_add(&app->frameTimes, FS_frame, frame_times_ms_since(&tframe));
+        if (app->playing) {
+            camera_path_playback_add_frame(&app->playback, frame_times_ms_since(&tframe));
+        }
+
+        if (TIMELINE_ENABLED && frames == TIMELINE_FIRST_FRAME + TIMELINE_FRAMES - 1) {
+            timeline_set_recording(false);
+            if (timeline_write_chrome_json(TIMELINE_OUTPUT_PATH)) {
+                char message[256];
+                snprintf(message, sizeof(message), "Timeline of frames %u-%u written to %s",
+                    TIMELINE_FIRST_FRAME, frames, TIMELINE_OUTPUT_PATH);
+                output_message(message);
+            }
+        }
+
+        if (PROM_METRICS_ENABLED && (quit || frame_times_ms_since(&tmetrics) >= PROM_METRICS_INTERVAL_MS)) {
+            write_prom_metrics(app, &tstart, frames, raysTraced, frameImg, allFrames, accumulatedFrames, frameTasks);
+            clock_gettime(CLOCK_MONOTONIC, &tmetrics);
+        }
+
+        if (quit) {
             printf("User pressed the Esc key, exiting.\n");
             return;
         }
+
+        // Apply the changes of the scene file (if it was modified) and restart accumulating frames, as they show the old scene (or the
+        // camera moved).
+        if ((scene_watch_poll(&app->sceneWatch) && reload_scene(app)) || app->resetPending) {
+            app->resetPending = false;
+            memset(&allFrames, 0, sizeof(Color) * app->windowHeight * app->windowWidth);
+            accumulatedFrames = 0;
+            cost_map_reset(&app->costMap);
+        }
     }
 }
 
-static void output_stats(App *app, struct timespec *tstart, uint64_t frames)
+/**
+ * Applies the changes of the scene file to the live scene. Returns true if the scene has changed.
+ */
+static bool reload_scene(App *app)
+{
+    SceneFileReloadStats stats;
+    if (! scene_file_reload(&app->scene, SCENE_FILE_PATH, &stats)) {
+        log_err("Scene file reload failed, keeping the current scene.\n");
+        output_skip_stats_lines();
+        return false;
+    }
+
+    if (stats.added == 0 && stats.removed == 0 && stats.moved == 0 && stats.materialsEdited == 0 && stats.planesChanged == 0
+        && stats.meshesChanged == 0 && stats.chunksChanged == 0) {
+        return false;
+    }
+
+    char message[256];
+    snprintf(message, sizeof(message), "Scene reloaded: %u added, %u removed, %u moved, %u materials edited, %u planes changed,"
+        " %u meshes changed%s (%u spheres, %u planes, %u meshes).", stats.added, stats.removed, stats.moved, stats.materialsEdited,
+        stats.planesChanged, stats.meshesChanged, stats.chunksChanged ? ", chunks replaced" : "", app->scene.spheresLength,
+        app->scene.planesLength, app->scene.meshesLength);
+    output_message(message);
+    return true;
+}
+
+static void output_stats(App *app, struct timespec *tstart, uint64_t frames, RayStats *frameRayStats, PerfStats *framePerfStats)
 {
     struct timespec tnow;
 
@@ -153,23 +319,228 @@ static void output_stats(App *app, struct timespec *tstart, uint64_t frames)
 
     // Output stats (overwriting previous output).
     if (frames > 1) {
-        output_go_up_one_line();
-        output_clear_current_line();
-        output_go_up_one_line();
-        output_clear_current_line();
+        output_clear_stats();
     }
     printf("FPS             = %f\n", fps);
     printf("Rays per second = %'f\n", rps);
+    if (RAY_STATS_ENABLED) {
+        ray_stats_print(stdout, frameRayStats);
+    }
+    frame_times_print(stdout, &app->frameTimes);
+    if (PERF_COUNTERS_ENABLED) {
+        perf_stats_print(stdout, framePerfStats, app->workers.threadsCount);
+    }
+}
+
+/**
+ * Writes the rendering metrics into PROM_METRICS_PATH (see prom_metrics.h). `frameImg` is the last rendered frame (split into `frameTasks`
+ * worker tasks), and `allFrames` the sum of the `accumulatedFrames` frames of the current image.
+ */
+static void write_prom_metrics(App *app, struct timespec *tstart, uint64_t frames, uint64_t raysTraced, Color *frameImg, Color *allFrames,
+    uint32_t accumulatedFrames, uint32_t frameTasks)
+{
+    PromMetrics m;
+    prom_metrics_init(&m);
+    m.uptimeSeconds     = frame_times_ms_since(tstart) / 1000.0;
+    m.frames            = frames;
+    m.samplesPerPixel   = accumulatedFrames * ANTIALIAS_FACTOR * ANTIALIAS_FACTOR;
+    m.raysTraced        = raysTraced;
+    m.raysPerSecond     = raysTraced / m.uptimeSeconds;
+    for (uint32_t s = 0; s < FRAME_STAGES_COUNT; s++) {
+        m.stageSeconds[s] = app->frameTimes.totalMs[s] / 1000.0;
+    }
+    m.workers           = &app->workers;
+    m.queueDepth        = frameTasks;
+    m.noiseEstimate     = image_noise_estimate(frameImg, allFrames, accumulatedFrames, app->windowHeight * app->windowWidth);
+
+    if (! prom_metrics_write(PROM_METRICS_PATH, &m)) {
+        output_skip_stats_lines();
+    }
+}
+
+/**
+ * Clears the lines output by output_stats() and moves the cursor to the first of them.
+ */
+static void output_clear_stats()
+{
+    for (uint32_t i = 0; i < STATS_OUTPUT_LINES; i++) {
+        output_go_up_one_line();
+        output_clear_current_line();
+    }
+}
+
+/**
+ * Outputs empty lines in place of the stats lines, so that the next output_stats() doesn't overwrite the lines printed before this.
+ */
+static void output_skip_stats_lines()
+{
+    for (uint32_t i = 0; i < STATS_OUTPUT_LINES; i++) {
+        printf("\n");
+    }
+}
+
+/**
+ * Prints `message` above the (overwritten) stats lines.
+ */
+static void output_message(const char *message)
+{
+    output_clear_stats();
+    printf("%s\n", message);
+    output_skip_stats_lines();
+}
+
+/**
+ * Moves the camera `forward` and `sideways` (to the right), and turns it by `yawDegrees` (to the left) and `pitchDegrees` (upwards).
+ * Restarts accumulating frames, and records the new camera position (if recording).
+ */
+static void move_camera(App *app, double forward, double sideways, double yawDegrees, double pitchDegrees)
+{
+    Ray ray = app->camera.camCenterRay;
+    Vector3 up = {.x = 0, .y = 0, .z = 1};
+    Vector3 right;
+    vector3_cross(&ray.direction, &up, &right);
+    vector3_to_unit(&right);
+
+    ray.origin.x += ray.direction.x * forward + right.x * sideways;
+    ray.origin.y += ray.direction.y * forward + right.y * sideways;
+    ray.origin.z += ray.direction.z * forward + right.z * sideways;
+
+    // The direction is turned in spherical coordinates (around the z axis, and then up/down), keeping it off the poles.
+    double yaw = atan2(ray.direction.y, ray.direction.x) + yawDegrees * M_PI / 180;
+    double pitch = asin(ray.direction.z) + pitchDegrees * M_PI / 180;
+    double pitchMax = 89.0 * M_PI / 180;
+    pitch = pitch > pitchMax ? pitchMax : (pitch < -pitchMax ? -pitchMax : pitch);
+    ray.direction = (Vector3){.x = cos(pitch) * cos(yaw), .y = cos(pitch) * sin(yaw), .z = sin(pitch)};
+
+    cam_set(&app->camera, &ray, app->windowHeight, app->windowWidth);
+    app->resetPending = true;
+    if (app->recording) {
+        camera_path_add(&app->recordedPath, frame_times_ms_since(&app->recordStart) / 1000.0, CK_camera, &ray);
+    }
+}
+
+/**
+ * Starts recording the camera path, or stops recording it and saves it into CAMERA_PATH_RECORD_PATH.
+ */
+static void toggle_recording(App *app)
+{
+    char message[256];
+    if (! app->recording) {
+        // The path starts from the current camera (and the accumulation restarts with it, so that playback starts from the same state).
+        camera_path_init(&app->recordedPath);
+        clock_gettime(CLOCK_MONOTONIC, &app->recordStart);
+        camera_path_add(&app->recordedPath, 0, CK_camera, &app->camera.camCenterRay);
+        app->resetPending = true;
+        app->recording = true;
+        output_message("Recording the camera path (press R to stop).");
+        return;
+    }
+
+    camera_path_add(&app->recordedPath, frame_times_ms_since(&app->recordStart) / 1000.0, CK_end, NULL);
+    if (camera_path_save(&app->recordedPath, CAMERA_PATH_RECORD_PATH)) {
+        snprintf(message, sizeof(message), "Camera path (%u keyframes) saved to %s", app->recordedPath.keyframesLength,
+            CAMERA_PATH_RECORD_PATH);
+        output_message(message);
+    }
+    camera_path_free(&app->recordedPath);
+    app->recording = false;
+}
+
+/**
+ * Writes the results of the ended camera path playback into CAMERA_PATH_REPORT_PATH.
+ */
+static void finish_playback(App *app)
+{
+    FILE *f = fopen(CAMERA_PATH_REPORT_PATH, "w");
+    if (f == NULL) {
+        log_err("Could not open the camera path report file for writing: %s\n", CAMERA_PATH_REPORT_PATH);
+        output_skip_stats_lines();
+    } else {
+        camera_path_playback_write_json(&app->playback, f);
+        fclose(f);
+        char message[256];
+        snprintf(message, sizeof(message), "Camera path played back (%u frames), results written to %s", app->playback.frameMsLength,
+            CAMERA_PATH_REPORT_PATH);
+        output_message(message);
+    }
+    camera_path_playback_free(&app->playback);
+    app->playing = false;
 }
 
-static bool keyboard_esc_pressed()
+/**
+ * Processes all events currently in the event queue. Returns true if the user pressed the Esc key.
+ *
+ * Keys:
+ *     H - toggles between the rendered image and the cost heatmap (see DisplayMode).
+ *     M - switches to the next cost metric (and restarts measuring the cost).
+ *     E - exports the cost map to COST_MAP_EXPORT_PATH.
+ *     W/S/A/D, arrows - move and turn the camera (see CAMERA_MOVE_STEP, CAMERA_TURN_DEGREES), except during a camera path playback.
+ *     Backspace - restarts accumulating frames.
+ *     R - starts/stops recording the camera path (see CAMERA_PATH_RECORD_PATH).
+ */
+static bool process_events(App *app)
 {
     SDL_Event event;
+    char message[256];
 
-    // Process all events currently in the event queue.
     while (SDL_PollEvent(&event)) {
-        if (event.type == SDL_KEYDOWN && event.key.keysym.scancode == SDL_SCANCODE_ESCAPE) {
-            return true;
+        if (event.type != SDL_KEYDOWN) {
+            continue;
+        }
+
+        // The input latency is measured from the oldest input that is not displayed yet.
+        if (! app->inputPending) {
+            app->inputPending = true;
+            app->inputTicks = event.key.timestamp;
+        }
+
+        switch (event.key.keysym.scancode) {
+            case SDL_SCANCODE_ESCAPE:
+                return true;
+
+            case SDL_SCANCODE_H:
+                app->displayMode = app->displayMode == DM_image ? DM_cost_heatmap : DM_image;
+                snprintf(message, sizeof(message), "Display mode: %s", app->displayMode == DM_image ? "image" : "cost heatmap");
+                output_message(message);
+                break;
+
+            case SDL_SCANCODE_M:
+                cost_map_set_metric(&app->costMap, (app->costMap.metric + 1) % COST_METRICS_COUNT);
+                snprintf(message, sizeof(message), "Cost metric: %s", cost_metric_name(app->costMap.metric));
+                output_message(message);
+                break;
+
+            case SDL_SCANCODE_E:
+                if (cost_map_save_pfm(&app->costMap, COST_MAP_EXPORT_PATH)) {
+                    snprintf(message, sizeof(message), "Cost map (%s, average %s per pixel per frame) exported to %s",
+                        cost_metric_name(app->costMap.metric), cost_metric_unit(app->costMap.metric), COST_MAP_EXPORT_PATH);
+                    output_message(message);
+                }
+                break;
+
+            case SDL_SCANCODE_BACKSPACE:
+                app->resetPending = true;
+                if (app->recording) {
+                    camera_path_add(&app->recordedPath, frame_times_ms_since(&app->recordStart) / 1000.0, CK_reset, NULL);
+                }
+                break;
+
+            case SDL_SCANCODE_R:
+                toggle_recording(app);
+                break;
+
+            default:
+                if (! app->playing) {
+                    SDL_Scancode key = event.key.keysym.scancode;
+                    double forward = key == SDL_SCANCODE_W ? CAMERA_MOVE_STEP : (key == SDL_SCANCODE_S ? -CAMERA_MOVE_STEP : 0);
+                    double sideways = key == SDL_SCANCODE_D ? CAMERA_MOVE_STEP : (key == SDL_SCANCODE_A ? -CAMERA_MOVE_STEP : 0);
+                    double yaw = key == SDL_SCANCODE_LEFT ? CAMERA_TURN_DEGREES : (key == SDL_SCANCODE_RIGHT ? -CAMERA_TURN_DEGREES : 0);
+                    double pitch = key == SDL_SCANCODE_UP ? CAMERA_TURN_DEGREES : (key == SDL_SCANCODE_DOWN ? -CAMERA_TURN_DEGREES : 0);
+                    if (forward != 0 || sideways != 0 || yaw != 0 || pitch != 0) {
+                        move_camera(app, forward, sideways, yaw, pitch);
+                    }
+                }
+                break;
         }
     }
     return false;
@@ -1,8 +1,7 @@
 #ifndef __MAIN_H__
 #define __MAIN_H__
 
-// stdio.h is required for log_err() definition (fprintf and stderr).
-#include <stdio.h>
+#include "rtcommon.h"
 
 #include "../envconfig.h"
 #if defined(ENV_LINUX) && ENV_LINUX
@@ -12,38 +11,66 @@
 #endif // ENV_LINUX
 
 
-// #define DEBUG 1
-#define DEBUG 0
+#define WINDOW_WIDTH        400
+#define WINDOW_HEIGHT       400
 
-#define DEBUG_ANGLE_TO_CC   DEBUG && 1
+// The amount of threads used for the parallelized parts of rendering. Set to 0 to use one thread per CPU core.
+#define WORKER_THREADS      0
 
-#define dbg(...) if (DEBUG) { printf(__VA_ARGS__); }
+// The seed of the rendered frames' random numbers. With 0 the random number generator is seeded from the clock (every run renders
+// different noise). Otherwise rendering is deterministic: sample N of every pixel uses random numbers derived from (RENDER_SEED, pixel,
+// N), so every run renders bit-identical images (regardless of the amount of threads).
+#define RENDER_SEED         0
 
-#define assert2(exp, msg) if (! (exp)) { printf("%s", msg); exit(1); }
+typedef enum {
+    // The rendered image.
+    DM_image,
 
-#define log_err(...) fprintf(stderr, __VA_ARGS__);
+    // A false-color heatmap of the rendering cost of each pixel (see cost_map.h).
+    DM_cost_heatmap,
+} DisplayMode;
 
-#define WINDOW_WIDTH        400
-#define WINDOW_HEIGHT       400
+// The display mode at startup (the H key toggles it) and the measured cost metric of the heatmap (the M key cycles through them).
+#define DISPLAY_MODE            DM_image
+#define COST_MAP_METRIC         CM_time
+
+// The file that the E key exports the cost map to (as a PFM float image, see cost_map_save_pfm()).
+#define COST_MAP_EXPORT_PATH    "costmap.pfm"
+
+// The frames whose timeline is recorded (when TIMELINE_ENABLED is 1, see timeline.h): TIMELINE_FRAMES frames, starting from frame
+// TIMELINE_FIRST_FRAME (1-based, skipping the first frames lets caches and the CPU clock warm up). The timeline is written to
+// TIMELINE_OUTPUT_PATH once the last of them is displayed.
+#define TIMELINE_FIRST_FRAME    10
+#define TIMELINE_FRAMES         5
+#define TIMELINE_OUTPUT_PATH    "timeline.json"
 
-// This configures the down-sampling (super-sampling) anti-aliasing.
-// How many vertical/horizontal pixels will be rendered and averaged to produce one resulting pixel, when anti-aliasing.
-// For example, if ANTIALIAS_FACTOR is 2 - then 4 pixels (2 by 2) will be rendered to produce one resulting pixel.
-//
-// Set ANTIALIAS_FACTOR to 1 to disable anti-aliasing.
-//
-// UPDATE: we don't use this anymore, but i kept the support for this anti-aliasing.
-// Instead we now randomize the camera rays directions for each pixel (within pixel's boundaries) for each frame, see cam_frame_init().
-// This performs much better and results in better anti-aliasing and better overall rendered image quality (after multiple frames are
-// blended together).
-#define ANTIALIAS_FACTOR    1
+// Camera controls: W/S move the camera forwards/backwards and A/D sideways by CAMERA_MOVE_STEP, the arrow keys turn it by
+// CAMERA_TURN_DEGREES.
+#define CAMERA_MOVE_STEP        1.0
+#define CAMERA_TURN_DEGREES     5.0
+
+// Camera paths (see camera_path.h). The R key starts/stops recording the camera movements (and the accumulation resets, the Backspace
+// key) into CAMERA_PATH_RECORD_PATH. If CAMERA_PATH_PLAYBACK_PATH is not NULL, that camera path is played back from startup: the app
+// exits at its end and writes the results into CAMERA_PATH_REPORT_PATH (and the image reached at each keyframe into
+// CAMERA_PATH_SNAPSHOT_DIR, if it is not NULL).
+#define CAMERA_PATH_RECORD_PATH     "camera_path.txt"
+#define CAMERA_PATH_PLAYBACK_PATH   NULL
+#define CAMERA_PATH_REPORT_PATH     "camera_path_report.json"
+#define CAMERA_PATH_SNAPSHOT_DIR    NULL
 
 
 typedef struct App_s            App;
 
 
 #include "camera.h"
+#include "camera_path.h"
+#include "cost_map.h"
+#include "frame_times.h"
 #include "scene.h"
+#include "scene_watch.h"
+#include "shm_export.h"
+#include "tonemap.h"
+#include "workers.h"
 
 
 struct App_s {
@@ -55,7 +82,29 @@ struct App_s {
     uint32_t        windowHeight;       // The final displayed image height.
 
     Scene           scene;
-    Camera          camera;
+    Camera          camera;             // camera.camCenterRay is the current camera position and direction.
+    SceneWatch      sceneWatch;         // Scene file hot-reload (see SCENE_HOT_RELOAD).
+    bool            resetPending;       // Whether the accumulated frames have to be discarded (e.g. the camera moved).
+
+    bool            recording;          // Whether the camera movements are being recorded into recordedPath.
+    CameraPath      recordedPath;
+    struct timespec recordStart;
+    bool            playing;            // Whether playbackPath is being played back.
+    CameraPath      playbackPath;
+    CameraPathPlayback playback;
+
+    WorkerPool      workers;
+    ToneMap         toneMap;            // How rendered images are converted into displayed pixels.
+
+    DisplayMode     displayMode;
+    CostMap         costMap;            // The rendering cost of each pixel, summed over the accumulated frames.
+    ToneMap         heatmapToneMap;     // Displays the heatmap colors as they are (without exposure, sRGB encoding, etc.).
+
+    FrameTimes      frameTimes;         // The recent frame times and input latencies (shown with the stats).
+    bool            inputPending;       // Whether an input was handled, but no frame was presented since.
+    uint32_t        inputTicks;         // The time (SDL_GetTicks()) of the pending input.
+
+    ShmExport       shmExport;          // Shared-memory framebuffer export (see SHM_EXPORT_ENABLED).
 };
 
 #endif // __MAIN_H__
@@ -3,6 +3,22 @@
 #include "material.h"
 
 
+static const char *materialTypeNames[MATERIAL_TYPES_COUNT] = {
+    [MT_matte]          = "matte",
+    [MT_metal]          = "metal",
+    [MT_dielectric]     = "dielectric",
+    [MT_light]          = "light",
+    [MT_gradient_sky]   = "gradient_sky",
+    [MT_ground]         = "ground",
+    [MT_shaded]         = "shaded",
+};
+
+
+const char * material_type_name(MaterialType type)
+{
+    return materialTypeNames[type];
+}
+
 void mat_mirror_reflect(Vector3 *incoming, Vector3 *normal, double fuzziness, Vector3 *reflected)
 {
     // Mirror reflection ray direction is calculated by formula: reflected = incoming + 2b
@@ -27,27 +43,54 @@ void mat_mirror_reflect(Vector3 *incoming, Vector3 *normal, double fuzziness, Ve
     }
 }
 
-Color mat_trace_scattered_ray(
-    Scene *scene, RTContext *rtContext, Sphere *sphere, Vector3 *pos, Vector3 *rayDirection, bool attenuate)
+void mat_refract(Vector3 *incoming, Vector3 *normal, double refractionRatio, double cosTheta, Vector3 *refracted)
+{
+    Vector3 refrPerp;
+    Vector3 normalMultipliedByCosTheta = *normal;
+    vector3_multiply_length(&normalMultipliedByCosTheta, cosTheta);
+    vector3_add_to(incoming, &normalMultipliedByCosTheta, &refrPerp);
+    vector3_multiply_length(&refrPerp, refractionRatio);
+
+    Vector3 refrPar = *normal;
+    double refrPerpLen = vector3_length(&refrPerp);
+    double refrParMultiplier = -sqrt(fabs(1.0 - (refrPerpLen*refrPerpLen)));
+    vector3_multiply_length(&refrPar, refrParMultiplier);
+
+    vector3_add_to(&refrPerp, &refrPar, refracted);
+
+    vector3_to_unit(refracted);
+}
+
+Color mat_trace_scattered_ray(Scene *scene, RTContext *rtContext, Hit *hit, Vector3 *rayDirection, bool attenuate)
 {
     Ray scatteredRay = (Ray){
-        .origin = *pos,
+        .origin = hit->pos,
         .direction = *rayDirection,
     };
 
+    // The caller traces the ray later (see RTContext.deferredRay) and multiplies its color by the color of the primitive itself.
+    DeferredRay *deferred = rtContext->deferredRay;
+    if (deferred != NULL) {
+        deferred->pending = true;
+        deferred->ray = scatteredRay;
+        deferred->attenuate = attenuate;
+        deferred->color = *hit->color;
+        return (Color)COLOR_BLACK;
+    }
+
     Color scatteredRayColor;
     bool traceSuccess = ray_trace(rtContext, scene, &scatteredRay, &scatteredRayColor);
 
     if (! traceSuccess) {
-        // Could not find any incoming color (light), so just shade this pixel of the sphere with black.
+        // Could not find any incoming color (light), so just shade this pixel of the primitive with black.
         return (Color)COLOR_BLACK;
     }
 
     if (attenuate) {
-        Color *sphereColor = &sphere->color;
-        scatteredRayColor.red *= sphereColor->red;
-        scatteredRayColor.green *= sphereColor->green;
-        scatteredRayColor.blue *= sphereColor->blue;
+        Color *hitColor = hit->color;
+        scatteredRayColor.red *= hitColor->red;
+        scatteredRayColor.green *= hitColor->green;
+        scatteredRayColor.blue *= hitColor->blue;
     }
 
     return scatteredRayColor;
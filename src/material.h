@@ -3,19 +3,33 @@
 
 typedef struct Material_s                   Material;
 
+typedef enum {
+    MT_matte,
+    MT_metal,
+    MT_dielectric,
+    MT_light,
+    MT_gradient_sky,
+    MT_ground,
+    MT_shaded,
+
+    MATERIAL_TYPES_COUNT,
+} MaterialType;
+
 
 #include "ray.h"
 #include "vector.h"
 
 
 struct Material_s {
+    MaterialType type;
+
     /**
-     * Returns the color of the `sphere` at position `pos` in the `scene`.
+     * Returns the color of the primitive (a sphere or a plane) that `ray` hit, at `hit` (see Hit) in the `scene`.
      * Internally this function can call ray_trace() (depending on the material) to calculate incoming light from scattered rays.
      *
-     * NOTE: this function can modify `ray` and `pos`.
+     * NOTE: this function can modify `ray` and `hit`.
      */
-    Color (*hit)(Scene *scene, Ray *ray, RTContext *rtContext, Sphere *sphere, Vector3 *pos);
+    Color (*hit)(Scene *scene, Ray *ray, RTContext *rtContext, Hit *hit);
 };
 
 
@@ -25,11 +39,12 @@ extern Material matMatte;
 // A special shaded material (was used for initial testing).
 extern Material matShaded;
 
-// A special material for the sky sphere, where the sky sphere is colored in a gradient from light blue at the top to white at the middle.
-// (see COLOR_GRADIENT_SKY_TOP, COLOR_GRADIENT_SKY_BOTTOM). Everything below middle (the bottom half) is also white.
+// A special material that looks like the gradient sky (see SKT_gradient): the sphere is colored (depending on the direction of the ray that
+// hits it) in a gradient from light blue at the top to white at the middle (see COLOR_GRADIENT_SKY_TOP, COLOR_GRADIENT_SKY_BOTTOM).
+// Everything below middle (the bottom half) is also white.
 extern Material matGradientSky;
 
-// A (temporary) special material for the ground sphere.
+// A (temporary) special material for the ground.
 extern Material matGround;
 
 // A material that simply emits a specific color at all times (rays don't scatter off of it).
@@ -42,6 +57,17 @@ extern Material matMetal;
 extern Material matDielectric;
 
 
+/**
+ * Returns the name of the material `type` (e.g. "matte").
+ */
+const char * material_type_name(MaterialType type);
+
+/**
+ * Returns true if `material` emits light (matLight). Occlusion queries can skip the primitives with such materials (see ray_occluded()):
+ * e.g. a shadow ray towards a light is not blocked by the light itself.
+ */
+static inline bool mat_is_emitter(Material *material);
+
 /**
  * Calculates reflection for an `incoming` ray, off of a mirror surface `normal`, and stores the reflected ray direction in `reflected`.
  *
@@ -52,20 +78,35 @@ extern Material matDielectric;
 void mat_mirror_reflect(Vector3 *incoming, Vector3 *normal, double fuzziness, Vector3 *reflected);
 
 /**
- * Given a direction of a ray that scattered after hitting a sphere - traces the scattered ray and returns the final color for the
- * **incoming** ray (meaning this also computes the shading between the color returned by the scattered ray and the color of the sphere
+ * Calculates refraction for an `incoming` ray (a unit vector), through a surface with the `normal`, and stores the (unit) refracted ray
+ * direction in `refracted`. `refractionRatio` is the ratio of the refractive indexes of the two materials (the one the ray comes from,
+ * divided by the one it enters) and `cosTheta` is the cosine of the angle between the reversed `incoming` ray and the `normal`.
+ *
+ * IMPORTANT: this function expects the surface `normal` vector to go in the opposite direction from the `incoming` ray direction vector.
+ */
+void mat_refract(Vector3 *incoming, Vector3 *normal, double refractionRatio, double cosTheta, Vector3 *refracted);
+
+/**
+ * Given a direction of a ray that scattered after hitting a primitive - traces the scattered ray and returns the final color for the
+ * **incoming** ray (meaning this also computes the shading between the color returned by the scattered ray and the color of the primitive
  * itself).
  *
  * @param scene The scene.
  * @param rtContext The ray-tracing context for this ray.
- * @param sphere The sphere that was hit.
- * @param pos The position where the sphere was hit by the incoming ray. This will be used as the origin point for the scattered ray.
+ * @param hit Where the primitive was hit by the incoming ray. Hit.pos will be used as the origin point for the scattered ray.
  * @param rayDirection The direction of the scattered ray.
- * @param attenuate A boolean, determining whether to use the color of the sphere when determining the final color or not. This will be
+ * @param attenuate A boolean, determining whether to use the color of the primitive when determining the final color or not. This will be
  *                  false for colorless see-through materials (e.g. glass) and true otherwise. This is a micro-optimisation to avoid
  *                  needlessly multiplying the traced scattered ray color by 1.0, for those materials.
- * @return Color The color to be returned for the **incoming** ray.
+ * @return Color The color to be returned for the **incoming** ray. If rtContext->deferredRay is set, the scattered ray is only stored there
+ *               (to be traced later, see RTContext.deferredRay) and black is returned.
  */
-Color mat_trace_scattered_ray(Scene *scene, RTContext *rtContext, Sphere *sphere, Vector3 *pos, Vector3 *rayDirection, bool attenuate);
+Color mat_trace_scattered_ray(Scene *scene, RTContext *rtContext, Hit *hit, Vector3 *rayDirection, bool attenuate);
+
+
+static inline bool mat_is_emitter(Material *material)
+{
+    return material->type == MT_light;
+}
 
 #endif // __MATERIAL_H__
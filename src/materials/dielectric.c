@@ -1,16 +1,17 @@
 #include "dielectric.h"
 #include "../material.h"
 #include "../ray_inline_fns.h"
+#include "../ray_stats.h"
 #include "../rtalloc.h"
 
 
-static Color dielectric_hit(Scene *scene, Ray *ray, RTContext *rtContext, Sphere *sphere, Vector3 *pos);
+static Color dielectric_hit(Scene *scene, Ray *ray, RTContext *rtContext, Hit *hit);
 static inline bool does_ray_hit_from_sphere_inside(Vector3 *rayDir, Vector3 *sphereOutwardNormal);
 static inline double schlicks_reflectance_approximation(double cosTheta, double refractionRatio);
-static inline void refract(Vector3 *incoming, Vector3 *normal, double refractionRatio, double cosTheta, Vector3 *refracted);
 
 
 Material matDielectric = {
+    .type = MT_dielectric,
     .hit = dielectric_hit,
 };
 
@@ -41,10 +42,10 @@ Sphere * sphere_dielectric_init(Sphere *sphere, double refractionIndex)
  *
  * IMPORTANT: it is important for this function that ray->direction is a **unit** vector !
  */
-static Color dielectric_hit(Scene *scene, Ray *ray, RTContext *rtContext, Sphere *sphere, Vector3 *pos)
+static Color dielectric_hit(Scene *scene, Ray *ray, RTContext *rtContext, Hit *hit)
 {
-    Vector3 sphereSurfaceNormal;
-    calc_sphere_surface_normal(sphere, pos, &sphereSurfaceNormal);
+    // For spheres this is the outward normal. For planes it faces the ray, so they are always hit from "outside".
+    Vector3 sphereSurfaceNormal = hit->normal;
 
     bool isHitFromSphereInside = does_ray_hit_from_sphere_inside(&ray->direction, &sphereSurfaceNormal);
 
@@ -58,7 +59,7 @@ static Color dielectric_hit(Scene *scene, Ray *ray, RTContext *rtContext, Sphere
         sphereRayHitNormal = &sphereSurfaceNormalReversed;
     }
 
-    MaterialDataDielectric *matData = sphere->matData;
+    MaterialDataDielectric *matData = hit->matData;
     double refractionRatio = isHitFromSphereInside ? matData->refractionIndex : matData->_refractionIndexInvBackToAir;
 
     // It is important for this calculation that `ray->direction` is a unit vector.
@@ -85,12 +86,14 @@ static Color dielectric_hit(Scene *scene, Ray *ray, RTContext *rtContext, Sphere
     bool cannotRefract = (refractionRatio * sinTheta) > 1.0;
 
     if (cannotRefract || schlicks_reflectance_approximation(cosTheta, refractionRatio) > random_double_0_1_exc()) {
+        RAY_STATS_INC(dielectricReflected);
         mat_mirror_reflect(&ray->direction, sphereRayHitNormal, 0.0, &scatteredRayDirection);
     } else {
-        refract(&ray->direction, sphereRayHitNormal, refractionRatio, cosTheta, &scatteredRayDirection);
+        RAY_STATS_INC(dielectricRefracted);
+        mat_refract(&ray->direction, sphereRayHitNormal, refractionRatio, cosTheta, &scatteredRayDirection);
     }
 
-    return mat_trace_scattered_ray(scene, rtContext, sphere, pos, &scatteredRayDirection, false);
+    return mat_trace_scattered_ray(scene, rtContext, hit, &scatteredRayDirection, false);
 }
 
 static inline bool does_ray_hit_from_sphere_inside(Vector3 *rayDir, Vector3 *sphereOutwardNormal)
@@ -104,21 +107,3 @@ static inline double schlicks_reflectance_approximation(double cosTheta, double
     double r0 = r0root*r0root;
     return r0 + ((1 - r0) * pow((1 - cosTheta), 5));
 }
-
-static inline void refract(Vector3 *incoming, Vector3 *normal, double refractionRatio, double cosTheta, Vector3 *refracted)
-{
-    Vector3 refrPerp;
-    Vector3 normalMultipliedByCosTheta = *normal;
-    vector3_multiply_length(&normalMultipliedByCosTheta, cosTheta);
-    vector3_add_to(incoming, &normalMultipliedByCosTheta, &refrPerp);
-    vector3_multiply_length(&refrPerp, refractionRatio);
-
-    Vector3 refrPar = *normal;
-    double refrPerpLen = vector3_length(&refrPerp);
-    double refrParMultiplier = -sqrt(fabs(1.0 - (refrPerpLen*refrPerpLen)));
-    vector3_multiply_length(&refrPar, refrParMultiplier);
-
-    vector3_add_to(&refrPerp, &refrPar, refracted);
-
-    vector3_to_unit(refracted);
-}
@@ -1,29 +1,25 @@
 #include "../material.h"
+#include "../ray_stats.h"
+#include "../sky.h"
 
 
-static Color gradient_sky_hit(Scene *scene, Ray *ray, RTContext *rtContext, Sphere *sphere, Vector3 *pos);
+static Color gradient_sky_hit(Scene *scene, Ray *ray, RTContext *rtContext, Hit *hit);
 
 
 Material matGradientSky = {
+    .type = MT_gradient_sky,
     .hit = gradient_sky_hit,
 };
 
-
-static Color skyTopColor = (Color)COLOR_GRADIENT_SKY_TOP;
-static Color skyBottomColor = (Color)COLOR_GRADIENT_SKY_BOTTOM;
-
-static Color gradient_sky_hit(Scene *scene, Ray *ray, RTContext *rtContext, Sphere *sphere, Vector3 *pos)
+static Color gradient_sky_hit(Scene *scene, Ray *ray, RTContext *rtContext, Hit *hit)
 {
     (void)(scene);      // Disable gcc -Wextra "unused parameter" errors.
     (void)(rtContext);
-    (void)(sphere);
-    (void)(pos);
-
-    double z = ray->direction.z;
-    if (z < 0) {
-        return skyBottomColor;
-    } else {
-        return gradient(&skyBottomColor, &skyTopColor, 0, 1, z);
-    }
+    (void)(hit);
+
+    // The path ends here (no ray is scattered): hitting the sky counts as escaping the scene.
+    RAY_STATS_INC(pathsEscaped);
+
+    return sky_gradient_color(&ray->direction);
 }
 
@@ -1,21 +1,25 @@
 #include "../material.h"
+#include "../ray_stats.h"
 
 
-static Color ground_hit(Scene *scene, Ray *ray, RTContext *rtContext, Sphere *sphere, Vector3 *pos);
+static Color ground_hit(Scene *scene, Ray *ray, RTContext *rtContext, Hit *hit);
 
 
 Material matGround = {
+    .type = MT_ground,
     .hit = ground_hit,
 };
 
 
-static Color ground_hit(Scene *scene, Ray *ray, RTContext *rtContext, Sphere *sphere, Vector3 *pos)
+static Color ground_hit(Scene *scene, Ray *ray, RTContext *rtContext, Hit *hit)
 {
     (void)(scene);      // Disable gcc -Wextra "unused parameter" errors.
     (void)(ray);
     (void)(rtContext);
-    (void)(sphere);
-    (void)(pos);
+    (void)(hit);
+
+    // The path ends here (no ray is scattered).
+    RAY_STATS_INC(pathsOther);
 
     return (Color)COLOR_GROUND;
 }
@@ -1,12 +1,14 @@
 #include "light.h"
 #include "../material.h"
+#include "../ray_stats.h"
 #include "../rtalloc.h"
 
 
-static Color light_hit(Scene *scene, Ray *ray, RTContext *rtContext, Sphere *sphere, Vector3 *pos);
+static Color light_hit(Scene *scene, Ray *ray, RTContext *rtContext, Hit *hit);
 
 
 Material matLight = {
+    .type = MT_light,
     .hit = light_hit,
 };
 
@@ -22,14 +24,16 @@ Sphere * sphere_light_init(Sphere *sphere, Color color)
     return sphere;
 }
 
-static Color light_hit(Scene *scene, Ray *ray, RTContext *rtContext, Sphere *sphere, Vector3 *pos)
+static Color light_hit(Scene *scene, Ray *ray, RTContext *rtContext, Hit *hit)
 {
     (void)(scene);      // Disable gcc -Wextra "unused parameter" errors.
     (void)(ray);
     (void)(rtContext);
-    (void)(pos);
 
-    MaterialDataLight *matData = sphere->matData;
+    // The path ends here (no ray is scattered).
+    RAY_STATS_INC(pathsLight);
+
+    MaterialDataLight *matData = hit->matData;
 
     return matData->color;
 }
@@ -3,22 +3,22 @@
 #include "../ray_inline_fns.h"
 
 
-static Color matte_hit(Scene *scene, Ray *ray, RTContext *rtContext, Sphere *sphere, Vector3 *pos);
+static Color matte_hit(Scene *scene, Ray *ray, RTContext *rtContext, Hit *hit);
 
 
 Material matMatte = {
+    .type = MT_matte,
     .hit = matte_hit,
 };
 
 
-static Color matte_hit(Scene *scene, Ray *ray, RTContext *rtContext, Sphere *sphere, Vector3 *pos)
+static Color matte_hit(Scene *scene, Ray *ray, RTContext *rtContext, Hit *hit)
 {
     (void)(ray);        // Disable gcc -Wextra "unused parameter" errors.
 
-    Vector3 normal;
-    calc_sphere_surface_normal(sphere, pos, &normal);
+    Vector3 normal = hit->normal;
 
-    // Generate a random point/vector for the scattered ray that will scatter from the `pos` (where the incoming ray
+    // Generate a random point/vector for the scattered ray that will scatter from `hit->pos` (where the incoming ray
     // hits this surface). How we will generate the scattered ray depends on MATTE_DIFFUSE_TYPE.
     MatteDiffuseAlgo mda = MATTE_DIFFUSE_ALGO;
     Vector3 bouncedRayDirection;
@@ -37,5 +37,5 @@ static Color matte_hit(Scene *scene, Ray *ray, RTContext *rtContext, Sphere *sph
         vector3_to_unit(&bouncedRayDirection);
     }
 
-    return mat_trace_scattered_ray(scene, rtContext, sphere, pos, &bouncedRayDirection, true);
+    return mat_trace_scattered_ray(scene, rtContext, hit, &bouncedRayDirection, true);
 }
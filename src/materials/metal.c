@@ -4,10 +4,11 @@
 #include "../rtalloc.h"
 
 
-static Color metal_hit(Scene *scene, Ray *ray, RTContext *rtContext, Sphere *sphere, Vector3 *pos);
+static Color metal_hit(Scene *scene, Ray *ray, RTContext *rtContext, Hit *hit);
 
 
 Material matMetal = {
+    .type = MT_metal,
     .hit = metal_hit,
 };
 
@@ -23,16 +24,13 @@ Sphere * sphere_metal_init(Sphere *sphere, double fuzziness)
     return sphere;
 }
 
-static Color metal_hit(Scene *scene, Ray *ray, RTContext *rtContext, Sphere *sphere, Vector3 *pos)
+static Color metal_hit(Scene *scene, Ray *ray, RTContext *rtContext, Hit *hit)
 {
     // A metal surface does a mirror-like reflection of incoming light, along the surface normal.
 
-    Vector3 normal;
-    calc_sphere_surface_normal(sphere, pos, &normal);
-
     Vector3 bouncedRayDirection;
-    MaterialDataMetal *matData = sphere->matData;
-    mat_mirror_reflect(&ray->direction, &normal, matData->fuzziness, &bouncedRayDirection);
+    MaterialDataMetal *matData = hit->matData;
+    mat_mirror_reflect(&ray->direction, &hit->normal, matData->fuzziness, &bouncedRayDirection);
 
-    return mat_trace_scattered_ray(scene, rtContext, sphere, pos, &bouncedRayDirection, true);
+    return mat_trace_scattered_ray(scene, rtContext, hit, &bouncedRayDirection, true);
 }
@@ -1,27 +1,28 @@
 #include "../material.h"
+#include "../ray_stats.h"
 #include "../ray_inline_fns.h"
 
 
-static Color shaded_hit(Scene *scene, Ray *ray, RTContext *rtContext, Sphere *sphere, Vector3 *pos);
+static Color shaded_hit(Scene *scene, Ray *ray, RTContext *rtContext, Hit *hit);
 
 
 Material matShaded = {
+    .type = MT_shaded,
     .hit = shaded_hit,
 };
 
 
-static Color shaded_hit(Scene *scene, Ray *ray, RTContext *rtContext, Sphere *sphere, Vector3 *pos)
+static Color shaded_hit(Scene *scene, Ray *ray, RTContext *rtContext, Hit *hit)
 {
     (void)(scene);      // Disable gcc -Wextra "unused parameter" errors.
     (void)(ray);
     (void)(rtContext);
-    (void)(sphere);
-    (void)(pos);
 
-    // Calculate the sphere surface normal vector at `pos`.
-    // I.e. a normalized (unit) vector from `sphere->center` to `pos`.
-    Vector3 normal;
-    calc_sphere_surface_normal(sphere, pos, &normal);
+    // The path ends here (no ray is scattered).
+    RAY_STATS_INC(pathsOther);
+
+    // The surface normal vector at `hit->pos` (for spheres: a normalized (unit) vector from the center of the sphere to `hit->pos`).
+    Vector3 normal = hit->normal;
 
     return (Color){
         .red = floor((normal.x + 1) * 128),
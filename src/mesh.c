@@ -0,0 +1,375 @@
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "mesh.h"
+#include "ray.h"
+#include "rtalloc.h"
+#include "rtcommon.h"
+
+
+#define MESH_INITIAL_CAPACITY       64
+#define MESH_OBJ_LINE_MAX           4096
+
+
+typedef struct WatertightRay_s  WatertightRay;
+typedef struct MeshRayContext_s MeshRayContext;
+
+// A ray, transformed for the watertight ray/triangle test: the axes are permuted, so that the ray goes along the (permuted) z axis the
+// most, and the shear (sx, sy, sz) transforms the ray direction to [0, 0, 1].
+struct WatertightRay_s {
+    double      origin[3];
+    uint32_t    kx, ky, kz;
+    double      sx, sy, sz;
+};
+
+// The data of the BVH leaf callbacks (see test_leaf(), test_leaf_any()).
+struct MeshRayContext_s {
+    Mesh           *mesh;
+    WatertightRay   wr;
+    uint32_t        tests;
+};
+
+
+static void mesh_ray_context_init(MeshRayContext *ctx, Mesh *mesh, Ray *ray);
+static bool test_leaf(void *data, uint32_t first, uint32_t count, double *dist, uint32_t *triangle);
+static bool test_leaf_any(void *data, uint32_t first, uint32_t count, double *dist, uint32_t *triangle);
+static inline bool ray_hits_triangle(WatertightRay *wr, Mesh *mesh, uint32_t triangle, double maxDist, double *dist);
+static bool parse_face(Mesh *mesh, char *p, uint32_t **face, uint32_t *faceCapacity);
+
+
+void mesh_init(Mesh *mesh)
+{
+    mesh->vertices          = rtalloc(sizeof(Vector3) * MESH_INITIAL_CAPACITY);
+    mesh->verticesLength    = 0;
+    mesh->verticesCapacity  = MESH_INITIAL_CAPACITY;
+    mesh->triangles         = rtalloc(sizeof(uint32_t) * 3 * MESH_INITIAL_CAPACITY);
+    mesh->trianglesLength   = 0;
+    mesh->trianglesCapacity = MESH_INITIAL_CAPACITY;
+    bvh_init(&mesh->bvh);
+    mesh->path              = NULL;
+    mesh->material          = &matMatte;
+    mesh->matData           = NULL;
+    mesh->color             = (Color)COLOR_WHITE;
+}
+
+void mesh_free(Mesh *mesh)
+{
+    rtfree(mesh->vertices);
+    rtfree(mesh->triangles);
+    bvh_free(&mesh->bvh);
+    rtfree(mesh->path);
+    mesh->vertices = NULL;
+    mesh->triangles = NULL;
+    mesh->path = NULL;
+    mesh->verticesLength = 0;
+    mesh->trianglesLength = 0;
+}
+
+uint32_t mesh_add_vertex(Mesh *mesh, Vector3 *vertex)
+{
+    if (mesh->verticesLength == mesh->verticesCapacity) {
+        mesh->verticesCapacity *= 2;
+        mesh->vertices = rtrealloc(mesh->vertices, sizeof(Vector3) * mesh->verticesCapacity);
+    }
+    mesh->vertices[mesh->verticesLength] = *vertex;
+    return mesh->verticesLength++;
+}
+
+void mesh_add_triangle(Mesh *mesh, uint32_t v0, uint32_t v1, uint32_t v2)
+{
+    if (mesh->trianglesLength == mesh->trianglesCapacity) {
+        mesh->trianglesCapacity *= 2;
+        mesh->triangles = rtrealloc(mesh->triangles, sizeof(uint32_t) * 3 * (size_t)mesh->trianglesCapacity);
+    }
+    uint32_t *t = &mesh->triangles[3 * (size_t)mesh->trianglesLength++];
+    t[0] = v0;
+    t[1] = v1;
+    t[2] = v2;
+}
+
+bool mesh_load_obj(Mesh *mesh, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        log_err("Could not open OBJ file \"%s\": %s\n", path, strerror(errno));
+        return false;
+    }
+
+    // The vertex indexes of the current face (polygon).
+    uint32_t faceCapacity = 16;
+    uint32_t *face = rtalloc(sizeof(uint32_t) * faceCapacity);
+
+    bool ok = true;
+    char line[MESH_OBJ_LINE_MAX];
+    for (uint32_t lineNum = 1; fgets(line, sizeof(line), f) != NULL; lineNum++) {
+        if (strchr(line, '\n') == NULL && ! feof(f)) {
+            log_err("%s:%u: line is too long (max %d characters)\n", path, lineNum, MESH_OBJ_LINE_MAX - 2);
+            ok = false;
+            break;
+        }
+
+        char *p = line + strspn(line, " \t");
+        if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+            Vector3 v;
+            char *end;
+            v.x = strtod(p + 2, &end);
+            bool valid = end != p + 2;
+            p = end;
+            v.y = strtod(p, &end);
+            valid = valid && end != p;
+            p = end;
+            v.z = strtod(p, &end);
+            valid = valid && end != p;
+            if (! valid) {
+                log_err("%s:%u: invalid vertex: %s", path, lineNum, line);
+                ok = false;
+                break;
+            }
+            mesh_add_vertex(mesh, &v);
+        } else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+            if (! parse_face(mesh, p + 2, &face, &faceCapacity)) {
+                log_err("%s:%u: invalid face: %s", path, lineNum, line);
+                ok = false;
+                break;
+            }
+        }
+        // Everything else (comments, normals, texture coordinates, groups, materials) is ignored.
+    }
+
+    if (ok && ferror(f)) {
+        log_err("Could not read OBJ file \"%s\": %s\n", path, strerror(errno));
+        ok = false;
+    }
+    rtfree(face);
+    fclose(f);
+
+    if (ok) {
+        mesh->path = rtalloc(strlen(path) + 1);
+        strcpy(mesh->path, path);
+        mesh_build_bvh(mesh);
+    }
+    return ok;
+}
+
+void mesh_build_bvh(Mesh *mesh)
+{
+    uint32_t count = mesh->trianglesLength;
+    BVHBounds *bounds = rtalloc(sizeof(BVHBounds) * (count > 0 ? count : 1));
+    uint32_t *order = rtalloc(sizeof(uint32_t) * (count > 0 ? count : 1));
+    for (uint32_t t = 0; t < count; t++) {
+        uint32_t *tri = &mesh->triangles[3 * (size_t)t];
+        Vector3 *v0 = &mesh->vertices[tri[0]];
+        Vector3 *v1 = &mesh->vertices[tri[1]];
+        Vector3 *v2 = &mesh->vertices[tri[2]];
+        Vector3 min = {.x = fmin(v0->x, fmin(v1->x, v2->x)), .y = fmin(v0->y, fmin(v1->y, v2->y)), .z = fmin(v0->z, fmin(v1->z, v2->z))};
+        Vector3 max = {.x = fmax(v0->x, fmax(v1->x, v2->x)), .y = fmax(v0->y, fmax(v1->y, v2->y)), .z = fmax(v0->z, fmax(v1->z, v2->z))};
+        bvh_bounds_set(&bounds[t], &min, &max);
+        order[t] = t;
+    }
+
+    bvh_build(&mesh->bvh, bounds, order, count);
+
+    // Reorder the triangles the same way as the BVH build reordered their bounds.
+    uint32_t *triangles = rtalloc(sizeof(uint32_t) * 3 * (size_t)mesh->trianglesCapacity);
+    for (uint32_t t = 0; t < count; t++) {
+        memcpy(&triangles[3 * (size_t)t], &mesh->triangles[3 * (size_t)order[t]], sizeof(uint32_t) * 3);
+    }
+    rtfree(mesh->triangles);
+    mesh->triangles = triangles;
+
+    rtfree(order);
+    rtfree(bounds);
+}
+
+Mesh * mesh_set_material(Mesh *mesh, Sphere *materialTemplate)
+{
+    mesh->material  = materialTemplate->material;
+    mesh->matData   = materialTemplate->matData;
+    mesh->color     = materialTemplate->color;
+    return mesh;
+}
+
+bool mesh_intersect(Mesh *mesh, Ray *ray, double *dist, uint32_t *triangle, uint32_t *tests)
+{
+    if (mesh->bvh.nodesLength == 0) {
+        return false;
+    }
+
+    MeshRayContext ctx;
+    mesh_ray_context_init(&ctx, mesh, ray);
+    bool hit = bvh_intersect(&mesh->bvh, &ray->origin, &ray->direction, test_leaf, &ctx, dist, triangle);
+    *tests += ctx.tests;
+    return hit;
+}
+
+bool mesh_occluded(Mesh *mesh, Ray *ray, double dist, uint32_t *tests)
+{
+    if (mesh->bvh.nodesLength == 0) {
+        return false;
+    }
+
+    MeshRayContext ctx;
+    mesh_ray_context_init(&ctx, mesh, ray);
+    bool hit = bvh_occluded(&mesh->bvh, &ray->origin, &ray->direction, test_leaf_any, &ctx, dist);
+    *tests += ctx.tests;
+    return hit;
+}
+
+void mesh_triangle_normal(Mesh *mesh, uint32_t triangle, Vector3 *normal)
+{
+    uint32_t *tri = &mesh->triangles[3 * (size_t)triangle];
+    Vector3 e1, e2;
+    vector3_subtract(&mesh->vertices[tri[1]], &mesh->vertices[tri[0]], &e1);
+    vector3_subtract(&mesh->vertices[tri[2]], &mesh->vertices[tri[0]], &e2);
+    vector3_cross(&e1, &e2, normal);
+    vector3_to_unit(normal);
+}
+
+/**
+ * Initializes `ctx` for tracing `ray` through `mesh` (see WatertightRay).
+ */
+static void mesh_ray_context_init(MeshRayContext *ctx, Mesh *mesh, Ray *ray)
+{
+    ctx->mesh = mesh;
+    ctx->tests = 0;
+    WatertightRay *wr = &ctx->wr;
+    double dir[3] = {ray->direction.x, ray->direction.y, ray->direction.z};
+    wr->origin[0] = ray->origin.x;
+    wr->origin[1] = ray->origin.y;
+    wr->origin[2] = ray->origin.z;
+    wr->kz = fabs(dir[0]) > fabs(dir[1]) ? (fabs(dir[0]) > fabs(dir[2]) ? 0 : 2) : (fabs(dir[1]) > fabs(dir[2]) ? 1 : 2);
+    wr->kx = (wr->kz + 1) % 3;
+    wr->ky = (wr->kx + 1) % 3;
+    if (dir[wr->kz] < 0) {
+        // Swap kx and ky, to preserve the winding of the triangles.
+        uint32_t k = wr->kx;
+        wr->kx = wr->ky;
+        wr->ky = k;
+    }
+    wr->sx = dir[wr->kx] / dir[wr->kz];
+    wr->sy = dir[wr->ky] / dir[wr->kz];
+    wr->sz = 1.0 / dir[wr->kz];
+}
+
+/**
+ * The BVH leaf callback of mesh_intersect(): tests the triangles [first, first + count).
+ */
+static bool test_leaf(void *data, uint32_t first, uint32_t count, double *dist, uint32_t *triangle)
+{
+    MeshRayContext *ctx = data;
+    bool hit = false;
+    for (uint32_t t = first; t < first + count; t++) {
+        if (ray_hits_triangle(&ctx->wr, ctx->mesh, t, *dist, dist)) {
+            *triangle = t;
+            hit = true;
+        }
+    }
+    ctx->tests += count;
+    return hit;
+}
+
+/**
+ * The BVH leaf callback of mesh_occluded(): like test_leaf(), but returns at the first triangle that the ray hits.
+ */
+static bool test_leaf_any(void *data, uint32_t first, uint32_t count, double *dist, uint32_t *triangle)
+{
+    MeshRayContext *ctx = data;
+    for (uint32_t t = first; t < first + count; t++) {
+        if (ray_hits_triangle(&ctx->wr, ctx->mesh, t, *dist, dist)) {
+            ctx->tests += t - first + 1;
+            *triangle = t;
+            return true;
+        }
+    }
+    ctx->tests += count;
+    return false;
+}
+
+/**
+ * The watertight ray/triangle test: transforms the triangle into the space of the ray (where the ray starts at [0, 0, 0] and goes along
+ * the z axis) and checks on which side of each of its edges the ray is, using 2D edge functions. Rays that go exactly through an edge or a
+ * vertex hit the triangles that share it (they are never missed by all of them).
+ */
+static inline bool ray_hits_triangle(WatertightRay *wr, Mesh *mesh, uint32_t triangle, double maxDist, double *dist)
+{
+    uint32_t *tri = &mesh->triangles[3 * (size_t)triangle];
+    Vector3 *v0 = &mesh->vertices[tri[0]];
+    Vector3 *v1 = &mesh->vertices[tri[1]];
+    Vector3 *v2 = &mesh->vertices[tri[2]];
+    double a[3] = {v0->x - wr->origin[0], v0->y - wr->origin[1], v0->z - wr->origin[2]};
+    double b[3] = {v1->x - wr->origin[0], v1->y - wr->origin[1], v1->z - wr->origin[2]};
+    double c[3] = {v2->x - wr->origin[0], v2->y - wr->origin[1], v2->z - wr->origin[2]};
+
+    double ax = a[wr->kx] - wr->sx * a[wr->kz];
+    double ay = a[wr->ky] - wr->sy * a[wr->kz];
+    double bx = b[wr->kx] - wr->sx * b[wr->kz];
+    double by = b[wr->ky] - wr->sy * b[wr->kz];
+    double cx = c[wr->kx] - wr->sx * c[wr->kz];
+    double cy = c[wr->ky] - wr->sy * c[wr->kz];
+
+    // The scaled barycentric coordinates of the hit point.
+    double u = cx*by - cy*bx;
+    double v = ax*cy - ay*cx;
+    double w = bx*ay - by*ax;
+    if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0)) {
+        return false;
+    }
+
+    double det = u + v + w;
+    if (det == 0) {
+        return false;
+    }
+
+    double t = (u * a[wr->kz] + v * b[wr->kz] + w * c[wr->kz]) * wr->sz / det;
+    if (! (t >= RAY_DISTANCE_MIN && t < maxDist)) {
+        return false;
+    }
+    *dist = t;
+    return true;
+}
+
+/**
+ * Parses the vertex indexes of an OBJ face ("f v1 v2 v3 ...", each index can be followed by "/vt/vn" references, which are ignored,
+ * negative indexes are relative to the end of the vertex list) at `p` and adds it to `mesh` as triangles. Returns false if it is invalid.
+ */
+static bool parse_face(Mesh *mesh, char *p, uint32_t **face, uint32_t *faceCapacity)
+{
+    uint32_t length = 0;
+    while (true) {
+        p += strspn(p, " \t\r\n");
+        if (*p == '\0') {
+            break;
+        }
+
+        char *end;
+        long idx = strtol(p, &end, 10);
+        if (end == p) {
+            return false;
+        }
+        if (idx < 0) {
+            idx += (long)mesh->verticesLength + 1;
+        }
+        if (idx < 1 || idx > (long)mesh->verticesLength) {
+            return false;
+        }
+
+        if (length == *faceCapacity) {
+            *faceCapacity *= 2;
+            *face = rtrealloc(*face, sizeof(uint32_t) * *faceCapacity);
+        }
+        (*face)[length++] = (uint32_t)(idx - 1);
+
+        // Skip the texture coordinate/normal references.
+        p = end + strcspn(end, " \t\r\n");
+    }
+
+    if (length < 3) {
+        return false;
+    }
+    for (uint32_t i = 1; i + 1 < length; i++) {
+        mesh_add_triangle(mesh, (*face)[0], (*face)[i], (*face)[i + 1]);
+    }
+    return true;
+}
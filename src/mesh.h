@@ -0,0 +1,108 @@
+#ifndef __MESH_H__
+#define __MESH_H__
+
+/**
+ * Indexed triangle meshes (see Scene.meshes), loaded from Wavefront OBJ files (see mesh_load_obj()).
+ *
+ * Each mesh has its own bounding volume hierarchy (see bvh.h) over its triangles, so a ray is only tested against the few triangles near
+ * its path.
+ *
+ * The ray/triangle test is watertight (Woop, Benthin, Wald: "Watertight Ray/Triangle Intersection", 2013): rays never slip through the
+ * shared edges and vertices of adjacent triangles.
+ *
+ * The normal of a triangle is defined by its winding (the OBJ convention): it points towards where its vertices are seen in
+ * counter-clockwise order. Like for spheres, it is the outward normal of a closed mesh (dielectric materials rely on it).
+ */
+
+typedef struct Mesh_s           Mesh;
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bvh.h"
+#include "color.h"
+#include "sphere.h"
+#include "vector.h"
+
+
+struct Mesh_s {
+    Vector3        *vertices;
+    uint32_t        verticesLength;
+    uint32_t        verticesCapacity;
+
+    // The vertex indexes of the triangles (3 per triangle). Building the BVH reorders the triangles.
+    uint32_t       *triangles;
+    uint32_t        trianglesLength;
+    uint32_t        trianglesCapacity;
+
+    BVH             bvh;                // Empty until mesh_build_bvh() is called.
+
+    char           *path;               // The OBJ file the mesh was loaded from (NULL if it wasn't).
+
+    Material       *material;
+    void           *matData;
+    Color           color;
+};
+
+
+/**
+ * Initializes `mesh` as an empty mesh (without a material).
+ */
+void mesh_init(Mesh *mesh);
+
+/**
+ * Frees the memory of the geometry of `mesh` (but not its material data, which may be shared).
+ */
+void mesh_free(Mesh *mesh);
+
+/**
+ * Adds a vertex to `mesh`. Returns its index.
+ */
+uint32_t mesh_add_vertex(Mesh *mesh, Vector3 *vertex);
+
+/**
+ * Adds a triangle with the vertexes `v0`, `v1`, `v2` (indexes of existing vertices, in counter-clockwise order when looking at the front
+ * of the triangle) to `mesh`.
+ */
+void mesh_add_triangle(Mesh *mesh, uint32_t v0, uint32_t v1, uint32_t v2);
+
+/**
+ * Loads the vertices and faces of the Wavefront OBJ file at `path` into `mesh` (which must be initialized and empty) and builds its BVH.
+ * Polygons are split into triangles (as fans), everything other than vertex positions and faces (normals, texture coordinates, groups,
+ * materials) is ignored. The file is read line by line, so it does not have to fit into memory (only the mesh does).
+ *
+ * Returns false (and logs the error) if the file could not be read or is invalid.
+ */
+bool mesh_load_obj(Mesh *mesh, const char *path);
+
+/**
+ * (Re-)builds the BVH of `mesh`. Must be called after adding triangles (mesh_load_obj() calls it).
+ */
+void mesh_build_bvh(Mesh *mesh);
+
+/**
+ * Sets the material (material, matData, color) of `mesh` to the one of `materialTemplate` (a sphere initialized with one of the material
+ * init functions, e.g. sphere_metal_init()). The material data is shared, not copied. Returns the same `mesh` pointer.
+ */
+Mesh * mesh_set_material(Mesh *mesh, Sphere *materialTemplate);
+
+/**
+ * Finds the closest triangle of `mesh` that `ray` hits closer than `*dist` (and not closer than RAY_DISTANCE_MIN). If there is one - stores
+ * the distance to it in `*dist` and its index in `*triangle` and returns true. Otherwise returns false (and leaves them unchanged).
+ * Adds the amount of triangles tested to `*tests`.
+ */
+bool mesh_intersect(Mesh *mesh, Ray *ray, double *dist, uint32_t *triangle, uint32_t *tests);
+
+/**
+ * Returns true if `ray` hits any triangle of `mesh` closer than `dist` (and not closer than RAY_DISTANCE_MIN): stops at the first one it
+ * finds (see bvh_occluded()). Adds the amount of triangles tested to `*tests`.
+ */
+bool mesh_occluded(Mesh *mesh, Ray *ray, double dist, uint32_t *tests);
+
+/**
+ * Stores the (unit) normal of the `triangle` of `mesh` (see the winding convention above) in `normal`.
+ */
+void mesh_triangle_normal(Mesh *mesh, uint32_t triangle, Vector3 *normal);
+
+#endif // __MESH_H__
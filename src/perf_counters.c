@@ -0,0 +1,261 @@
+#include "../envconfig.h"
+#if defined(ENV_LINUX) && ENV_LINUX
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif // ENV_LINUX
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "perf_counters.h"
+#include "rtcommon.h"
+
+
+typedef enum {
+    PTS_closed,             // The counters were not opened yet.
+    PTS_open,
+    PTS_unavailable,        // The counters could not be opened (they read as 0).
+} PerfThreadState;
+
+typedef struct PerfThread_s     PerfThread;
+
+// The counters of a thread.
+struct PerfThread_s {
+    PerfThreadState state;
+    int             fds[PERF_COUNTERS_COUNT];       // -1 if the counter is not supported. fds[PC_cycles] is the group leader.
+
+    // The index of each counter in the group's values (see perf_counters_read()), or -1 if the counter is not supported.
+    int             groupIdx[PERF_COUNTERS_COUNT];
+    uint32_t        groupSize;
+
+    PerfStats       stats;
+};
+
+
+static const char *perfCounterNames[PERF_COUNTERS_COUNT] = {
+    [PC_cycles]         = "cycles",
+    [PC_instructions]   = "instructions",
+    [PC_l1d_misses]     = "l1dMisses",
+    [PC_llc_misses]     = "llcMisses",
+    [PC_branch_misses]  = "branchMisses",
+};
+
+static const char *perfPhaseNames[PERF_PHASES_COUNT] = {
+    [PP_camera]     = "camera",
+    [PP_trace]      = "trace",
+    [PP_blend]      = "blend",
+    [PP_display]    = "display",
+};
+
+#if PERF_COUNTERS_ENABLED
+static _Thread_local PerfThread perfThread RT_TLS_MODEL;
+#endif // PERF_COUNTERS_ENABLED
+
+// Whether an error opening the counters was already logged (only the first thread's error is logged).
+static atomic_flag perfErrorLogged = ATOMIC_FLAG_INIT;
+
+
+static void perf_thread_open(PerfThread *pt);
+
+
+void perf_counters_read(PerfSnapshot *snapshot)
+{
+    memset(snapshot, 0, sizeof(PerfSnapshot));
+
+#if PERF_COUNTERS_ENABLED && defined(ENV_LINUX) && ENV_LINUX
+    PerfThread *pt = &perfThread;
+    if (pt->state == PTS_closed) {
+        perf_thread_open(pt);
+    }
+    if (pt->state != PTS_open) {
+        return;
+    }
+
+    // The group's values (PERF_FORMAT_GROUP): the amount of values, the time the counters were enabled and running, the values.
+    uint64_t data[3 + PERF_COUNTERS_COUNT];
+    ssize_t size = read(pt->fds[PC_cycles], data, sizeof(data));
+    if (size < (ssize_t)(sizeof(uint64_t) * (3 + pt->groupSize)) || data[2] == 0) {
+        return;
+    }
+
+    // If there are more counters than the CPU has hardware counters, the kernel multiplexes them (each one only runs for a part of the
+    // time), so the values are scaled up to the whole time.
+    double scale = (double)data[1] / data[2];
+    for (uint32_t c = 0; c < PERF_COUNTERS_COUNT; c++) {
+        if (pt->groupIdx[c] >= 0) {
+            snapshot->values[c] = (uint64_t)(data[3 + pt->groupIdx[c]] * scale);
+        }
+    }
+#else
+    (void)(perf_thread_open);
+#endif // PERF_COUNTERS_ENABLED && ENV_LINUX
+}
+
+void perf_counters_add_phase(PerfSnapshot *start, PerfPhase phase)
+{
+#if PERF_COUNTERS_ENABLED
+    PerfSnapshot end;
+    perf_counters_read(&end);
+    for (uint32_t c = 0; c < PERF_COUNTERS_COUNT; c++) {
+        // The scaled values of multiplexed counters are estimates, so they may (slightly) decrease.
+        if (end.values[c] > start->values[c]) {
+            perfThread.stats.counts[phase][c] += end.values[c] - start->values[c];
+        }
+    }
+#else
+    (void)(start);      // Disable gcc -Wextra "unused parameter" errors.
+    (void)(phase);      // Disable gcc -Wextra "unused parameter" errors.
+#endif // PERF_COUNTERS_ENABLED
+}
+
+void perf_counters_close_thread()
+{
+#if PERF_COUNTERS_ENABLED && defined(ENV_LINUX) && ENV_LINUX
+    PerfThread *pt = &perfThread;
+    if (pt->state == PTS_open) {
+        for (uint32_t c = 0; c < PERF_COUNTERS_COUNT; c++) {
+            if (pt->fds[c] >= 0) {
+                close(pt->fds[c]);
+            }
+        }
+    }
+    pt->state = PTS_closed;
+#endif // PERF_COUNTERS_ENABLED && ENV_LINUX
+}
+
+void perf_stats_reset(PerfStats *stats)
+{
+    memset(stats, 0, sizeof(PerfStats));
+}
+
+void perf_stats_merge(PerfStats *dst, PerfStats *src)
+{
+    for (uint32_t p = 0; p < PERF_PHASES_COUNT; p++) {
+        for (uint32_t c = 0; c < PERF_COUNTERS_COUNT; c++) {
+            dst->counts[p][c] += src->counts[p][c];
+        }
+    }
+}
+
+void perf_stats_collect_thread(PerfStats *dst)
+{
+#if PERF_COUNTERS_ENABLED
+    perf_stats_merge(dst, &perfThread.stats);
+    perf_stats_reset(&perfThread.stats);
+#else
+    (void)(dst);        // Disable gcc -Wextra "unused parameter" errors.
+#endif // PERF_COUNTERS_ENABLED
+}
+
+const char * perf_counter_name(PerfCounter counter)
+{
+    return perfCounterNames[counter];
+}
+
+const char * perf_phase_name(PerfPhase phase)
+{
+    return perfPhaseNames[phase];
+}
+
+void perf_stats_print(FILE *f, PerfStats *threadStats, uint32_t threadsCount)
+{
+    PerfStats total;
+    perf_stats_reset(&total);
+    for (uint32_t t = 0; t < threadsCount; t++) {
+        perf_stats_merge(&total, &threadStats[t]);
+    }
+
+    for (uint32_t p = 0; p < PERF_PHASES_COUNT; p++) {
+        uint64_t *counts = total.counts[p];
+        double kiloInstructions = counts[PC_instructions] > 0 ? counts[PC_instructions] / 1000.0 : 1;
+        fprintf(f, "%-8s %'14" PRIu64 " cycles, IPC %.2f, misses per 1K instructions: L1d %.2f, LLC %.3f, branch %.2f\n",
+            perf_phase_name(p), counts[PC_cycles], counts[PC_cycles] > 0 ? (double)counts[PC_instructions] / counts[PC_cycles] : 0.0,
+            counts[PC_l1d_misses] / kiloInstructions, counts[PC_llc_misses] / kiloInstructions,
+            counts[PC_branch_misses] / kiloInstructions);
+    }
+
+    // The load balance of the ray tracing between the threads: the slowest thread's cycles relative to the average thread's.
+    uint64_t maxCycles = 0;
+    double minIpc = 0, maxIpc = 0;
+    for (uint32_t t = 0; t < threadsCount; t++) {
+        uint64_t *counts = threadStats[t].counts[PP_trace];
+        double ipc = counts[PC_cycles] > 0 ? (double)counts[PC_instructions] / counts[PC_cycles] : 0.0;
+        minIpc = (t == 0 || ipc < minIpc) ? ipc : minIpc;
+        maxIpc = (t == 0 || ipc > maxIpc) ? ipc : maxIpc;
+        maxCycles = counts[PC_cycles] > maxCycles ? counts[PC_cycles] : maxCycles;
+    }
+    double avgCycles = threadsCount > 0 ? (double)total.counts[PP_trace][PC_cycles] / threadsCount : 0;
+    fprintf(f, "Trace threads: %" PRIu32 ", IPC min %.2f max %.2f, cycles max / average %.3f\n", threadsCount, minIpc, maxIpc,
+        avgCycles > 0 ? maxCycles / avgCycles : 0.0);
+}
+
+void perf_stats_write_json(FILE *f, PerfStats *stats)
+{
+    fprintf(f, "{");
+    for (uint32_t p = 0; p < PERF_PHASES_COUNT; p++) {
+        fprintf(f, "%s\"%s\": {", p > 0 ? ", " : "", perf_phase_name(p));
+        for (uint32_t c = 0; c < PERF_COUNTERS_COUNT; c++) {
+            fprintf(f, "%s\"%s\": %" PRIu64, c > 0 ? ", " : "", perf_counter_name(c), stats->counts[p][c]);
+        }
+        fprintf(f, "}");
+    }
+    fprintf(f, "}");
+}
+
+/**
+ * Opens the counters group of the calling thread (sets `pt->state` to PTS_unavailable if the group leader can't be opened).
+ */
+static void perf_thread_open(PerfThread *pt)
+{
+#if defined(ENV_LINUX) && ENV_LINUX
+    static const struct {
+        uint32_t    type;
+        uint64_t    config;
+    } events[PERF_COUNTERS_COUNT] = {
+        [PC_cycles]         = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        [PC_instructions]   = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        [PC_l1d_misses]     = {PERF_TYPE_HW_CACHE,
+            PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+        [PC_llc_misses]     = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        [PC_branch_misses]  = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    };
+
+    pt->groupSize = 0;
+    for (uint32_t c = 0; c < PERF_COUNTERS_COUNT; c++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[c].type;
+        attr.config = events[c].config;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        // pid 0, cpu -1: count the calling thread, on any CPU.
+        int groupFd = c == PC_cycles ? -1 : pt->fds[PC_cycles];
+        int fd = syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0);
+        if (fd < 0 && c == PC_cycles) {
+            if (! atomic_flag_test_and_set(&perfErrorLogged)) {
+                log_err("Hardware performance counters are not available: perf_event_open() failed: %s (see "
+                    "/proc/sys/kernel/perf_event_paranoid)\n", strerror(errno));
+            }
+            pt->state = PTS_unavailable;
+            return;
+        }
+
+        // The other counters are optional (e.g. a CPU may not have some of the cache events).
+        pt->fds[c] = fd;
+        pt->groupIdx[c] = fd >= 0 ? (int)pt->groupSize++ : -1;
+    }
+    pt->state = PTS_open;
+#else
+    if (! atomic_flag_test_and_set(&perfErrorLogged)) {
+        log_err("Hardware performance counters are only supported on Linux.\n");
+    }
+    pt->state = PTS_unavailable;
+#endif // ENV_LINUX
+}
@@ -0,0 +1,127 @@
+#ifndef __PERF_COUNTERS_H__
+#define __PERF_COUNTERS_H__
+
+/**
+ * Hardware performance counters (CPU cycles, instructions, L1 data cache misses, last level cache misses and branch mispredictions) per
+ * render phase and per thread, to tell whether rendering is bound by compute, branch mispredictions or cache misses (which rays/sec alone
+ * doesn't tell).
+ *
+ * Each thread opens its own group of counters (with the Linux perf_event_open() system call) on its first measured phase. The counters
+ * only count the user-space work of that thread. A phase is measured with a PERF_PHASE_BEGIN(), PERF_PHASE_END() pair (that reads the
+ * counters before and after it) and the counts are added to the thread-local PerfStats, which the rendering code collects (see
+ * perf_stats_collect_thread()) just like the ray tracing statistics (see ray_stats.h).
+ *
+ * If the counters can't be opened (not Linux, a too restrictive /proc/sys/kernel/perf_event_paranoid, a virtual machine without a PMU)
+ * all counts are 0 (the reason is logged once). When PERF_COUNTERS_ENABLED is 0, the macros expand to nothing.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+
+// #define PERF_COUNTERS_ENABLED   1
+#define PERF_COUNTERS_ENABLED   0
+
+
+typedef enum {
+    PC_cycles,
+    PC_instructions,
+    PC_l1d_misses,          // L1 data cache read misses.
+    PC_llc_misses,          // Last level cache misses.
+    PC_branch_misses,       // Mispredicted branches.
+
+    PERF_COUNTERS_COUNT,
+} PerfCounter;
+
+typedef enum {
+    PP_camera,              // cam_frame_init().
+    PP_trace,               // Ray tracing the image rows.
+    PP_blend,               // blend_frame().
+    PP_display,             // Displaying the image (texture upload, presenting).
+
+    PERF_PHASES_COUNT,
+} PerfPhase;
+
+
+typedef struct PerfStats_s      PerfStats;
+typedef struct PerfSnapshot_s   PerfSnapshot;
+
+struct PerfStats_s {
+    uint64_t    counts[PERF_PHASES_COUNT][PERF_COUNTERS_COUNT];
+};
+
+// The values of the calling thread's counters at some point in time.
+struct PerfSnapshot_s {
+    uint64_t    values[PERF_COUNTERS_COUNT];
+};
+
+
+#if PERF_COUNTERS_ENABLED
+
+// Declares the variable `var` and reads the counters into it (the start of a phase, that is ended by PERF_PHASE_END()).
+#define PERF_PHASE_BEGIN(var)           PerfSnapshot var; perf_counters_read(&var)
+
+// Adds the counts since PERF_PHASE_BEGIN(var) to the phase `phase` of the calling thread's PerfStats.
+#define PERF_PHASE_END(var, phase)      perf_counters_add_phase(&var, (phase))
+
+#else
+
+#define PERF_PHASE_BEGIN(var)
+#define PERF_PHASE_END(var, phase)      ((void)0)
+
+#endif // PERF_COUNTERS_ENABLED
+
+
+/**
+ * Reads the calling thread's counters into `snapshot` (opening them on the first call).
+ */
+void perf_counters_read(PerfSnapshot *snapshot);
+
+/**
+ * Adds the counts since `start` to the phase `phase` of the calling thread's PerfStats.
+ */
+void perf_counters_add_phase(PerfSnapshot *start, PerfPhase phase);
+
+/**
+ * Closes the calling thread's counters (must be called by threads that measured phases, before they exit).
+ */
+void perf_counters_close_thread();
+
+/**
+ * Sets all counts of `stats` to 0.
+ */
+void perf_stats_reset(PerfStats *stats);
+
+/**
+ * Adds the counts of `src` to `dst`.
+ */
+void perf_stats_merge(PerfStats *dst, PerfStats *src);
+
+/**
+ * Adds the counts of the calling thread to `dst` and resets them. Does nothing if PERF_COUNTERS_ENABLED is 0.
+ */
+void perf_stats_collect_thread(PerfStats *dst);
+
+/**
+ * Returns the name of `counter` (e.g. "cycles").
+ */
+const char * perf_counter_name(PerfCounter counter);
+
+/**
+ * Returns the name of `phase` (e.g. "trace").
+ */
+const char * perf_phase_name(PerfPhase phase);
+
+/**
+ * Prints a (PERF_PHASES_COUNT + 1 lines long) human readable summary of the counts of `threadsCount` threads `threadStats`: the
+ * instructions per cycle and the misses per 1000 instructions of each phase (of all threads), and how evenly the ray tracing work was
+ * split between the threads.
+ */
+void perf_stats_print(FILE *f, PerfStats *threadStats, uint32_t threadsCount);
+
+/**
+ * Writes `stats` into `f` as a single line JSON object (the counts of each counter, of each phase).
+ */
+void perf_stats_write_json(FILE *f, PerfStats *stats);
+
+#endif // __PERF_COUNTERS_H__
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "pfm.h"
+#include "rtalloc.h"
+#include "rtcommon.h"
+
+
+static inline bool is_little_endian();
+static inline float swap_float_bytes(float f);
+
+
+bool pfm_write(const char *path, float *data, uint32_t width, uint32_t height, uint32_t channels)
+{
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        log_err("Could not open PFM file for writing: %s\n", path);
+        return false;
+    }
+
+    // The scale's sign is the byte order of the floats (negative means little-endian). We write them in the machine's byte order.
+    // PFM rows go from bottom to top.
+    bool ok = fprintf(f, "%s\n%u %u\n%s\n", channels == 3 ? "PF" : "Pf", width, height, is_little_endian() ? "-1.0" : "1.0") > 0;
+    uint32_t rowLength = width * channels;
+    for (uint32_t r = 0; ok && r < height; r++) {
+        ok = fwrite(&data[(height - r - 1) * rowLength], sizeof(float), rowLength, f) == rowLength;
+    }
+    ok = (fclose(f) == 0) && ok;
+
+    if (! ok) {
+        log_err("Could not write PFM file: %s\n", path);
+    }
+    return ok;
+}
+
+bool pfm_write_color(const char *path, Color *img, uint32_t width, uint32_t height)
+{
+    uint32_t pixels = width * height;
+    float *data = rtalloc(sizeof(float) * 3 * pixels);
+    for (uint32_t p = 0; p < pixels; p++) {
+        data[p * 3 + 0] = (float)img[p].red;
+        data[p * 3 + 1] = (float)img[p].green;
+        data[p * 3 + 2] = (float)img[p].blue;
+    }
+
+    bool ok = pfm_write(path, data, width, height, 3);
+    rtfree(data);
+    return ok;
+}
+
+Color * pfm_read_color(const char *path, uint32_t *width, uint32_t *height)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        log_err("Could not open PFM file: %s\n", path);
+        return NULL;
+    }
+
+    char type[3];
+    double scale;
+    // A single whitespace character separates the header from the pixels.
+    if (fscanf(f, "%2s %u %u %lf", type, width, height, &scale) != 4 || strcmp(type, "PF") != 0 || *width == 0 || *height == 0
+        || fgetc(f) == EOF) {
+        log_err("Not an RGB PFM file: %s\n", path);
+        fclose(f);
+        return NULL;
+    }
+
+    uint32_t rowLength = *width * 3;
+    float *row = rtalloc(sizeof(float) * rowLength);
+    Color *img = rtalloc(sizeof(Color) * *width * *height);
+    bool swap = (scale < 0) != is_little_endian();
+    bool ok = true;
+    for (uint32_t r = 0; ok && r < *height; r++) {
+        ok = fread(row, sizeof(float), rowLength, f) == rowLength;
+        Color *imgRow = &img[(*height - r - 1) * *width];
+        for (uint32_t x = 0; ok && x < *width; x++) {
+            imgRow[x].red   = swap ? swap_float_bytes(row[x * 3 + 0]) : row[x * 3 + 0];
+            imgRow[x].green = swap ? swap_float_bytes(row[x * 3 + 1]) : row[x * 3 + 1];
+            imgRow[x].blue  = swap ? swap_float_bytes(row[x * 3 + 2]) : row[x * 3 + 2];
+        }
+    }
+    fclose(f);
+    rtfree(row);
+
+    if (! ok) {
+        log_err("Could not read PFM file (truncated?): %s\n", path);
+        rtfree(img);
+        return NULL;
+    }
+    return img;
+}
+
+static inline bool is_little_endian()
+{
+    uint16_t v = 1;
+    return *(uint8_t *)&v == 1;
+}
+
+static inline float swap_float_bytes(float f)
+{
+    uint8_t bytes[sizeof(float)];
+    memcpy(bytes, &f, sizeof(float));
+    for (uint32_t i = 0; i < sizeof(float) / 2; i++) {
+        uint8_t b = bytes[i];
+        bytes[i] = bytes[sizeof(float) - i - 1];
+        bytes[sizeof(float) - i - 1] = b;
+    }
+    memcpy(&f, bytes, sizeof(float));
+    return f;
+}
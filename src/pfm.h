@@ -0,0 +1,33 @@
+#ifndef __PFM_H__
+#define __PFM_H__
+
+/**
+ * Reading and writing PFM (portable float map) images: an uncompressed format of 32 bit float pixels, either grayscale (1 channel) or
+ * RGB (3 channels). Used for the images whose exact (unbounded, linear) values matter, e.g. cost maps and reference renders.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "color.h"
+
+
+/**
+ * Writes the `width` x `height` image `data` (`channels` (1 or 3) floats per pixel, rows from top to bottom) into a PFM file at `path`.
+ * Returns false (and logs the error) if the file could not be written.
+ */
+bool pfm_write(const char *path, float *data, uint32_t width, uint32_t height, uint32_t channels);
+
+/**
+ * Writes the `width` x `height` image `img` (rows from top to bottom) into an RGB PFM file at `path`. Returns false (and logs the error)
+ * if the file could not be written.
+ */
+bool pfm_write_color(const char *path, Color *img, uint32_t width, uint32_t height);
+
+/**
+ * Reads the RGB PFM file at `path` into a newly allocated image (rows from top to bottom, freed with rtfree()) and stores its size in
+ * `width`, `height`. Returns NULL (and logs the error) if the file could not be read, or is not an RGB PFM image.
+ */
+Color * pfm_read_color(const char *path, uint32_t *width, uint32_t *height);
+
+#endif // __PFM_H__
@@ -0,0 +1,64 @@
+#include <math.h>
+
+#include "plane.h"
+
+
+static void init_plane_geometry(Plane *plane, PlaneType type, Vector3 *point, Vector3 *normal);
+
+
+Plane * plane_init(Plane *plane, Vector3 *point, Vector3 *normal)
+{
+    init_plane_geometry(plane, PLT_plane, point, normal);
+    return plane;
+}
+
+Plane * plane_disk_init(Plane *plane, Vector3 *center, Vector3 *normal, double radius)
+{
+    init_plane_geometry(plane, PLT_disk, center, normal);
+    plane->center = *center;
+    plane->radiusSquared = radius*radius;
+    return plane;
+}
+
+Plane * plane_rect_init(Plane *plane, Vector3 *corner1, Vector3 *corner2)
+{
+    Vector3 normal;
+    if (corner1->x == corner2->x && corner1->y != corner2->y && corner1->z != corner2->z) {
+        normal = (Vector3){.x = 1, .y = 0, .z = 0};
+    } else if (corner1->y == corner2->y && corner1->x != corner2->x && corner1->z != corner2->z) {
+        normal = (Vector3){.x = 0, .y = 1, .z = 0};
+    } else if (corner1->z == corner2->z && corner1->x != corner2->x && corner1->y != corner2->y) {
+        normal = (Vector3){.x = 0, .y = 0, .z = 1};
+    } else {
+        return NULL;
+    }
+
+    init_plane_geometry(plane, PLT_rect, corner1, &normal);
+    plane->min = (Vector3){
+        .x = normal.x != 0 ? -INFINITY : fmin(corner1->x, corner2->x),
+        .y = normal.y != 0 ? -INFINITY : fmin(corner1->y, corner2->y),
+        .z = normal.z != 0 ? -INFINITY : fmin(corner1->z, corner2->z),
+    };
+    plane->max = (Vector3){
+        .x = normal.x != 0 ? INFINITY : fmax(corner1->x, corner2->x),
+        .y = normal.y != 0 ? INFINITY : fmax(corner1->y, corner2->y),
+        .z = normal.z != 0 ? INFINITY : fmax(corner1->z, corner2->z),
+    };
+    return plane;
+}
+
+Plane * plane_set_material(Plane *plane, Sphere *materialTemplate)
+{
+    plane->material = materialTemplate->material;
+    plane->matData  = materialTemplate->matData;
+    plane->color    = materialTemplate->color;
+    return plane;
+}
+
+static void init_plane_geometry(Plane *plane, PlaneType type, Vector3 *point, Vector3 *normal)
+{
+    plane->type = type;
+    plane->normal = *normal;
+    vector3_to_unit(&plane->normal);
+    plane->offset = vector3_dot(&plane->normal, point);
+}
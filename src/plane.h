@@ -0,0 +1,76 @@
+#ifndef __PLANE_H__
+#define __PLANE_H__
+
+/**
+ * Planar primitives: infinite planes, disks and axis-aligned rectangles (see Scene.planes).
+ *
+ * The ground used to be a huge (radius 2000) sphere. A plane is cheaper to intersect (a dot product and a division, see
+ * calc_ray_distance_to_plane()), has a constant normal and doesn't lose precision far from the camera.
+ *
+ * Planar primitives have no inside: they are two-sided, i.e. a ray hits them the same way from both sides (the normal passed to the
+ * material always faces the incoming ray, see calc_plane_surface_normal()).
+ */
+
+typedef struct Plane_s          Plane;
+
+
+#include <stdint.h>
+
+#include "color.h"
+#include "sphere.h"
+#include "vector.h"
+
+
+typedef enum {
+    PLT_plane,              // An infinite plane.
+    PLT_disk,               // A disk (the part of the plane within `radius` of `center`).
+    PLT_rect,               // An axis-aligned rectangle (the part of the plane within [min, max]).
+} PlaneType;
+
+struct Plane_s {
+    PlaneType       type;
+
+    // The plane consists of the points p, where vector3_dot(normal, p) == offset. `normal` is a unit vector.
+    Vector3         normal;
+    double          offset;
+
+    Vector3         center;         // PLT_disk only.
+    double          radiusSquared;  // PLT_disk only.
+
+    // PLT_rect only: the bounds of the rectangle. They are infinite along the axis of `normal` (so that the points on the plane that are
+    // off by a rounding error are not missed).
+    Vector3         min;
+    Vector3         max;
+
+    Material       *material;
+    void           *matData;
+    Color           color;
+};
+
+
+/**
+ * Initializes the geometry of `plane` as an infinite plane through `point`, perpendicular to `normal` (any length but 0). Returns the same
+ * `plane` pointer (this is useful for chaining function calls).
+ */
+Plane * plane_init(Plane *plane, Vector3 *point, Vector3 *normal);
+
+/**
+ * Initializes the geometry of `plane` as a disk with `center` and `radius`, perpendicular to `normal` (any length but 0). Returns the same
+ * `plane` pointer.
+ */
+Plane * plane_disk_init(Plane *plane, Vector3 *center, Vector3 *normal, double radius);
+
+/**
+ * Initializes the geometry of `plane` as an axis-aligned rectangle, with the opposite corners `corner1` and `corner2`, which must differ in
+ * exactly two coordinates (the third one is the position of the rectangle along its normal axis). Returns the same `plane` pointer, or
+ * NULL if the corners do not form such a rectangle.
+ */
+Plane * plane_rect_init(Plane *plane, Vector3 *corner1, Vector3 *corner2);
+
+/**
+ * Sets the material (material, matData, color) of `plane` to the one of `materialTemplate` (a sphere initialized with one of the material
+ * init functions, e.g. sphere_metal_init()). The material data is shared, not copied. Returns the same `plane` pointer.
+ */
+Plane * plane_set_material(Plane *plane, Sphere *materialTemplate);
+
+#endif // __PLANE_H__
@@ -0,0 +1,149 @@
+#include "../envconfig.h"
+#if defined(ENV_LINUX) && ENV_LINUX
+#include <unistd.h>
+#else
+#define PSAPI_VERSION 2
+#include <windows.h>
+#include <psapi.h>
+#endif // ENV_LINUX
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+
+#include "prom_metrics.h"
+#include "rtcommon.h"
+
+
+#define PROM_METRICS_PATH_MAX       1024
+
+
+static void write_metric(FILE *f, const char *name, const char *type, const char *help, double value);
+static uint64_t rss_bytes();
+static bool replace_file(const char *from, const char *to);
+
+
+void prom_metrics_init(PromMetrics *m)
+{
+    m->uptimeSeconds    = NAN;
+    m->frames           = 0;
+    m->samplesPerPixel  = 0;
+    m->raysTraced       = 0;
+    m->raysPerSecond    = NAN;
+    for (uint32_t s = 0; s < FRAME_STAGES_COUNT; s++) {
+        m->stageSeconds[s] = NAN;
+    }
+    m->workers          = NULL;
+    m->queueDepth       = 0;
+    m->noiseEstimate    = NAN;
+}
+
+bool prom_metrics_write(const char *path, PromMetrics *m)
+{
+    char tmpPath[PROM_METRICS_PATH_MAX];
+    if (snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path) >= (int)sizeof(tmpPath)) {
+        log_err("The metrics file path is too long: %s\n", path);
+        return false;
+    }
+
+    FILE *f = fopen(tmpPath, "w");
+    if (f == NULL) {
+        log_err("Could not open the metrics file for writing: %s\n", tmpPath);
+        return false;
+    }
+
+    write_metric(f, "toyrt_uptime_seconds", "gauge", "Time since rendering started.", m->uptimeSeconds);
+    write_metric(f, "toyrt_frames_total", "counter", "Frames (one sample per pixel each) rendered.", m->frames);
+    write_metric(f, "toyrt_samples_per_pixel", "gauge", "Samples per pixel accumulated into the current image.", m->samplesPerPixel);
+    write_metric(f, "toyrt_rays_traced_total", "counter", "Rays traced, counting every bounce.", m->raysTraced);
+    write_metric(f, "toyrt_rays_per_second", "gauge", "Rays traced per second.", m->raysPerSecond);
+    write_metric(f, "toyrt_convergence_rmse_estimate", "gauge",
+        "Estimated RMSE of the current image against the converged one (the per-sample noise divided by sqrt(samples)).",
+        m->noiseEstimate);
+    write_metric(f, "toyrt_resident_memory_bytes", "gauge", "Resident set size of the process.", rss_bytes());
+
+    fprintf(f, "# HELP toyrt_stage_seconds_total Time spent in each frame stage.\n# TYPE toyrt_stage_seconds_total counter\n");
+    for (uint32_t s = 0; s < FRAME_STAGES_COUNT; s++) {
+        if (s != FS_input_latency && ! isnan(m->stageSeconds[s])) {
+            fprintf(f, "toyrt_stage_seconds_total{stage=\"%s\"} %.6f\n", frame_stage_name(s), m->stageSeconds[s]);
+        }
+    }
+
+    if (m->workers != NULL) {
+        WorkerPool *pool = m->workers;
+        write_metric(f, "toyrt_worker_threads", "gauge", "Threads rendering in parallel.", pool->threadsCount);
+        // The tasks are handed out dynamically and each frame waits for all of them to finish, so the queue is empty between frames:
+        // its depth is the amount of tasks that each frame queues. (Not the pool's last tasksCount: the last workers_run() of a frame is
+        // the tone mapping, or a rebuild of the acceleration structures.)
+        write_metric(f, "toyrt_worker_queue_depth", "gauge",
+            "Ray tracing tasks (image rows, or batches of rows with out-of-core spheres) queued to the worker threads per frame.",
+            m->queueDepth);
+        fprintf(f, "# HELP toyrt_worker_utilization Fraction of the parallel rendering time that each thread spent running tasks.\n"
+            "# TYPE toyrt_worker_utilization gauge\n");
+        for (uint32_t t = 0; t < pool->threadsCount; t++) {
+            fprintf(f, "toyrt_worker_utilization{thread=\"%" PRIu32 "\"} %.4f\n", t, workers_utilization(pool, t));
+        }
+    }
+
+    bool ok = ! ferror(f);
+    ok = (fclose(f) == 0) && ok;
+    if (! ok) {
+        log_err("Could not write the metrics file: %s\n", tmpPath);
+        remove(tmpPath);
+        return false;
+    }
+
+    if (! replace_file(tmpPath, path)) {
+        log_err("Could not replace the metrics file: %s\n", path);
+        remove(tmpPath);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Writes a metric without labels (with its HELP and TYPE lines). Does nothing if `value` is NAN.
+ */
+static void write_metric(FILE *f, const char *name, const char *type, const char *help, double value)
+{
+    if (isnan(value)) {
+        return;
+    }
+    fprintf(f, "# HELP %s %s\n# TYPE %s %s\n%s %.10g\n", name, help, name, type, name, value);
+}
+
+/**
+ * Returns the current resident set size (the physical memory used) of the process, in bytes (0 if it is not known).
+ */
+static uint64_t rss_bytes()
+{
+#if defined(ENV_LINUX) && ENV_LINUX
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f == NULL) {
+        return 0;
+    }
+    uint64_t sizePages, residentPages;
+    bool ok = fscanf(f, "%" SCNu64 " %" SCNu64, &sizePages, &residentPages) == 2;
+    fclose(f);
+    return ok ? residentPages * (uint64_t)sysconf(_SC_PAGESIZE) : 0;
+#else
+    PROCESS_MEMORY_COUNTERS counters;
+    if (! GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return counters.WorkingSetSize;
+#endif // ENV_LINUX
+}
+
+/**
+ * Atomically replaces the file `to` with the file `from` (readers of `to` see either the old or the new file, never a mix).
+ */
+static bool replace_file(const char *from, const char *to)
+{
+#if defined(ENV_LINUX) && ENV_LINUX
+    return rename(from, to) == 0;
+#else
+    // rename() fails on Windows if the target exists.
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+#endif // ENV_LINUX
+}
@@ -0,0 +1,58 @@
+#ifndef __PROM_METRICS_H__
+#define __PROM_METRICS_H__
+
+/**
+ * Metrics export in the Prometheus text format, for the textfile collector of node_exporter: a long running render periodically writes
+ * its progress (rays/sec, samples per pixel, stage times, thread utilization, memory, convergence) into a .prom file in the collector's
+ * directory, so that it can be monitored (and alerted on) without parsing its output.
+ *
+ * The file is replaced atomically (written into a temporary file next to it, which is then renamed), so the collector never reads a
+ * partially written file.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "frame_times.h"
+#include "workers.h"
+
+
+// Set PROM_METRICS_ENABLED to 1 for the app to write its metrics into PROM_METRICS_PATH every PROM_METRICS_INTERVAL_MS milliseconds
+// (and once more when it exits). The path should be in node_exporter's --collector.textfile.directory, and end with ".prom".
+#define PROM_METRICS_ENABLED        0
+#define PROM_METRICS_PATH           "toyraytracer.prom"
+#define PROM_METRICS_INTERVAL_MS    10000
+
+
+typedef struct PromMetrics_s    PromMetrics;
+
+struct PromMetrics_s {
+    double          uptimeSeconds;                      // Since rendering started.
+    uint64_t        frames;                             // Rendered since rendering started.
+    uint32_t        samplesPerPixel;                    // Accumulated into the current image (restarts when the scene changes).
+    uint64_t        raysTraced;                         // Since rendering started (counting every bounce).
+    double          raysPerSecond;
+
+    // The total time spent in each frame stage (FS_input_latency is not a stage, and is ignored). NAN if not measured.
+    double          stageSeconds[FRAME_STAGES_COUNT];
+
+    WorkerPool     *workers;                            // The thread utilization is exported if not NULL.
+    uint32_t        queueDepth;                         // The tasks that a frame is split into (see render_frame_img()), with `workers`.
+
+    // The estimated RMSE of the current image against the converged image (see image_noise_estimate()). NAN if not known.
+    double          noiseEstimate;
+};
+
+
+/**
+ * Initializes `m` with no measurements: all counts are 0 and all other values are NAN (or NULL).
+ */
+void prom_metrics_init(PromMetrics *m);
+
+/**
+ * Writes `m` into the file at `path` in the Prometheus text format, replacing it atomically. Metrics whose value is NAN are omitted.
+ * Returns false (and logs the error) if the file could not be written.
+ */
+bool prom_metrics_write(const char *path, PromMetrics *m);
+
+#endif // __PROM_METRICS_H__
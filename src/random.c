@@ -0,0 +1,4 @@
+#include "random.h"
+
+
+_Thread_local RandomState randomThreadState RT_TLS_MODEL = {.state = 0};
@@ -1,35 +1,102 @@
 #ifndef __RANDOM_H__
 #define __RANDOM_H__
 
+#include <stdint.h>
 #include <stdlib.h>
 
+#include "rtcommon.h"
+
+
+typedef struct RandomState_s    RandomState;
+
+// The state of a random number generator (SplitMix64). Unlike C built-in rand(), it produces exactly the same sequence of numbers for the
+// same seed on every platform, which makes it suitable for generating reproducible data (e.g. procedurally generated scenes, see
+// scene_gen.h) and reproducible renders.
+struct RandomState_s {
+    uint64_t state;
+};
+
+// The generator used by the random_*() functions below (other than random_state_*()). Each thread has its own state, so rendering threads
+// don't contend over (or corrupt) a shared state, and the random numbers of each thread only depend on how it was seeded (see
+// random_seed()).
+extern _Thread_local RandomState randomThreadState RT_TLS_MODEL;
+
+/**
+ * Seeds the explicitly seeded random number generator `rs`.
+ */
+static inline void random_state_seed(RandomState *rs, uint64_t seed)
+{
+    rs->state = seed;
+}
+
+/**
+ * Generates and returns a random 64 bit integer, using the SplitMix64 algorithm.
+ */
+static inline uint64_t random_state_next(RandomState *rs)
+{
+    uint64_t z = (rs->state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Generates and returns a random double in the range [0, 1), using the generator `rs`.
+ */
+static inline double random_state_double_0_1_exc(RandomState *rs)
+{
+    // The top 53 bits (the precision of a double) scaled by 2^-53.
+    return (random_state_next(rs) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * Generates and returns a random double in the range [min, max), using the generator `rs`.
+ */
+static inline double random_state_double_exc(RandomState *rs, double min, double max)
+{
+    return min + ((max - min) * random_state_double_0_1_exc(rs));
+}
+
+/**
+ * Returns a well mixed 64 bit hash of `a` and `b` (two rounds of SplitMix64). Used to derive independent seeds from several values, e.g.
+ * (render seed, sample index) or (frame seed, pixel index), so that the random numbers of every sample of every pixel are fixed by them.
+ */
+static inline uint64_t random_hash2(uint64_t a, uint64_t b)
+{
+    RandomState rs;
+    random_state_seed(&rs, a);
+    random_state_seed(&rs, random_state_next(&rs) ^ b);
+    return random_state_next(&rs);
+}
+
 
 /**
- * Seeds the random number generator.
+ * Seeds the random number generator of the current thread.
  */
-static inline void random_seed(unsigned int seed)
+static inline void random_seed(uint64_t seed)
 {
-    srand(seed);
+    random_state_seed(&randomThreadState, seed);
 }
 
 /**
- * Generates and returns a random double in the range [0, 1), using C built-in rand().
+ * Generates and returns a random double in the range [0, 1), using the current thread's generator.
  */
 static inline double random_double_0_1_exc()
 {
-    return ((double)rand()) / (RAND_MAX + 1.0);
+    return random_state_double_0_1_exc(&randomThreadState);
 }
 
 /**
- * Generates and returns a random double in the range [0, 1], using C built-in rand().
+ * Generates and returns a random double in the range [0, 1], using the current thread's generator.
  */
 static inline double random_double_0_1_inc()
 {
-    return ((double)rand()) / RAND_MAX;
+    // The top 53 bits (the precision of a double) scaled by 1/(2^53 - 1).
+    return (random_state_next(&randomThreadState) >> 11) * (1.0 / 9007199254740991.0);
 }
 
 /**
- * Generates and returns a random double in the range [min, max), using C built-in rand().
+ * Generates and returns a random double in the range [min, max), using the current thread's generator.
  */
 static inline double random_double_exc(double min, double max)
 {
@@ -37,7 +104,7 @@ static inline double random_double_exc(double min, double max)
 }
 
 /**
- * Generates and returns a random double in the range [min, max], using C built-in rand().
+ * Generates and returns a random double in the range [min, max], using the current thread's generator.
  */
 static inline double random_double_inc(double min, double max)
 {
@@ -45,7 +112,7 @@ static inline double random_double_inc(double min, double max)
 }
 
 /**
- * Generates and returns a random int in the range [min, max), using C built-in rand().
+ * Generates and returns a random int in the range [min, max), using the current thread's generator.
  */
 static inline int random_int_exc(int min, int max)
 {
@@ -53,7 +120,7 @@ static inline int random_int_exc(int min, int max)
 }
 
 /**
- * Generates and returns a random int in the range [min, max], using C built-in rand().
+ * Generates and returns a random int in the range [min, max], using the current thread's generator.
  */
 static inline int random_int_inc(int min, int max)
 {
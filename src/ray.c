@@ -4,136 +4,268 @@
 
 #include "ray.h"
 #include "ray_inline_fns.h"
+#include "ray_stats.h"
+#include "sphere_chunks.h"
 #include "vector.h"
 
 
-static double ray_distance_to_sphere(Ray *ray, Sphere *sphere);
+static bool find_occluder(RTContext *rtContext, Scene *scene, Ray *ray, double dist, bool ignoreLights);
 
 
 bool ray_trace(RTContext *rtContext, Scene *scene, Ray *ray, Color *color)
+{
+    RayHit hit;
+    if (! ray_trace_find_hit(rtContext, scene, ray, &hit)) {
+        return false;
+    }
+
+    // Then the out-of-core spheres (see sphere_chunks.h), the chunks of which are loaded as the ray gets to them.
+    if (scene->sphereChunks != NULL) {
+        double dist = hit.dist;
+        uint32_t sphereTests = 0;
+        if (sphere_chunks_intersect(scene->sphereChunks, ray, &dist, &hit.chunkSphere, &sphereTests)) {
+            ray_hit_chunk_sphere(&hit, dist);
+        }
+        RAY_STATS_ADD(sphereTests, sphereTests);
+        rtContext->intersectionTests += sphereTests;
+    }
+
+    return ray_trace_shade_hit(rtContext, scene, ray, &hit, color);
+}
+
+bool ray_trace_find_hit(RTContext *rtContext, Scene *scene, Ray *ray, RayHit *hit)
 {
     if (rtContext->bounces >= RAY_BOUNCES_MAX) {
+        RAY_STATS_INC(pathsMaxBounces);
         return false;
     }
 
     rtContext->bounces++;
+    RAY_STATS_INC(raysTraced);
+    RAY_STATS_ADD(planeTests, scene->planesLength);
+    rtContext->intersectionTests += scene->planesLength;
 
-    // Find the closest sphere that `ray` hits (if any) and store it in `minSphere` and the distance to it in `minDist`.
+    // Find the closest sphere that `ray` hits (if any) and store it in hit->sphere and the distance to it in `minDist`.
     bool hitSomething = false;
     double minDist = DBL_MAX;
-    Sphere *minSphere;
-    Sphere *sphereList = scene->spheres;
-    for (uint32_t i = 0; i < scene->spheresLength; i++) {
-        Sphere *sphere = &sphereList[i];
-        double dist = ray_distance_to_sphere(ray, sphere);
+    Sphere *minSphere = NULL;
+    if (scene->sphereAccel == SA_grid) {
+        // Only the spheres in the grid cells along the ray (see sphere_grid.h).
+        uint32_t sphereTests = 0;
+        minSphere = sphere_grid_intersect(&scene->sphereGrid, scene->spheres, ray, &minDist, &sphereTests);
+        hitSomething = minSphere != NULL;
+        RAY_STATS_ADD(sphereTests, sphereTests);
+        rtContext->intersectionTests += sphereTests;
+    } else if (scene->sphereAccel == SA_wide_bvh) {
+        // Only the spheres in the leaves of the BVH along the ray (see wide_bvh.h).
+        uint32_t sphereTests = 0;
+        minSphere = wide_bvh_intersect(&scene->sphereBVH, scene->spheres, ray, &minDist, &sphereTests);
+        hitSomething = minSphere != NULL;
+        RAY_STATS_ADD(sphereTests, sphereTests);
+        rtContext->intersectionTests += sphereTests;
+    } else {
+        RAY_STATS_ADD(sphereTests, scene->spheresLength);
+        rtContext->intersectionTests += scene->spheresLength;
+        Sphere *sphereList = scene->spheres;
+        for (uint32_t i = 0; i < scene->spheresLength; i++) {
+            Sphere *sphere = &sphereList[i];
+            double dist = calc_ray_distance_to_sphere(ray, sphere);
+            if (dist >= RAY_DISTANCE_MIN) {
+                hitSomething = true;
+                if (dist < minDist) {
+                    minDist = dist;
+                    minSphere = sphere;
+                }
+            }
+        }
+    }
+    hit->sphere = minSphere;
+
+    // Then the planes: if one of them is closer than the sphere - store it in hit->plane.
+    hit->plane = NULL;
+    Plane *planeList = scene->planes;
+    for (uint32_t i = 0; i < scene->planesLength; i++) {
+        Plane *plane = &planeList[i];
+        double dist = calc_ray_distance_to_plane(ray, plane);
         if (dist >= RAY_DISTANCE_MIN) {
             hitSomething = true;
             if (dist < minDist) {
                 minDist = dist;
-                minSphere = sphere;
+                hit->plane = plane;
             }
         }
     }
 
-    if (! hitSomething) {
-        // When we could not hit anything - return the environment's ambient color (darkness).
-        // If we would want ambient lighting (i.e. lighting coming from everywhere) - then change this to that light's color.
-        *color = (Color)COLOR_BLACK;
-        return false;
+    // Then the meshes (each tests only the triangles near the ray, see mesh_intersect()): if one of them is closer - store it in hit->mesh.
+    hit->mesh = NULL;
+    hit->triangle = 0;
+    uint32_t triangleTests = 0;
+    for (uint32_t i = 0; i < scene->meshesLength; i++) {
+        Mesh *mesh = &scene->meshes[i];
+        if (mesh_intersect(mesh, ray, &minDist, &hit->triangle, &triangleTests)) {
+            hitSomething = true;
+            hit->mesh = mesh;
+        }
+    }
+
+    // Then the instances (through the top-level BVH, see instances_intersect()): if one of them is closer - store it in hit->instanceHit.
+    hit->instance = false;
+    if (scene->instancesLength > 0) {
+        hit->instance = instances_intersect(scene, ray, &minDist, &hit->instanceHit);
+        hitSomething |= hit->instance;
+        RAY_STATS_ADD(instanceTests, hit->instanceHit.instanceTests);
+        RAY_STATS_ADD(sphereTests, hit->instanceHit.sphereTests);
+        triangleTests += hit->instanceHit.triangleTests;
+        rtContext->intersectionTests += hit->instanceHit.instanceTests + hit->instanceHit.sphereTests;
+    }
+    RAY_STATS_ADD(triangleTests, triangleTests);
+    rtContext->intersectionTests += triangleTests;
+
+    hit->hitSomething = hitSomething;
+    hit->dist = minDist;
+    return true;
+}
+
+bool ray_trace_shade_hit(RTContext *rtContext, Scene *scene, Ray *ray, RayHit *rayHit, Color *color)
+{
+    if (! rayHit->hitSomething) {
+        // When we could not hit anything - return the light of the sky (if the scene has one), in the ray's direction.
+        RAY_STATS_INC(pathsEscaped);
+        if (scene->sky.type == SKT_none) {
+            *color = (Color)COLOR_BLACK;
+            return false;
+        }
+        *color = sky_color(&scene->sky, &ray->direction);
+        return true;
     }
 
-    // Set `hitPoint` to the point on `minSphere` where `ray` hits.
-    Vector3 hitPoint;
-    ray_point(ray, minDist, &hitPoint);
+    // Set `hit` to where `ray` hits the closest primitive.
+    Hit hit;
+    Material *material;
+    ray_point(ray, rayHit->dist, &hit.pos);
+    if (rayHit->instance) {
+        material = instances_hit(scene, &rayHit->instanceHit, rayHit->dist, &hit);
+    } else if (rayHit->mesh != NULL) {
+        material = rayHit->mesh->material;
+        mesh_triangle_normal(rayHit->mesh, rayHit->triangle, &hit.normal);
+        hit.matData = rayHit->mesh->matData;
+        hit.color = &rayHit->mesh->color;
+    } else if (rayHit->plane != NULL) {
+        material = rayHit->plane->material;
+        calc_plane_surface_normal(rayHit->plane, ray, &hit.normal);
+        hit.matData = rayHit->plane->matData;
+        hit.color = &rayHit->plane->color;
+    } else {
+        Sphere *sphere = rayHit->sphere;
+        material = sphere->material;
+        calc_sphere_surface_normal(sphere, &hit.pos, &hit.normal);
+        hit.matData = sphere->matData;
+        hit.color = &sphere->color;
+    }
 
-    *color = minSphere->material->hit(scene, ray, rtContext, minSphere, &hitPoint);
+    RAY_STATS_INC(materialHits[material->type]);
+
+    *color = material->hit(scene, ray, rtContext, &hit);
 
     return true;
 }
 
+bool ray_occluded(RTContext *rtContext, Scene *scene, Ray *ray, double distMin, double distMax, bool ignoreLights)
+{
+    RAY_STATS_INC(occlusionRays);
+
+    // The hits closer than `distMin` are skipped by starting the ray at `distMin` (the primitives test only the distances from the start).
+    Ray startedRay = *ray;
+    double dist = distMax;
+    if (distMin > 0) {
+        ray_point(ray, distMin, &startedRay.origin);
+        dist = distMax - distMin;
+    }
+    if (! (dist > RAY_DISTANCE_MIN)) {
+        return false;
+    }
+
+    bool occluded = find_occluder(rtContext, scene, &startedRay, dist, ignoreLights);
+    if (occluded) {
+        RAY_STATS_INC(occludedRays);
+    }
+    return occluded;
+}
+
+double ray_distance_to_sphere(Ray *ray, Sphere *sphere)
+{
+    return calc_ray_distance_to_sphere(ray, sphere);
+}
+
+double ray_distance_to_plane(Ray *ray, Plane *plane)
+{
+    return calc_ray_distance_to_plane(ray, plane);
+}
+
 /**
- * If `ray` hits `sphere` - returns the distance (>= 0) from the origin of the `ray` to the point on `sphere` where it hits.
- * Otherwise returns a negative value.
+ * Returns true if `ray` hits any primitive of the `scene` closer than `dist` (see ray_occluded()), stopping at the first hit. The planes
+ * are tested first: they are cheap to test and often block the ray (e.g. the ground).
  */
-static double ray_distance_to_sphere(Ray *ray, Sphere *sphere)
+static bool find_occluder(RTContext *rtContext, Scene *scene, Ray *ray, double dist, bool ignoreLights)
 {
-    // We determine if a ray hit a sphere using vector algebra.
-    // We are solving this equation for t:
-    // 0 = (t^2)*vector3_dot(ray->direction, ray->direction)
-    //       + 2*t*vector3_dot(ray->direction, ray->origin - sphere->center)
-    //       + vector3_dot(ray->origin - sphere->center, ray->origin - sphere->center)
-    //       - (sphere->radius^2)
-    //
-    // This is a quadratic equation, i.e.: a*(x^2) + b*x + c = 0
-    // Where:
-    //      a: vector3_dot(ray->direction, ray->direction)
-    //      b: 2*vector3_dot(ray->direction, ray->origin - sphere->center)
-    //      c: vector3_dot(ray->origin - sphere->center, ray->origin - sphere->center) - (sphere->radius^2)
-    //
-    // Quadratic equations are solved using the quadratic formula:
-    //      x = (-b +- sqrt(b^2 - 4*a  *c)) / 2*a
-    //
-    // Note the +- and the sqrt() - this means there can be 2, 1 or 0 solutions to the equation, depending on the values of a, b, c.
-    //
-    // After solving this equation for t using the quadratic formula, we get:
-    // t = (
-    //          -(2*vector3_dot(ray->direction, ray->origin - sphere->center))
-    //          +- sqrt(
-    //                      (2*vector3_dot(ray->direction, ray->origin - sphere->center))^2
-    //                    - (4*vector3_dot(ray->direction, ray->direction)
-    //                        * (   vector3_dot(ray->origin - sphere->center, ray->origin - sphere->center)
-    //                            - (sphere->radius^2))))
-    //     ) / (2*vector3_dot(ray->direction, ray->direction))
-    //
-    // A line drawn through the ray hits the sphere if the discriminant (the inside of sqrt()) is non-negative (there are 1 or 2 solutions
-    // to the equation).
-
-    Vector3 ray_orig_and_sphere_diff = ray->origin; // Copy ray->origin into ray_orig_and_sphere_diff
-    vector3_subtract_from(&ray_orig_and_sphere_diff, &sphere->center);
-
-    double a = vector3_dot(&ray->direction, &ray->direction);
-    double b = 2*vector3_dot(&ray->direction, &ray_orig_and_sphere_diff);
-    double c = vector3_dot(&ray_orig_and_sphere_diff, &ray_orig_and_sphere_diff) - (sphere->radius*sphere->radius);
-
-    double discriminant = (b*b) - (4*a*c);
-
-    if (discriminant < 0) {
-        // If the discriminant is negative - then a line drawn through the ray doesn't intersect with the sphere at all.
-        // That is, the ray doesn't intersect with the sphere and if we would reverse the ray (make it go in the opposite direction) - it
-        // would also not intersect with the sphere.
-        return -1;
-    }
-
-    // Since the discriminant is positive - that means that the ray _can_ have one or two intersections with the sphere.
-    //
-    // If the ray hits the sphere - then we want to return the closer (out of the two possible points) where ray hits the sphere.
-    // To do that we use - out of the two (+-) solutions (to get the smaller value).
-    //
-    // It is also possible that the ray goes in the opposite direction (away) from the sphere. In that case - both solutions will
-    // yield negative results. We can return either of the results in that case (a negative return value means that the ray did not hit the
-    // sphere).
-    //
-    // There is also a nuance, regarding the sky sphere and dielectric materials (that refract some rays that hit the sphere to inside the
-    // sphere) that rays can also hit from _inside_ of the sphere. In that case: sqrt(discriminant) > -b. So the smaller value is negative,
-    // but the larger value is positive. So we do an additional check for this, and return the larger value in this case.
-    //
-    // Also, note that since refacted rays can bounce off (scatter) from sphere boundary to inside the sphere (for dielectric (e.g. glass)
-    // spheres) - in that case it is important to return the second of the two solutions, not the first one. The first one will be around
-    // 0.0, but because of floating point inaccuracies/deviations - we compare against RAY_DISTANCE_MIN instead (this is important,
-    // otherwise refracted rays of dielectric spheres will be rendered incorrectly).
-    //
-    // TL;DR: we return the smaller positive solution (> RAY_DISTANCE_MIN) out of the two possible solutions, if one exists.
-    // Otherwise return -1.
-    double sqrtDiscriminant = sqrt(discriminant);
-
-    double a2 = 2.0 * a;
-    double distLarger = (-b + sqrtDiscriminant) / a2;
-    if (distLarger < RAY_DISTANCE_MIN) {
-        // Both solutions are negative, ray goes in the opposite direction and doesn't hit the sphere.
-        return -1;
-    }
-    double distSmaller = (-b - sqrtDiscriminant) / a2;
-    double dist = distSmaller < RAY_DISTANCE_MIN ? distLarger : distSmaller;
-
-    return dist;
+    bool occluded = false;
+
+    uint32_t planeTests = 0;
+    for (uint32_t i = 0; i < scene->planesLength && ! occluded; i++) {
+        Plane *plane = &scene->planes[i];
+        if (ignoreLights && mat_is_emitter(plane->material)) {
+            continue;
+        }
+        double d = calc_ray_distance_to_plane(ray, plane);
+        occluded = d >= RAY_DISTANCE_MIN && d < dist;
+        planeTests++;
+    }
+    RAY_STATS_ADD(planeTests, planeTests);
+    rtContext->intersectionTests += planeTests;
+
+    uint32_t sphereTests = 0;
+    if (occluded) {
+        // (Already blocked by a plane.)
+    } else if (scene->sphereAccel == SA_grid) {
+        occluded = sphere_grid_occluded(&scene->sphereGrid, scene->spheres, ray, dist, ignoreLights, &sphereTests);
+    } else if (scene->sphereAccel == SA_wide_bvh) {
+        occluded = wide_bvh_occluded(&scene->sphereBVH, scene->spheres, ray, dist, ignoreLights, &sphereTests);
+    } else {
+        for (uint32_t i = 0; i < scene->spheresLength && ! occluded; i++) {
+            Sphere *sphere = &scene->spheres[i];
+            if (ignoreLights && mat_is_emitter(sphere->material)) {
+                continue;
+            }
+            double d = calc_ray_distance_to_sphere(ray, sphere);
+            occluded = d >= RAY_DISTANCE_MIN && d < dist;
+            sphereTests++;
+        }
+    }
+
+    uint32_t triangleTests = 0;
+    for (uint32_t i = 0; i < scene->meshesLength && ! occluded; i++) {
+        Mesh *mesh = &scene->meshes[i];
+        if (ignoreLights && mat_is_emitter(mesh->material)) {
+            continue;
+        }
+        occluded = mesh_occluded(mesh, ray, dist, &triangleTests);
+    }
+
+    if (! occluded && scene->instancesLength > 0) {
+        InstanceHit stats;
+        occluded = instances_occluded(scene, ray, dist, ignoreLights, &stats);
+        RAY_STATS_ADD(instanceTests, stats.instanceTests);
+        sphereTests += stats.sphereTests;
+        triangleTests += stats.triangleTests;
+        rtContext->intersectionTests += stats.instanceTests;
+    }
+
+    if (! occluded && scene->sphereChunks != NULL) {
+        occluded = sphere_chunks_occluded(scene->sphereChunks, ray, dist, ignoreLights, &sphereTests);
+    }
+
+    RAY_STATS_ADD(sphereTests, sphereTests);
+    RAY_STATS_ADD(triangleTests, triangleTests);
+    rtContext->intersectionTests += sphereTests + triangleTests;
+    return occluded;
 }
@@ -14,8 +14,12 @@
 
 typedef struct Ray_s            Ray;
 typedef struct RTContext_s      RTContext;
+typedef struct Hit_s            Hit;
+typedef struct RayHit_s         RayHit;         // Defined in ray_inline_fns.h (where the types of all primitives are complete).
+typedef struct DeferredRay_s    DeferredRay;
 
 
+#include "color.h"
 #include "scene.h"
 #include "vector.h"
 
@@ -25,12 +29,39 @@ struct Ray_s {
     Vector3 direction;
 };
 
+// A ray that scattered off a primitive, which is traced later, instead of recursively (see RTContext.deferredRay).
+struct DeferredRay_s {
+    bool        pending;                // Set by mat_trace_scattered_ray() when it stores a ray here.
+    Ray         ray;
+    bool        attenuate;              // Whether the color the ray brings is multiplied by `color` (the color of the primitive).
+    Color       color;
+};
+
 // Ray tracing context.
 struct RTContext_s {
-    uint8_t bounces;
+    uint8_t     bounces;
+    uint32_t    intersectionTests;      // Ray-primitive intersection tests performed for all bounces (see CM_intersection_tests).
+
+    // If not NULL, mat_trace_scattered_ray() stores the scattered ray here (and returns black), instead of tracing it: the caller traces
+    // it later, together with the rays of other paths (see render_batch_task() in tracer.c).
+    DeferredRay *deferredRay;
+};
+
+// Where a ray hit the closest primitive (a sphere or a plane) of the scene: what the material of the primitive is shaded with (see
+// Material.hit).
+struct Hit_s {
+    Vector3     pos;                    // The point where the ray hit.
+
+    // The surface normal (a unit vector) at `pos`. For spheres it points outwards (also when the ray hits from inside the sphere), for
+    // planes it faces the ray (see calc_plane_surface_normal()).
+    Vector3     normal;
+
+    void       *matData;                // The material data of the primitive.
+    Color      *color;                  // The color of the primitive (see Sphere.color).
 };
 
 
+
 /**
  * Traces `ray` through the `scene`.
  *
@@ -39,9 +70,47 @@ struct RTContext_s {
  *
  * IMPORTANT: ray->direction must be a **unit** vector (some materials expect the passed incoming ray to be a unit vector).
  *
- * NOTE: the ray may hit a sphere from outside of it or from inside it (e.g. for the sky sphere or if it is a ray that refracted off the
- * surface of the sphere to inside the sphere). This function handles both cases.
+ * NOTE: the ray may hit a sphere from outside of it or from inside it (e.g. if it is a ray that refracted off the surface of the sphere to
+ * inside the sphere). This function handles both cases.
  */
 bool ray_trace(RTContext *rtContext, Scene *scene, Ray *ray, Color *color);
 
+/**
+ * The first half of ray_trace(), for tracing the rays of many paths in batches (see render_frame_img()): counts `ray` as a bounce of its
+ * path and finds the closest primitive of the `scene` that it hits (storing it in `hit`), except for the out-of-core spheres of the
+ * `scene` (see Scene.sphereChunks), which the caller looks up for the whole batch at once (see sphere_chunks_intersect_batch()).
+ *
+ * Returns false if the path already has RAY_BOUNCES_MAX bounces (the ray is not traced, like when ray_trace() returns false).
+ */
+bool ray_trace_find_hit(RTContext *rtContext, Scene *scene, Ray *ray, RayHit *hit);
+
+/**
+ * The second half of ray_trace(): shades the closest primitive that `ray` hits (see ray_trace_find_hit()) and stores the resulting color
+ * in `color`. Returns false if the ray didn't hit anything and the scene has no sky.
+ */
+bool ray_trace_shade_hit(RTContext *rtContext, Scene *scene, Ray *ray, RayHit *rayHit, Color *color);
+
+/**
+ * An occlusion (any-hit) query, for shadow, ambient occlusion and visibility rays: returns true if `ray` hits any primitive of the `scene`
+ * at a distance [distMin, distMax) along it (and not closer than RAY_DISTANCE_MIN to the start of the ray, or to the point at `distMin`).
+ * If `ignoreLights` - the primitives that emit light (see mat_is_emitter()) don't block the ray (e.g. for a shadow ray towards a light,
+ * which would otherwise be blocked by the light itself, or by other lights).
+ *
+ * Unlike ray_trace(), it doesn't look for the closest hit: each acceleration structure stops at the first primitive it finds (see
+ * bvh_occluded(), wide_bvh_occluded()), and nothing is shaded. The ray is not counted as a bounce of its path. The acceleration
+ * structures of the `scene` must be up to date (like for ray_trace()).
+ */
+bool ray_occluded(RTContext *rtContext, Scene *scene, Ray *ray, double distMin, double distMax, bool ignoreLights);
+
+/**
+ * Exported calc_ray_distance_to_sphere() (see ray_inline_fns.h), for code outside of the ray-tracing core (the kernel microbenchmarks).
+ * The core itself uses the inline version: calling this through the PLT of the shared library on every ray-sphere test is much slower.
+ */
+double ray_distance_to_sphere(Ray *ray, Sphere *sphere);
+
+/**
+ * Exported calc_ray_distance_to_plane() (see ray_inline_fns.h), for the kernel microbenchmarks (like ray_distance_to_sphere()).
+ */
+double ray_distance_to_plane(Ray *ray, Plane *plane);
+
 #endif // __RAY_H__
@@ -1,9 +1,30 @@
 #ifndef __RAY_INLINE_FNS_H__
 #define __RAY_INLINE_FNS_H__
 
+#include <math.h>
+
 #include "ray.h"
 
 
+// The closest primitive of the scene that a ray hits (see ray_trace_find_hit()).
+struct RayHit_s {
+    bool        hitSomething;
+    double      dist;
+
+    // The hit primitive: an instance (if `instance` is set), a triangle of a mesh, a plane or a sphere, whichever is not NULL first.
+    bool        instance;
+    InstanceHit instanceHit;
+    Mesh       *mesh;
+    uint32_t    triangle;
+    Plane      *plane;
+    Sphere     *sphere;
+
+    // A copy of the hit sphere, if it is one of the out-of-core spheres of the scene (see sphere_chunks.h and ray_hit_chunk_sphere()): the
+    // chunk that it is in may be evicted from memory before the hit is shaded.
+    Sphere      chunkSphere;
+};
+
+
 /**
  * Initializes the ray tracing context.
  */
@@ -15,16 +36,41 @@ static inline void ray_trace_context_init(RTContext *context);
  */
 static inline void ray_point(Ray *ray, double dist, Vector3 *point);
 
+/**
+ * If `ray` hits `sphere` - returns the distance (>= RAY_DISTANCE_MIN) from the origin of the `ray` to the point on `sphere` where it hits.
+ * Otherwise returns a negative value.
+ */
+static inline double calc_ray_distance_to_sphere(Ray *ray, Sphere *sphere);
+
+/**
+ * If `ray` hits `plane` (from either side) - returns the distance (>= RAY_DISTANCE_MIN) from the origin of the `ray` to the point on
+ * `plane` where it hits. Otherwise returns a negative value.
+ */
+static inline double calc_ray_distance_to_plane(Ray *ray, Plane *plane);
+
 /**
  * Calculates sphere surface normal vector: a normalized (unit, i.e length 1) vector from `sphere->center` to `point` and stores it in
  * `normal`.
  */
 static inline void calc_sphere_surface_normal(Sphere *sphere, Vector3 *point, Vector3 *normal);
 
+/**
+ * Stores the normal of `plane`, facing the `ray` that hits it (i.e. going in the opposite direction from ray->direction), in `normal`.
+ */
+static inline void calc_plane_surface_normal(Plane *plane, Ray *ray, Vector3 *normal);
+
+/**
+ * Makes the out-of-core sphere in hit->chunkSphere, at the distance `dist`, the closest primitive of `hit` (it must be closer than the
+ * primitive found by ray_trace_find_hit()).
+ */
+static inline void ray_hit_chunk_sphere(RayHit *hit, double dist);
+
 
 static inline void ray_trace_context_init(RTContext *context)
 {
     context->bounces = 0;
+    context->intersectionTests = 0;
+    context->deferredRay = NULL;
 }
 
 static inline void ray_point(Ray *ray, double dist, Vector3 *point)
@@ -35,6 +81,117 @@ static inline void ray_point(Ray *ray, double dist, Vector3 *point)
     vector3_add_to(&ray->origin, &rayDirAtDist, point);
 }
 
+static inline double calc_ray_distance_to_sphere(Ray *ray, Sphere *sphere)
+{
+    // We determine if a ray hit a sphere using vector algebra.
+    // We are solving this equation for t:
+    // 0 = (t^2)*vector3_dot(ray->direction, ray->direction)
+    //       + 2*t*vector3_dot(ray->direction, ray->origin - sphere->center)
+    //       + vector3_dot(ray->origin - sphere->center, ray->origin - sphere->center)
+    //       - (sphere->radius^2)
+    //
+    // This is a quadratic equation, i.e.: a*(x^2) + b*x + c = 0
+    // Where:
+    //      a: vector3_dot(ray->direction, ray->direction)
+    //      b: 2*vector3_dot(ray->direction, ray->origin - sphere->center)
+    //      c: vector3_dot(ray->origin - sphere->center, ray->origin - sphere->center) - (sphere->radius^2)
+    //
+    // Quadratic equations are solved using the quadratic formula:
+    //      x = (-b +- sqrt(b^2 - 4*a  *c)) / 2*a
+    //
+    // Note the +- and the sqrt() - this means there can be 2, 1 or 0 solutions to the equation, depending on the values of a, b, c.
+    //
+    // After solving this equation for t using the quadratic formula, we get:
+    // t = (
+    //          -(2*vector3_dot(ray->direction, ray->origin - sphere->center))
+    //          +- sqrt(
+    //                      (2*vector3_dot(ray->direction, ray->origin - sphere->center))^2
+    //                    - (4*vector3_dot(ray->direction, ray->direction)
+    //                        * (   vector3_dot(ray->origin - sphere->center, ray->origin - sphere->center)
+    //                            - (sphere->radius^2))))
+    //     ) / (2*vector3_dot(ray->direction, ray->direction))
+    //
+    // A line drawn through the ray hits the sphere if the discriminant (the inside of sqrt()) is non-negative (there are 1 or 2 solutions
+    // to the equation).
+
+    Vector3 ray_orig_and_sphere_diff = ray->origin; // Copy ray->origin into ray_orig_and_sphere_diff
+    vector3_subtract_from(&ray_orig_and_sphere_diff, &sphere->center);
+
+    double a = vector3_dot(&ray->direction, &ray->direction);
+    double b = 2*vector3_dot(&ray->direction, &ray_orig_and_sphere_diff);
+    double c = vector3_dot(&ray_orig_and_sphere_diff, &ray_orig_and_sphere_diff) - (sphere->radius*sphere->radius);
+
+    double discriminant = (b*b) - (4*a*c);
+
+    if (discriminant < 0) {
+        // If the discriminant is negative - then a line drawn through the ray doesn't intersect with the sphere at all.
+        // That is, the ray doesn't intersect with the sphere and if we would reverse the ray (make it go in the opposite direction) - it
+        // would also not intersect with the sphere.
+        return -1;
+    }
+
+    // Since the discriminant is positive - that means that the ray _can_ have one or two intersections with the sphere.
+    //
+    // If the ray hits the sphere - then we want to return the closer (out of the two possible points) where ray hits the sphere.
+    // To do that we use - out of the two (+-) solutions (to get the smaller value).
+    //
+    // It is also possible that the ray goes in the opposite direction (away) from the sphere. In that case - both solutions will
+    // yield negative results. We can return either of the results in that case (a negative return value means that the ray did not hit the
+    // sphere).
+    //
+    // There is also a nuance, regarding dielectric materials (that refract some rays that hit the sphere to inside the sphere) and cameras
+    // placed inside of spheres, that rays can also hit from _inside_ of the sphere. In that case: sqrt(discriminant) > -b. So the smaller
+    // value is negative, but the larger value is positive. So we do an additional check for this, and return the larger value in this case.
+    //
+    // Also, note that since refacted rays can bounce off (scatter) from sphere boundary to inside the sphere (for dielectric (e.g. glass)
+    // spheres) - in that case it is important to return the second of the two solutions, not the first one. The first one will be around
+    // 0.0, but because of floating point inaccuracies/deviations - we compare against RAY_DISTANCE_MIN instead (this is important,
+    // otherwise refracted rays of dielectric spheres will be rendered incorrectly).
+    //
+    // TL;DR: we return the smaller positive solution (> RAY_DISTANCE_MIN) out of the two possible solutions, if one exists.
+    // Otherwise return -1.
+    double sqrtDiscriminant = sqrt(discriminant);
+
+    double a2 = 2.0 * a;
+    double distLarger = (-b + sqrtDiscriminant) / a2;
+    if (distLarger < RAY_DISTANCE_MIN) {
+        // Both solutions are negative, ray goes in the opposite direction and doesn't hit the sphere.
+        return -1;
+    }
+    double distSmaller = (-b - sqrtDiscriminant) / a2;
+    double dist = distSmaller < RAY_DISTANCE_MIN ? distLarger : distSmaller;
+
+    return dist;
+}
+
+static inline double calc_ray_distance_to_plane(Ray *ray, Plane *plane)
+{
+    // The points on the ray are: ray->origin + t*ray->direction. Substituting them into the plane equation
+    // (vector3_dot(plane->normal, p) == plane->offset) and solving it for t gives:
+    //      t = (plane->offset - vector3_dot(plane->normal, ray->origin)) / vector3_dot(plane->normal, ray->direction)
+    double cosAngle = vector3_dot(&plane->normal, &ray->direction);
+    if (cosAngle == 0.0) {
+        // The ray is parallel to the plane.
+        return -1;
+    }
+
+    double dist = (plane->offset - vector3_dot(&plane->normal, &ray->origin)) / cosAngle;
+    if (dist < RAY_DISTANCE_MIN || plane->type == PLT_plane) {
+        return dist;
+    }
+
+    Vector3 point;
+    ray_point(ray, dist, &point);
+    if (plane->type == PLT_disk) {
+        vector3_subtract_from(&point, &plane->center);
+        return vector3_dot(&point, &point) <= plane->radiusSquared ? dist : -1;
+    } else {
+        bool inside = point.x >= plane->min.x && point.x <= plane->max.x && point.y >= plane->min.y && point.y <= plane->max.y
+            && point.z >= plane->min.z && point.z <= plane->max.z;
+        return inside ? dist : -1;
+    }
+}
+
 static inline void calc_sphere_surface_normal(Sphere *sphere, Vector3 *point, Vector3 *normal)
 {
     *normal = *point;
@@ -42,4 +199,22 @@ static inline void calc_sphere_surface_normal(Sphere *sphere, Vector3 *point, Ve
     vector3_to_unit(normal);
 }
 
+static inline void calc_plane_surface_normal(Plane *plane, Ray *ray, Vector3 *normal)
+{
+    *normal = plane->normal;
+    if (vector3_dot(&ray->direction, normal) > 0.0) {
+        vector3_multiply_length(normal, -1.0);
+    }
+}
+
+static inline void ray_hit_chunk_sphere(RayHit *hit, double dist)
+{
+    hit->hitSomething = true;
+    hit->dist = dist;
+    hit->instance = false;
+    hit->mesh = NULL;
+    hit->plane = NULL;
+    hit->sphere = &hit->chunkSphere;
+}
+
 #endif // __RAY_INLINE_FNS_H__
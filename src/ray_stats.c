@@ -0,0 +1,105 @@
+#include <inttypes.h>
+#include <string.h>
+
+#include "material.h"
+#include "ray.h"
+#include "ray_stats.h"
+
+
+_Static_assert(RAY_STATS_MATERIAL_TYPES >= MATERIAL_TYPES_COUNT, "RAY_STATS_MATERIAL_TYPES must be >= MATERIAL_TYPES_COUNT");
+_Static_assert(RAY_STATS_BOUNCES >= RAY_BOUNCES_MAX + 1, "RAY_STATS_BOUNCES must be >= RAY_BOUNCES_MAX + 1");
+
+
+#if RAY_STATS_ENABLED
+_Thread_local RayStats rayStatsThread RT_TLS_MODEL;
+#endif // RAY_STATS_ENABLED
+
+
+void ray_stats_reset(RayStats *stats)
+{
+    memset(stats, 0, sizeof(RayStats));
+}
+
+void ray_stats_merge(RayStats *dst, RayStats *src)
+{
+    // RayStats consists only of uint64_t counters.
+    uint64_t *d = (uint64_t *)dst;
+    uint64_t *s = (uint64_t *)src;
+    for (uint32_t i = 0; i < sizeof(RayStats) / sizeof(uint64_t); i++) {
+        d[i] += s[i];
+    }
+}
+
+void ray_stats_collect_thread(RayStats *dst)
+{
+#if RAY_STATS_ENABLED
+    ray_stats_merge(dst, &rayStatsThread);
+    ray_stats_reset(&rayStatsThread);
+#else
+    (void)(dst);        // Disable gcc -Wextra "unused parameter" errors.
+#endif // RAY_STATS_ENABLED
+}
+
+uint64_t ray_stats_paths(RayStats *stats)
+{
+    return stats->pathsMaxBounces + stats->pathsEscaped + stats->pathsLight + stats->pathsOther;
+}
+
+void ray_stats_print(FILE *f, RayStats *stats)
+{
+    uint64_t paths = ray_stats_paths(stats);
+    double pathsDiv = paths > 0 ? paths / 100.0 : 1;
+    double raysDiv = stats->raysTraced > 0 ? stats->raysTraced : 1;
+
+    double bouncesSum = 0;
+    for (uint32_t b = 0; b < RAY_STATS_BOUNCES; b++) {
+        bouncesSum += (double)b * stats->pathBounces[b];
+    }
+
+    fprintf(f, "Rays %" PRIu64 ", sphere tests %" PRIu64 " (%.1f per ray), plane tests %" PRIu64 " (%.1f per ray), triangle tests %" PRIu64
+        " (%.1f per ray), instance tests %" PRIu64 " (%.1f per ray), paths %" PRIu64 " (%.2f rays per path)\n", stats->raysTraced,
+        stats->sphereTests, stats->sphereTests / raysDiv, stats->planeTests, stats->planeTests / raysDiv, stats->triangleTests,
+        stats->triangleTests / raysDiv, stats->instanceTests, stats->instanceTests / raysDiv, paths, paths > 0 ? bouncesSum / paths : 0.0);
+    fprintf(f, "Paths ended: max bounces %.2f%%, escaped %.2f%%, light %.2f%%, other %.2f%%\n", stats->pathsMaxBounces / pathsDiv,
+        stats->pathsEscaped / pathsDiv, stats->pathsLight / pathsDiv, stats->pathsOther / pathsDiv);
+
+    if (stats->occlusionRays > 0) {
+        fprintf(f, "Occlusion rays %" PRIu64 " (%.2f%% occluded)\n", stats->occlusionRays,
+            stats->occludedRays * 100.0 / stats->occlusionRays);
+    }
+
+    fprintf(f, "Hits:");
+    for (uint32_t m = 0; m < MATERIAL_TYPES_COUNT; m++) {
+        fprintf(f, " %s %.1f%%", material_type_name(m), stats->materialHits[m] * 100 / raysDiv);
+    }
+    fprintf(f, "\n");
+
+    uint64_t dielectricScattered = stats->dielectricReflected + stats->dielectricRefracted;
+    fprintf(f, "Dielectric reflected %.2f%%, unit sphere sampling %.3f iterations per point\n",
+        dielectricScattered > 0 ? stats->dielectricReflected * 100.0 / dielectricScattered : 0.0,
+        stats->unitSpherePoints > 0 ? (double)stats->unitSphereIterations / stats->unitSpherePoints : 0.0);
+}
+
+void ray_stats_write_json(FILE *f, RayStats *stats)
+{
+    fprintf(f, "{\"raysTraced\": %" PRIu64 ", \"sphereTests\": %" PRIu64 ", \"planeTests\": %" PRIu64 ", \"triangleTests\": %" PRIu64
+        ", \"instanceTests\": %" PRIu64 ", \"materialHits\": {", stats->raysTraced, stats->sphereTests, stats->planeTests,
+        stats->triangleTests, stats->instanceTests);
+    for (uint32_t m = 0; m < MATERIAL_TYPES_COUNT; m++) {
+        fprintf(f, "%s\"%s\": %" PRIu64, m > 0 ? ", " : "", material_type_name(m), stats->materialHits[m]);
+    }
+
+    // The bounces histogram: index i is the amount of paths with i rays traced.
+    fprintf(f, "}, \"pathBounces\": [");
+    for (uint32_t b = 0; b <= RAY_BOUNCES_MAX; b++) {
+        fprintf(f, "%s%" PRIu64, b > 0 ? ", " : "", stats->pathBounces[b]);
+    }
+
+    fprintf(f, "], \"pathsMaxBounces\": %" PRIu64 ", \"pathsEscaped\": %" PRIu64 ", \"pathsLight\": %" PRIu64 ", \"pathsOther\": %" PRIu64,
+        stats->pathsMaxBounces, stats->pathsEscaped, stats->pathsLight, stats->pathsOther);
+    fprintf(f, ", \"occlusionRays\": %" PRIu64 ", \"occludedRays\": %" PRIu64, stats->occlusionRays, stats->occludedRays);
+    fprintf(f, ", \"unitSpherePoints\": %" PRIu64 ", \"unitSphereIterations\": %" PRIu64, stats->unitSpherePoints,
+        stats->unitSphereIterations);
+    fprintf(f, ", \"dielectricReflected\": %" PRIu64 ", \"dielectricRefracted\": %" PRIu64 "}", stats->dielectricReflected,
+        stats->dielectricRefracted);
+}
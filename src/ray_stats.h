@@ -0,0 +1,112 @@
+#ifndef __RAY_STATS_H__
+#define __RAY_STATS_H__
+
+/**
+ * Ray tracing statistics: counters of where the ray tracing work goes (rays, sphere and plane intersection tests, material hits, occlusion
+ * queries, path lengths and how paths end, rejection sampling loops, dielectric reflections vs refractions).
+ *
+ * The counters are incremented (with RAY_STATS_INC(), RAY_STATS_ADD()) in a thread-local RayStats, so the rendering threads never share
+ * a cache line. The rendering code collects them (see ray_stats_collect_thread()) after every rendered image row and render_frame_img()
+ * merges them into the caller's RayStats.
+ *
+ * When RAY_STATS_ENABLED is 0, RAY_STATS_INC() and RAY_STATS_ADD() expand to nothing, so the counters have no cost at all (and all the
+ * collected statistics are 0).
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "rtcommon.h"
+
+
+// #define RAY_STATS_ENABLED   1
+#define RAY_STATS_ENABLED   0
+
+// The sizes of the per-material and per-bounce counters arrays. They must be at least MATERIAL_TYPES_COUNT and RAY_BOUNCES_MAX + 1
+// (checked in ray_stats.c). They are defined here, so that this header doesn't depend on material.h and ray.h (because it is also
+// included by vector.h, which they depend on).
+#define RAY_STATS_MATERIAL_TYPES    8
+#define RAY_STATS_BOUNCES           32
+
+
+typedef struct RayStats_s       RayStats;
+
+struct RayStats_s {
+    uint64_t    raysTraced;                             // Rays traced (ray_trace() calls under the bounce limit), including every bounce.
+    uint64_t    sphereTests;                            // Ray-sphere intersection tests.
+    uint64_t    planeTests;                             // Ray-plane (and disk, rectangle) intersection tests.
+    uint64_t    triangleTests;                          // Ray-triangle intersection tests (of the mesh BVH leaves that the rays reached).
+    uint64_t    instanceTests;                          // Rays transformed into the object space of instances (see instance.h).
+    uint64_t    materialHits[RAY_STATS_MATERIAL_TYPES]; // Closest hits, per MaterialType.
+
+    // Occlusion queries (see ray_occluded()), and how many of them hit something. Their intersection tests are counted above, too.
+    uint64_t    occlusionRays;
+    uint64_t    occludedRays;
+
+    // Paths (camera rays, with all of their bounces), by the amount of rays traced for them (see RTContext.bounces).
+    uint64_t    pathBounces[RAY_STATS_BOUNCES];
+
+    // How the paths ended. Every path ends in exactly one of these ways.
+    uint64_t    pathsMaxBounces;                        // Reached RAY_BOUNCES_MAX.
+    uint64_t    pathsEscaped;                           // Hit nothing, or hit the sky.
+    uint64_t    pathsLight;                             // Hit a light.
+    uint64_t    pathsOther;                             // Hit another material that doesn't scatter rays (ground, shaded).
+
+    // Rejection sampling of random_point_in_unit_sphere__random_algo(): the amount of generated points and of the loop iterations
+    // (generated points / iterations is the acceptance rate, ~52%).
+    uint64_t    unitSpherePoints;
+    uint64_t    unitSphereIterations;
+
+    // Rays scattered by dielectric materials.
+    uint64_t    dielectricReflected;
+    uint64_t    dielectricRefracted;
+};
+
+
+#if RAY_STATS_ENABLED
+
+// The counters of the current thread.
+extern _Thread_local RayStats rayStatsThread RT_TLS_MODEL;
+
+#define RAY_STATS_INC(counter)          (rayStatsThread.counter++)
+#define RAY_STATS_ADD(counter, amount)  (rayStatsThread.counter += (amount))
+
+#else
+
+#define RAY_STATS_INC(counter)          ((void)0)
+#define RAY_STATS_ADD(counter, amount)  ((void)0)
+
+#endif // RAY_STATS_ENABLED
+
+
+/**
+ * Sets all counters of `stats` to 0.
+ */
+void ray_stats_reset(RayStats *stats);
+
+/**
+ * Adds the counters of `src` to `dst`.
+ */
+void ray_stats_merge(RayStats *dst, RayStats *src);
+
+/**
+ * Adds the counters of the current thread to `dst` and resets them. Does nothing if RAY_STATS_ENABLED is 0.
+ */
+void ray_stats_collect_thread(RayStats *dst);
+
+/**
+ * Returns the total amount of paths (the sum of the path end counters).
+ */
+uint64_t ray_stats_paths(RayStats *stats);
+
+/**
+ * Prints a (4 lines long) human readable summary of `stats` to `f`.
+ */
+void ray_stats_print(FILE *f, RayStats *stats);
+
+/**
+ * Writes `stats` into `f` as a single line JSON object.
+ */
+void ray_stats_write_json(FILE *f, RayStats *stats);
+
+#endif // __RAY_STATS_H__
@@ -2,6 +2,7 @@
 #define __RTALLOC_H__
 
 #include <stdio.h>
+#include <stdlib.h>
 
 
 /**
@@ -24,6 +25,12 @@
  */
 static inline void * rtalloc(size_t sz);
 
+/**
+ * Resizes the heap memory block `p` (previously allocated by rtalloc()/rtrealloc(), or NULL) to `sz` bytes. Just like rtalloc() - exits
+ * the program immediately (with exit code 1) if allocation failed.
+ */
+static inline void * rtrealloc(void *p, size_t sz);
+
 
 static inline void * rtalloc(size_t sz)
 {
@@ -35,4 +42,14 @@ static inline void * rtalloc(size_t sz)
     return p;
 }
 
+static inline void * rtrealloc(void *p, size_t sz)
+{
+    void *np = realloc(p, sz);
+    if (np == NULL) {
+        fprintf(stderr, "Error: could not allocate heap memory. Exiting.");
+        exit(1);
+    }
+    return np;
+}
+
 #endif // __RTALLOC_H__
@@ -0,0 +1,47 @@
+#ifndef __RTCOMMON_H__
+#define __RTCOMMON_H__
+
+/**
+ * Common definitions (debugging/logging helpers and rendering configuration) shared by all of the ray-tracer's sources.
+ *
+ * NOTE: this must not include SDL (or anything else that only the interactive application needs), because the ray-tracing core is also
+ * built as a standalone library (libtoyrt, see toyrt.h).
+ */
+
+// stdio.h is required for log_err() definition (fprintf and stderr).
+#include <stdio.h>
+#include <stdlib.h>
+
+
+// #define DEBUG 1
+#define DEBUG 0
+
+#define DEBUG_ANGLE_TO_CC   DEBUG && 1
+
+#define dbg(...) if (DEBUG) { printf(__VA_ARGS__); }
+
+#define assert2(exp, msg) if (! (exp)) { printf("%s", msg); exit(1); }
+
+#define log_err(...) fprintf(stderr, __VA_ARGS__);
+
+// The TLS model of the thread-local variables, that are accessed by the rendering hot paths (e.g. randomThreadState, rayStatsThread).
+// The initial-exec model keeps accessing them cheap in the (ELF) shared library libtoyrt too.
+#if defined(__ELF__)
+#define RT_TLS_MODEL    __attribute__((tls_model("initial-exec")))
+#else
+#define RT_TLS_MODEL
+#endif
+
+// This configures the down-sampling (super-sampling) anti-aliasing.
+// How many vertical/horizontal pixels will be rendered and averaged to produce one resulting pixel, when anti-aliasing.
+// For example, if ANTIALIAS_FACTOR is 2 - then 4 pixels (2 by 2) will be rendered to produce one resulting pixel.
+//
+// Set ANTIALIAS_FACTOR to 1 to disable anti-aliasing.
+//
+// UPDATE: we don't use this anymore, but i kept the support for this anti-aliasing.
+// Instead we now randomize the camera rays directions for each pixel (within pixel's boundaries) for each frame, see cam_frame_init().
+// This performs much better and results in better anti-aliasing and better overall rendered image quality (after multiple frames are
+// blended together).
+#define ANTIALIAS_FACTOR    1
+
+#endif // __RTCOMMON_H__
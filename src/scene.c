@@ -2,14 +2,49 @@
  * Various pre-defined scene/camera/sky configurations that can be used.
  */
 
-#include "main.h"
+#include <math.h>
+#include <string.h>
+
 #include "rtalloc.h"
+#include "rtcommon.h"
 #include "scene.h"
+#include "scene_file.h"
+#include "scene_gen.h"
 #include "materials/dielectric.h"
 #include "materials/light.h"
 #include "materials/metal.h"
 
 
+const BenchScene benchScenes[] = {
+    {"6_spheres__fov_40__cam_z_0",                SC_6_spheres__fov_40__cam_z_0,                    CC_z_0},
+    {"6_spheres__fov_40__cam_z_15_downwards",     SC_6_spheres__fov_40__cam_z_15_downwards,         CC_z_15_downwards},
+    {"6_spheres__fov_40__cam_z_15_downwards_v2",  SC_6_spheres__fov_40__cam_z_15_downwards_v2,      CC_z_15_downwards},
+    {"6_spheres__fov_40__cam_z_15_downwards_v3",  SC_6_spheres__fov_40__cam_z_15_downwards_v3,      CC_z_15_downwards},
+    {"7_spheres__fov_40__cam_z_15_downwards",     SC_7_spheres__fov_40__cam_z_15_downwards,         CC_z_15_downwards},
+    {"gen_random_field",                          SC_gen_random_field,                              CC_z_15_downwards},
+    {"gen_clustered_grid",                        SC_gen_clustered_grid,                            CC_z_15_downwards},
+    {"gen_glass_shells",                          SC_gen_glass_shells,                              CC_z_15_downwards},
+    {"gen_many_lights",                           SC_gen_many_lights,                               CC_z_15_downwards},
+    {"gen_instanced_clusters",                    SC_gen_instanced_clusters,                        CC_z_15_downwards},
+};
+
+const uint32_t benchScenesCount = sizeof(benchScenes) / sizeof(benchScenes[0]);
+
+static const char *sphereAccelNames[SPHERE_ACCELS_COUNT] = {
+    [SA_linear]     = "linear",
+    [SA_grid]       = "grid",
+    [SA_wide_bvh]   = "wide_bvh",
+};
+
+// The ground used to be a huge sphere (center [0, GROUND_SPHERE_CENTER_Y, GROUND_SPHERE_CENTER_Z], radius GROUND_SPHERE_RADIUS). Now it
+// is the plane that touches that sphere at y = GROUND_TANGENT_Y (under the middle of the pre-defined scenes), so the spheres of the scenes
+// still stand on the ground (within ~0.1).
+#define GROUND_SPHERE_CENTER_Y      220.0
+#define GROUND_SPHERE_CENTER_Z    -2000.0
+#define GROUND_SPHERE_RADIUS       2000.0
+#define GROUND_TANGENT_Y             70.0
+
+
 static void scene_6_spheres__fov_90(Scene *scene);
 static void scene_6_spheres__fov_40__cam_z_0(Scene *scene);
 static void scene_6_spheres__fov_40__cam_z_15_downwards(Scene *scene);
@@ -25,16 +60,37 @@ static void sky_ambient_gray_07(Scene *scene);
 static void sky_gradient_blue(Scene *scene);
 static void sky_ambient_blue(Scene *scene);
 
-static void add_sphere(Scene *scene, Sphere *sphere);
+// A shorthand for scene_add_sphere(), used by the pre-defined scenes.
+static inline void add_sphere(Scene *scene, Sphere *sphere);
+
+// A shorthand for scene_add_ground(), used by the pre-defined scenes.
+static inline void add_ground(Scene *scene);
 
 
-void init_scene(Scene *scene)
+void init_scene(Scene *scene, SceneConfig sc, SkyConfig sk)
 {
-    scene->spheres = rtalloc(sizeof(Sphere) * SCENE_SPHERES_MAX);
-    scene->spheresLength = 0;
+    scene_init_empty(scene);
+
+    // Choose one of the available sky configurations (descriptions inside each function).
+    switch (sk) {
+        case SK_none:
+            break;
+
+        case SK_ambient_gray_07:
+            sky_ambient_gray_07(scene); break;
+
+        case SK_gradient_blue:
+            sky_gradient_blue(scene); break;
+
+        case SK_ambient_blue:
+            sky_ambient_blue(scene); break;
+
+        default:
+            log_err("Fatal error: unknown sky configuration used: %d", sk);
+            exit(1);
+    }
 
     // Choose one of the available scene configurations (descriptions inside each function).
-    SceneConfig sc = SCENE_CONFIG;
     switch (sc) {
         case SC_none:
             break;
@@ -72,30 +128,77 @@ void init_scene(Scene *scene)
         case SC_rt_testing__1_sphere_inside__fov_40:
             scene_rt_testing__1_sphere_inside__fov_40(scene); break;
 
+        case SC_gen_random_field:
+            scene_generate(scene, SG_random_field, SCENE_GEN_COUNT, SCENE_GEN_SEED); break;
+
+        case SC_gen_clustered_grid:
+            scene_generate(scene, SG_clustered_grid, SCENE_GEN_COUNT, SCENE_GEN_SEED); break;
+
+        case SC_gen_glass_shells:
+            scene_generate(scene, SG_glass_shells, SCENE_GEN_COUNT, SCENE_GEN_SEED); break;
+
+        case SC_gen_many_lights:
+            scene_generate(scene, SG_many_lights, SCENE_GEN_COUNT, SCENE_GEN_SEED); break;
+
+        case SC_gen_instanced_clusters:
+            scene_generate(scene, SG_instanced_clusters, SCENE_GEN_COUNT, SCENE_GEN_SEED); break;
+
+        case SC_file:
+            if (! scene_file_load(scene, SCENE_FILE_PATH)) {
+                log_err("Fatal error: could not load the scene file \"%s\"", SCENE_FILE_PATH);
+                exit(1);
+            }
+            break;
+
         default:
             log_err("Fatal error: unknown scene configuration used: %d", sc);
             exit(1);
     }
+}
 
-    // Choose one of the available sky configurations (descriptions inside each function).
-    SkyConfig sk = SKY_CONFIG;
-    switch (sk) {
-        case SK_none:
+void init_camera_ray(CameraConfig cc, Ray *camCenterRay)
+{
+    Vector3 camOrigin;
+    Vector3 camDirection;
+
+    switch (cc) {
+        case CC_z_0:
+            // Camera is centered at [0, 0, 0] and looking towards the y axis.
+            camOrigin       = (Vector3){.x = 0, .y = 0, .z = 0};
+            camDirection    = (Vector3){.x = 0, .y = 1, .z = 0};
             break;
 
-        case SK_ambient_gray_07:
-            sky_ambient_gray_07(scene); break;
-
-        case SK_gradient_blue:
-            sky_gradient_blue(scene); break;
+        case CC_z_15_downwards:
+            // Camera is slightly above ground (z=15) and looking towards the y axis, at a slightly downward angle.
+            camOrigin       = (Vector3){.x = 0, .y = 0, .z = 15};
+            camDirection    = (Vector3){.x = 0, .y = 1, .z = -0.2};
+            break;
 
-        case SK_ambient_blue:
-            sky_ambient_blue(scene); break;
+        case CC_down__fov_40:
+            // Camera is high up above ground and looking straight down onto the scene.
+            camOrigin       = (Vector3){.x = 0, .y = 80, .z = 200};
+            camDirection    = (Vector3){.x = 0, .y = 0.001, .z = -1};
+            break;
 
         default:
-            log_err("Fatal error: unknown sky configuration used: %d", sk);
+            log_err("Fatal error: unknown camera configuration used: %d", cc);
             exit(1);
     }
+
+    vector3_to_unit(&camDirection);     // Camera direction vector must be a unit (normalized to length 1) vector.
+
+    camCenterRay->origin    = camOrigin;
+    camCenterRay->direction = camDirection;
+}
+
+const BenchScene * bench_scene_find(const char *name)
+{
+    for (uint32_t s = 0; s < benchScenesCount; s++) {
+        if (strcmp(benchScenes[s].name, name) == 0) {
+            return &benchScenes[s];
+        }
+    }
+    return NULL;
 }
 
 static void scene_6_spheres__fov_90(Scene *scene)
@@ -114,7 +217,7 @@ static void scene_6_spheres__fov_90(Scene *scene)
 
     add_sphere(scene, sphere_light_init(&(Sphere){.center = {.x = -9, .y = 20, .z = 10}, .radius = 3}, (Color)COLOR_LIGHT));                // A light.
 
-    add_sphere(scene, &(Sphere){.center = {.x = 0, .y = 220, .z = -2000}, .radius = 2000, .material = &matMatte, .color = COLOR_GROUND});   // Ground sphere.
+    add_ground(scene);                                                                                                                      // Ground plane.
 }
 
 static void scene_6_spheres__fov_40__cam_z_0(Scene *scene)
@@ -132,7 +235,7 @@ static void scene_6_spheres__fov_40__cam_z_0(Scene *scene)
 
     add_sphere(scene, sphere_light_init(&(Sphere){.center = {.x = -9, .y = 80, .z = 16}, .radius = 3}, (Color)COLOR_LIGHT));                // A light.
 
-    add_sphere(scene, &(Sphere){.center = {.x = 0, .y = 220, .z = -2000}, .radius = 2000, .material = &matMatte, .color = COLOR_GROUND});   // Ground sphere.
+    add_ground(scene);                                                                                                                      // Ground plane.
 }
 
 static void scene_6_spheres__fov_40__cam_z_15_downwards(Scene *scene)
@@ -149,7 +252,7 @@ static void scene_6_spheres__fov_40__cam_z_15_downwards(Scene *scene)
 
     add_sphere(scene, sphere_light_init(&(Sphere){.center = {.x = -9, .y = 75, .z = 20}, .radius = 4}, (Color)COLOR_LIGHT));                // A light.
 
-    add_sphere(scene, &(Sphere){.center = {.x = 0, .y = 220, .z = -2000}, .radius = 2000, .material = &matMatte, .color = COLOR_GROUND});   // Ground sphere.
+    add_ground(scene);                                                                                                                      // Ground plane.
 }
 
 static void scene_6_spheres__fov_40__cam_z_15_downwards_v2(Scene *scene)
@@ -166,7 +269,7 @@ static void scene_6_spheres__fov_40__cam_z_15_downwards_v2(Scene *scene)
 
     add_sphere(scene, sphere_light_init(&(Sphere){.center = {.x = -9, .y = 75, .z = 20}, .radius = 4}, (Color)COLOR_LIGHT));                // A light.
 
-    add_sphere(scene, &(Sphere){.center = {.x = 0, .y = 220, .z = -2000}, .radius = 2000, .material = &matMatte, .color = COLOR_GROUND});   // Ground sphere.
+    add_ground(scene);                                                                                                                      // Ground plane.
 }
 
 static void scene_6_spheres__fov_40__cam_z_15_downwards_v3(Scene *scene)
@@ -183,7 +286,7 @@ static void scene_6_spheres__fov_40__cam_z_15_downwards_v3(Scene *scene)
 
     add_sphere(scene, sphere_light_init(&(Sphere){.center = {.x = -9, .y = 75, .z = 20}, .radius = 4}, (Color)COLOR_LIGHT));                // A light.
 
-    add_sphere(scene, &(Sphere){.center = {.x = 0, .y = 220, .z = -2000}, .radius = 2000, .material = &matMatte, .color = COLOR_GROUND});   // Ground sphere.
+    add_ground(scene);                                                                                                                      // Ground plane.
 }
 
 static void scene_7_spheres__fov_40__cam_z_15_downwards(Scene *scene)
@@ -202,7 +305,7 @@ static void scene_7_spheres__fov_40__cam_z_15_downwards(Scene *scene)
 
     add_sphere(scene, sphere_light_init(&(Sphere){.center = {.x = -15, .y = 75, .z = 20}, .radius = 4}, (Color)COLOR_LIGHT));               // A light.
 
-    add_sphere(scene, &(Sphere){.center = {.x = 0, .y = 220, .z = -2000}, .radius = 2000, .material = &matMatte, .color = COLOR_GROUND});   // Ground sphere.
+    add_ground(scene);                                                                                                                      // Ground plane.
 }
 
 static void scene_camera_testing_1_sphere__fov_90(Scene *scene)
@@ -248,29 +351,285 @@ static void scene_rt_testing__1_sphere_inside__fov_40(Scene *scene)
 
 static void sky_ambient_gray_07(Scene *scene)
 {
-    // Sky sphere, providing an ambient light (COLOR_BLACK is the Color equivalent of NULL).
-    add_sphere(scene, sphere_light_init(&(Sphere){.center = {.x = 0, .y = 0, .z = 0}, .radius = 20000}, (Color)COLOR_AMBIENT_LIGHT));
+    // Sky providing an ambient light.
+    scene->sky = (Sky){.type = SKT_ambient, .color = COLOR_AMBIENT_LIGHT};
 }
 
 static void sky_gradient_blue(Scene *scene)
 {
-    // Sky sphere, providing a gradient (blue-white) light.
-    add_sphere(scene, &(Sphere){.center = {.x = 0, .y = 0, .z = 0}, .radius = 20000, .material = &matGradientSky, .color = COLOR_BLACK});
+    // Sky providing a gradient (blue-white) light.
+    scene->sky = (Sky){.type = SKT_gradient, .color = COLOR_BLACK};
 }
 
 static void sky_ambient_blue(Scene *scene)
 {
-    // Sky sphere, providing a ambient blue-ish light.
-    add_sphere(scene, sphere_light_init(&(Sphere){.center = {.x = 0, .y = 0, .z = 0}, .radius = 20000}, (Color)COLOR_SKY));
+    // Sky providing an ambient blue-ish light.
+    scene->sky = (Sky){.type = SKT_ambient, .color = COLOR_SKY};
+}
+
+void scene_init_empty(Scene *scene)
+{
+    scene->spheres = rtalloc(sizeof(Sphere) * SCENE_SPHERES_INITIAL_CAPACITY);
+    scene->spheresLength = 0;
+    scene->spheresCapacity = SCENE_SPHERES_INITIAL_CAPACITY;
+    scene->fileSpheresFirst = 0;
+    scene->planes = rtalloc(sizeof(Plane) * SCENE_PLANES_INITIAL_CAPACITY);
+    scene->planesLength = 0;
+    scene->planesCapacity = SCENE_PLANES_INITIAL_CAPACITY;
+    scene->filePlanesFirst = 0;
+    scene->meshes = rtalloc(sizeof(Mesh) * SCENE_MESHES_INITIAL_CAPACITY);
+    scene->meshesLength = 0;
+    scene->meshesCapacity = SCENE_MESHES_INITIAL_CAPACITY;
+    scene->fileMeshesFirst = 0;
+    scene->sphereAccel = SA_linear;
+    sphere_grid_init(&scene->sphereGrid);
+    scene->sphereGridDirty = false;
+    wide_bvh_init(&scene->sphereBVH);
+    scene->sphereBVHDirty = false;
+    scene->sphereBVHMoved = false;
+    scene->prototypes = rtalloc(sizeof(Prototype) * SCENE_PROTOTYPES_INITIAL_CAPACITY);
+    scene->prototypesLength = 0;
+    scene->prototypesCapacity = SCENE_PROTOTYPES_INITIAL_CAPACITY;
+    scene->instances = rtalloc(sizeof(Instance) * SCENE_INSTANCES_INITIAL_CAPACITY);
+    scene->instancesLength = 0;
+    scene->instancesCapacity = SCENE_INSTANCES_INITIAL_CAPACITY;
+    bvh_init(&scene->instancesBVH);
+    scene->instancesBVHOrder = NULL;
+    scene->instancesBVHDirty = false;
+    scene->sphereChunks = NULL;
+    scene->sky = (Sky){.type = SKT_none, .color = COLOR_BLACK};
 }
 
-static void add_sphere(Scene *scene, Sphere *sphere)
+void scene_add_sphere(Scene *scene, Sphere *sphere)
 {
-    if (scene->spheresLength == SCENE_SPHERES_MAX) {
-        log_err("Cannot add another sphere to the scene - scene already has maximum spheres");
-        exit(1);
+    if (scene->spheresLength == scene->spheresCapacity) {
+        scene->spheresCapacity *= 2;
+        scene->spheres = rtrealloc(scene->spheres, sizeof(Sphere) * scene->spheresCapacity);
     }
 
     scene->spheres[scene->spheresLength] = *sphere;
     scene->spheresLength++;
+    scene->sphereGridDirty = true;
+    scene->sphereBVHDirty = true;
+}
+
+void scene_add_plane(Scene *scene, Plane *plane)
+{
+    if (scene->planesLength == scene->planesCapacity) {
+        scene->planesCapacity *= 2;
+        scene->planes = rtrealloc(scene->planes, sizeof(Plane) * scene->planesCapacity);
+    }
+
+    scene->planes[scene->planesLength] = *plane;
+    scene->planesLength++;
+}
+
+void scene_add_mesh(Scene *scene, Mesh *mesh)
+{
+    if (scene->meshesLength == scene->meshesCapacity) {
+        scene->meshesCapacity *= 2;
+        scene->meshes = rtrealloc(scene->meshes, sizeof(Mesh) * scene->meshesCapacity);
+    }
+
+    scene->meshes[scene->meshesLength] = *mesh;
+    scene->meshesLength++;
+}
+
+uint32_t scene_add_prototype(Scene *scene, Prototype *prototype)
+{
+    if (scene->prototypesLength == scene->prototypesCapacity) {
+        scene->prototypesCapacity *= 2;
+        scene->prototypes = rtrealloc(scene->prototypes, sizeof(Prototype) * scene->prototypesCapacity);
+    }
+
+    prototype_build(prototype);
+    scene->prototypes[scene->prototypesLength] = *prototype;
+    return scene->prototypesLength++;
+}
+
+bool scene_add_instance(Scene *scene, uint32_t prototype, Transform *objectToWorld)
+{
+    Instance instance = {.prototype = prototype};
+    if (! transform_invert(objectToWorld, &instance.worldToObject)) {
+        return false;
+    }
+
+    // The world bounds of the instance: the bounds of the 8 transformed corners of the prototype's bounds.
+    Prototype *proto = &scene->prototypes[prototype];
+    Vector3 min = {.x = INFINITY, .y = INFINITY, .z = INFINITY};
+    Vector3 max = {.x = -INFINITY, .y = -INFINITY, .z = -INFINITY};
+    double (*m)[4] = objectToWorld->m;
+    for (uint32_t c = 0; c < 8; c++) {
+        double p[3] = {
+            (c & 1) ? proto->max.x : proto->min.x,
+            (c & 2) ? proto->max.y : proto->min.y,
+            (c & 4) ? proto->max.z : proto->min.z,
+        };
+        double w[3];
+        for (uint32_t i = 0; i < 3; i++) {
+            w[i] = m[i][0]*p[0] + m[i][1]*p[1] + m[i][2]*p[2] + m[i][3];
+        }
+        min = (Vector3){.x = fmin(min.x, w[0]), .y = fmin(min.y, w[1]), .z = fmin(min.z, w[2])};
+        max = (Vector3){.x = fmax(max.x, w[0]), .y = fmax(max.y, w[1]), .z = fmax(max.z, w[2])};
+    }
+    bvh_bounds_set(&instance.bounds, &min, &max);
+
+    if (scene->instancesLength == scene->instancesCapacity) {
+        scene->instancesCapacity *= 2;
+        scene->instances = rtrealloc(scene->instances, sizeof(Instance) * scene->instancesCapacity);
+    }
+    scene->instances[scene->instancesLength] = instance;
+    scene->instancesLength++;
+    scene->instancesBVHDirty = true;
+    return true;
+}
+
+void scene_build_instances_bvh(Scene *scene)
+{
+    if (! scene->instancesBVHDirty) {
+        return;
+    }
+    scene->instancesBVHDirty = false;
+
+    // The instances are not reordered (Scene.instances keeps the order they were added in): the BVH refers to them through
+    // instancesBVHOrder.
+    uint32_t count = scene->instancesLength;
+    BVHBounds *bounds = rtalloc(sizeof(BVHBounds) * (count > 0 ? count : 1));
+    rtfree(scene->instancesBVHOrder);
+    scene->instancesBVHOrder = rtalloc(sizeof(uint32_t) * (count > 0 ? count : 1));
+    for (uint32_t i = 0; i < count; i++) {
+        bounds[i] = scene->instances[i].bounds;
+        scene->instancesBVHOrder[i] = i;
+    }
+    bvh_build(&scene->instancesBVH, bounds, scene->instancesBVHOrder, count);
+    rtfree(bounds);
+}
+
+void scene_build_sphere_accel(Scene *scene, WorkerPool *workers)
+{
+    if (scene->sphereAccel == SA_grid && scene->sphereGridDirty) {
+        scene->sphereGridDirty = false;
+        sphere_grid_build(&scene->sphereGrid, scene->spheres, scene->spheresLength, workers);
+    } else if (scene->sphereAccel == SA_wide_bvh && scene->sphereBVHDirty) {
+        scene->sphereBVHDirty = false;
+        scene->sphereBVHMoved = false;
+        wide_bvh_build(&scene->sphereBVH, scene->spheres, scene->spheresLength);
+    } else if (scene->sphereAccel == SA_wide_bvh && scene->sphereBVHMoved) {
+        scene->sphereBVHMoved = false;
+        wide_bvh_refit(&scene->sphereBVH, scene->spheres, scene->spheresLength, workers);
+    }
+}
+
+void scene_spheres_moved(Scene *scene)
+{
+    scene->sphereGridDirty = true;
+    scene->sphereBVHMoved = true;
+}
+
+bool scene_set_sphere_chunks(Scene *scene, const char *path, uint64_t cacheBytes)
+{
+    SphereChunks *chunks = rtalloc(sizeof(SphereChunks));
+    if (! sphere_chunks_open(chunks, path, cacheBytes)) {
+        rtfree(chunks);
+        return false;
+    }
+
+    if (scene->sphereChunks != NULL) {
+        sphere_chunks_close(scene->sphereChunks);
+        rtfree(scene->sphereChunks);
+    }
+    scene->sphereChunks = chunks;
+    return true;
+}
+
+const char * sphere_accel_name(SphereAccel accel)
+{
+    if ((uint32_t)accel >= SPHERE_ACCELS_COUNT) {
+        return "unknown";
+    }
+    return sphereAccelNames[accel];
+}
+
+bool sphere_accel_by_name(const char *name, SphereAccel *accel)
+{
+    for (uint32_t i = 0; i < SPHERE_ACCELS_COUNT; i++) {
+        if (strcmp(name, sphereAccelNames[i]) == 0) {
+            *accel = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void scene_add_ground(Scene *scene)
+{
+    // The normal of the old ground sphere at the tangent point (its length is the radius).
+    Vector3 normal = {.x = 0, .y = GROUND_TANGENT_Y - GROUND_SPHERE_CENTER_Y, .z = 0};
+    normal.z = sqrt(GROUND_SPHERE_RADIUS*GROUND_SPHERE_RADIUS - normal.y*normal.y);
+    Vector3 tangentPoint = {.x = 0, .y = GROUND_TANGENT_Y, .z = GROUND_SPHERE_CENTER_Z + normal.z};
+
+    scene_add_plane(scene, plane_init(&(Plane){.material = &matMatte, .color = COLOR_GROUND}, &tangentPoint, &normal));
+}
+
+double scene_ground_z(double x, double y)
+{
+    (void)(x);          // The ground plane is horizontal along the x axis.
+
+    double dy = GROUND_TANGENT_Y - GROUND_SPHERE_CENTER_Y;
+    double normalZ = sqrt(GROUND_SPHERE_RADIUS*GROUND_SPHERE_RADIUS - dy*dy);
+    return GROUND_SPHERE_CENTER_Z + normalZ - (dy / normalZ) * (y - GROUND_TANGENT_Y);
+}
+
+void scene_free(Scene *scene)
+{
+    rtfree(scene->spheres);
+    scene->spheres = NULL;
+    scene->spheresLength = 0;
+    scene->spheresCapacity = 0;
+    sphere_grid_free(&scene->sphereGrid);
+    scene->sphereGridDirty = false;
+    wide_bvh_free(&scene->sphereBVH);
+    scene->sphereBVHDirty = false;
+    scene->sphereBVHMoved = false;
+    rtfree(scene->planes);
+    scene->planes = NULL;
+    scene->planesLength = 0;
+    scene->planesCapacity = 0;
+    for (uint32_t i = 0; i < scene->meshesLength; i++) {
+        mesh_free(&scene->meshes[i]);
+    }
+    rtfree(scene->meshes);
+    scene->meshes = NULL;
+    scene->meshesLength = 0;
+    scene->meshesCapacity = 0;
+    for (uint32_t i = 0; i < scene->prototypesLength; i++) {
+        prototype_free(&scene->prototypes[i]);
+    }
+    rtfree(scene->prototypes);
+    scene->prototypes = NULL;
+    scene->prototypesLength = 0;
+    scene->prototypesCapacity = 0;
+    rtfree(scene->instances);
+    scene->instances = NULL;
+    scene->instancesLength = 0;
+    scene->instancesCapacity = 0;
+    bvh_free(&scene->instancesBVH);
+    rtfree(scene->instancesBVHOrder);
+    scene->instancesBVHOrder = NULL;
+    scene->instancesBVHDirty = false;
+    if (scene->sphereChunks != NULL) {
+        sphere_chunks_close(scene->sphereChunks);
+        rtfree(scene->sphereChunks);
+        scene->sphereChunks = NULL;
+    }
+}
+
+static inline void add_sphere(Scene *scene, Sphere *sphere)
+{
+    scene_add_sphere(scene, sphere);
+}
+
+static inline void add_ground(Scene *scene)
+{
+    scene_add_ground(scene);
 }
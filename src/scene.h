@@ -5,15 +5,48 @@
  * Various pre-defined scene/camera/sky configurations that can be used.
  */
 
-#define SCENE_SPHERES_MAX   20
+// The initial size of the Scene.spheres array (it is grown as needed, when spheres are added).
+#define SCENE_SPHERES_INITIAL_CAPACITY  16
+
+// The initial size of the Scene.planes array.
+#define SCENE_PLANES_INITIAL_CAPACITY   4
+
+// The initial size of the Scene.meshes array.
+#define SCENE_MESHES_INITIAL_CAPACITY   4
+
+// The initial size of the Scene.prototypes array.
+#define SCENE_PROTOTYPES_INITIAL_CAPACITY   4
+
+// The initial size of the Scene.instances array.
+#define SCENE_INSTANCES_INITIAL_CAPACITY    16
 
 
 typedef struct Scene_s          Scene;
+typedef struct BenchScene_s     BenchScene;
+
+
+// How ray_trace() finds the closest sphere of a scene (see Scene.sphereAccel).
+typedef enum {
+    SA_linear,              // Test every sphere. Best for scenes with few spheres (or spheres of very different sizes).
+    SA_grid,                // Walk through a uniform grid over the spheres (see sphere_grid.h). Best for dense fields of many spheres.
+    SA_wide_bvh,            // Traverse a compressed 4-ary BVH over the spheres (see wide_bvh.h). Best for huge scenes (10^6+ spheres).
+} SphereAccel;
+
+#define SPHERE_ACCELS_COUNT     3
 
 
+#include <stdbool.h>
 #include <stdint.h>
 
+#include "plane.h"
+#include "mesh.h"           // After plane.h: mesh.h includes ray.h (through sphere.h), which needs the Plane type.
+#include "instance.h"
+#include "sphere_chunks.h"
+#include "sphere_grid.h"
+#include "wide_bvh.h"
+#include "sky.h"
 #include "sphere.h"
+#include "workers.h"
 
 
 typedef enum {
@@ -59,10 +92,26 @@ typedef enum {
 
     SC_rt_testing__1_sphere_center__fov_40,
     SC_rt_testing__1_sphere_inside__fov_40,
+
+    // Procedurally generated large scenes (see scene_gen.h), with SCENE_GEN_COUNT spheres, seeded with SCENE_GEN_SEED.
+    // For use with CC_z_15_downwards.
+    SC_gen_random_field,
+    SC_gen_clustered_grid,
+    SC_gen_glass_shells,
+    SC_gen_many_lights,
+    SC_gen_instanced_clusters,      // SCENE_GEN_COUNT instances of a cluster of SCENE_GEN_COUNT spheres.
+
+    // A scene loaded from the scene file SCENE_FILE_PATH (see scene_file.h).
+    SC_file,
 } SceneConfig;
 
 #define SCENE_CONFIG    SC_7_spheres__fov_40__cam_z_15_downwards
 
+// Parameters of the SC_gen_* and SC_file scene configurations.
+#define SCENE_GEN_COUNT     1000
+#define SCENE_GEN_SEED      1
+#define SCENE_FILE_PATH     "scene.txt"
+
 
 typedef enum {
     SK_none,                                // No predefined sky.
@@ -77,9 +126,173 @@ typedef enum {
 struct Scene_s {
     Sphere         *spheres;
     uint32_t        spheresLength;
+    uint32_t        spheresCapacity;
+
+    // The index of the first sphere loaded from a scene file (see scene_file_load()). The spheres before it are not a part of the file
+    // and are not changed by scene_file_reload().
+    uint32_t        fileSpheresFirst;
+
+    // The planar primitives (planes, disks, rectangles, see plane.h), e.g. the ground. A ray hits the closest primitive, be it a sphere
+    // or a plane.
+    Plane          *planes;
+    uint32_t        planesLength;
+    uint32_t        planesCapacity;
+
+    // The index of the first plane loaded from a scene file (like fileSpheresFirst).
+    uint32_t        filePlanesFirst;
+
+    // The triangle meshes (see mesh.h). The scene owns their geometry (see scene_add_mesh()).
+    Mesh           *meshes;
+    uint32_t        meshesLength;
+    uint32_t        meshesCapacity;
+
+    // The index of the first mesh loaded from a scene file (like fileSpheresFirst).
+    uint32_t        fileMeshesFirst;
+
+    // How the closest sphere is found. With SA_grid, sphereGrid is rebuilt (by scene_build_sphere_accel()) when sphereGridDirty is set
+    // (when spheres are added or changed), with SA_wide_bvh - sphereBVH, when sphereBVHDirty is set, or refitted when only
+    // sphereBVHMoved is set (see scene_spheres_moved()).
+    SphereAccel     sphereAccel;
+    SphereGrid      sphereGrid;
+    bool            sphereGridDirty;
+    WideBVH         sphereBVH;
+    bool            sphereBVHDirty;
+    bool            sphereBVHMoved;
+
+    // The shared sub-assemblies (clusters of spheres, meshes) and their instances (see instance.h). The scene owns the geometry of the
+    // prototypes (see scene_add_prototype()).
+    Prototype      *prototypes;
+    uint32_t        prototypesLength;
+    uint32_t        prototypesCapacity;
+    Instance       *instances;
+    uint32_t        instancesLength;
+    uint32_t        instancesCapacity;
+
+    // The top-level BVH over the instances. Its leaves refer to instancesBVHOrder, which maps them to the indexes of Scene.instances.
+    // It is rebuilt (by scene_build_instances_bvh()) when instancesBVHDirty is set (when instances are added).
+    BVH             instancesBVH;
+    uint32_t       *instancesBVHOrder;
+    bool            instancesBVHDirty;
+
+    // The out-of-core spheres (see sphere_chunks.h), in addition to `spheres`: NULL if the scene has none. The scene owns them (see
+    // scene_set_sphere_chunks()).
+    SphereChunks   *sphereChunks;
+
+    // The light of the rays that don't hit anything.
+    Sky             sky;
 };
 
 
-void init_scene(Scene *scene);
+// A canonical benchmark scene: a built-in scene configuration, with the camera that it is meant to be viewed with (see benchScenes).
+struct BenchScene_s {
+    const char     *name;
+    SceneConfig     scene;
+    CameraConfig    camera;
+};
+
+// The canonical benchmark scenes (used by the benchmarking tools, see src/tools/).
+extern const BenchScene benchScenes[];
+extern const uint32_t benchScenesCount;
+
+
+/**
+ * Initializes `scene` as the pre-defined scene `sc` and sky `sk` (the interactive mode uses SCENE_CONFIG and SKY_CONFIG).
+ */
+void init_scene(Scene *scene, SceneConfig sc, SkyConfig sk);
+
+/**
+ * Sets `camCenterRay` to the camera origin and (unit) direction of the pre-defined camera configuration `cc` (the interactive mode uses
+ * CAMERA_CONFIG). The ray can be passed to cam_set().
+ */
+void init_camera_ray(CameraConfig cc, Ray *camCenterRay);
+
+/**
+ * Returns the benchmark scene (see benchScenes) called `name`, or NULL if there is no such scene.
+ */
+const BenchScene * bench_scene_find(const char *name);
+
+/**
+ * Initializes `scene` as an empty scene (without any spheres, planes or meshes).
+ */
+void scene_init_empty(Scene *scene);
+
+/**
+ * Adds a copy of `sphere` to the `scene`.
+ */
+void scene_add_sphere(Scene *scene, Sphere *sphere);
+
+/**
+ * Adds a copy of `plane` to the `scene`.
+ */
+void scene_add_plane(Scene *scene, Plane *plane);
+
+/**
+ * Adds `mesh` to the `scene`, which takes over its geometry (it is freed by scene_free(), `mesh` must not be freed by the caller).
+ */
+void scene_add_mesh(Scene *scene, Mesh *mesh);
+
+/**
+ * Adds `prototype` to the `scene` (building its BVH, see prototype_build()), which takes over its geometry (it is freed by scene_free(),
+ * `prototype` must not be freed by the caller). Returns its index, to be passed to scene_add_instance().
+ */
+uint32_t scene_add_prototype(Scene *scene, Prototype *prototype);
+
+/**
+ * Adds an instance of the prototype with the index `prototype` (see scene_add_prototype()) to the `scene`, placed into the world by the
+ * (object to world) transform `objectToWorld`. Returns false if the transform is not invertible (the instance is not added).
+ */
+bool scene_add_instance(Scene *scene, uint32_t prototype, Transform *objectToWorld);
+
+/**
+ * Rebuilds the top-level BVH of the instances of the `scene`, if instances were added since it was last built. Must be called before
+ * tracing rays (render_frame_img() calls it).
+ */
+void scene_build_instances_bvh(Scene *scene);
+
+/**
+ * Rebuilds (or refits) the grid or the wide BVH over the spheres of the `scene` (using the threads of `workers`, if not NULL), if it uses
+ * one (see Scene.sphereAccel) and its spheres changed since it was last built. Must be called before tracing rays (render_frame_img()
+ * calls it).
+ */
+void scene_build_sphere_accel(Scene *scene, WorkerPool *workers);
+
+/**
+ * Marks the centers and/or radiuses of the spheres of the `scene` as changed (but not their amount or order), e.g. after moving them for
+ * the next frame of an animation: the next scene_build_sphere_accel() refits the wide BVH (see wide_bvh_refit()), instead of rebuilding
+ * it.
+ */
+void scene_spheres_moved(Scene *scene);
+
+/**
+ * Opens the chunk file at `path` (see sphere_chunks_open()) as the out-of-core spheres of the `scene` (replacing the previous ones, if
+ * any), with a cache of at most `cacheBytes` of chunks. Returns false (and logs the error) if the file could not be opened.
+ */
+bool scene_set_sphere_chunks(Scene *scene, const char *path, uint64_t cacheBytes);
+
+/**
+ * Returns the name of `accel` (e.g. "grid"), as used by scene files and the benchmarks.
+ */
+const char * sphere_accel_name(SphereAccel accel);
+
+/**
+ * Finds a sphere acceleration method by its `name` (see sphere_accel_name()). Returns false if there is no such method.
+ */
+bool sphere_accel_by_name(const char *name, SphereAccel *accel);
+
+/**
+ * Adds the standard ground (a matte plane, slightly tilted towards the camera of the pre-defined scenes) to the `scene`.
+ */
+void scene_add_ground(Scene *scene);
+
+/**
+ * Returns the height (z) of the standard ground (see scene_add_ground()) at [x, y].
+ */
+double scene_ground_z(double x, double y);
+
+/**
+ * Frees the memory allocated by the `scene` itself, the geometry of its meshes and prototypes and its out-of-core spheres (but not the
+ * material data of its spheres, planes, meshes and prototypes, which may be shared between scenes).
+ */
+void scene_free(Scene *scene);
 
 #endif // __SCENE_H__
@@ -0,0 +1,789 @@
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "rtalloc.h"
+#include "rtcommon.h"
+#include "scene_file.h"
+#include "materials/dielectric.h"
+#include "materials/light.h"
+#include "materials/metal.h"
+
+
+#define SCENE_FILE_LINE_MAX             512
+#define SCENE_FILE_MATDATA_CACHE_SIZE   1024        // The initial capacity of the material data cache (must be a power of 2).
+
+
+typedef struct SceneFileMaterial_s  SceneFileMaterial;
+typedef struct MatDataCache_s       MatDataCache;
+typedef struct MatDataCacheEntry_s  MatDataCacheEntry;
+
+struct SceneFileMaterial_s {
+    const char     *name;
+    Material       *material;
+    uint32_t        paramsCount;        // The amount of material parameters (after the color).
+};
+
+// A hash table of the material data created while loading a file, keyed by the material and its parameters, so that spheres with the same
+// material parameters share the same material data.
+struct MatDataCacheEntry_s {
+    Material       *material;           // NULL if the entry is empty.
+    double          params[3];
+    void           *matData;
+};
+
+struct MatDataCache_s {
+    MatDataCacheEntry  *entries;
+    uint32_t            length;
+    uint32_t            capacity;
+};
+
+
+static const SceneFileMaterial sceneFileMaterials[] = {
+    {.name = "matte",           .material = &matMatte,          .paramsCount = 0},
+    {.name = "metal",           .material = &matMetal,          .paramsCount = 1},
+    {.name = "dielectric",      .material = &matDielectric,     .paramsCount = 1},
+    {.name = "light",           .material = &matLight,          .paramsCount = 3},
+    {.name = "gradient_sky",    .material = &matGradientSky,    .paramsCount = 0},
+    {.name = "ground",          .material = &matGround,         .paramsCount = 0},
+    {.name = "shaded",          .material = &matShaded,         .paramsCount = 0},
+};
+
+#define SCENE_FILE_MATERIALS_COUNT  (sizeof(sceneFileMaterials) / sizeof(sceneFileMaterials[0]))
+
+
+static bool sphere_geometry_equal(Sphere *a, Sphere *b);
+static bool sphere_material_equal(Sphere *a, Sphere *b);
+static bool plane_equal(Plane *a, Plane *b);
+static bool mesh_equal(Mesh *a, Mesh *b);
+static inline bool vector3_equal(Vector3 *a, Vector3 *b);
+static uint32_t collect_matdata(Scene *scene, void **ptrs);
+static uint32_t sort_unique_ptrs(void **ptrs, uint32_t length);
+static int ptr_cmp(const void *a, const void *b);
+static bool parse_sphere(char *line, Sphere *sphere, MatDataCache *cache);
+static bool parse_plane(char *line, Plane *plane, MatDataCache *cache);
+static bool parse_mesh(char *line, Mesh *mesh, MatDataCache *cache);
+static bool parse_accel(char *line, SphereAccel *accel);
+static bool parse_chunks(char *line, char *chunksPath, uint64_t *cacheBytes);
+static bool sphere_chunks_equal(SphereChunks *a, SphereChunks *b);
+static bool parse_material(char *p, Sphere *materialTemplate, MatDataCache *cache);
+static bool write_material(FILE *f, Material *material, void *matData, Color *color);
+static void * matdata_get(MatDataCache *cache, Material *material, double *params);
+static void * matdata_create(Material *material, double *params);
+static inline uint32_t matdata_hash(Material *material, double *params);
+static void matdata_cache_insert(MatDataCache *cache, Material *material, double *params, void *matData);
+
+
+bool scene_file_load(Scene *scene, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        log_err("Could not open scene file \"%s\": %s\n", path, strerror(errno));
+        return false;
+    }
+
+    MatDataCache cache = {
+        .entries    = calloc(SCENE_FILE_MATDATA_CACHE_SIZE, sizeof(MatDataCacheEntry)),
+        .length     = 0,
+        .capacity   = SCENE_FILE_MATDATA_CACHE_SIZE,
+    };
+    if (cache.entries == NULL) {
+        log_err("Error: could not allocate heap memory. Exiting.");
+        exit(1);
+    }
+
+    scene->fileSpheresFirst = scene->spheresLength;
+    scene->filePlanesFirst = scene->planesLength;
+    scene->fileMeshesFirst = scene->meshesLength;
+
+    bool ok = true;
+    char line[SCENE_FILE_LINE_MAX];
+    for (uint32_t lineNum = 1; fgets(line, sizeof(line), f) != NULL; lineNum++) {
+        if (strchr(line, '\n') == NULL && ! feof(f)) {
+            log_err("%s:%u: line is too long (max %d characters)\n", path, lineNum, SCENE_FILE_LINE_MAX - 2);
+            ok = false;
+            break;
+        }
+
+        char *p = line + strspn(line, " \t\r\n");
+        if (*p == '\0' || *p == '#') {
+            continue;
+        }
+
+        if (strncmp(p, "sphere", 6) == 0) {
+            Sphere sphere;
+            if (! parse_sphere(p, &sphere, &cache)) {
+                log_err("%s:%u: invalid sphere definition: %s\n", path, lineNum, p);
+                ok = false;
+                break;
+            }
+            scene_add_sphere(scene, &sphere);
+        } else if (strncmp(p, "accel", 5) == 0) {
+            if (! parse_accel(p, &scene->sphereAccel)) {
+                log_err("%s:%u: invalid accel definition: %s\n", path, lineNum, p);
+                ok = false;
+                break;
+            }
+        } else if (strncmp(p, "chunks", 6) == 0) {
+            char chunksPath[SCENE_FILE_LINE_MAX];
+            uint64_t cacheBytes;
+            if (! parse_chunks(p, chunksPath, &cacheBytes)) {
+                log_err("%s:%u: invalid chunks definition: %s\n", path, lineNum, p);
+                ok = false;
+                break;
+            }
+            if (! scene_set_sphere_chunks(scene, chunksPath, cacheBytes)) {
+                ok = false;
+                break;
+            }
+        } else if (strncmp(p, "mesh", 4) == 0) {
+            Mesh mesh;
+            if (! parse_mesh(p, &mesh, &cache)) {
+                log_err("%s:%u: invalid mesh definition: %s\n", path, lineNum, p);
+                ok = false;
+                break;
+            }
+            scene_add_mesh(scene, &mesh);
+        } else {
+            Plane plane;
+            if (! parse_plane(p, &plane, &cache)) {
+                log_err("%s:%u: invalid plane definition: %s\n", path, lineNum, p);
+                ok = false;
+                break;
+            }
+            scene_add_plane(scene, &plane);
+        }
+    }
+
+    if (ok && ferror(f)) {
+        log_err("Could not read scene file \"%s\": %s\n", path, strerror(errno));
+        ok = false;
+    }
+
+    rtfree(cache.entries);
+    fclose(f);
+    return ok;
+}
+
+bool scene_file_reload(Scene *scene, const char *path, SceneFileReloadStats *stats)
+{
+    memset(stats, 0, sizeof(SceneFileReloadStats));
+
+    Scene loaded;
+    scene_init_empty(&loaded);
+    bool ok = scene_file_load(&loaded, path);
+
+    // All material data that may become unused: of the current scene file spheres (and planes, meshes) and of the loaded ones.
+    void **oldPtrs = rtalloc(sizeof(void *) * ((size_t)scene->spheresLength + loaded.spheresLength + scene->planesLength
+        + loaded.planesLength + scene->meshesLength + loaded.meshesLength + 1));
+    uint32_t oldPtrsLength = collect_matdata(scene, oldPtrs);
+    oldPtrsLength += collect_matdata(&loaded, &oldPtrs[oldPtrsLength]);
+    oldPtrsLength = sort_unique_ptrs(oldPtrs, oldPtrsLength);
+
+    if (ok) {
+        uint32_t first = scene->fileSpheresFirst;
+        Sphere *live = &scene->spheres[first];
+        Sphere *next = loaded.spheres;
+        uint32_t liveLength = scene->spheresLength - first;
+        uint32_t nextLength = loaded.spheresLength;
+
+        // Skip the unchanged spheres at the start and at the end.
+        uint32_t prefix = 0;
+        while (prefix < liveLength && prefix < nextLength && sphere_geometry_equal(&live[prefix], &next[prefix])
+            && sphere_material_equal(&live[prefix], &next[prefix])) {
+            prefix++;
+        }
+        uint32_t suffix = 0;
+        while (suffix < liveLength - prefix && suffix < nextLength - prefix
+            && sphere_geometry_equal(&live[liveLength - 1 - suffix], &next[nextLength - 1 - suffix])
+            && sphere_material_equal(&live[liveLength - 1 - suffix], &next[nextLength - 1 - suffix])) {
+            suffix++;
+        }
+
+        uint32_t liveMid = liveLength - prefix - suffix;
+        uint32_t nextMid = nextLength - prefix - suffix;
+        uint32_t paired = liveMid < nextMid ? liveMid : nextMid;
+
+        // Spheres in the changed range are paired up by their position.
+        for (uint32_t i = prefix; i < prefix + paired; i++) {
+            if (! sphere_geometry_equal(&live[i], &next[i])) {
+                stats->moved++;
+                live[i].center = next[i].center;
+                live[i].radius = next[i].radius;
+            }
+            if (! sphere_material_equal(&live[i], &next[i])) {
+                stats->materialsEdited++;
+                live[i].material    = next[i].material;
+                live[i].matData     = next[i].matData;
+                live[i].color       = next[i].color;
+            }
+        }
+
+        // Spheres added/removed in the changed range: shift the unchanged spheres at the end and copy the added ones.
+        if (nextMid > liveMid) {
+            stats->added = nextMid - liveMid;
+            while (scene->spheresCapacity < first + nextLength) {
+                scene->spheresCapacity *= 2;
+            }
+            scene->spheres = rtrealloc(scene->spheres, sizeof(Sphere) * scene->spheresCapacity);
+            live = &scene->spheres[first];
+        } else {
+            stats->removed = liveMid - nextMid;
+        }
+        memmove(&live[prefix + nextMid], &live[prefix + liveMid], sizeof(Sphere) * suffix);
+        memcpy(&live[prefix + paired], &next[prefix + paired], sizeof(Sphere) * (nextMid - paired));
+        scene->spheresLength = first + nextLength;
+
+        stats->firstChanged = first + prefix;
+        stats->lastChanged  = first + prefix + nextMid;
+        if (stats->added > 0 || stats->removed > 0) {
+            scene->sphereGridDirty = true;
+            scene->sphereBVHDirty = true;
+        } else if (stats->moved > 0) {
+            scene_spheres_moved(scene);
+        }
+        scene->sphereAccel = loaded.sphereAccel;
+
+        // There are only a few planes, so if any of them changed - all of the scene file planes are replaced.
+        uint32_t firstPlane = scene->filePlanesFirst;
+        uint32_t livePlanes = scene->planesLength - firstPlane;
+        uint32_t nextPlanes = loaded.planesLength;
+        for (uint32_t i = 0; i < livePlanes || i < nextPlanes; i++) {
+            if (i >= livePlanes || i >= nextPlanes || ! plane_equal(&scene->planes[firstPlane + i], &loaded.planes[i])) {
+                stats->planesChanged++;
+            }
+        }
+        if (stats->planesChanged > 0) {
+            scene->planesLength = firstPlane;
+            for (uint32_t i = 0; i < nextPlanes; i++) {
+                scene_add_plane(scene, &loaded.planes[i]);
+            }
+        }
+
+        // Meshes are replaced the same way (their OBJ files have been loaded again anyway). The scene takes over the loaded meshes.
+        uint32_t firstMesh = scene->fileMeshesFirst;
+        uint32_t liveMeshes = scene->meshesLength - firstMesh;
+        uint32_t nextMeshes = loaded.meshesLength;
+        for (uint32_t i = 0; i < liveMeshes || i < nextMeshes; i++) {
+            if (i >= liveMeshes || i >= nextMeshes || ! mesh_equal(&scene->meshes[firstMesh + i], &loaded.meshes[i])) {
+                stats->meshesChanged++;
+            }
+        }
+        if (stats->meshesChanged > 0) {
+            for (uint32_t i = firstMesh; i < scene->meshesLength; i++) {
+                mesh_free(&scene->meshes[i]);
+            }
+            scene->meshesLength = firstMesh;
+            for (uint32_t i = 0; i < nextMeshes; i++) {
+                scene_add_mesh(scene, &loaded.meshes[i]);
+            }
+            loaded.meshesLength = 0;
+        }
+
+        // The out-of-core spheres are replaced if their chunk file or cache size changed (otherwise the cache of the loaded chunks is
+        // kept). Changes of the contents of the chunk file itself are not detected.
+        if (! sphere_chunks_equal(scene->sphereChunks, loaded.sphereChunks)) {
+            stats->chunksChanged = 1;
+            SphereChunks *chunks = scene->sphereChunks;
+            scene->sphereChunks = loaded.sphereChunks;
+            loaded.sphereChunks = chunks;
+        }
+    }
+
+    // Free the material data that is no longer used by the scene (all of the loaded material data, if loading failed).
+    void **usedPtrs = rtalloc(sizeof(void *) * ((size_t)scene->spheresLength + scene->planesLength + scene->meshesLength + 1));
+    uint32_t usedPtrsLength = sort_unique_ptrs(usedPtrs, collect_matdata(scene, usedPtrs));
+    for (uint32_t i = 0; i < oldPtrsLength; i++) {
+        if (bsearch(&oldPtrs[i], usedPtrs, usedPtrsLength, sizeof(void *), ptr_cmp) == NULL) {
+            rtfree(oldPtrs[i]);
+        }
+    }
+
+    rtfree(usedPtrs);
+    rtfree(oldPtrs);
+    scene_free(&loaded);
+    return ok;
+}
+
+bool scene_file_save(Scene *scene, const char *path)
+{
+    if (scene->instancesLength > 0) {
+        log_err("Could not save scene file \"%s\": the scene has instances, which scene files don't support\n", path);
+        return false;
+    }
+
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        log_err("Could not open scene file \"%s\" for writing: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    fprintf(f, "# toyraytracer scene: %u spheres, %u planes, %u meshes\n", scene->spheresLength, scene->planesLength, scene->meshesLength);
+    fprintf(f, "# sphere <x> <y> <z> <radius> <material> <red> <green> <blue> [material parameters]\n");
+    if (scene->sphereAccel != SA_linear) {
+        fprintf(f, "accel %s\n", sphere_accel_name(scene->sphereAccel));
+    }
+
+    bool ok = true;
+    SphereChunks *chunks = scene->sphereChunks;
+    if (chunks != NULL) {
+        if (chunks->path[strcspn(chunks->path, " \t\r\n")] != '\0') {
+            log_err("Could not save scene file \"%s\": the path of the chunk file \"%s\" has spaces\n", path, chunks->path);
+            ok = false;
+        }
+        fprintf(f, "chunks %s %.17g\n", chunks->path, chunks->cacheBytes / 1048576.0);
+    }
+    for (uint32_t i = 0; i < scene->spheresLength && ok; i++) {
+        Sphere *s = &scene->spheres[i];
+        fprintf(f, "sphere %.17g %.17g %.17g %.17g", s->center.x, s->center.y, s->center.z, s->radius);
+        if (! write_material(f, s->material, s->matData, &s->color)) {
+            log_err("Could not save scene file \"%s\": sphere %u has an unknown material\n", path, i);
+            ok = false;
+        }
+    }
+
+    for (uint32_t i = 0; i < scene->planesLength && ok; i++) {
+        Plane *pl = &scene->planes[i];
+        Vector3 point = pl->normal;
+        switch (pl->type) {
+            case PLT_plane:
+                // The point of the plane that is the closest to [0, 0, 0] (adding 0.0 turns -0 into 0).
+                vector3_multiply_length(&point, pl->offset);
+                fprintf(f, "plane %.17g %.17g %.17g %.17g %.17g %.17g", point.x + 0.0, point.y + 0.0, point.z + 0.0, pl->normal.x,
+                    pl->normal.y, pl->normal.z);
+                break;
+            case PLT_disk:
+                fprintf(f, "disk %.17g %.17g %.17g %.17g %.17g %.17g %.17g", pl->center.x, pl->center.y, pl->center.z, pl->normal.x,
+                    pl->normal.y, pl->normal.z, sqrt(pl->radiusSquared));
+                break;
+            case PLT_rect:
+                // The bounds are infinite along the normal axis, where the rectangle is at `offset`.
+                fprintf(f, "rect %.17g %.17g %.17g %.17g %.17g %.17g", isinf(pl->min.x) ? pl->offset : pl->min.x,
+                    isinf(pl->min.y) ? pl->offset : pl->min.y, isinf(pl->min.z) ? pl->offset : pl->min.z,
+                    isinf(pl->max.x) ? pl->offset : pl->max.x, isinf(pl->max.y) ? pl->offset : pl->max.y,
+                    isinf(pl->max.z) ? pl->offset : pl->max.z);
+                break;
+        }
+        if (! write_material(f, pl->material, pl->matData, &pl->color)) {
+            log_err("Could not save scene file \"%s\": plane %u has an unknown material\n", path, i);
+            ok = false;
+        }
+    }
+
+    for (uint32_t i = 0; i < scene->meshesLength && ok; i++) {
+        Mesh *m = &scene->meshes[i];
+        if (m->path == NULL || m->path[strcspn(m->path, " \t\r\n")] != '\0') {
+            log_err("Could not save scene file \"%s\": mesh %u was not loaded from an OBJ file (with no spaces in its path)\n", path, i);
+            ok = false;
+            break;
+        }
+        fprintf(f, "mesh %s", m->path);
+        if (! write_material(f, m->material, m->matData, &m->color)) {
+            log_err("Could not save scene file \"%s\": mesh %u has an unknown material\n", path, i);
+            ok = false;
+        }
+    }
+
+    bool written = ! ferror(f);
+    if (fclose(f) != 0 || ! written || ! ok) {
+        if (ok) {
+            log_err("Could not write scene file \"%s\": %s\n", path, strerror(errno));
+        }
+        return false;
+    }
+    return true;
+}
+
+static bool sphere_geometry_equal(Sphere *a, Sphere *b)
+{
+    return a->center.x == b->center.x && a->center.y == b->center.y && a->center.z == b->center.z && a->radius == b->radius;
+}
+
+static bool sphere_material_equal(Sphere *a, Sphere *b)
+{
+    if (a->material != b->material || a->color.red != b->color.red || a->color.green != b->color.green || a->color.blue != b->color.blue) {
+        return false;
+    }
+
+    if (a->matData == b->matData) {
+        return true;
+    } else if (a->material == &matMetal) {
+        return ((MaterialDataMetal *)a->matData)->fuzziness == ((MaterialDataMetal *)b->matData)->fuzziness;
+    } else if (a->material == &matDielectric) {
+        return ((MaterialDataDielectric *)a->matData)->refractionIndex == ((MaterialDataDielectric *)b->matData)->refractionIndex;
+    } else if (a->material == &matLight) {
+        Color *ca = &((MaterialDataLight *)a->matData)->color;
+        Color *cb = &((MaterialDataLight *)b->matData)->color;
+        return ca->red == cb->red && ca->green == cb->green && ca->blue == cb->blue;
+    }
+    return false;
+}
+
+static bool plane_equal(Plane *a, Plane *b)
+{
+    if (a->type != b->type || ! vector3_equal(&a->normal, &b->normal) || a->offset != b->offset) {
+        return false;
+    }
+    if ((a->type == PLT_disk && (! vector3_equal(&a->center, &b->center) || a->radiusSquared != b->radiusSquared))
+        || (a->type == PLT_rect && (! vector3_equal(&a->min, &b->min) || ! vector3_equal(&a->max, &b->max)))) {
+        return false;
+    }
+
+    Sphere ma = {.material = a->material, .matData = a->matData, .color = a->color};
+    Sphere mb = {.material = b->material, .matData = b->matData, .color = b->color};
+    return sphere_material_equal(&ma, &mb);
+}
+
+/**
+ * Meshes are equal if they were loaded from the same OBJ file, with the same material.
+ */
+static bool mesh_equal(Mesh *a, Mesh *b)
+{
+    if (a->path == NULL || b->path == NULL || strcmp(a->path, b->path) != 0) {
+        return false;
+    }
+
+    Sphere ma = {.material = a->material, .matData = a->matData, .color = a->color};
+    Sphere mb = {.material = b->material, .matData = b->matData, .color = b->color};
+    return sphere_material_equal(&ma, &mb);
+}
+
+static inline bool vector3_equal(Vector3 *a, Vector3 *b)
+{
+    return a->x == b->x && a->y == b->y && a->z == b->z;
+}
+
+/**
+ * Stores the (non-NULL) material data pointers of the scene file spheres, planes and meshes of `scene` in `ptrs` (may contain duplicates).
+ * Returns their amount.
+ */
+static uint32_t collect_matdata(Scene *scene, void **ptrs)
+{
+    uint32_t length = 0;
+    for (uint32_t i = scene->fileSpheresFirst; i < scene->spheresLength; i++) {
+        if (scene->spheres[i].matData != NULL) {
+            ptrs[length++] = scene->spheres[i].matData;
+        }
+    }
+    for (uint32_t i = scene->filePlanesFirst; i < scene->planesLength; i++) {
+        if (scene->planes[i].matData != NULL) {
+            ptrs[length++] = scene->planes[i].matData;
+        }
+    }
+    for (uint32_t i = scene->fileMeshesFirst; i < scene->meshesLength; i++) {
+        if (scene->meshes[i].matData != NULL) {
+            ptrs[length++] = scene->meshes[i].matData;
+        }
+    }
+    return length;
+}
+
+/**
+ * Sorts `ptrs` and removes duplicates. Returns the new length.
+ */
+static uint32_t sort_unique_ptrs(void **ptrs, uint32_t length)
+{
+    if (length == 0) {
+        return 0;
+    }
+
+    qsort(ptrs, length, sizeof(void *), ptr_cmp);
+    uint32_t unique = 1;
+    for (uint32_t i = 1; i < length; i++) {
+        if (ptrs[i] != ptrs[unique - 1]) {
+            ptrs[unique++] = ptrs[i];
+        }
+    }
+    return unique;
+}
+
+static int ptr_cmp(const void *a, const void *b)
+{
+    uintptr_t pa = (uintptr_t)*(void * const *)a;
+    uintptr_t pb = (uintptr_t)*(void * const *)b;
+    return (pa > pb) - (pa < pb);
+}
+
+/**
+ * Parses a "sphere ..." scene file `line` into `sphere`. Returns false if the line is invalid.
+ */
+static bool parse_sphere(char *line, Sphere *sphere, MatDataCache *cache)
+{
+    int consumed = 0;
+    int n = sscanf(line, "sphere %lf %lf %lf %lf%n", &sphere->center.x, &sphere->center.y, &sphere->center.z, &sphere->radius, &consumed);
+    if (n != 4 || consumed == 0 || ! (sphere->radius > 0)) {
+        return false;
+    }
+    return parse_material(line + consumed, sphere, cache);
+}
+
+/**
+ * Parses a "plane ...", "disk ..." or "rect ..." scene file `line` into `plane`. Returns false if the line is invalid.
+ */
+static bool parse_plane(char *line, Plane *plane, MatDataCache *cache)
+{
+    Vector3 a, b;
+    double radius;
+    int consumed = 0;
+    if (sscanf(line, "plane %lf %lf %lf %lf %lf %lf%n", &a.x, &a.y, &a.z, &b.x, &b.y, &b.z, &consumed) == 6 && consumed > 0) {
+        if (! (vector3_length(&b) > 0)) {
+            return false;
+        }
+        plane_init(plane, &a, &b);
+    } else if (sscanf(line, "disk %lf %lf %lf %lf %lf %lf %lf%n", &a.x, &a.y, &a.z, &b.x, &b.y, &b.z, &radius, &consumed) == 7
+        && consumed > 0) {
+        if (! (vector3_length(&b) > 0) || ! (radius > 0)) {
+            return false;
+        }
+        plane_disk_init(plane, &a, &b, radius);
+    } else if (sscanf(line, "rect %lf %lf %lf %lf %lf %lf%n", &a.x, &a.y, &a.z, &b.x, &b.y, &b.z, &consumed) == 6 && consumed > 0) {
+        if (plane_rect_init(plane, &a, &b) == NULL) {
+            return false;
+        }
+    } else {
+        return false;
+    }
+
+    Sphere materialTemplate;
+    if (! parse_material(line + consumed, &materialTemplate, cache)) {
+        return false;
+    }
+    plane_set_material(plane, &materialTemplate);
+    return true;
+}
+
+/**
+ * Parses a "mesh ..." scene file `line` into `mesh` (loading its OBJ file). Returns false if the line (or the OBJ file) is invalid.
+ */
+static bool parse_mesh(char *line, Mesh *mesh, MatDataCache *cache)
+{
+    char path[SCENE_FILE_LINE_MAX];
+    int consumed = 0;
+    if (sscanf(line, "mesh %s%n", path, &consumed) != 1 || consumed == 0) {
+        return false;
+    }
+
+    // Parse the material first, so that an invalid line doesn't load the OBJ file.
+    Sphere materialTemplate;
+    if (! parse_material(line + consumed, &materialTemplate, cache)) {
+        return false;
+    }
+
+    mesh_init(mesh);
+    if (! mesh_load_obj(mesh, path)) {
+        mesh_free(mesh);
+        return false;
+    }
+    mesh_set_material(mesh, &materialTemplate);
+    return true;
+}
+
+/**
+ * Parses an "accel <name>" scene file line into `accel`. Returns false if it is invalid.
+ */
+static bool parse_accel(char *line, SphereAccel *accel)
+{
+    char name[32];
+    int consumed = 0;
+    if (sscanf(line, "accel %31s%n", name, &consumed) != 1 || line[consumed + strspn(line + consumed, " \t\r\n")] != '\0') {
+        return false;
+    }
+    return sphere_accel_by_name(name, accel);
+}
+
+/**
+ * Parses a "chunks <path> <cache MiB>" scene file line into `chunksPath` (of at least SCENE_FILE_LINE_MAX characters) and `cacheBytes`.
+ * Returns false if it is invalid.
+ */
+static bool parse_chunks(char *line, char *chunksPath, uint64_t *cacheBytes)
+{
+    double cacheMiB;
+    int consumed = 0;
+    if (sscanf(line, "chunks %s %lf%n", chunksPath, &cacheMiB, &consumed) != 2
+        || line[consumed + strspn(line + consumed, " \t\r\n")] != '\0' || ! (cacheMiB > 0 && cacheMiB < 1e12)) {
+        return false;
+    }
+    *cacheBytes = (uint64_t)(cacheMiB * 1048576.0);
+    return true;
+}
+
+/**
+ * Returns true if `a` and `b` are both NULL or are the same chunk file with the same cache size.
+ */
+static bool sphere_chunks_equal(SphereChunks *a, SphereChunks *b)
+{
+    if (a == NULL || b == NULL) {
+        return a == b;
+    }
+    return strcmp(a->path, b->path) == 0 && a->cacheBytes == b->cacheBytes;
+}
+
+/**
+ * Parses the "<material> <red> <green> <blue> [material parameters]" part of a scene file line at `p` into (the material, matData and
+ * color of) `materialTemplate`. Returns false if it is invalid.
+ */
+static bool parse_material(char *p, Sphere *materialTemplate, MatDataCache *cache)
+{
+    char matName[32];
+    int consumed = 0;
+    int n = sscanf(p, " %31s %lf %lf %lf%n", matName, &materialTemplate->color.red, &materialTemplate->color.green,
+        &materialTemplate->color.blue, &consumed);
+    if (n != 4 || ! isspace((unsigned char)*p)) {
+        return false;
+    }
+
+    const SceneFileMaterial *sfm = NULL;
+    for (uint32_t m = 0; m < SCENE_FILE_MATERIALS_COUNT; m++) {
+        if (strcmp(sceneFileMaterials[m].name, matName) == 0) {
+            sfm = &sceneFileMaterials[m];
+            break;
+        }
+    }
+    if (sfm == NULL) {
+        return false;
+    }
+
+    double params[3] = {0, 0, 0};
+    p += consumed;
+    for (uint32_t i = 0; i < sfm->paramsCount; i++) {
+        char *end;
+        params[i] = strtod(p, &end);
+        if (end == p) {
+            return false;
+        }
+        p = end;
+    }
+    if (p[strspn(p, " \t\r\n")] != '\0') {
+        return false;                       // Trailing garbage.
+    }
+
+    if (sfm->material == &matMetal && ! (params[0] >= 0)) {
+        return false;
+    }
+    if (sfm->material == &matDielectric && ! (params[0] > 0)) {
+        return false;
+    }
+
+    materialTemplate->material = sfm->material;
+    materialTemplate->matData = sfm->paramsCount > 0 ? matdata_get(cache, sfm->material, params) : NULL;
+    return true;
+}
+
+/**
+ * Writes the " <material> <red> <green> <blue> [material parameters]" part of a scene file line (and the line end) into `f`. Returns false
+ * (and writes nothing) if the material is not supported by scene files.
+ */
+static bool write_material(FILE *f, Material *material, void *matData, Color *color)
+{
+    const SceneFileMaterial *sfm = NULL;
+    for (uint32_t m = 0; m < SCENE_FILE_MATERIALS_COUNT; m++) {
+        if (sceneFileMaterials[m].material == material) {
+            sfm = &sceneFileMaterials[m];
+            break;
+        }
+    }
+    if (sfm == NULL) {
+        return false;
+    }
+
+    fprintf(f, " %s %.17g %.17g %.17g", sfm->name, color->red, color->green, color->blue);
+
+    if (material == &matMetal) {
+        fprintf(f, " %.17g", ((MaterialDataMetal *)matData)->fuzziness);
+    } else if (material == &matDielectric) {
+        fprintf(f, " %.17g", ((MaterialDataDielectric *)matData)->refractionIndex);
+    } else if (material == &matLight) {
+        Color *c = &((MaterialDataLight *)matData)->color;
+        fprintf(f, " %.17g %.17g %.17g", c->red, c->green, c->blue);
+    }
+
+    fputc('\n', f);
+    return true;
+}
+
+/**
+ * Returns the (shared) material data of `material` with `params`, creating it if it does not exist yet.
+ */
+static void * matdata_get(MatDataCache *cache, Material *material, double *params)
+{
+    uint32_t mask = cache->capacity - 1;
+    for (uint32_t i = matdata_hash(material, params) & mask; ; i = (i + 1) & mask) {
+        MatDataCacheEntry *e = &cache->entries[i];
+        if (e->material == NULL) {
+            break;
+        }
+        if (e->material == material && memcmp(e->params, params, sizeof(e->params)) == 0) {
+            return e->matData;
+        }
+    }
+
+    void *matData = matdata_create(material, params);
+
+    // Keep the load factor <= 1/2.
+    if ((cache->length + 1) * 2 > cache->capacity) {
+        MatDataCache grown = {
+            .entries    = calloc(cache->capacity * 2, sizeof(MatDataCacheEntry)),
+            .length     = 0,
+            .capacity   = cache->capacity * 2,
+        };
+        if (grown.entries == NULL) {
+            log_err("Error: could not allocate heap memory. Exiting.");
+            exit(1);
+        }
+        for (uint32_t i = 0; i < cache->capacity; i++) {
+            MatDataCacheEntry *e = &cache->entries[i];
+            if (e->material != NULL) {
+                matdata_cache_insert(&grown, e->material, e->params, e->matData);
+            }
+        }
+        rtfree(cache->entries);
+        *cache = grown;
+    }
+    matdata_cache_insert(cache, material, params, matData);
+
+    return matData;
+}
+
+static void * matdata_create(Material *material, double *params)
+{
+    Sphere tmp;
+    if (material == &matMetal) {
+        return sphere_metal_init(&tmp, params[0])->matData;
+    } else if (material == &matDielectric) {
+        return sphere_dielectric_init(&tmp, params[0])->matData;
+    } else {
+        return sphere_light_init(&tmp, (Color){.red = params[0], .green = params[1], .blue = params[2]})->matData;
+    }
+}
+
+static inline uint32_t matdata_hash(Material *material, double *params)
+{
+    // FNV-1a over the material pointer and the parameter bytes.
+    uint64_t h = 14695981039346656037ULL;
+    uintptr_t m = (uintptr_t)material;
+    const unsigned char *bytes = (const unsigned char *)&m;
+    for (size_t i = 0; i < sizeof(m); i++) {
+        h = (h ^ bytes[i]) * 1099511628211ULL;
+    }
+    bytes = (const unsigned char *)params;
+    for (size_t i = 0; i < sizeof(double) * 3; i++) {
+        h = (h ^ bytes[i]) * 1099511628211ULL;
+    }
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+static void matdata_cache_insert(MatDataCache *cache, Material *material, double *params, void *matData)
+{
+    uint32_t mask = cache->capacity - 1;
+    uint32_t i = matdata_hash(material, params) & mask;
+    while (cache->entries[i].material != NULL) {
+        i = (i + 1) & mask;
+    }
+
+    cache->entries[i].material = material;
+    memcpy(cache->entries[i].params, params, sizeof(cache->entries[i].params));
+    cache->entries[i].matData = matData;
+    cache->length++;
+}
@@ -0,0 +1,97 @@
+#ifndef __SCENE_FILE_H__
+#define __SCENE_FILE_H__
+
+/**
+ * Loading/saving scenes from/to text files.
+ *
+ * A scene file contains one sphere, planar primitive (see plane.h) or triangle mesh (see mesh.h) per line:
+ *
+ *     sphere <x> <y> <z> <radius> <material> <red> <green> <blue> [material parameters]
+ *     plane <x> <y> <z> <normal x> <normal y> <normal z> <material> <red> <green> <blue> [material parameters]
+ *     disk <x> <y> <z> <normal x> <normal y> <normal z> <radius> <material> <red> <green> <blue> [material parameters]
+ *     rect <x1> <y1> <z1> <x2> <y2> <z2> <material> <red> <green> <blue> [material parameters]
+ *     mesh <obj file path> <material> <red> <green> <blue> [material parameters]
+ *
+ * A plane goes through the point [x, y, z], a disk is centered at it. A rect is axis-aligned: [x1, y1, z1] and [x2, y2, z2] are its
+ * opposite corners (they must differ in exactly two coordinates).
+ * A mesh is loaded from a Wavefront OBJ file (see mesh_load_obj()), its path (without spaces) is relative to the working directory.
+ *
+ * Where <material> is one of:
+ *     matte
+ *     metal <fuzziness>
+ *     dielectric <refraction_index>
+ *     light <light_red> <light_green> <light_blue>
+ *     gradient_sky
+ *     ground
+ *     shaded
+ *
+ * <red> <green> <blue> is the color of the primitive (Sphere.color, Plane.color, Mesh.color). Empty lines and lines starting with '#' are
+ * ignored. Numbers are written with full (round-trip) double precision, so a saved and re-loaded scene is exactly the same as the original
+ * (except for planes with a normal that is not axis-aligned, which can differ by a rounding error).
+ *
+ * A line `accel <linear|grid|wide_bvh>` selects how the closest sphere of the scene is found (see Scene.sphereAccel, the default is
+ * linear).
+ *
+ * A line `chunks <chunk file path> <cache MiB>` adds the spheres of a chunk file (see sphere_chunks.h) to the scene, as out-of-core
+ * spheres (see Scene.sphereChunks): they are loaded as rays get to them, into a cache of at most <cache MiB> megabytes.
+ */
+
+#include <stdbool.h>
+
+#include "scene.h"
+
+
+typedef struct SceneFileReloadStats_s   SceneFileReloadStats;
+
+struct SceneFileReloadStats_s {
+    uint32_t    added;
+    uint32_t    removed;
+    uint32_t    moved;                  // Spheres whose center and/or radius changed.
+    uint32_t    materialsEdited;        // Spheres whose material, material parameters and/or color changed.
+
+    // Planes that were added, removed or changed (in any way). If there are any - all of the scene file planes are replaced.
+    uint32_t    planesChanged;
+
+    // Meshes that were added, removed or changed (their OBJ file path or material). If there are any - all of the scene file meshes are
+    // replaced. Changes of the contents of the OBJ files themselves are not detected.
+    uint32_t    meshesChanged;
+
+    // 1 if the chunk file of the out-of-core spheres (or its cache size) changed, and the chunks were replaced.
+    uint32_t    chunksChanged;
+
+    // The range of indexes of the scene spheres that were changed/added: [firstChanged, lastChanged). Spheres before `firstChanged`
+    // keep their index, spheres after `lastChanged` may have been shifted (if spheres were added/removed).
+    uint32_t    firstChanged;
+    uint32_t    lastChanged;
+};
+
+
+/**
+ * Loads the spheres, planes and meshes from the scene file at `path` and adds them to (the end of) `scene`. Primitives that use the same
+ * material with the same parameters share the material data. Returns false (and logs the error) if the file could not be read or is
+ * invalid - primitives read before the error are kept in the `scene`.
+ */
+bool scene_file_load(Scene *scene, const char *path);
+
+/**
+ * Re-loads the scene file at `path` and applies only the differences between it and the scene file spheres of `scene` (see
+ * Scene.fileSpheresFirst), in place: spheres are matched by their position in the file, so unchanged spheres (before and after the
+ * edited lines) keep their data, edited lines become moved spheres and/or edited materials and inserted/deleted lines become
+ * added/removed spheres. The scene file planes (see Scene.filePlanesFirst) and meshes (see Scene.fileMeshesFirst) are replaced if any of
+ * them changed, and so are the out-of-core spheres (see Scene.sphereChunks). Fills `stats` with what changed.
+ *
+ * The material data of the scene file spheres of `scene` must be owned by the scene file loads (i.e. they must have been loaded with
+ * scene_file_load()), because material data that is no longer used after the update is freed.
+ *
+ * Returns false (and logs the error) if the file could not be loaded - the `scene` is left unchanged in that case.
+ */
+bool scene_file_reload(Scene *scene, const char *path, SceneFileReloadStats *stats);
+
+/**
+ * Saves all spheres, planes and meshes of `scene` (and the chunk file of its out-of-core spheres) into a scene file at `path` (the meshes
+ * must have been loaded from OBJ files, and the scene must not have instances). Returns false (and logs the error) if the file could not be
+ * written.
+ */
+bool scene_file_save(Scene *scene, const char *path);
+
+#endif // __SCENE_FILE_H__
@@ -0,0 +1,326 @@
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "random.h"
+#include "rtalloc.h"
+#include "rtcommon.h"
+#include "scene_gen.h"
+#include "materials/dielectric.h"
+#include "materials/light.h"
+#include "materials/metal.h"
+
+
+// The area of the ground (in front of the camera) where the generated spheres are placed.
+#define GEN_FIELD_X_MIN     -50.0
+#define GEN_FIELD_Y_MIN      20.0
+#define GEN_FIELD_SIZE      100.0
+
+// Material data is shared between generated spheres (allocating it for each of millions of spheres would waste a lot of memory), so
+// the generated materials are picked from small palettes.
+#define GEN_METAL_FUZZ_LEVELS   8
+#define GEN_LIGHT_COLORS        8
+
+#define GEN_CLUSTER_EDGE        8           // Clusters are GEN_CLUSTER_EDGE^3 spheres.
+#define GEN_SHELL_LAYERS        5
+
+
+typedef struct GenPalette_s     GenPalette;
+
+struct GenPalette_s {
+    void   *metal[GEN_METAL_FUZZ_LEVELS];   // matData of metals with fuzziness [0, 0.4375], in steps of 1/16.
+    void   *glass;
+    void   *airBubble;                      // A dielectric with the inverse of glass refraction index (air inside of glass).
+    void   *lights[GEN_LIGHT_COLORS];
+};
+
+
+static void gen_random_field(Scene *scene, uint32_t count, RandomState *rs, GenPalette *palette);
+static void gen_clustered_grid(Scene *scene, uint32_t count, RandomState *rs, GenPalette *palette);
+static void gen_glass_shells(Scene *scene, uint32_t count, RandomState *rs, GenPalette *palette);
+static void gen_many_lights(Scene *scene, uint32_t count, RandomState *rs, GenPalette *palette);
+static void gen_instanced_clusters(Scene *scene, uint32_t count, RandomState *rs, GenPalette *palette);
+static void gen_palette_init(GenPalette *palette, RandomState *rs);
+static void gen_random_material(Sphere *sphere, RandomState *rs, GenPalette *palette, double matteProb, double metalProb);
+static inline uint32_t grid_side(uint32_t cells);
+
+
+static const char *generatorNames[SCENE_GENERATORS_COUNT] = {
+    [SG_random_field]       = "random_field",
+    [SG_clustered_grid]     = "clustered_grid",
+    [SG_glass_shells]       = "glass_shells",
+    [SG_many_lights]        = "many_lights",
+    [SG_instanced_clusters] = "instanced_clusters",
+};
+
+
+void scene_generate(Scene *scene, SceneGenerator generator, uint32_t count, uint64_t seed)
+{
+    RandomState rs;
+    random_state_seed(&rs, seed);
+
+    GenPalette palette;
+    gen_palette_init(&palette, &rs);
+
+    switch (generator) {
+        case SG_random_field:
+            gen_random_field(scene, count, &rs, &palette); break;
+
+        case SG_clustered_grid:
+            gen_clustered_grid(scene, count, &rs, &palette); break;
+
+        case SG_glass_shells:
+            gen_glass_shells(scene, count, &rs, &palette); break;
+
+        case SG_many_lights:
+            gen_many_lights(scene, count, &rs, &palette); break;
+
+        case SG_instanced_clusters:
+            gen_instanced_clusters(scene, count, &rs, &palette); break;
+
+        default:
+            log_err("Fatal error: unknown scene generator used: %d", generator);
+            exit(1);
+    }
+
+    // The standard ground (the same one that the pre-defined scenes use).
+    scene_add_ground(scene);
+}
+
+const char * scene_generator_name(SceneGenerator generator)
+{
+    if ((uint32_t)generator >= SCENE_GENERATORS_COUNT) {
+        return "unknown";
+    }
+    return generatorNames[generator];
+}
+
+bool scene_generator_by_name(const char *name, SceneGenerator *generator)
+{
+    for (uint32_t i = 0; i < SCENE_GENERATORS_COUNT; i++) {
+        if (strcmp(name, generatorNames[i]) == 0) {
+            *generator = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void gen_random_field(Scene *scene, uint32_t count, RandomState *rs, GenPalette *palette)
+{
+    // The 3 big spheres in the middle of the field (if there are enough spheres to generate).
+    uint32_t bigCount = count >= 10 ? 3 : 0;
+    if (bigCount > 0) {
+        double r = 6;
+        Sphere glass = {.center = {.x = -16, .y = 70, .z = scene_ground_z(-16, 70) + r}, .radius = r, .material = &matDielectric,
+                        .matData = palette->glass, .color = COLOR_WHITE};
+        Sphere matte = {.center = {.x = 0, .y = 80, .z = scene_ground_z(0, 80) + r}, .radius = r, .material = &matMatte,
+                        .color = {0.4, 0.2, 0.1}};
+        Sphere metal = {.center = {.x = 16, .y = 70, .z = scene_ground_z(16, 70) + r}, .radius = r, .material = &matMetal,
+                        .matData = palette->metal[0], .color = {0.7, 0.6, 0.5}};
+        scene_add_sphere(scene, &glass);
+        scene_add_sphere(scene, &matte);
+        scene_add_sphere(scene, &metal);
+    }
+
+    // Small spheres, one per grid cell, with a random offset within the cell.
+    uint32_t smallCount = count - bigCount;
+    uint32_t side = grid_side(smallCount);
+    double cellSize = GEN_FIELD_SIZE / side;
+    for (uint32_t i = 0; i < smallCount; i++) {
+        double r = cellSize * random_state_double_exc(rs, 0.15, 0.3);
+        double x = GEN_FIELD_X_MIN + cellSize * ((i % side) + random_state_double_exc(rs, 0.3, 0.7));
+        double y = GEN_FIELD_Y_MIN + cellSize * ((i / side) + random_state_double_exc(rs, 0.3, 0.7));
+
+        Sphere sphere = {.center = {.x = x, .y = y, .z = scene_ground_z(x, y) + r}, .radius = r};
+        gen_random_material(&sphere, rs, palette, 0.8, 0.15);
+        scene_add_sphere(scene, &sphere);
+    }
+}
+
+static void gen_clustered_grid(Scene *scene, uint32_t count, RandomState *rs, GenPalette *palette)
+{
+    uint32_t perCluster = GEN_CLUSTER_EDGE * GEN_CLUSTER_EDGE * GEN_CLUSTER_EDGE;
+    uint32_t clusters = (count + perCluster - 1) / perCluster;
+
+    // Clusters are placed one per grid cell (with a random offset within the cell) and spheres fill each cluster in a regular grid.
+    uint32_t side = grid_side(clusters);
+    double cellSize = GEN_FIELD_SIZE / side;
+    double clusterSize = cellSize * 0.6;
+    double spacing = clusterSize / GEN_CLUSTER_EDGE;
+
+    uint32_t added = 0;
+    for (uint32_t c = 0; c < clusters; c++) {
+        double baseX = GEN_FIELD_X_MIN + cellSize * ((c % side) + random_state_double_exc(rs, 0.0, 0.4));
+        double baseY = GEN_FIELD_Y_MIN + cellSize * ((c / side) + random_state_double_exc(rs, 0.0, 0.4));
+        double baseZ = scene_ground_z(baseX + clusterSize/2, baseY + clusterSize/2) + random_state_double_exc(rs, 0.0, clusterSize);
+
+        Sphere clusterSphere = {.radius = 0};
+        gen_random_material(&clusterSphere, rs, palette, 0.7, 0.3);
+
+        for (uint32_t i = 0; i < perCluster && added < count; i++, added++) {
+            uint32_t ix = i % GEN_CLUSTER_EDGE;
+            uint32_t iy = (i / GEN_CLUSTER_EDGE) % GEN_CLUSTER_EDGE;
+            uint32_t iz = i / (GEN_CLUSTER_EDGE * GEN_CLUSTER_EDGE);
+
+            Sphere sphere = clusterSphere;
+            sphere.radius = spacing * 0.4;
+            sphere.center = (Vector3){
+                .x = baseX + spacing * (ix + 0.5),
+                .y = baseY + spacing * (iy + 0.5),
+                .z = baseZ + spacing * (iz + 0.5),
+            };
+            scene_add_sphere(scene, &sphere);
+        }
+    }
+}
+
+static void gen_glass_shells(Scene *scene, uint32_t count, RandomState *rs, GenPalette *palette)
+{
+    // Relative radii of the layers of each group, from the outside in.
+    static const double layerRadius[GEN_SHELL_LAYERS] = {1.0, 0.9, 0.7, 0.6, 0.35};
+
+    uint32_t groups = (count + GEN_SHELL_LAYERS - 1) / GEN_SHELL_LAYERS;
+    uint32_t side = grid_side(groups);
+    double cellSize = GEN_FIELD_SIZE / side;
+
+    uint32_t added = 0;
+    for (uint32_t g = 0; g < groups; g++) {
+        double r = cellSize * random_state_double_exc(rs, 0.25, 0.4);
+        double x = GEN_FIELD_X_MIN + cellSize * ((g % side) + 0.5);
+        double y = GEN_FIELD_Y_MIN + cellSize * ((g / side) + 0.5);
+        Vector3 center = {.x = x, .y = y, .z = scene_ground_z(x, y) + r};
+        Color coreColor = {
+            .red = random_state_double_0_1_exc(rs), .green = random_state_double_0_1_exc(rs), .blue = random_state_double_0_1_exc(rs)};
+
+        for (uint32_t l = 0; l < GEN_SHELL_LAYERS && added < count; l++, added++) {
+            Sphere sphere = {.center = center, .radius = r * layerRadius[l]};
+            if (l == GEN_SHELL_LAYERS - 1) {
+                sphere.material = &matMatte;
+                sphere.color = coreColor;
+            } else {
+                sphere.material = &matDielectric;
+                sphere.matData = (l % 2 == 0) ? palette->glass : palette->airBubble;
+                sphere.color = (Color)COLOR_WHITE;
+            }
+            scene_add_sphere(scene, &sphere);
+        }
+    }
+}
+
+static void gen_many_lights(Scene *scene, uint32_t count, RandomState *rs, GenPalette *palette)
+{
+    uint32_t side = grid_side(count);
+    double cellSize = GEN_FIELD_SIZE / side;
+    for (uint32_t i = 0; i < count; i++) {
+        double r = cellSize * random_state_double_exc(rs, 0.15, 0.3);
+        double x = GEN_FIELD_X_MIN + cellSize * ((i % side) + random_state_double_exc(rs, 0.3, 0.7));
+        double y = GEN_FIELD_Y_MIN + cellSize * ((i / side) + random_state_double_exc(rs, 0.3, 0.7));
+
+        Sphere sphere = {.center = {.x = x, .y = y, .z = scene_ground_z(x, y) + r}, .radius = r};
+        if (i % 4 == 0) {
+            sphere.material = &matLight;
+            sphere.matData = palette->lights[random_state_next(rs) % GEN_LIGHT_COLORS];
+            sphere.color = (Color)COLOR_BLACK;
+        } else {
+            gen_random_material(&sphere, rs, palette, 0.9, 0.1);
+        }
+        scene_add_sphere(scene, &sphere);
+    }
+}
+
+static void gen_instanced_clusters(Scene *scene, uint32_t count, RandomState *rs, GenPalette *palette)
+{
+    // The cluster: `count` spheres at random positions in a unit cube (in its object space: [-0.5, 0.5] x [-0.5, 0.5] x [0, 1], standing
+    // on z = 0).
+    Prototype cluster;
+    prototype_init_spheres(&cluster);
+    double r = 0.3 / cbrt((double)(count > 0 ? count : 1));
+    for (uint32_t i = 0; i < count; i++) {
+        Sphere sphere = {
+            .center = {
+                .x = random_state_double_exc(rs, -0.5 + r, 0.5 - r),
+                .y = random_state_double_exc(rs, -0.5 + r, 0.5 - r),
+                .z = random_state_double_exc(rs, r, 1 - r),
+            },
+            .radius = r,
+        };
+        gen_random_material(&sphere, rs, palette, 0.7, 0.3);
+        prototype_add_sphere(&cluster, &sphere);
+    }
+    uint32_t prototype = scene_add_prototype(scene, &cluster);
+
+    // The instances: one per grid cell, scaled to the cell and randomly rotated around the vertical axis.
+    uint32_t side = grid_side(count);
+    double cellSize = GEN_FIELD_SIZE / side;
+    double scale = cellSize * 0.6;
+    Vector3 axis = {.x = 0, .y = 0, .z = 1};
+    for (uint32_t i = 0; i < count; i++) {
+        double x = GEN_FIELD_X_MIN + cellSize * ((i % side) + 0.5);
+        double y = GEN_FIELD_Y_MIN + cellSize * ((i / side) + 0.5);
+        Vector3 translation = {.x = x, .y = y, .z = scene_ground_z(x, y)};
+        Transform transform;
+        transform_init(&transform, &translation, &axis, random_state_double_exc(rs, 0, 2 * M_PI), scale);
+        scene_add_instance(scene, prototype, &transform);
+    }
+}
+
+static void gen_palette_init(GenPalette *palette, RandomState *rs)
+{
+    // The sphere_*_init() functions allocate the material data - we just keep the pointers, so they can be shared between spheres.
+    Sphere tmp;
+    for (uint32_t i = 0; i < GEN_METAL_FUZZ_LEVELS; i++) {
+        palette->metal[i] = sphere_metal_init(&tmp, i / 16.0)->matData;
+    }
+    palette->glass = sphere_glass_init(&tmp)->matData;
+    palette->airBubble = sphere_dielectric_init(&tmp, 1.0 / MAT_GLASS_REFRACTION_INDEX)->matData;
+
+    for (uint32_t i = 0; i < GEN_LIGHT_COLORS; i++) {
+        double luminosity = random_state_double_exc(rs, 4, 10);
+        Color color = {
+            .red    = luminosity * random_state_double_exc(rs, 0.3, 1),
+            .green  = luminosity * random_state_double_exc(rs, 0.3, 1),
+            .blue   = luminosity * random_state_double_exc(rs, 0.3, 1),
+        };
+        palette->lights[i] = sphere_light_init(&tmp, color)->matData;
+    }
+}
+
+/**
+ * Picks a random material (and color) for `sphere`: matte with probability `matteProb`, metal with probability `metalProb`, otherwise
+ * glass.
+ */
+static void gen_random_material(Sphere *sphere, RandomState *rs, GenPalette *palette, double matteProb, double metalProb)
+{
+    double choice = random_state_double_0_1_exc(rs);
+    if (choice < matteProb) {
+        sphere->material = &matMatte;
+        sphere->matData = NULL;
+        sphere->color = (Color){
+            .red    = random_state_double_0_1_exc(rs) * random_state_double_0_1_exc(rs),
+            .green  = random_state_double_0_1_exc(rs) * random_state_double_0_1_exc(rs),
+            .blue   = random_state_double_0_1_exc(rs) * random_state_double_0_1_exc(rs),
+        };
+    } else if (choice < matteProb + metalProb) {
+        sphere->material = &matMetal;
+        sphere->matData = palette->metal[random_state_next(rs) % GEN_METAL_FUZZ_LEVELS];
+        sphere->color = (Color){
+            .red    = random_state_double_exc(rs, 0.5, 1),
+            .green  = random_state_double_exc(rs, 0.5, 1),
+            .blue   = random_state_double_exc(rs, 0.5, 1),
+        };
+    } else {
+        sphere->material = &matDielectric;
+        sphere->matData = palette->glass;
+        sphere->color = (Color)COLOR_WHITE;
+    }
+}
+
+/**
+ * Returns the side length of the smallest square grid that has at least `cells` cells.
+ */
+static inline uint32_t grid_side(uint32_t cells)
+{
+    uint32_t side = (uint32_t)ceil(sqrt((double)cells));
+    return side > 0 ? side : 1;
+}
@@ -0,0 +1,60 @@
+#ifndef __SCENE_GEN_H__
+#define __SCENE_GEN_H__
+
+/**
+ * Procedural generators of large scenes, for stress testing and benchmarking the ray-tracer with many spheres.
+ *
+ * Every generator adds exactly `count` spheres (plus the standard ground plane) to a scene, so the same generator can be used to
+ * produce anything from 10 to 10^7 spheres. Generation is deterministic: the same generator, count and seed always produce exactly the
+ * same scene (on every platform), so generated scenes can be used for repeatable benchmarks (see also scene_file.h and the `scenegen`
+ * tool). The exception is SG_instanced_clusters: it adds `count` instances of a cluster of `count` spheres, i.e. count^2 spheres (e.g.
+ * 10^8 with a count of 10^4), without storing each of them (and such scenes can't be saved into scene files).
+ *
+ * The spheres are laid out on the ground, in front of the camera (as configured by CC_z_15_downwards). The more spheres are generated -
+ * the smaller and denser they are.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "scene.h"
+
+
+typedef enum {
+    // The classic "Ray Tracing in One Weekend" final scene: a field of small randomly colored matte/metal/glass spheres, with 3 big ones.
+    SG_random_field,
+
+    // Dense clusters (8x8x8 grids) of small spheres, each cluster of a single random color and material, scattered on the ground.
+    SG_clustered_grid,
+
+    // Nested glass shells: each group is a glass sphere with an air bubble inside it, a smaller glass sphere inside that bubble, another
+    // air bubble and a colored matte core. Stresses the dielectric material (long paths through many refractive boundaries).
+    SG_glass_shells,
+
+    // A field of small spheres, where every 4th sphere is a randomly colored light. Stresses scenes with many light sources.
+    SG_many_lights,
+
+    // Instances (see instance.h) of a single cluster of small randomly colored spheres, each rotated around the vertical axis, scattered
+    // on the ground. Stresses the two-level acceleration structure.
+    SG_instanced_clusters,
+} SceneGenerator;
+
+#define SCENE_GENERATORS_COUNT  5
+
+
+/**
+ * Adds `count` procedurally generated spheres (and the ground plane) to `scene`, using `generator`, seeded with `seed`.
+ */
+void scene_generate(Scene *scene, SceneGenerator generator, uint32_t count, uint64_t seed);
+
+/**
+ * Returns the name of the `generator` (e.g. "random_field"), as used by the `scenegen` tool and benchmarks.
+ */
+const char * scene_generator_name(SceneGenerator generator);
+
+/**
+ * Finds a generator by its `name` (see scene_generator_name()). Returns false if there is no such generator.
+ */
+bool scene_generator_by_name(const char *name, SceneGenerator *generator);
+
+#endif // __SCENE_GEN_H__
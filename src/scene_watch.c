@@ -0,0 +1,104 @@
+#include <string.h>
+
+#include "../envconfig.h"
+#include "rtcommon.h"
+
+#if defined(ENV_LINUX) && ENV_LINUX
+#include <errno.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif // ENV_LINUX
+
+#include "scene_watch.h"
+
+
+void scene_watch_init(SceneWatch *watch, const char *path)
+{
+    watch->enabled  = false;
+    watch->fd       = -1;
+
+#if defined(ENV_LINUX) && ENV_LINUX
+    // Split `path` into the directory (that is watched) and the file name (that events are filtered by).
+    char dir[SCENE_WATCH_PATH_MAX];
+    const char *slash = strrchr(path, '/');
+    if (strlen(path) >= SCENE_WATCH_PATH_MAX) {
+        log_err("Error: scene file path is too long. Scene hot-reload is disabled.\n");
+        return;
+    }
+    if (slash == NULL) {
+        strcpy(dir, ".");
+        strcpy(watch->fileName, path);
+    } else {
+        size_t dirLength = slash == path ? 1 : (size_t)(slash - path);
+        memcpy(dir, path, dirLength);
+        dir[dirLength] = '\0';
+        strcpy(watch->fileName, slash + 1);
+    }
+
+    watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch->fd == -1) {
+        log_err("Error: inotify_init1() failed: %s. Scene hot-reload is disabled.\n", strerror(errno));
+        return;
+    }
+
+    if (inotify_add_watch(watch->fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) == -1) {
+        log_err("Error: could not watch directory \"%s\": %s. Scene hot-reload is disabled.\n", dir, strerror(errno));
+        close(watch->fd);
+        watch->fd = -1;
+        return;
+    }
+
+    watch->enabled = true;
+#else
+    (void)(path);       // Disable gcc -Wextra "unused parameter" errors.
+    log_err("Scene hot-reload is only supported on Linux. Hot-reload is disabled.\n");
+#endif // ENV_LINUX
+}
+
+bool scene_watch_poll(SceneWatch *watch)
+{
+    if (! watch->enabled) {
+        return false;
+    }
+
+    bool modified = false;
+
+#if defined(ENV_LINUX) && ENV_LINUX
+    // Drain all pending events.
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (true) {
+        ssize_t len = read(watch->fd, buf, sizeof(buf));
+        if (len <= 0) {
+            if (len == -1 && errno != EAGAIN && errno != EINTR) {
+                log_err("Error: reading inotify events failed: %s. Scene hot-reload is disabled.\n", strerror(errno));
+                scene_watch_close(watch);
+            }
+            break;
+        }
+
+        for (char *p = buf; p < buf + len; ) {
+            struct inotify_event *event = (struct inotify_event *)p;
+            if (event->len > 0 && strcmp(event->name, watch->fileName) == 0) {
+                modified = true;
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+#endif // ENV_LINUX
+
+    return modified;
+}
+
+void scene_watch_close(SceneWatch *watch)
+{
+    if (! watch->enabled) {
+        return;
+    }
+
+#if defined(ENV_LINUX) && ENV_LINUX
+    close(watch->fd);
+#endif // ENV_LINUX
+
+    watch->enabled  = false;
+    watch->fd       = -1;
+}
@@ -0,0 +1,49 @@
+#ifndef __SCENE_WATCH_H__
+#define __SCENE_WATCH_H__
+
+/**
+ * Scene file hot-reload.
+ *
+ * Watches the scene file (see SC_file, SCENE_FILE_PATH) for changes, using inotify (Linux only), so that edits to the file can be applied
+ * to the live scene (see scene_file_reload()) without restarting the ray-tracer.
+ *
+ * The directory of the file is watched (rather than the file itself), because many editors save files by writing a new file and renaming
+ * it over the old one.
+ */
+
+#include <stdbool.h>
+
+
+// Set SCENE_HOT_RELOAD to 0 to disable watching the scene file (only used with the SC_file scene configuration).
+#define SCENE_HOT_RELOAD            1
+
+#define SCENE_WATCH_PATH_MAX        4096
+
+
+typedef struct SceneWatch_s         SceneWatch;
+
+
+struct SceneWatch_s {
+    bool        enabled;
+    int         fd;                                 // The inotify instance.
+    char        fileName[SCENE_WATCH_PATH_MAX];     // The name of the watched file (without the directory).
+};
+
+
+/**
+ * Starts watching the scene file at `path`. On failure logs an error and leaves `watch` disabled.
+ */
+void scene_watch_init(SceneWatch *watch, const char *path);
+
+/**
+ * Returns true if the watched file has been modified (written or replaced) since the last call. Never blocks.
+ * Multiple modifications between calls are reported as one.
+ */
+bool scene_watch_poll(SceneWatch *watch);
+
+/**
+ * Stops watching the scene file.
+ */
+void scene_watch_close(SceneWatch *watch);
+
+#endif // __SCENE_WATCH_H__
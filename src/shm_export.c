@@ -0,0 +1,194 @@
+#include <stdatomic.h>
+#include <string.h>
+
+#include "../envconfig.h"
+#include "rtcommon.h"
+
+#if defined(ENV_LINUX) && ENV_LINUX
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // ENV_LINUX
+
+#include "shm_export.h"
+
+
+#if defined(ENV_LINUX) && ENV_LINUX
+static bool segment_owner(uint32_t *ownerPid);
+static bool segment_inode(uint64_t *inode);
+#endif // ENV_LINUX
+
+
+void shm_export_init(ShmExport *shm, uint32_t width, uint32_t height)
+{
+    shm->enabled            = false;
+    shm->header             = NULL;
+    shm->pixels             = NULL;
+    shm->framesPublished    = 0;
+    shm->width              = width;
+    shm->height             = height;
+    shm->pitch              = width * 3;
+    shm->size               = SHM_EXPORT_PIXELS_OFFSET + (size_t)shm->pitch * height;
+    shm->inode              = 0;
+
+#if defined(ENV_LINUX) && ENV_LINUX
+    int fd = shm_open(SHM_EXPORT_NAME, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd == -1 && errno == EEXIST) {
+        // Only replace a segment that was left over by a tracer that is no longer running (it may also be of a different size).
+        uint32_t ownerPid = 0;
+        if (segment_owner(&ownerPid) && ownerPid != 0 && (kill((pid_t)ownerPid, 0) == 0 || errno != ESRCH)) {
+            log_err("Error: the shared-memory framebuffer \"%s\" is used by another running tracer (pid %u). Shared-memory framebuffer"
+                " export is disabled.\n", SHM_EXPORT_NAME, ownerPid);
+            return;
+        }
+        shm_unlink(SHM_EXPORT_NAME);
+        fd = shm_open(SHM_EXPORT_NAME, O_RDWR | O_CREAT | O_EXCL, 0644);
+    }
+    if (fd == -1) {
+        log_err("Error: shm_open(\"%s\") failed: %s. Shared-memory framebuffer export is disabled.\n", SHM_EXPORT_NAME, strerror(errno));
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        log_err("Error: fstat() of the shared-memory framebuffer failed: %s. Export is disabled.\n", strerror(errno));
+        close(fd);
+        shm_unlink(SHM_EXPORT_NAME);
+        return;
+    }
+    shm->inode = (uint64_t)st.st_ino;
+
+    if (ftruncate(fd, shm->size) != 0) {
+        log_err("Error: ftruncate() of the shared-memory framebuffer failed: %s. Export is disabled.\n", strerror(errno));
+        close(fd);
+        shm_unlink(SHM_EXPORT_NAME);
+        return;
+    }
+
+    void *mem = mmap(NULL, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);      // The mapping stays valid after the descriptor is closed.
+    if (mem == MAP_FAILED) {
+        log_err("Error: mmap() of the shared-memory framebuffer failed: %s. Export is disabled.\n", strerror(errno));
+        shm_unlink(SHM_EXPORT_NAME);
+        return;
+    }
+
+    shm->header = mem;
+    shm->pixels = (uint8_t *)mem + SHM_EXPORT_PIXELS_OFFSET;
+
+    // The segment is zero filled by ftruncate(), so `seq` starts at 0 (even, i.e. no frame is being written) and frameNum at 0 (no
+    // frame has been published yet).
+    ShmFrameHeader *header = shm->header;
+    header->magic   = SHM_EXPORT_MAGIC;
+    header->version = SHM_EXPORT_VERSION;
+    header->ownerPid = (uint32_t)getpid();
+    atomic_store_explicit(&header->width,       width,                  memory_order_relaxed);
+    atomic_store_explicit(&header->height,      height,                 memory_order_relaxed);
+    atomic_store_explicit(&header->pitch,       shm->pitch,             memory_order_relaxed);
+    atomic_store_explicit(&header->pixelFormat, SHM_PIXEL_FORMAT_RGB24, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    shm->enabled = true;
+#else
+    log_err("Shared-memory framebuffer export is only supported on Linux. Export is disabled.\n");
+#endif // ENV_LINUX
+}
+
+void shm_export_publish(ShmExport *shm, uint8_t *pixels, uint32_t srcPitch, uint64_t sampleCount)
+{
+    if (! shm->enabled) {
+        return;
+    }
+
+    ShmFrameHeader *header = shm->header;
+    shm->framesPublished++;
+
+    // Seqlock write side. We are the only writer, so `seq` can be incremented without a read-modify-write operation.
+    // The release fence after making `seq` odd makes sure that readers can't see any of the new frame data without also seeing an odd
+    // `seq` (either at the start or at the end of their read).
+    uint32_t seq = atomic_load_explicit(&header->seq, memory_order_relaxed);
+    atomic_store_explicit(&header->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    atomic_store_explicit(&header->frameNum,    shm->framesPublished,   memory_order_relaxed);
+    atomic_store_explicit(&header->sampleCount, sampleCount,            memory_order_relaxed);
+
+    if (srcPitch == shm->pitch) {
+        memcpy(shm->pixels, pixels, (size_t)shm->pitch * shm->height);
+    } else {
+        for (uint32_t row = 0; row < shm->height; row++) {
+            memcpy(&shm->pixels[row * shm->pitch], &pixels[row * srcPitch], shm->pitch);
+        }
+    }
+
+    atomic_store_explicit(&header->seq, seq + 2, memory_order_release);
+}
+
+void shm_export_close(ShmExport *shm)
+{
+    if (! shm->enabled) {
+        return;
+    }
+
+#if defined(ENV_LINUX) && ENV_LINUX
+    munmap(shm->header, shm->size);
+
+    // The name may refer to another segment by now (if ours was removed, e.g. by hand, and another tracer created a new one).
+    uint64_t inode;
+    if (segment_inode(&inode) && inode == shm->inode) {
+        shm_unlink(SHM_EXPORT_NAME);
+    }
+#endif // ENV_LINUX
+
+    shm->enabled    = false;
+    shm->header     = NULL;
+    shm->pixels     = NULL;
+}
+
+#if defined(ENV_LINUX) && ENV_LINUX
+/**
+ * Reads the ShmFrameHeader.ownerPid of the existing segment SHM_EXPORT_NAME into `ownerPid`. Returns false if it can not be read (the
+ * segment is gone, or too small to have a header).
+ */
+static bool segment_owner(uint32_t *ownerPid)
+{
+    int fd = shm_open(SHM_EXPORT_NAME, O_RDONLY, 0);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ShmFrameHeader)) {
+        close(fd);
+        return false;
+    }
+    void *mem = mmap(NULL, sizeof(ShmFrameHeader), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        return false;
+    }
+    *ownerPid = ((ShmFrameHeader *)mem)->ownerPid;
+    munmap(mem, sizeof(ShmFrameHeader));
+    return true;
+}
+
+/**
+ * Stores the inode of the segment that SHM_EXPORT_NAME currently refers to in `inode`. Returns false if there is no such segment.
+ */
+static bool segment_inode(uint64_t *inode)
+{
+    int fd = shm_open(SHM_EXPORT_NAME, O_RDONLY, 0);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0;
+    close(fd);
+    if (ok) {
+        *inode = (uint64_t)st.st_ino;
+    }
+    return ok;
+}
+#endif // ENV_LINUX
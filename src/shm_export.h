@@ -0,0 +1,129 @@
+#ifndef __SHM_EXPORT_H__
+#define __SHM_EXPORT_H__
+
+/**
+ * Shared-memory framebuffer export.
+ *
+ * When enabled, every image that is drawn to the screen is also published into a POSIX shared-memory segment (named SHM_EXPORT_NAME),
+ * so that external processes (viewers, compositors, monitoring dashboards) can read the live progressive image, without going through
+ * files or screenshots.
+ *
+ * The segment starts with a ShmFrameHeader, followed by the pixels (at SHM_EXPORT_PIXELS_OFFSET). Pixels are stored exactly like they
+ * are drawn to the SDL texture: RGB24, `pitch` bytes per row, top row first.
+ *
+ * Synchronization is done with a seqlock (the `seq` header field), so the tracer never blocks on (or even knows about) readers:
+ * * The tracer increments `seq` to an odd value before it starts writing a frame, and increments it again (to an even value) once the
+ *   frame is fully written.
+ * * A reader reads `seq` (see shm_frame_read_begin()), reads whatever it needs directly from the mapped segment (no copies are needed)
+ *   and then checks that `seq` did not change (see shm_frame_read_retry()). If it did - the frame was being overwritten while it was read
+ *   and the reader must retry.
+ *
+ * Only one tracer can export at a time: a second one finds the segment in use (see ShmFrameHeader.ownerPid) and runs without the export,
+ * instead of taking the name over from the first one (whose readers would be left with an orphaned segment).
+ *
+ * NOTE: this is only supported on Linux. On other platforms shm_export_init() just disables the export.
+ */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+// Set SHM_EXPORT_ENABLED to 1 to publish displayed frames into the shared-memory segment.
+#define SHM_EXPORT_ENABLED          0
+
+// The POSIX shared-memory object name (readers open it with shm_open(SHM_EXPORT_NAME, O_RDONLY, 0)).
+#define SHM_EXPORT_NAME             "/toyraytracer_fb"
+
+#define SHM_EXPORT_MAGIC            0x46425254      // "TRBF" (in little endian).
+#define SHM_EXPORT_VERSION          1
+
+#define SHM_PIXEL_FORMAT_RGB24      1
+
+// The offset (in bytes, from the start of the segment) of the pixels. Keeps pixels cache line aligned.
+#define SHM_EXPORT_PIXELS_OFFSET    64
+
+
+typedef struct ShmFrameHeader_s     ShmFrameHeader;
+typedef struct ShmExport_s          ShmExport;
+
+
+struct ShmFrameHeader_s {
+    uint32_t            magic;              // SHM_EXPORT_MAGIC
+    uint32_t            version;            // SHM_EXPORT_VERSION
+
+    // Seqlock sequence number. Odd while the tracer is writing a frame, even when the frame is complete.
+    _Atomic uint32_t    seq;
+
+    // The fields below are written only while `seq` is odd.
+    _Atomic uint32_t    width;
+    _Atomic uint32_t    height;
+    _Atomic uint32_t    pitch;              // Bytes per pixels row.
+    _Atomic uint32_t    pixelFormat;        // SHM_PIXEL_FORMAT_RGB24
+
+    // The process id of the tracer that created the segment. A segment whose owner is no longer running was left over by a tracer that
+    // didn't exit cleanly, and is replaced.
+    uint32_t            ownerPid;
+    _Atomic uint64_t    frameNum;           // The number of frames published so far (including this one).
+    _Atomic uint64_t    sampleCount;        // How many samples (rays) per pixel were averaged to produce this frame.
+};
+
+_Static_assert(sizeof(ShmFrameHeader) <= SHM_EXPORT_PIXELS_OFFSET, "ShmFrameHeader must fit before SHM_EXPORT_PIXELS_OFFSET");
+
+struct ShmExport_s {
+    bool                enabled;
+    ShmFrameHeader     *header;
+    uint8_t            *pixels;
+    uint64_t            framesPublished;
+    uint32_t            width;
+    uint32_t            height;
+    uint32_t            pitch;
+    size_t              size;               // Size (in bytes) of the whole mapped segment.
+    uint64_t            inode;              // Of the segment that this process created (see shm_export_close()).
+};
+
+
+/**
+ * Creates the shared-memory segment for an image of `width` x `height` pixels (replacing a segment left over by a tracer that is no
+ * longer running). Must be called once, during startup. If the segment can not be created (e.g. another running tracer exports into it)
+ * - logs an error and leaves the export disabled (rendering continues without it).
+ */
+void shm_export_init(ShmExport *shm, uint32_t width, uint32_t height);
+
+/**
+ * Publishes an RGB24 image (`srcPitch` bytes per row) into the shared-memory segment. Never blocks.
+ * `sampleCount` is the amount of samples per pixel that were averaged to produce the image.
+ */
+void shm_export_publish(ShmExport *shm, uint8_t *pixels, uint32_t srcPitch, uint64_t sampleCount);
+
+/**
+ * Unmaps the shared-memory segment and unlinks it (only if the name still refers to the segment that this process created). Readers that
+ * already have it mapped can keep reading the last published frame.
+ */
+void shm_export_close(ShmExport *shm);
+
+
+/**
+ * Reader side: waits until no frame is being written and returns the sequence number that must be later passed to
+ * shm_frame_read_retry().
+ */
+static inline uint32_t shm_frame_read_begin(ShmFrameHeader *header)
+{
+    uint32_t seq;
+    while ((seq = atomic_load_explicit(&header->seq, memory_order_acquire)) & 1) {
+        // The tracer is writing a frame right now - spin (writing a frame takes a fraction of a millisecond).
+    }
+    return seq;
+}
+
+/**
+ * Reader side: returns true if the frame was modified while it was being read (since shm_frame_read_begin() returned `seq`), in which
+ * case the read data must be discarded and read again.
+ */
+static inline bool shm_frame_read_retry(ShmFrameHeader *header, uint32_t seq)
+{
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&header->seq, memory_order_relaxed) != seq;
+}
+
+#endif // __SHM_EXPORT_H__
@@ -0,0 +1,65 @@
+#ifndef __SKY_H__
+#define __SKY_H__
+
+/**
+ * The environment (sky) of a scene: the light that rays bring when they don't hit any geometry (see ray_trace()).
+ *
+ * The sky used to be a huge (radius 20000) sphere around the scene, that every ray was tested against (and that every escaping ray hit).
+ * As a "miss shader" it costs nothing for the rays that hit geometry, and doesn't lose precision at that distance. The results are the
+ * same: an ambient sky is what a light (matLight) sphere around the scene was, a gradient sky is what a matGradientSky sphere was.
+ */
+
+#include "color.h"
+#include "vector.h"
+
+
+typedef struct Sky_s            Sky;
+
+typedef enum {
+    SKT_none,               // No sky: escaping rays bring no light (black).
+    SKT_ambient,            // The same light (`color`) from every direction.
+    SKT_gradient,           // A gradient from white at (and below) the horizon, to light blue at the top (see sky_gradient_color()).
+} SkyType;
+
+struct Sky_s {
+    SkyType     type;
+    Color       color;      // For SKT_ambient.
+};
+
+
+static inline Color sky_gradient_color(Vector3 *direction);
+
+
+/**
+ * Returns the light that a ray going in `direction` (not necessarily a unit vector) brings from the sky `sky`.
+ */
+static inline Color sky_color(Sky *sky, Vector3 *direction)
+{
+    switch (sky->type) {
+        case SKT_ambient:
+            return sky->color;
+        case SKT_gradient:
+            return sky_gradient_color(direction);
+        default:
+            return (Color)COLOR_BLACK;
+    }
+}
+
+/**
+ * Returns the color of the gradient sky in `direction` (see COLOR_GRADIENT_SKY_TOP, COLOR_GRADIENT_SKY_BOTTOM). Also used by the
+ * matGradientSky material.
+ */
+static inline Color sky_gradient_color(Vector3 *direction)
+{
+    Color skyTopColor = (Color)COLOR_GRADIENT_SKY_TOP;
+    Color skyBottomColor = (Color)COLOR_GRADIENT_SKY_BOTTOM;
+
+    double z = direction->z;
+    if (z < 0) {
+        return skyBottomColor;
+    } else {
+        return gradient(&skyBottomColor, &skyTopColor, 0, 1, z);
+    }
+}
+
+#endif // __SKY_H__
@@ -13,7 +13,7 @@ typedef struct Sphere_s         Sphere;
 
 struct Sphere_s {
     Vector3         center;
-    uint32_t        radius;
+    double          radius;
     Material       *material;
     void           *matData;
     Color           color;
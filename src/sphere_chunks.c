@@ -0,0 +1,1106 @@
+#include <errno.h>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../envconfig.h"
+#include "rtalloc.h"
+#include "rtcommon.h"
+#include "sphere_chunks.h"
+#include "wide_bvh.h"
+#include "materials/dielectric.h"
+#include "materials/light.h"
+#include "materials/metal.h"
+
+
+// Seeks to (and tells) 64-bit offsets of a file (chunk files can be larger than 2 GiB).
+#if defined(ENV_LINUX) && ENV_LINUX
+#define file_seek(f, offset)    fseeko((f), (off_t)(offset), SEEK_SET)
+#define file_seek_end(f)        fseeko((f), 0, SEEK_END)
+#define file_tell(f)            ((int64_t)ftello(f))
+#else
+#define file_seek(f, offset)    _fseeki64((f), (__int64)(offset), SEEK_SET)
+#define file_seek_end(f)        _fseeki64((f), 0, SEEK_END)
+#define file_tell(f)            ((int64_t)_ftelli64(f))
+#endif
+
+// The initial capacity of the material hash table of a writer (must be a power of 2).
+#define SPHERE_CHUNKS_WRITER_MATERIALS  64
+
+
+typedef struct SphereChunksFileHeader_s     SphereChunksFileHeader;
+typedef struct SphereChunksFileChunk_s      SphereChunksFileChunk;
+typedef struct SphereChunksFileSphere_s     SphereChunksFileSphere;
+typedef struct ChunkRayCtx_s                ChunkRayCtx;
+typedef struct ChunkPair_s                  ChunkPair;
+typedef struct ChunkPairs_s                 ChunkPairs;
+typedef struct ChunkRun_s                   ChunkRun;
+
+struct SphereChunksFileHeader_s {
+    char            magic[8];           // SPHERE_CHUNKS_MAGIC (without the terminating '\0').
+    uint32_t        chunksLength;
+    uint32_t        materialsLength;
+    uint64_t        spheresLength;
+    uint64_t        tableOffset;        // Where the chunk table starts (the material table follows it).
+};
+
+// An entry of the chunk table.
+struct SphereChunksFileChunk_s {
+    float           min[3];
+    float           max[3];
+    uint64_t        offset;             // Where the nodes of the chunk start (its packets and spheres follow them).
+    uint32_t        spheresLength;
+    uint32_t        nodesLength;
+    uint32_t        packetsLength;
+    uint32_t        _padding;
+};
+
+// An entry of the material table.
+struct SphereChunksFileMaterial_s {
+    uint32_t        type;               // MaterialType.
+    uint32_t        _padding;
+    double          params[3];          // The material parameters, like in scene files (see scene_file.h): e.g. the fuzziness of a metal.
+};
+
+// A sphere of a chunk (64 bytes, instead of the 72 of a Sphere).
+struct SphereChunksFileSphere_s {
+    double          center[3];
+    double          radius;
+    double          color[3];
+    uint32_t        material;           // The index in the material table.
+    uint32_t        slot;               // Only used while writing: the index of the sphere in its group of chunks (0 in the file).
+};
+
+// The data of the leaf functions of the traversal of the chunks BVH (see sphere_chunks_intersect(), sphere_chunks_occluded()).
+struct ChunkRayCtx_s {
+    SphereChunks   *chunks;
+    Ray            *ray;
+    double          origin[3];
+    double          invDir[3];
+    Sphere         *sphere;
+    uint32_t        tests;
+    bool            ignoreLights;       // Only for occlude_chunks_leaf().
+
+    // If not NULL, the chunks that the ray goes through are only gathered into `pairs` (as the query `query`), not tested.
+    ChunkPairs     *pairs;
+    uint32_t        query;
+};
+
+// A chunk that a ray (a query of a batch) goes through.
+struct ChunkPair_s {
+    uint32_t        chunk;
+    uint32_t        query;
+    double          entry;              // The distance where the ray enters the bounds of the chunk.
+};
+
+struct ChunkPairs_s {
+    ChunkPair      *pairs;
+    uint32_t        length;
+    uint32_t        capacity;
+};
+
+// The pairs of a batch that go through the same chunk: pairs[first .. first + length).
+struct ChunkRun_s {
+    uint32_t        first;
+    uint32_t        length;
+    double          entry;              // The closest entry distance of the pairs.
+};
+
+
+// The materials of each MaterialType, that the spheres of the loaded chunks refer to.
+static Material * const chunkMaterials[MATERIAL_TYPES_COUNT] = {
+    [MT_matte]          = &matMatte,
+    [MT_metal]          = &matMetal,
+    [MT_dielectric]     = &matDielectric,
+    [MT_light]          = &matLight,
+    [MT_gradient_sky]   = &matGradientSky,
+    [MT_ground]         = &matGround,
+    [MT_shaded]         = &matShaded,
+};
+
+
+static SphereChunk * chunk_acquire(SphereChunks *chunks, uint32_t idx);
+static void chunk_release(SphereChunks *chunks, uint32_t idx);
+static uint8_t * chunk_read(SphereChunks *chunks, SphereChunk *chunk, uint64_t bytes);
+static void cache_evict(SphereChunks *chunks, uint64_t bytesNeeded);
+static void lru_remove(SphereChunks *chunks, uint32_t idx);
+static void lru_append(SphereChunks *chunks, uint32_t idx);
+static inline uint64_t chunk_bytes(SphereChunk *chunk);
+static inline bool chunk_intersect(SphereChunk *chunk, Ray *ray, double *dist, Sphere *sphere, uint32_t *tests);
+static inline WideBVH chunk_bvh(SphereChunk *chunk, Sphere **spheres);
+static inline bool ray_enters_chunk(SphereChunk *chunk, double *origin, double *invDir, double maxDist, double *entry);
+static void chunk_ray_ctx_init(ChunkRayCtx *ctx, SphereChunks *chunks, Ray *ray);
+static bool intersect_chunks_leaf(void *data, uint32_t first, uint32_t count, double *dist, uint32_t *chunkIdx);
+static bool occlude_chunks_leaf(void *data, uint32_t first, uint32_t count, double *dist, uint32_t *chunkIdx);
+static int chunk_pair_cmp(const void *a, const void *b);
+static int chunk_run_cmp(const void *a, const void *b);
+static void * matdata_create(SphereChunksFileMaterial *fm);
+static uint32_t writer_material(SphereChunksWriter *writer, Material *material, void *matData);
+static void writer_material_insert(SphereChunksWriter *writer, Material *material, void *matData, uint32_t index);
+static inline uint32_t writer_material_hash(Material *material, void *matData);
+static inline uint32_t morton_cell(SphereChunksWriter *writer, uint32_t bits, SphereChunksFileSphere *record);
+static bool write_chunk(FILE *f, SphereChunksFileSphere *records, uint32_t length, Sphere *spheres, SphereChunksFileChunk *entry,
+    uint64_t *offset);
+static char * path_with_suffix(const char *path, const char *suffix, uint32_t number);
+
+
+bool sphere_chunks_open(SphereChunks *chunks, const char *path, uint64_t cacheBytes)
+{
+    memset(chunks, 0, sizeof(SphereChunks));
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        log_err("Could not open chunk file \"%s\": %s\n", path, strerror(errno));
+        return false;
+    }
+
+    SphereChunksFileHeader header;
+    if (fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, SPHERE_CHUNKS_MAGIC, sizeof(header.magic)) != 0) {
+        log_err("Could not open chunk file \"%s\": it is not a chunk file (of this version)\n", path);
+        fclose(f);
+        return false;
+    }
+
+    // The tables (and each chunk) must lie within the file: their sizes are not trusted before they are allocated or read.
+    int64_t fileSize = file_seek_end(f) == 0 ? file_tell(f) : -1;
+    uint64_t tablesBytes = sizeof(SphereChunksFileChunk) * (uint64_t)header.chunksLength
+        + sizeof(SphereChunksFileMaterial) * (uint64_t)header.materialsLength;
+    if (fileSize < 0 || header.tableOffset > (uint64_t)fileSize || tablesBytes > (uint64_t)fileSize - header.tableOffset) {
+        log_err("Could not read the tables of chunk file \"%s\" (it is truncated or invalid)\n", path);
+        fclose(f);
+        return false;
+    }
+
+    SphereChunksFileChunk *fileChunks = rtalloc(sizeof(SphereChunksFileChunk) * ((size_t)header.chunksLength + 1));
+    SphereChunksFileMaterial *fileMaterials = rtalloc(sizeof(SphereChunksFileMaterial) * ((size_t)header.materialsLength + 1));
+    bool ok = file_seek(f, header.tableOffset) == 0
+        && fread(fileChunks, sizeof(SphereChunksFileChunk), header.chunksLength, f) == header.chunksLength
+        && fread(fileMaterials, sizeof(SphereChunksFileMaterial), header.materialsLength, f) == header.materialsLength;
+    for (uint32_t i = 0; i < header.materialsLength && ok; i++) {
+        ok = fileMaterials[i].type < MATERIAL_TYPES_COUNT;
+    }
+    for (uint32_t i = 0; i < header.chunksLength && ok; i++) {
+        SphereChunksFileChunk *fc = &fileChunks[i];
+        uint64_t chunkBytes = sizeof(WideBVHNode) * (uint64_t)fc->nodesLength + sizeof(WideBVHPacket) * (uint64_t)fc->packetsLength
+            + sizeof(SphereChunksFileSphere) * (uint64_t)fc->spheresLength;
+        ok = fc->offset >= sizeof(header) && fc->offset <= (uint64_t)fileSize && chunkBytes <= (uint64_t)fileSize - fc->offset;
+    }
+    if (! ok) {
+        log_err("Could not read the tables of chunk file \"%s\" (it is truncated or invalid)\n", path);
+        rtfree(fileChunks);
+        rtfree(fileMaterials);
+        fclose(f);
+        return false;
+    }
+
+    chunks->path = rtalloc(strlen(path) + 1);
+    strcpy(chunks->path, path);
+    chunks->file = f;
+    pthread_mutex_init(&chunks->fileMutex, NULL);
+    chunks->spheresLength = header.spheresLength;
+
+    chunks->materials = rtalloc(sizeof(SphereChunksMaterial) * ((size_t)header.materialsLength + 1));
+    chunks->materialsLength = header.materialsLength;
+    for (uint32_t i = 0; i < header.materialsLength; i++) {
+        chunks->materials[i].material = chunkMaterials[fileMaterials[i].type];
+        chunks->materials[i].matData = matdata_create(&fileMaterials[i]);
+    }
+
+    // The BVH over the bounds of the chunks reorders them: the chunks are stored in its order.
+    uint32_t chunksLength = header.chunksLength;
+    BVHBounds *bounds = rtalloc(sizeof(BVHBounds) * ((size_t)chunksLength + 1));
+    uint32_t *order = rtalloc(sizeof(uint32_t) * ((size_t)chunksLength + 1));
+    for (uint32_t i = 0; i < chunksLength; i++) {
+        memcpy(bounds[i].min, fileChunks[i].min, sizeof(bounds[i].min));
+        memcpy(bounds[i].max, fileChunks[i].max, sizeof(bounds[i].max));
+        order[i] = i;
+    }
+    bvh_init(&chunks->bvh);
+    bvh_build(&chunks->bvh, bounds, order, chunksLength);
+
+    chunks->chunks = rtalloc(sizeof(SphereChunk) * ((size_t)chunksLength + 1));
+    chunks->chunksLength = chunksLength;
+    for (uint32_t i = 0; i < chunksLength; i++) {
+        SphereChunksFileChunk *fc = &fileChunks[order[i]];
+        SphereChunk *chunk = &chunks->chunks[i];
+        memcpy(chunk->min, fc->min, sizeof(chunk->min));
+        memcpy(chunk->max, fc->max, sizeof(chunk->max));
+        chunk->offset = fc->offset;
+        chunk->spheresLength = fc->spheresLength;
+        chunk->nodesLength = fc->nodesLength;
+        chunk->packetsLength = fc->packetsLength;
+        chunk->data = NULL;
+        chunk->bytes = 0;
+        chunk->pins = 0;
+        chunk->loading = false;
+        chunk->lruPrev = SPHERE_CHUNKS_NONE;
+        chunk->lruNext = SPHERE_CHUNKS_NONE;
+    }
+
+    pthread_mutex_init(&chunks->mutex, NULL);
+    pthread_cond_init(&chunks->loadedCond, NULL);
+    chunks->cacheBytes = cacheBytes;
+    chunks->lruFirst = SPHERE_CHUNKS_NONE;
+    chunks->lruLast = SPHERE_CHUNKS_NONE;
+
+    rtfree(order);
+    rtfree(bounds);
+    rtfree(fileMaterials);
+    rtfree(fileChunks);
+    return true;
+}
+
+void sphere_chunks_close(SphereChunks *chunks)
+{
+    for (uint32_t i = 0; i < chunks->chunksLength; i++) {
+        rtfree(chunks->chunks[i].data);
+    }
+    rtfree(chunks->chunks);
+    chunks->chunks = NULL;
+    chunks->chunksLength = 0;
+    bvh_free(&chunks->bvh);
+    for (uint32_t i = 0; i < chunks->materialsLength; i++) {
+        rtfree(chunks->materials[i].matData);
+    }
+    rtfree(chunks->materials);
+    chunks->materials = NULL;
+    chunks->materialsLength = 0;
+    chunks->usedBytes = 0;
+
+    pthread_cond_destroy(&chunks->loadedCond);
+    pthread_mutex_destroy(&chunks->mutex);
+    pthread_mutex_destroy(&chunks->fileMutex);
+    fclose(chunks->file);
+    chunks->file = NULL;
+    rtfree(chunks->path);
+    chunks->path = NULL;
+}
+
+bool sphere_chunks_intersect(SphereChunks *chunks, Ray *ray, double *dist, Sphere *sphere, uint32_t *tests)
+{
+    ChunkRayCtx ctx;
+    chunk_ray_ctx_init(&ctx, chunks, ray);
+    ctx.sphere = sphere;
+
+    uint32_t chunkIdx;
+    bool hit = bvh_intersect(&chunks->bvh, &ray->origin, &ray->direction, intersect_chunks_leaf, &ctx, dist, &chunkIdx);
+    *tests += ctx.tests;
+    return hit;
+}
+
+bool sphere_chunks_occluded(SphereChunks *chunks, Ray *ray, double dist, bool ignoreLights, uint32_t *tests)
+{
+    ChunkRayCtx ctx;
+    chunk_ray_ctx_init(&ctx, chunks, ray);
+    ctx.ignoreLights = ignoreLights;
+
+    bool occluded = bvh_occluded(&chunks->bvh, &ray->origin, &ray->direction, occlude_chunks_leaf, &ctx, dist);
+    *tests += ctx.tests;
+    return occluded;
+}
+
+void sphere_chunks_intersect_batch(SphereChunks *chunks, SphereChunksQuery *queries, uint32_t count)
+{
+    // Gather the chunks that each ray goes through (closer than the ray's `dist`).
+    ChunkPairs pairs = {
+        .pairs      = rtalloc(sizeof(ChunkPair) * ((size_t)count + 1)),
+        .length     = 0,
+        .capacity   = count + 1,
+    };
+    for (uint32_t q = 0; q < count; q++) {
+        SphereChunksQuery *query = &queries[q];
+        query->hit = false;
+        query->tests = 0;
+
+        ChunkRayCtx ctx;
+        chunk_ray_ctx_init(&ctx, chunks, query->ray);
+        ctx.pairs = &pairs;
+        ctx.query = q;
+        uint32_t chunkIdx;
+        double dist = query->dist;
+        bvh_intersect(&chunks->bvh, &query->ray->origin, &query->ray->direction, intersect_chunks_leaf, &ctx, &dist, &chunkIdx);
+    }
+
+    // Group the pairs by their chunks, into runs, and visit the runs closest first (by the closest entry distance of their rays).
+    qsort(pairs.pairs, pairs.length, sizeof(ChunkPair), chunk_pair_cmp);
+    ChunkRun *runs = rtalloc(sizeof(ChunkRun) * ((size_t)pairs.length + 1));
+    uint32_t runsLength = 0;
+    for (uint32_t i = 0; i < pairs.length; i++) {
+        if (i == 0 || pairs.pairs[i].chunk != pairs.pairs[i - 1].chunk) {
+            runs[runsLength++] = (ChunkRun){.first = i, .length = 0, .entry = DBL_MAX};
+        }
+        ChunkRun *run = &runs[runsLength - 1];
+        run->length++;
+        run->entry = pairs.pairs[i].entry < run->entry ? pairs.pairs[i].entry : run->entry;
+    }
+    qsort(runs, runsLength, sizeof(ChunkRun), chunk_run_cmp);
+
+    for (uint32_t r = 0; r < runsLength; r++) {
+        ChunkPair *runPairs = &pairs.pairs[runs[r].first];
+        uint32_t runLength = runs[r].length;
+
+        // Skip (don't even load) the chunk, if all of its rays already hit something before they get to it.
+        bool needed = false;
+        for (uint32_t i = 0; i < runLength && ! needed; i++) {
+            needed = runPairs[i].entry < queries[runPairs[i].query].dist;
+        }
+        if (! needed) {
+            continue;
+        }
+
+        uint32_t chunkIdx = runPairs[0].chunk;
+        SphereChunk *chunk = chunk_acquire(chunks, chunkIdx);
+        for (uint32_t i = 0; i < runLength; i++) {
+            SphereChunksQuery *query = &queries[runPairs[i].query];
+            if (runPairs[i].entry < query->dist && chunk_intersect(chunk, query->ray, &query->dist, query->sphere, &query->tests)) {
+                query->hit = true;
+            }
+        }
+        chunk_release(chunks, chunkIdx);
+    }
+
+    rtfree(runs);
+    rtfree(pairs.pairs);
+}
+
+bool sphere_chunks_writer_open(SphereChunksWriter *writer, const char *path, uint32_t chunkSpheres)
+{
+    memset(writer, 0, sizeof(SphereChunksWriter));
+    writer->file = fopen(path, "wb");
+    if (writer->file == NULL) {
+        log_err("Could not open chunk file \"%s\" for writing: %s\n", path, strerror(errno));
+        return false;
+    }
+    char *spillPath = path_with_suffix(path, ".spill", UINT32_MAX);
+    writer->spill = fopen(spillPath, "w+b");
+    if (writer->spill == NULL) {
+        log_err("Could not create temporary file \"%s\": %s\n", spillPath, strerror(errno));
+        rtfree(spillPath);
+        fclose(writer->file);
+        remove(path);
+        return false;
+    }
+    rtfree(spillPath);
+
+    writer->path = rtalloc(strlen(path) + 1);
+    strcpy(writer->path, path);
+    writer->chunkSpheres = chunkSpheres > 0 ? chunkSpheres : 1;
+    writer->spheresLength = 0;
+    for (uint32_t a = 0; a < 3; a++) {
+        writer->min[a] = DBL_MAX;
+        writer->max[a] = -DBL_MAX;
+    }
+
+    writer->materials = calloc(SPHERE_CHUNKS_WRITER_MATERIALS, sizeof(SphereChunksWriterMaterial));
+    if (writer->materials == NULL) {
+        log_err("Error: could not allocate heap memory. Exiting.");
+        exit(1);
+    }
+    writer->materialsCapacity = SPHERE_CHUNKS_WRITER_MATERIALS;
+    writer->materialsLength = 0;
+    writer->fileMaterials = rtalloc(sizeof(SphereChunksFileMaterial) * (SPHERE_CHUNKS_WRITER_MATERIALS / 2));
+    return true;
+}
+
+void sphere_chunks_writer_add(SphereChunksWriter *writer, Sphere *sphere)
+{
+    SphereChunksFileSphere record = {
+        .center     = {sphere->center.x, sphere->center.y, sphere->center.z},
+        .radius     = sphere->radius,
+        .color      = {sphere->color.red, sphere->color.green, sphere->color.blue},
+        .material   = writer_material(writer, sphere->material, sphere->matData),
+        .slot       = 0,
+    };
+    // (Write errors are checked by sphere_chunks_writer_close().)
+    fwrite(&record, sizeof(record), 1, writer->spill);
+
+    for (uint32_t a = 0; a < 3; a++) {
+        writer->min[a] = record.center[a] < writer->min[a] ? record.center[a] : writer->min[a];
+        writer->max[a] = record.center[a] > writer->max[a] ? record.center[a] : writer->max[a];
+    }
+    writer->spheresLength++;
+}
+
+bool sphere_chunks_writer_close(SphereChunksWriter *writer)
+{
+    const char *path = writer->path;
+    FILE *f = writer->file;
+    FILE *spill = writer->spill;
+    bool ok = fflush(spill) == 0;
+    SphereChunksFileSphere *buffer = rtalloc(sizeof(SphereChunksFileSphere) * SPHERE_CHUNKS_IO_RECORDS);
+
+    // Count the spheres in each cell: about 8 spheres per cell (so the chunks are split at cell boundaries, in most cases).
+    uint32_t bits = 1;
+    while (bits < SPHERE_CHUNKS_MORTON_BITS && ((uint64_t)1 << (3 * bits)) * 8 < writer->spheresLength) {
+        bits++;
+    }
+    uint32_t cellsLength = 1u << (3 * bits);
+    uint64_t *cellFirst = calloc(cellsLength, sizeof(uint64_t));
+    uint32_t *cellSeen = rtalloc(sizeof(uint32_t) * cellsLength);
+    if (cellFirst == NULL) {
+        log_err("Error: could not allocate heap memory. Exiting.");
+        exit(1);
+    }
+    rewind(spill);
+    for (size_t n; ok && (n = fread(buffer, sizeof(SphereChunksFileSphere), SPHERE_CHUNKS_IO_RECORDS, spill)) > 0; ) {
+        for (size_t i = 0; i < n; i++) {
+            cellFirst[morton_cell(writer, bits, &buffer[i])]++;
+        }
+    }
+    ok = ok && ! ferror(spill);
+
+    // Turn the counts into the index (rank) of the first sphere of each cell, in the Morton order of the cells, and split the ranks into
+    // the chunks: chunk c has the spheres of the ranks [chunkFirst[c], chunkFirst[c + 1]).
+    uint32_t chunkSpheres = writer->chunkSpheres;
+    // (Two consecutive chunks have more than `chunkSpheres` spheres, otherwise they would be one chunk.)
+    uint64_t chunkFirstCapacity = (writer->spheresLength / chunkSpheres + 1) * 2 + 2;
+    uint64_t *chunkFirst = rtalloc(sizeof(uint64_t) * chunkFirstCapacity);
+    uint32_t chunksLength = 0;
+    uint64_t rank = 0;
+    uint64_t chunkStart = 0;
+    chunkFirst[0] = 0;
+    for (uint32_t c = 0; c < cellsLength; c++) {
+        uint64_t count = cellFirst[c];
+        cellFirst[c] = rank;
+        if (count == 0) {
+            continue;
+        }
+        if (rank > chunkStart && rank + count - chunkStart > chunkSpheres) {
+            chunkFirst[++chunksLength] = chunkStart = rank;
+        }
+        rank += count;
+        while (rank - chunkStart > chunkSpheres) {
+            // (Only when a single cell has more than `chunkSpheres` spheres.)
+            chunkStart += chunkSpheres;
+            chunkFirst[++chunksLength] = chunkStart;
+        }
+    }
+    if (rank > chunkStart) {
+        chunkFirst[++chunksLength] = rank;
+    }
+
+    // Group the chunks, so that each group has at most SPHERE_CHUNKS_WRITE_BATCH spheres (or a single chunk): group g has the chunks
+    // [groupFirst[g], groupFirst[g + 1]).
+    uint32_t *groupFirst = rtalloc(sizeof(uint32_t) * ((size_t)chunksLength + 1));
+    uint32_t groupsLength = 0;
+    for (uint32_t c = 0; c < chunksLength; ) {
+        uint32_t end = c + 1;
+        while (end < chunksLength && chunkFirst[end + 1] - chunkFirst[c] <= SPHERE_CHUNKS_WRITE_BATCH) {
+            end++;
+        }
+        groupFirst[groupsLength++] = c;
+        c = end;
+    }
+    groupFirst[groupsLength] = chunksLength;
+
+    SphereChunksFileHeader header;
+    memset(&header, 0, sizeof(header));
+    ok = ok && fwrite(&header, sizeof(header), 1, f) == 1;
+    uint64_t offset = sizeof(header);
+    SphereChunksFileChunk *table = rtalloc(sizeof(SphereChunksFileChunk) * ((size_t)chunksLength + 1));
+    SphereChunksFileSphere *records = NULL;
+    Sphere *spheres = rtalloc(sizeof(Sphere) * chunkSpheres);
+
+    // The spheres of up to SPHERE_CHUNKS_BUCKETS_MAX groups at a time are distributed from the spill file into a temporary file per group
+    // (in any order, with their rank in the group), then each group is read back into memory (sorted by the ranks) and its chunks are
+    // built and written.
+    FILE *buckets[SPHERE_CHUNKS_BUCKETS_MAX];
+    for (uint32_t passFirst = 0; passFirst < groupsLength && ok; passFirst += SPHERE_CHUNKS_BUCKETS_MAX) {
+        uint32_t passEnd = passFirst + SPHERE_CHUNKS_BUCKETS_MAX < groupsLength ? passFirst + SPHERE_CHUNKS_BUCKETS_MAX : groupsLength;
+        for (uint32_t g = passFirst; g < passEnd; g++) {
+            char *bucketPath = path_with_suffix(path, ".spill.", g);
+            buckets[g - passFirst] = fopen(bucketPath, "w+b");
+            if (buckets[g - passFirst] == NULL) {
+                log_err("Could not create temporary file \"%s\": %s\n", bucketPath, strerror(errno));
+                ok = false;
+                passEnd = g;
+            }
+            rtfree(bucketPath);
+        }
+
+        // Going through the spheres in the same order every pass gives every sphere the same rank.
+        memset(cellSeen, 0, sizeof(uint32_t) * cellsLength);
+        rewind(spill);
+        for (size_t n; ok && (n = fread(buffer, sizeof(SphereChunksFileSphere), SPHERE_CHUNKS_IO_RECORDS, spill)) > 0; ) {
+            for (size_t i = 0; i < n; i++) {
+                uint32_t cell = morton_cell(writer, bits, &buffer[i]);
+                uint64_t sphereRank = cellFirst[cell] + cellSeen[cell]++;
+
+                // The group of the sphere: the last one that starts at or before its rank.
+                uint32_t lo = 0, hi = groupsLength;
+                while (hi - lo > 1) {
+                    uint32_t mid = (lo + hi) / 2;
+                    if (chunkFirst[groupFirst[mid]] <= sphereRank) {
+                        lo = mid;
+                    } else {
+                        hi = mid;
+                    }
+                }
+                if (lo >= passFirst && lo < passEnd) {
+                    buffer[i].slot = (uint32_t)(sphereRank - chunkFirst[groupFirst[lo]]);
+                    ok = ok && fwrite(&buffer[i], sizeof(SphereChunksFileSphere), 1, buckets[lo - passFirst]) == 1;
+                }
+            }
+        }
+        ok = ok && ! ferror(spill);
+
+        for (uint32_t g = passFirst; g < passEnd; g++) {
+            FILE *bucket = buckets[g - passFirst];
+            uint64_t groupRank = chunkFirst[groupFirst[g]];
+            uint32_t groupSpheres = (uint32_t)(chunkFirst[groupFirst[g + 1]] - groupRank);
+            records = rtrealloc(records, sizeof(SphereChunksFileSphere) * groupSpheres);
+            ok = ok && fflush(bucket) == 0;
+            rewind(bucket);
+            for (size_t n; ok && (n = fread(buffer, sizeof(SphereChunksFileSphere), SPHERE_CHUNKS_IO_RECORDS, bucket)) > 0; ) {
+                for (size_t i = 0; i < n; i++) {
+                    records[buffer[i].slot] = buffer[i];
+                }
+            }
+            ok = ok && ! ferror(bucket);
+            fclose(bucket);
+            char *bucketPath = path_with_suffix(path, ".spill.", g);
+            remove(bucketPath);
+            rtfree(bucketPath);
+
+            for (uint32_t c = groupFirst[g]; c < groupFirst[g + 1] && ok; c++) {
+                ok = write_chunk(f, &records[chunkFirst[c] - groupRank], (uint32_t)(chunkFirst[c + 1] - chunkFirst[c]), spheres, &table[c],
+                    &offset);
+            }
+        }
+    }
+
+    header = (SphereChunksFileHeader){
+        .chunksLength       = chunksLength,
+        .materialsLength    = writer->materialsLength,
+        .spheresLength      = writer->spheresLength,
+        .tableOffset        = offset,
+    };
+    memcpy(header.magic, SPHERE_CHUNKS_MAGIC, sizeof(header.magic));
+    ok = ok && fwrite(table, sizeof(SphereChunksFileChunk), chunksLength, f) == chunksLength
+        && fwrite(writer->fileMaterials, sizeof(SphereChunksFileMaterial), writer->materialsLength, f) == writer->materialsLength
+        && file_seek(f, 0) == 0 && fwrite(&header, sizeof(header), 1, f) == 1;
+
+    bool written = ! ferror(f);
+    if (fclose(f) != 0 || ! written || ! ok) {
+        log_err("Could not write chunk file \"%s\": %s\n", path, strerror(errno));
+        ok = false;
+    }
+    fclose(spill);
+    char *spillPath = path_with_suffix(path, ".spill", UINT32_MAX);
+    remove(spillPath);
+    rtfree(spillPath);
+    if (! ok) {
+        remove(path);
+    }
+
+    rtfree(spheres);
+    rtfree(records);
+    rtfree(table);
+    rtfree(groupFirst);
+    rtfree(chunkFirst);
+    rtfree(cellSeen);
+    rtfree(cellFirst);
+    rtfree(buffer);
+    rtfree(writer->fileMaterials);
+    rtfree(writer->materials);
+    rtfree(writer->path);
+    memset(writer, 0, sizeof(SphereChunksWriter));
+    return ok;
+}
+
+/**
+ * Returns the chunk `idx` of `chunks`, loaded (reading it from the file if it is not loaded yet) and pinned: it is not evicted until
+ * chunk_release().
+ */
+static SphereChunk * chunk_acquire(SphereChunks *chunks, uint32_t idx)
+{
+    SphereChunk *chunk = &chunks->chunks[idx];
+    pthread_mutex_lock(&chunks->mutex);
+    while (chunk->loading) {
+        pthread_cond_wait(&chunks->loadedCond, &chunks->mutex);
+    }
+    if (chunk->data != NULL) {
+        if (chunk->pins == 0) {
+            lru_remove(chunks, idx);
+        }
+        chunk->pins++;
+        chunks->hits++;
+        pthread_mutex_unlock(&chunks->mutex);
+        return chunk;
+    }
+
+    // Make room for the chunk and load it without holding the lock (so the other threads can use the loaded chunks meanwhile).
+    uint64_t bytes = chunk_bytes(chunk);
+    cache_evict(chunks, bytes);
+    chunks->usedBytes += bytes;
+    chunks->peakBytes = chunks->usedBytes > chunks->peakBytes ? chunks->usedBytes : chunks->peakBytes;
+    chunk->loading = true;
+    chunk->pins = 1;
+    pthread_mutex_unlock(&chunks->mutex);
+
+    uint8_t *data = chunk_read(chunks, chunk, bytes);
+
+    pthread_mutex_lock(&chunks->mutex);
+    chunk->data = data;
+    chunk->bytes = bytes;
+    chunk->loading = false;
+    chunks->loads++;
+    chunks->bytesRead += sizeof(WideBVHNode) * (uint64_t)chunk->nodesLength + sizeof(WideBVHPacket) * (uint64_t)chunk->packetsLength
+        + sizeof(SphereChunksFileSphere) * (uint64_t)chunk->spheresLength;
+    pthread_cond_broadcast(&chunks->loadedCond);
+    pthread_mutex_unlock(&chunks->mutex);
+    return chunk;
+}
+
+/**
+ * Unpins the chunk `idx` (see chunk_acquire()): it stays loaded, until it is the least recently used chunk and the cache needs room.
+ */
+static void chunk_release(SphereChunks *chunks, uint32_t idx)
+{
+    pthread_mutex_lock(&chunks->mutex);
+    if (--chunks->chunks[idx].pins == 0) {
+        lru_append(chunks, idx);
+
+        // The cache may have been over its limit, while this chunk was in use.
+        cache_evict(chunks, 0);
+    }
+    pthread_mutex_unlock(&chunks->mutex);
+}
+
+/**
+ * Reads `chunk` (of `bytes` in memory) from the chunk file and returns it. Exits the program if it cannot be read (the file was valid when
+ * it was opened, so it must have been changed or truncated since) or if its spheres or its BVH are invalid (see wide_bvh_valid()).
+ */
+static uint8_t * chunk_read(SphereChunks *chunks, SphereChunk *chunk, uint64_t bytes)
+{
+    uint8_t *data = rtalloc(bytes);
+    uint32_t length = chunk->spheresLength;
+    size_t nodesBytes = sizeof(WideBVHNode) * (size_t)chunk->nodesLength;
+    size_t packetsBytes = sizeof(WideBVHPacket) * (size_t)chunk->packetsLength;
+
+    // The sphere records are smaller than the Spheres: they are read into the end of the memory of the spheres and converted in place,
+    // first to last (sphere i ends before record i + 1 starts).
+    Sphere *spheres = (Sphere *)(data + nodesBytes + packetsBytes);
+    SphereChunksFileSphere *records = (SphereChunksFileSphere *)(data + bytes - sizeof(SphereChunksFileSphere) * length);
+
+    pthread_mutex_lock(&chunks->fileMutex);
+    FILE *f = chunks->file;
+    bool ok = file_seek(f, chunk->offset) == 0 && fread(data, 1, nodesBytes + packetsBytes, f) == nodesBytes + packetsBytes
+        && fread(records, sizeof(SphereChunksFileSphere), length, f) == length;
+    pthread_mutex_unlock(&chunks->fileMutex);
+    if (! ok) {
+        log_err("Fatal error: could not read a chunk of chunk file \"%s\" (it was truncated or changed). Exiting.\n", chunks->path);
+        exit(1);
+    }
+
+    for (uint32_t i = 0; i < length; i++) {
+        SphereChunksFileSphere record = records[i];
+        if (record.material >= chunks->materialsLength) {
+            log_err("Fatal error: a sphere of chunk file \"%s\" has an invalid material. Exiting.\n", chunks->path);
+            exit(1);
+        }
+        SphereChunksMaterial *m = &chunks->materials[record.material];
+        spheres[i] = (Sphere){
+            .center     = {.x = record.center[0], .y = record.center[1], .z = record.center[2]},
+            .radius     = record.radius,
+            .material   = m->material,
+            .matData    = m->matData,
+            .color      = {.red = record.color[0], .green = record.color[1], .blue = record.color[2]},
+        };
+    }
+
+    // The nodes and packets are used as they are: a node or sphere index out of bounds would crash the traversal.
+    WideBVH bvh = {
+        .nodes          = (WideBVHNode *)data,
+        .nodesLength    = chunk->nodesLength,
+        .packets        = (WideBVHPacket *)(data + nodesBytes),
+        .packetsLength  = chunk->packetsLength,
+    };
+    if (! wide_bvh_valid(&bvh, length)) {
+        log_err("Fatal error: a chunk of chunk file \"%s\" has an invalid BVH. Exiting.\n", chunks->path);
+        exit(1);
+    }
+    return data;
+}
+
+/**
+ * Evicts the least recently used (loaded, not in use) chunks, until the cache has room for `bytesNeeded` more bytes (or there are no more
+ * chunks to evict). Must be called with the lock held.
+ */
+static void cache_evict(SphereChunks *chunks, uint64_t bytesNeeded)
+{
+    while (chunks->usedBytes + bytesNeeded > chunks->cacheBytes && chunks->lruFirst != SPHERE_CHUNKS_NONE) {
+        uint32_t idx = chunks->lruFirst;
+        SphereChunk *chunk = &chunks->chunks[idx];
+        lru_remove(chunks, idx);
+        rtfree(chunk->data);
+        chunk->data = NULL;
+        chunks->usedBytes -= chunk->bytes;
+        chunks->evictions++;
+    }
+}
+
+static void lru_remove(SphereChunks *chunks, uint32_t idx)
+{
+    SphereChunk *chunk = &chunks->chunks[idx];
+    if (chunk->lruPrev != SPHERE_CHUNKS_NONE) {
+        chunks->chunks[chunk->lruPrev].lruNext = chunk->lruNext;
+    } else {
+        chunks->lruFirst = chunk->lruNext;
+    }
+    if (chunk->lruNext != SPHERE_CHUNKS_NONE) {
+        chunks->chunks[chunk->lruNext].lruPrev = chunk->lruPrev;
+    } else {
+        chunks->lruLast = chunk->lruPrev;
+    }
+    chunk->lruPrev = SPHERE_CHUNKS_NONE;
+    chunk->lruNext = SPHERE_CHUNKS_NONE;
+}
+
+static void lru_append(SphereChunks *chunks, uint32_t idx)
+{
+    SphereChunk *chunk = &chunks->chunks[idx];
+    chunk->lruPrev = chunks->lruLast;
+    chunk->lruNext = SPHERE_CHUNKS_NONE;
+    if (chunks->lruLast != SPHERE_CHUNKS_NONE) {
+        chunks->chunks[chunks->lruLast].lruNext = idx;
+    } else {
+        chunks->lruFirst = idx;
+    }
+    chunks->lruLast = idx;
+}
+
+/**
+ * Returns the size of `chunk` in memory (see SphereChunk.data).
+ */
+static inline uint64_t chunk_bytes(SphereChunk *chunk)
+{
+    return sizeof(WideBVHNode) * (uint64_t)chunk->nodesLength + sizeof(WideBVHPacket) * (uint64_t)chunk->packetsLength
+        + sizeof(Sphere) * (uint64_t)chunk->spheresLength;
+}
+
+/**
+ * Finds the closest sphere of the (loaded) `chunk` that `ray` hits closer than `*dist`, like wide_bvh_intersect(). If there is one, copies
+ * it into `*sphere` and returns true.
+ */
+static inline bool chunk_intersect(SphereChunk *chunk, Ray *ray, double *dist, Sphere *sphere, uint32_t *tests)
+{
+    Sphere *spheres;
+    WideBVH bvh = chunk_bvh(chunk, &spheres);
+    Sphere *hit = wide_bvh_intersect(&bvh, spheres, ray, dist, tests);
+    if (hit == NULL) {
+        return false;
+    }
+    *sphere = *hit;
+    return true;
+}
+
+/**
+ * Returns a (read-only) view of the wide BVH of the loaded `chunk` and stores (a pointer to) its spheres in `*spheres`.
+ */
+static inline WideBVH chunk_bvh(SphereChunk *chunk, Sphere **spheres)
+{
+    size_t nodesBytes = sizeof(WideBVHNode) * (size_t)chunk->nodesLength;
+    size_t packetsBytes = sizeof(WideBVHPacket) * (size_t)chunk->packetsLength;
+    *spheres = (Sphere *)(chunk->data + nodesBytes + packetsBytes);
+    return (WideBVH){
+        .nodes          = (WideBVHNode *)chunk->data,
+        .nodesLength    = chunk->nodesLength,
+        .packets        = (WideBVHPacket *)(chunk->data + nodesBytes),
+        .packetsLength  = chunk->packetsLength,
+    };
+}
+
+/**
+ * Returns true if the ray (with `origin` and the inverted direction `invDir`) enters the bounds of `chunk` at a distance [RAY_DISTANCE_MIN,
+ * maxDist] (or starts inside them) and stores that distance in `*entry`.
+ */
+static inline bool ray_enters_chunk(SphereChunk *chunk, double *origin, double *invDir, double maxDist, double *entry)
+{
+    // (The same test as for the nodes of the BVH over the chunks.)
+    BVHNode box;
+    memcpy(box.min, chunk->min, sizeof(box.min));
+    memcpy(box.max, chunk->max, sizeof(box.max));
+    return bvh_ray_hits_node(&box, origin, invDir, maxDist, entry);
+}
+
+static void chunk_ray_ctx_init(ChunkRayCtx *ctx, SphereChunks *chunks, Ray *ray)
+{
+    ctx->chunks = chunks;
+    ctx->ray = ray;
+    ctx->origin[0] = ray->origin.x;
+    ctx->origin[1] = ray->origin.y;
+    ctx->origin[2] = ray->origin.z;
+    ctx->invDir[0] = 1.0 / ray->direction.x;
+    ctx->invDir[1] = 1.0 / ray->direction.y;
+    ctx->invDir[2] = 1.0 / ray->direction.z;
+    ctx->sphere = NULL;
+    ctx->tests = 0;
+    ctx->ignoreLights = false;
+    ctx->pairs = NULL;
+    ctx->query = 0;
+}
+
+/**
+ * The leaf function of the traversal of the BVH over the chunks (see BVHLeafFn): tests the ray against the spheres of the chunks [first,
+ * first + count) that it goes through (loading them), or only gathers them (see ChunkRayCtx.pairs).
+ */
+static bool intersect_chunks_leaf(void *data, uint32_t first, uint32_t count, double *dist, uint32_t *chunkIdx)
+{
+    ChunkRayCtx *ctx = data;
+    bool hit = false;
+    for (uint32_t i = first; i < first + count; i++) {
+        double entry;
+        if (! ray_enters_chunk(&ctx->chunks->chunks[i], ctx->origin, ctx->invDir, *dist, &entry)) {
+            continue;
+        }
+
+        if (ctx->pairs != NULL) {
+            ChunkPairs *pairs = ctx->pairs;
+            if (pairs->length == pairs->capacity) {
+                pairs->capacity *= 2;
+                pairs->pairs = rtrealloc(pairs->pairs, sizeof(ChunkPair) * pairs->capacity);
+            }
+            pairs->pairs[pairs->length++] = (ChunkPair){.chunk = i, .query = ctx->query, .entry = entry};
+            continue;
+        }
+
+        SphereChunk *chunk = chunk_acquire(ctx->chunks, i);
+        if (chunk_intersect(chunk, ctx->ray, dist, ctx->sphere, &ctx->tests)) {
+            hit = true;
+            *chunkIdx = i;
+        }
+        chunk_release(ctx->chunks, i);
+    }
+    return hit;
+}
+
+/**
+ * The leaf function of sphere_chunks_occluded(): returns at the first of the chunks [first, first + count) that the ray hits any sphere
+ * of (loading the chunks that it goes through, until then).
+ */
+static bool occlude_chunks_leaf(void *data, uint32_t first, uint32_t count, double *dist, uint32_t *chunkIdx)
+{
+    ChunkRayCtx *ctx = data;
+    for (uint32_t i = first; i < first + count; i++) {
+        double entry;
+        if (! ray_enters_chunk(&ctx->chunks->chunks[i], ctx->origin, ctx->invDir, *dist, &entry)) {
+            continue;
+        }
+
+        SphereChunk *chunk = chunk_acquire(ctx->chunks, i);
+        Sphere *spheres;
+        WideBVH bvh = chunk_bvh(chunk, &spheres);
+        bool occluded = wide_bvh_occluded(&bvh, spheres, ctx->ray, *dist, ctx->ignoreLights, &ctx->tests);
+        chunk_release(ctx->chunks, i);
+        if (occluded) {
+            *chunkIdx = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static int chunk_pair_cmp(const void *a, const void *b)
+{
+    const ChunkPair *pa = a;
+    const ChunkPair *pb = b;
+    if (pa->chunk != pb->chunk) {
+        return pa->chunk < pb->chunk ? -1 : 1;
+    }
+    return pa->query < pb->query ? -1 : (pa->query > pb->query);
+}
+
+static int chunk_run_cmp(const void *a, const void *b)
+{
+    const ChunkRun *ra = a;
+    const ChunkRun *rb = b;
+    if (ra->entry != rb->entry) {
+        return ra->entry < rb->entry ? -1 : 1;
+    }
+    return ra->first < rb->first ? -1 : (ra->first > rb->first);
+}
+
+/**
+ * Creates the material data of the material table entry `fm` (NULL for the materials without parameters).
+ */
+static void * matdata_create(SphereChunksFileMaterial *fm)
+{
+    Sphere tmp;
+    switch (fm->type) {
+        case MT_metal:
+            return sphere_metal_init(&tmp, fm->params[0])->matData;
+        case MT_dielectric:
+            return sphere_dielectric_init(&tmp, fm->params[0])->matData;
+        case MT_light:
+            return sphere_light_init(&tmp, (Color){.red = fm->params[0], .green = fm->params[1], .blue = fm->params[2]})->matData;
+        default:
+            return NULL;
+    }
+}
+
+/**
+ * Returns the index of the material table entry of `material` with `matData`, adding it to the table if it is not there yet.
+ */
+static uint32_t writer_material(SphereChunksWriter *writer, Material *material, void *matData)
+{
+    uint32_t mask = writer->materialsCapacity - 1;
+    for (uint32_t i = writer_material_hash(material, matData) & mask; ; i = (i + 1) & mask) {
+        SphereChunksWriterMaterial *e = &writer->materials[i];
+        if (e->material == NULL) {
+            break;
+        }
+        if (e->material == material && e->matData == matData) {
+            return e->index;
+        }
+    }
+
+    // Keep the load factor <= 1/2 (the material table of the file has room for half of the capacity).
+    if ((writer->materialsLength + 1) * 2 > writer->materialsCapacity) {
+        SphereChunksWriterMaterial *old = writer->materials;
+        uint32_t oldCapacity = writer->materialsCapacity;
+        writer->materials = calloc((size_t)oldCapacity * 2, sizeof(SphereChunksWriterMaterial));
+        if (writer->materials == NULL) {
+            log_err("Error: could not allocate heap memory. Exiting.");
+            exit(1);
+        }
+        writer->materialsCapacity = oldCapacity * 2;
+        for (uint32_t i = 0; i < oldCapacity; i++) {
+            if (old[i].material != NULL) {
+                writer_material_insert(writer, old[i].material, old[i].matData, old[i].index);
+            }
+        }
+        rtfree(old);
+        writer->fileMaterials = rtrealloc(writer->fileMaterials, sizeof(SphereChunksFileMaterial) * (writer->materialsCapacity / 2));
+    }
+
+    uint32_t index = writer->materialsLength++;
+    writer_material_insert(writer, material, matData, index);
+
+    SphereChunksFileMaterial *fm = &writer->fileMaterials[index];
+    memset(fm, 0, sizeof(SphereChunksFileMaterial));
+    fm->type = material->type;
+    if (material->type == MT_metal) {
+        fm->params[0] = ((MaterialDataMetal *)matData)->fuzziness;
+    } else if (material->type == MT_dielectric) {
+        fm->params[0] = ((MaterialDataDielectric *)matData)->refractionIndex;
+    } else if (material->type == MT_light) {
+        Color *c = &((MaterialDataLight *)matData)->color;
+        fm->params[0] = c->red;
+        fm->params[1] = c->green;
+        fm->params[2] = c->blue;
+    }
+    return index;
+}
+
+static void writer_material_insert(SphereChunksWriter *writer, Material *material, void *matData, uint32_t index)
+{
+    uint32_t mask = writer->materialsCapacity - 1;
+    uint32_t i = writer_material_hash(material, matData) & mask;
+    while (writer->materials[i].material != NULL) {
+        i = (i + 1) & mask;
+    }
+    writer->materials[i] = (SphereChunksWriterMaterial){.material = material, .matData = matData, .index = index};
+}
+
+static inline uint32_t writer_material_hash(Material *material, void *matData)
+{
+    // FNV-1a over the two pointers.
+    uintptr_t ptrs[2] = {(uintptr_t)material, (uintptr_t)matData};
+    const unsigned char *bytes = (const unsigned char *)ptrs;
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < sizeof(ptrs); i++) {
+        h = (h ^ bytes[i]) * 1099511628211ULL;
+    }
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+/**
+ * Returns the index of the cell (of a grid of 2^`bits` cells along each axis, over the bounds of the centers of the spheres of `writer`)
+ * that the center of `record` is in, in the Morton order of the cells: the bits of the x, y and z coordinates of the cell, interleaved.
+ */
+static inline uint32_t morton_cell(SphereChunksWriter *writer, uint32_t bits, SphereChunksFileSphere *record)
+{
+    uint32_t res = 1u << bits;
+    uint32_t q[3];
+    for (uint32_t a = 0; a < 3; a++) {
+        double extent = writer->max[a] - writer->min[a];
+        double t = extent > 0 ? (record->center[a] - writer->min[a]) / extent * res : 0;
+        q[a] = t < res ? (uint32_t)t : res - 1;
+    }
+
+    uint32_t code = 0;
+    for (uint32_t b = 0; b < bits; b++) {
+        code |= ((q[0] >> b) & 1) << (3 * b);
+        code |= ((q[1] >> b) & 1) << (3 * b + 1);
+        code |= ((q[2] >> b) & 1) << (3 * b + 2);
+    }
+    return code;
+}
+
+/**
+ * Builds a chunk of the `length` sphere `records` (using `spheres` as scratch memory, for the wide BVH), writes it into `f` at `*offset`
+ * (advancing it past the chunk) and fills its chunk table `entry`. Returns false if it could not be written.
+ */
+static bool write_chunk(FILE *f, SphereChunksFileSphere *records, uint32_t length, Sphere *spheres, SphereChunksFileChunk *entry,
+    uint64_t *offset)
+{
+    Vector3 min = {.x = DBL_MAX, .y = DBL_MAX, .z = DBL_MAX};
+    Vector3 max = {.x = -DBL_MAX, .y = -DBL_MAX, .z = -DBL_MAX};
+    for (uint32_t i = 0; i < length; i++) {
+        SphereChunksFileSphere *r = &records[i];
+        r->slot = 0;
+        spheres[i] = (Sphere){
+            .center     = {.x = r->center[0], .y = r->center[1], .z = r->center[2]},
+            .radius     = r->radius,
+            .material   = NULL,
+            .matData    = NULL,
+            .color      = {.red = 0, .green = 0, .blue = 0},
+        };
+        min.x = fmin(min.x, r->center[0] - r->radius);
+        min.y = fmin(min.y, r->center[1] - r->radius);
+        min.z = fmin(min.z, r->center[2] - r->radius);
+        max.x = fmax(max.x, r->center[0] + r->radius);
+        max.y = fmax(max.y, r->center[1] + r->radius);
+        max.z = fmax(max.z, r->center[2] + r->radius);
+    }
+
+    WideBVH bvh;
+    wide_bvh_init(&bvh);
+    wide_bvh_build(&bvh, spheres, length);
+
+    BVHBounds bounds;
+    bvh_bounds_set(&bounds, &min, &max);
+    *entry = (SphereChunksFileChunk){
+        .offset         = *offset,
+        .spheresLength  = length,
+        .nodesLength    = bvh.nodesLength,
+        .packetsLength  = bvh.packetsLength,
+        ._padding       = 0,
+    };
+    memcpy(entry->min, bounds.min, sizeof(entry->min));
+    memcpy(entry->max, bounds.max, sizeof(entry->max));
+
+    bool ok = fwrite(bvh.nodes, sizeof(WideBVHNode), bvh.nodesLength, f) == bvh.nodesLength
+        && fwrite(bvh.packets, sizeof(WideBVHPacket), bvh.packetsLength, f) == bvh.packetsLength
+        && fwrite(records, sizeof(SphereChunksFileSphere), length, f) == length;
+    *offset += sizeof(WideBVHNode) * (uint64_t)bvh.nodesLength + sizeof(WideBVHPacket) * (uint64_t)bvh.packetsLength
+        + sizeof(SphereChunksFileSphere) * (uint64_t)length;
+    wide_bvh_free(&bvh);
+    return ok;
+}
+
+/**
+ * Returns (a newly allocated) `path` + `suffix` (+ `number`, unless it is UINT32_MAX).
+ */
+static char * path_with_suffix(const char *path, const char *suffix, uint32_t number)
+{
+    size_t length = strlen(path) + strlen(suffix) + 11;
+    char *res = rtalloc(length);
+    if (number == UINT32_MAX) {
+        snprintf(res, length, "%s%s", path, suffix);
+    } else {
+        snprintf(res, length, "%s%s%u", path, suffix, number);
+    }
+    return res;
+}
@@ -0,0 +1,218 @@
+#ifndef __SPHERE_CHUNKS_H__
+#define __SPHERE_CHUNKS_H__
+
+/**
+ * Out-of-core spheres: for scenes with more spheres than fit into memory (e.g. simulation outputs with billions of particles). The spheres
+ * are stored in a chunk file, split into spatially coherent chunks, each with its own wide BVH (see wide_bvh.h). Only the chunk table
+ * (and a binary BVH over the bounds of the chunks, see bvh.h) is kept in memory. The chunks themselves are read from the file when rays
+ * get to their bounds, into a cache of at most `cacheBytes` (the least recently used chunks are evicted to make room for new ones).
+ *
+ * The chunk file is written by a SphereChunksWriter, which takes the spheres one at a time (so they don't have to be in memory all at
+ * once either): it spills them into a temporary file, sorts them (by the Morton codes of the cells of a grid over their centers, see
+ * sphere_chunks_writer_close()) into chunks of up to `chunkSpheres` spheres and builds and writes the chunks a group at a time.
+ *
+ * Tracing single rays through the chunks (see sphere_chunks_intersect()) loads every chunk that any ray goes through, in whatever order
+ * the rays come. When the cache is much smaller than the scene, the same chunks get loaded over and over again. So rays are traced in
+ * batches instead (see sphere_chunks_intersect_batch()): the rays of a batch are grouped by the chunks they go through and each chunk is
+ * loaded once for the whole group. The chunks are visited closest first, so rays that already hit something are not tested against (and
+ * don't load) the chunks behind the hit.
+ *
+ * The chunk file layout (native byte order, it is not meant to be moved between machines): a header (SphereChunksFileHeader in
+ * sphere_chunks.c), the chunks (each: its wide BVH nodes, its packets and its spheres, as SphereChunksFileSphere records), the chunk table
+ * and the material table (a material type and its parameters, referred to by the index of the sphere records).
+ */
+
+typedef struct SphereChunks_s           SphereChunks;
+typedef struct SphereChunk_s            SphereChunk;
+typedef struct SphereChunksMaterial_s   SphereChunksMaterial;
+typedef struct SphereChunksQuery_s      SphereChunksQuery;
+typedef struct SphereChunksWriter_s     SphereChunksWriter;
+typedef struct SphereChunksWriterMaterial_s SphereChunksWriterMaterial;
+typedef struct SphereChunksFileMaterial_s   SphereChunksFileMaterial;      // The material table entries (see sphere_chunks.c).
+
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bvh.h"
+#include "ray.h"
+#include "sphere.h"
+
+
+// The magic bytes at the start of a chunk file (the last one is the version of the format).
+#define SPHERE_CHUNKS_MAGIC             "TOYRTSC1"
+
+// The default amount of spheres per chunk (see sphere_chunks_writer_open()).
+#define SPHERE_CHUNKS_SPHERES           65536
+
+// The maximum amount of bits of each coordinate of the cells that the spheres are sorted by, when writing a chunk file (see
+// sphere_chunks_writer_close()): up to 2^21 cells.
+#define SPHERE_CHUNKS_MORTON_BITS       7
+
+// The maximum amount of spheres that are in memory at once, when writing a chunk file (the chunks are built in groups of about this many
+// spheres, or a single chunk, if it is larger).
+#define SPHERE_CHUNKS_WRITE_BATCH       (1u << 20)
+
+// The maximum amount of groups (and of their temporary files) that the spilled spheres are distributed into in one pass.
+#define SPHERE_CHUNKS_BUCKETS_MAX       64
+
+// The amount of sphere records that are read from (or written to) the temporary files at once.
+#define SPHERE_CHUNKS_IO_RECORDS        4096
+
+// The amount of rays (pixels) traced together, when rendering a scene with out-of-core spheres (see render_frame_img()).
+#define SPHERE_CHUNKS_BATCH_RAYS        16384
+
+// No chunk (the end of the LRU list of the chunks cache).
+#define SPHERE_CHUNKS_NONE              UINT32_MAX
+
+
+// A material of the spheres of a chunk file (the spheres of the loaded chunks point to them).
+struct SphereChunksMaterial_s {
+    Material       *material;
+    void           *matData;            // Owned by the SphereChunks.
+};
+
+struct SphereChunk_s {
+    // From the chunk table of the file: the bounds of the spheres of the chunk, where the chunk starts in the file and its size.
+    float           min[3];
+    float           max[3];
+    uint64_t        offset;
+    uint32_t        spheresLength;
+    uint32_t        nodesLength;
+    uint32_t        packetsLength;
+
+    // The chunk in memory (NULL if it is not loaded): its wide BVH nodes, then its packets and then its spheres, in one block of `bytes`.
+    uint8_t        *data;
+    uint64_t        bytes;
+    uint32_t        pins;               // The amount of threads using the chunk (it is not evicted while it is in use).
+    bool            loading;            // A thread is loading the chunk (the others wait for it, see SphereChunks.loadedCond).
+
+    // The loaded chunks that are not in use, least recently used first (see SphereChunks.lruFirst).
+    uint32_t        lruPrev;
+    uint32_t        lruNext;
+};
+
+struct SphereChunks_s {
+    char           *path;
+    FILE           *file;
+    pthread_mutex_t fileMutex;          // Only one thread reads the file at a time.
+    uint64_t        spheresLength;
+
+    // The chunks, ordered like the leaves of `bvh` (a binary BVH over their bounds).
+    SphereChunk    *chunks;
+    uint32_t        chunksLength;
+    BVH             bvh;
+
+    SphereChunksMaterial *materials;
+    uint32_t        materialsLength;
+
+    // The cache of the loaded chunks (guarded by `mutex`). It may temporarily exceed `cacheBytes` by the chunks that are in use (at most
+    // one per thread), if they don't fit otherwise.
+    pthread_mutex_t mutex;
+    pthread_cond_t  loadedCond;         // Signalled when a chunk has been loaded.
+    uint64_t        cacheBytes;
+    uint64_t        usedBytes;
+    uint64_t        peakBytes;
+    uint32_t        lruFirst;
+    uint32_t        lruLast;
+
+    // What the cache did, since the chunks were opened.
+    uint64_t        loads;              // The chunks read from the file.
+    uint64_t        hits;               // The chunks that were used while they were (still) loaded.
+    uint64_t        evictions;
+    uint64_t        bytesRead;
+};
+
+// A ray of a batch (see sphere_chunks_intersect_batch()).
+struct SphereChunksQuery_s {
+    Ray            *ray;
+
+    // Only spheres closer than `dist` are looked for (e.g. the distance to the closest in-memory primitive). If one is hit, its distance
+    // is stored in `dist`, a copy of it in `*sphere` and `hit` is set.
+    double          dist;
+    Sphere         *sphere;
+    bool            hit;
+
+    uint32_t        tests;              // The amount of ray-sphere tests done (see wide_bvh_intersect()).
+};
+
+// An interned material (see SphereChunksWriter.materials).
+struct SphereChunksWriterMaterial_s {
+    Material       *material;           // NULL if the entry is empty.
+    void           *matData;
+    uint32_t        index;              // The index in the material table of the file.
+};
+
+struct SphereChunksWriter_s {
+    char           *path;
+    FILE           *file;
+    FILE           *spill;              // The spheres added so far (see sphere_chunks_writer_add()), at `path` + ".spill".
+    uint32_t        chunkSpheres;
+    uint64_t        spheresLength;
+    double          min[3];             // The bounds of the centers of the spheres.
+    double          max[3];
+
+    // A hash table of the materials of the spheres (keyed by the material and the material data pointers), with `materialsLength` entries,
+    // and the material table of the file (the types and parameters of the materials), in the order of their indexes.
+    SphereChunksWriterMaterial *materials;
+    uint32_t        materialsCapacity;
+    uint32_t        materialsLength;
+    SphereChunksFileMaterial *fileMaterials;
+};
+
+
+/**
+ * Opens the chunk file at `path` (see sphere_chunks_writer_close()) and reads its chunk table, into `chunks`. The chunks are loaded into a
+ * cache of at most `cacheBytes`, as rays get to them. Returns false (and logs the error) if the file could not be opened or is invalid.
+ */
+bool sphere_chunks_open(SphereChunks *chunks, const char *path, uint64_t cacheBytes);
+
+/**
+ * Closes the chunk file of `chunks` and frees the chunks cache, the chunk table and the material data of the spheres.
+ */
+void sphere_chunks_close(SphereChunks *chunks);
+
+/**
+ * Finds the closest of the spheres of `chunks` that `ray` hits closer than `*dist` (and not closer than RAY_DISTANCE_MIN), loading the
+ * chunks that the ray goes through (closest first, until the hit is closer than the next chunk). If there is one - stores the distance to
+ * it in `*dist`, a copy of it in `*sphere` and returns true. Adds the amount of the ray-sphere tests done to `*tests`.
+ */
+bool sphere_chunks_intersect(SphereChunks *chunks, Ray *ray, double *dist, Sphere *sphere, uint32_t *tests);
+
+/**
+ * Returns true if `ray` hits any of the spheres of `chunks` closer than `dist` (and not closer than RAY_DISTANCE_MIN), skipping the spheres
+ * that emit light (see mat_is_emitter()) if `ignoreLights`. Loads the chunks that the ray goes through (in no particular order), until it
+ * finds one. Adds the amount of the ray-sphere tests done to `*tests`.
+ */
+bool sphere_chunks_occluded(SphereChunks *chunks, Ray *ray, double dist, bool ignoreLights, uint32_t *tests);
+
+/**
+ * Does sphere_chunks_intersect() for each of the `count` `queries`, a chunk at a time: each chunk that any of the rays go through is
+ * loaded (at most) once, for all of them. Safe to call from several threads at once.
+ */
+void sphere_chunks_intersect_batch(SphereChunks *chunks, SphereChunksQuery *queries, uint32_t count);
+
+/**
+ * Starts writing a chunk file at `path`, with up to `chunkSpheres` spheres per chunk. Returns false (and logs the error) if the file (or
+ * the temporary file next to it) could not be created.
+ */
+bool sphere_chunks_writer_open(SphereChunksWriter *writer, const char *path, uint32_t chunkSpheres);
+
+/**
+ * Adds `sphere` to the chunk file that is being written by `writer`.
+ */
+void sphere_chunks_writer_add(SphereChunksWriter *writer, Sphere *sphere);
+
+/**
+ * Sorts the spheres added to `writer` into chunks, writes them and closes the chunk file (and deletes the temporary files). Returns false
+ * (and logs the error) if the file could not be written.
+ *
+ * The spheres are sorted by the Morton code (Z-order curve) of the cell (of a grid of up to 2^SPHERE_CHUNKS_MORTON_BITS cells along each
+ * axis, over the bounds of their centers) that their center is in: consecutive cells are close to each other in space. The sorted spheres
+ * are split into chunks of up to `chunkSpheres` spheres at the cell boundaries (or inside a cell, if it has more spheres than that).
+ */
+bool sphere_chunks_writer_close(SphereChunksWriter *writer);
+
+#endif // __SPHERE_CHUNKS_H__
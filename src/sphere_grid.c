@@ -0,0 +1,410 @@
+#include <math.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "material.h"
+#include "rtalloc.h"
+#include "ray_inline_fns.h"
+#include "rtcommon.h"
+#include "sphere_grid.h"
+
+
+// Spheres are added to the cells that their bounding box, enlarged by this fraction of a cell, overlaps (so that rounding errors of the
+// cell coordinates never leave a sphere out of a cell that a ray hits it in).
+#define SPHERE_GRID_CELL_EPSILON    1e-9
+
+
+typedef struct GridBuildCtx_s   GridBuildCtx;
+
+// The data shared by the tasks of the grid build phases (see sphere_grid_build()).
+struct GridBuildCtx_s {
+    SphereGrid         *grid;
+    Sphere             *spheres;
+    uint32_t            spheresLength;
+
+    double            (*taskBounds)[6];     // The bounds (min x, y, z, max x, y, z) of the spheres of each task.
+    uint64_t           *taskRefs;           // The amount of (sphere, cell) pairs of each task.
+    _Atomic uint32_t   *cellCounters;       // The amounts of spheres of each cell, and then the next free index of its list.
+};
+
+
+static inline Sphere * grid_walk(SphereGrid *grid, Sphere *spheres, Ray *ray, double *dist, bool anyHit, bool ignoreLights,
+    uint32_t *tests);
+static void run_tasks(WorkerPool *workers, WorkerTaskFn fn, GridBuildCtx *ctx, uint32_t tasksCount);
+static void bounds_task(void *ctx, uint32_t taskIdx, uint32_t workerIdx);
+static void count_task(void *ctx, uint32_t taskIdx, uint32_t workerIdx);
+static void fill_task(void *ctx, uint32_t taskIdx, uint32_t workerIdx);
+static void sort_task(void *ctx, uint32_t taskIdx, uint32_t workerIdx);
+static void set_resolution(SphereGrid *grid, double *min, double *max, uint32_t spheresLength);
+static inline void sphere_cells(SphereGrid *grid, Sphere *sphere, uint32_t *lo, uint32_t *hi);
+static inline uint32_t cell_coord(SphereGrid *grid, uint32_t axis, double x);
+static inline uint32_t tasks_count(uint32_t items);
+
+
+void sphere_grid_init(SphereGrid *grid)
+{
+    grid->cellsCount = 0;
+    grid->cellFirst = NULL;
+    grid->cellSpheres = NULL;
+}
+
+void sphere_grid_free(SphereGrid *grid)
+{
+    rtfree(grid->cellFirst);
+    rtfree(grid->cellSpheres);
+    sphere_grid_init(grid);
+}
+
+void sphere_grid_build(SphereGrid *grid, Sphere *spheres, uint32_t spheresLength, WorkerPool *workers)
+{
+    sphere_grid_free(grid);
+    if (spheresLength == 0) {
+        return;
+    }
+
+    uint32_t sphereTasks = tasks_count(spheresLength);
+    GridBuildCtx ctx = {
+        .grid           = grid,
+        .spheres        = spheres,
+        .spheresLength  = spheresLength,
+        .taskBounds     = rtalloc(sizeof(double[6]) * sphereTasks),
+        .taskRefs       = rtalloc(sizeof(uint64_t) * sphereTasks),
+    };
+
+    // The bounds of all spheres, and the grid resolution.
+    run_tasks(workers, bounds_task, &ctx, sphereTasks);
+    double min[3] = {INFINITY, INFINITY, INFINITY};
+    double max[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (uint32_t t = 0; t < sphereTasks; t++) {
+        for (uint32_t a = 0; a < 3; a++) {
+            min[a] = fmin(min[a], ctx.taskBounds[t][a]);
+            max[a] = fmax(max[a], ctx.taskBounds[t][3 + a]);
+        }
+    }
+    set_resolution(grid, min, max, spheresLength);
+
+    // Count the spheres of each cell...
+    ctx.cellCounters = rtalloc(sizeof(_Atomic uint32_t) * grid->cellsCount);
+    for (uint32_t c = 0; c < grid->cellsCount; c++) {
+        atomic_init(&ctx.cellCounters[c], 0);
+    }
+    run_tasks(workers, count_task, &ctx, sphereTasks);
+
+    uint64_t refs = 0;
+    for (uint32_t t = 0; t < sphereTasks; t++) {
+        refs += ctx.taskRefs[t];
+    }
+    if (refs > UINT32_MAX) {
+        log_err("Fatal error: too many (sphere, cell) pairs in the sphere grid: %llu\n", (unsigned long long)refs);
+        exit(1);
+    }
+
+    // ... turn the counts into the offsets of the cells' lists (the counters become the next free index of each list) ...
+    grid->cellFirst = rtalloc(sizeof(uint32_t) * ((size_t)grid->cellsCount + 1));
+    uint32_t offset = 0;
+    for (uint32_t c = 0; c < grid->cellsCount; c++) {
+        grid->cellFirst[c] = offset;
+        offset += atomic_load_explicit(&ctx.cellCounters[c], memory_order_relaxed);
+        atomic_store_explicit(&ctx.cellCounters[c], grid->cellFirst[c], memory_order_relaxed);
+    }
+    grid->cellFirst[grid->cellsCount] = offset;
+
+    // ... and write the spheres into the lists. The threads write them in any order, so each list is sorted afterwards (the grid and the
+    // closest sphere found for equally distant spheres must not depend on the amount of threads).
+    grid->cellSpheres = rtalloc(sizeof(uint32_t) * (refs > 0 ? refs : 1));
+    run_tasks(workers, fill_task, &ctx, sphereTasks);
+    run_tasks(workers, sort_task, &ctx, tasks_count(grid->cellsCount));
+
+    rtfree(ctx.cellCounters);
+    rtfree(ctx.taskRefs);
+    rtfree(ctx.taskBounds);
+}
+
+Sphere * sphere_grid_intersect(SphereGrid *grid, Sphere *spheres, Ray *ray, double *dist, uint32_t *tests)
+{
+    return grid_walk(grid, spheres, ray, dist, false, false, tests);
+}
+
+bool sphere_grid_occluded(SphereGrid *grid, Sphere *spheres, Ray *ray, double dist, bool ignoreLights, uint32_t *tests)
+{
+    return grid_walk(grid, spheres, ray, &dist, true, ignoreLights, tests) != NULL;
+}
+
+/**
+ * Walks the cells of `grid` along `ray` (with a 3D-DDA) and tests it against their spheres. Finds the closest sphere that the ray hits
+ * closer than `*dist` (like sphere_grid_intersect()), or if `anyHit`, returns the first one that it finds (skipping the ones that emit
+ * light, if `ignoreLights`), without updating `*dist`.
+ *
+ * Inlined into both callers, so that the branches on the constant `anyHit` and `ignoreLights` are compiled out.
+ */
+static inline Sphere * grid_walk(SphereGrid *grid, Sphere *spheres, Ray *ray, double *dist, bool anyHit, bool ignoreLights,
+    uint32_t *tests)
+{
+    if (grid->cellsCount == 0) {
+        return NULL;
+    }
+
+    double origin[3] = {ray->origin.x, ray->origin.y, ray->origin.z};
+    double direction[3] = {ray->direction.x, ray->direction.y, ray->direction.z};
+
+    // Clip the ray to the bounds of the grid.
+    double tEnter = 0;
+    double tExit = *dist;
+    for (uint32_t a = 0; a < 3; a++) {
+        if (direction[a] == 0) {
+            if (origin[a] < grid->min[a] || origin[a] > grid->max[a]) {
+                return NULL;
+            }
+            continue;
+        }
+        double t0 = (grid->min[a] - origin[a]) / direction[a];
+        double t1 = (grid->max[a] - origin[a]) / direction[a];
+        tEnter = fmax(tEnter, fmin(t0, t1));
+        tExit = fmin(tExit, fmax(t0, t1));
+    }
+    if (tEnter > tExit) {
+        return NULL;
+    }
+
+    // The cell where the ray enters the grid, and the distances to the next cell boundaries along each axis (3D-DDA).
+    int32_t cell[3];
+    int32_t step[3];
+    int32_t end[3];
+    double tNext[3];
+    double tDelta[3];
+    for (uint32_t a = 0; a < 3; a++) {
+        cell[a] = cell_coord(grid, a, origin[a] + tEnter * direction[a]);
+        if (direction[a] > 0) {
+            step[a] = 1;
+            end[a] = grid->res[a];
+            tNext[a] = (grid->min[a] + (cell[a] + 1) * grid->cellSize - origin[a]) / direction[a];
+            tDelta[a] = grid->cellSize / direction[a];
+        } else if (direction[a] < 0) {
+            step[a] = -1;
+            end[a] = -1;
+            tNext[a] = (grid->min[a] + cell[a] * grid->cellSize - origin[a]) / direction[a];
+            tDelta[a] = -grid->cellSize / direction[a];
+        } else {
+            step[a] = 0;
+            end[a] = -1;
+            tNext[a] = INFINITY;
+            tDelta[a] = INFINITY;
+        }
+    }
+
+    Sphere *minSphere = NULL;
+    uint32_t sphereTests = 0;
+    while (true) {
+        uint32_t c = ((uint32_t)cell[2] * grid->res[1] + (uint32_t)cell[1]) * grid->res[0] + (uint32_t)cell[0];
+        uint32_t last = grid->cellFirst[c + 1];
+        for (uint32_t i = grid->cellFirst[c]; i < last; i++) {
+            Sphere *sphere = &spheres[grid->cellSpheres[i]];
+            double d = calc_ray_distance_to_sphere(ray, sphere);
+            if (d >= RAY_DISTANCE_MIN && d < *dist) {
+                if (anyHit) {
+                    if (ignoreLights && mat_is_emitter(sphere->material)) {
+                        continue;
+                    }
+                    *tests += sphereTests + (i - grid->cellFirst[c]) + 1;
+                    return sphere;
+                }
+                *dist = d;
+                minSphere = sphere;
+            }
+        }
+        sphereTests += last - grid->cellFirst[c];
+
+        // Step into the next cell, along the axis of the closest cell boundary. A hit before that boundary is the closest one (the
+        // spheres of the cells further along the ray can't be hit closer), so the walk can stop there.
+        uint32_t a = tNext[0] < tNext[1] ? (tNext[0] < tNext[2] ? 0 : 2) : (tNext[1] < tNext[2] ? 1 : 2);
+        if (tNext[a] > tExit || (minSphere != NULL && *dist <= tNext[a])) {
+            break;
+        }
+        cell[a] += step[a];
+        if (cell[a] == end[a]) {
+            break;
+        }
+        tNext[a] += tDelta[a];
+    }
+
+    *tests += sphereTests;
+    return minSphere;
+}
+
+/**
+ * Runs `fn` for each task in [0, tasksCount) on the threads of `workers`, or on this thread if `workers` is NULL.
+ */
+static void run_tasks(WorkerPool *workers, WorkerTaskFn fn, GridBuildCtx *ctx, uint32_t tasksCount)
+{
+    if (workers != NULL) {
+        workers_run(workers, fn, ctx, tasksCount);
+    } else {
+        for (uint32_t t = 0; t < tasksCount; t++) {
+            fn(ctx, t, 0);
+        }
+    }
+}
+
+static void bounds_task(void *ctx, uint32_t taskIdx, uint32_t workerIdx)
+{
+    (void)(workerIdx); // Disable gcc -Wextra "unused parameter" errors.
+
+    GridBuildCtx *bc = ctx;
+    double *bounds = bc->taskBounds[taskIdx];
+    for (uint32_t a = 0; a < 3; a++) {
+        bounds[a] = INFINITY;
+        bounds[3 + a] = -INFINITY;
+    }
+
+    uint32_t first = taskIdx * SPHERE_GRID_TASK_SIZE;
+    uint32_t last = first + SPHERE_GRID_TASK_SIZE < bc->spheresLength ? first + SPHERE_GRID_TASK_SIZE : bc->spheresLength;
+    for (uint32_t i = first; i < last; i++) {
+        Sphere *sphere = &bc->spheres[i];
+        double center[3] = {sphere->center.x, sphere->center.y, sphere->center.z};
+        for (uint32_t a = 0; a < 3; a++) {
+            bounds[a] = fmin(bounds[a], center[a] - sphere->radius);
+            bounds[3 + a] = fmax(bounds[3 + a], center[a] + sphere->radius);
+        }
+    }
+}
+
+static void count_task(void *ctx, uint32_t taskIdx, uint32_t workerIdx)
+{
+    (void)(workerIdx); // Disable gcc -Wextra "unused parameter" errors.
+
+    GridBuildCtx *bc = ctx;
+    SphereGrid *grid = bc->grid;
+    uint64_t refs = 0;
+    uint32_t first = taskIdx * SPHERE_GRID_TASK_SIZE;
+    uint32_t last = first + SPHERE_GRID_TASK_SIZE < bc->spheresLength ? first + SPHERE_GRID_TASK_SIZE : bc->spheresLength;
+    for (uint32_t i = first; i < last; i++) {
+        uint32_t lo[3], hi[3];
+        sphere_cells(grid, &bc->spheres[i], lo, hi);
+        for (uint32_t z = lo[2]; z <= hi[2]; z++) {
+            for (uint32_t y = lo[1]; y <= hi[1]; y++) {
+                uint32_t row = (z * grid->res[1] + y) * grid->res[0];
+                for (uint32_t x = lo[0]; x <= hi[0]; x++) {
+                    atomic_fetch_add_explicit(&bc->cellCounters[row + x], 1, memory_order_relaxed);
+                }
+            }
+        }
+        refs += (uint64_t)(hi[0] - lo[0] + 1) * (hi[1] - lo[1] + 1) * (hi[2] - lo[2] + 1);
+    }
+    bc->taskRefs[taskIdx] = refs;
+}
+
+static void fill_task(void *ctx, uint32_t taskIdx, uint32_t workerIdx)
+{
+    (void)(workerIdx); // Disable gcc -Wextra "unused parameter" errors.
+
+    GridBuildCtx *bc = ctx;
+    SphereGrid *grid = bc->grid;
+    uint32_t first = taskIdx * SPHERE_GRID_TASK_SIZE;
+    uint32_t last = first + SPHERE_GRID_TASK_SIZE < bc->spheresLength ? first + SPHERE_GRID_TASK_SIZE : bc->spheresLength;
+    for (uint32_t i = first; i < last; i++) {
+        uint32_t lo[3], hi[3];
+        sphere_cells(grid, &bc->spheres[i], lo, hi);
+        for (uint32_t z = lo[2]; z <= hi[2]; z++) {
+            for (uint32_t y = lo[1]; y <= hi[1]; y++) {
+                uint32_t row = (z * grid->res[1] + y) * grid->res[0];
+                for (uint32_t x = lo[0]; x <= hi[0]; x++) {
+                    uint32_t idx = atomic_fetch_add_explicit(&bc->cellCounters[row + x], 1, memory_order_relaxed);
+                    grid->cellSpheres[idx] = i;
+                }
+            }
+        }
+    }
+}
+
+static void sort_task(void *ctx, uint32_t taskIdx, uint32_t workerIdx)
+{
+    (void)(workerIdx); // Disable gcc -Wextra "unused parameter" errors.
+
+    GridBuildCtx *bc = ctx;
+    SphereGrid *grid = bc->grid;
+    uint32_t first = taskIdx * SPHERE_GRID_TASK_SIZE;
+    uint32_t last = first + SPHERE_GRID_TASK_SIZE < grid->cellsCount ? first + SPHERE_GRID_TASK_SIZE : grid->cellsCount;
+    for (uint32_t c = first; c < last; c++) {
+        // An insertion sort: the lists are short (a few spheres).
+        uint32_t *list = &grid->cellSpheres[grid->cellFirst[c]];
+        uint32_t length = grid->cellFirst[c + 1] - grid->cellFirst[c];
+        for (uint32_t i = 1; i < length; i++) {
+            uint32_t v = list[i];
+            uint32_t j = i;
+            for (; j > 0 && list[j - 1] > v; j--) {
+                list[j] = list[j - 1];
+            }
+            list[j] = v;
+        }
+    }
+}
+
+/**
+ * Sets the cell size and the resolution of `grid` over the bounds [min, max], for about SPHERE_GRID_CELLS_PER_SPHERE cells per sphere
+ * (and at most SPHERE_GRID_CELLS_MAX cells).
+ */
+static void set_resolution(SphereGrid *grid, double *min, double *max, uint32_t spheresLength)
+{
+    double extent[3] = {max[0] - min[0], max[1] - min[1], max[2] - min[2]};
+    double targetCells = fmin(spheresLength * SPHERE_GRID_CELLS_PER_SPHERE, SPHERE_GRID_CELLS_MAX);
+    double cellSize = cbrt(extent[0] * extent[1] * extent[2] / targetCells);
+    if (! (cellSize > 0)) {
+        // A flat grid (e.g. of spheres with a radius of 0): size the cells by the largest extent.
+        cellSize = fmax(extent[0], fmax(extent[1], extent[2])) / cbrt(targetCells);
+    }
+    if (! (cellSize > 0)) {
+        cellSize = 1;
+    }
+
+    // Rounding the resolution up can add many cells (e.g. for a flat grid), so the cells are grown until they fit.
+    while (true) {
+        double cells = 1;
+        for (uint32_t a = 0; a < 3; a++) {
+            cells *= fmax(1, ceil(extent[a] / cellSize));
+        }
+        if (cells <= SPHERE_GRID_CELLS_MAX) {
+            break;
+        }
+        cellSize *= 1.1;
+    }
+
+    grid->cellSize = cellSize;
+    grid->invCellSize = 1.0 / cellSize;
+    grid->cellsCount = 1;
+    for (uint32_t a = 0; a < 3; a++) {
+        grid->res[a] = (uint32_t)fmax(1, ceil(extent[a] / cellSize));
+        grid->min[a] = min[a];
+        grid->max[a] = min[a] + grid->res[a] * cellSize;
+        grid->cellsCount *= grid->res[a];
+    }
+}
+
+/**
+ * Stores the range of the cells [lo, hi] (inclusive, along each axis) that `sphere` overlaps into `lo`, `hi`.
+ */
+static inline void sphere_cells(SphereGrid *grid, Sphere *sphere, uint32_t *lo, uint32_t *hi)
+{
+    double center[3] = {sphere->center.x, sphere->center.y, sphere->center.z};
+    double r = sphere->radius + grid->cellSize * SPHERE_GRID_CELL_EPSILON;
+    for (uint32_t a = 0; a < 3; a++) {
+        lo[a] = cell_coord(grid, a, center[a] - r);
+        hi[a] = cell_coord(grid, a, center[a] + r);
+    }
+}
+
+/**
+ * Returns the coordinate (along `axis`) of the cell that contains the coordinate `x`, clamped to the grid.
+ */
+static inline uint32_t cell_coord(SphereGrid *grid, uint32_t axis, double x)
+{
+    double c = floor((x - grid->min[axis]) * grid->invCellSize);
+    if (! (c > 0)) {
+        return 0;
+    }
+    return c >= grid->res[axis] - 1 ? grid->res[axis] - 1 : (uint32_t)c;
+}
+
+static inline uint32_t tasks_count(uint32_t items)
+{
+    return (items + SPHERE_GRID_TASK_SIZE - 1) / SPHERE_GRID_TASK_SIZE;
+}
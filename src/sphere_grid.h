@@ -0,0 +1,85 @@
+#ifndef __SPHERE_GRID_H__
+#define __SPHERE_GRID_H__
+
+/**
+ * A uniform grid over the spheres of a scene (see Scene.sphereAccel): an alternative to the linear scan of all spheres, for dense fields
+ * of many similar-sized spheres (e.g. particles).
+ *
+ * The bounds of the spheres are split into cubic cells, about SPHERE_GRID_CELLS_PER_SPHERE of them per sphere. Each cell has a list of
+ * the spheres whose bounding boxes overlap it. The grid is built in linear time, by a counting sort of the (sphere, cell) pairs into the
+ * cells: the spheres of each cell are counted, the counts are turned into the offsets of the cells' lists (a prefix sum) and then the
+ * spheres are written into the lists. The counting and writing is split across the worker threads (the counters are atomic).
+ *
+ * A ray walks through the cells it goes through in order (3D-DDA, see Amanatides, Woo: "A Fast Voxel Traversal Algorithm for Ray
+ * Tracing", 1987) and only tests the spheres of those cells, until the closest hit is within the current cell. Unlike a BVH traversal,
+ * each step is a few additions and comparisons, without a stack. But the grid adapts badly to uneven sphere sizes or densities: big
+ * spheres are in many cells and sparse areas waste cells (scenes like that are better off with the linear scan, or with a BVH).
+ */
+
+typedef struct SphereGrid_s     SphereGrid;
+
+
+#include <stdint.h>
+
+
+// The target amount of grid cells per sphere. More cells means fewer spheres tested per cell, but more cells walked through per ray.
+#define SPHERE_GRID_CELLS_PER_SPHERE    2.0
+
+// The maximum amount of grid cells (the grid resolution is reduced to stay within it).
+#define SPHERE_GRID_CELLS_MAX           (1 << 24)
+
+// The amount of spheres (and of cells) per task, when building the grid with worker threads.
+#define SPHERE_GRID_TASK_SIZE           16384
+
+
+struct SphereGrid_s {
+    double          min[3];             // The lower corner of the grid.
+    double          max[3];             // The upper corner of the grid.
+    double          cellSize;
+    double          invCellSize;
+    uint32_t        res[3];             // The amount of cells along each axis.
+    uint32_t        cellsCount;         // 0 if the grid is empty.
+
+    // The spheres of cell c (indexes of Scene.spheres, in increasing order) are cellSpheres[cellFirst[c] .. cellFirst[c + 1]). Cells are
+    // stored in x, then y, then z order: c = (z * res[1] + y) * res[0] + x.
+    uint32_t       *cellFirst;
+    uint32_t       *cellSpheres;
+};
+
+
+// Included after the structs: ray.h includes scene.h, which needs the complete SphereGrid type.
+#include "ray.h"
+#include "sphere.h"
+#include "workers.h"
+
+
+/**
+ * Initializes `grid` as an empty grid.
+ */
+void sphere_grid_init(SphereGrid *grid);
+
+/**
+ * Frees the cells of `grid` (it becomes empty).
+ */
+void sphere_grid_free(SphereGrid *grid);
+
+/**
+ * (Re-)builds `grid` over the `spheresLength` `spheres`, splitting the work across the threads of `workers` (if not NULL).
+ */
+void sphere_grid_build(SphereGrid *grid, Sphere *spheres, uint32_t spheresLength, WorkerPool *workers);
+
+/**
+ * Finds the closest of the `spheres` (that `grid` was built over) that `ray` hits closer than `*dist` (and not closer than
+ * RAY_DISTANCE_MIN). If there is one - stores the distance to it in `*dist` and returns it. Otherwise returns NULL. Adds the amount of
+ * the ray-sphere tests done to `*tests` (a sphere that is in several cells may be tested more than once).
+ */
+Sphere * sphere_grid_intersect(SphereGrid *grid, Sphere *spheres, Ray *ray, double *dist, uint32_t *tests);
+
+/**
+ * Returns true if `ray` hits any of the `spheres` (that `grid` was built over) closer than `dist` (and not closer than RAY_DISTANCE_MIN),
+ * skipping the spheres that emit light (see mat_is_emitter()) if `ignoreLights`: stops at the first one it finds. Adds the amount of the
+ * ray-sphere tests done to `*tests`.
+ */
+bool sphere_grid_occluded(SphereGrid *grid, Sphere *spheres, Ray *ray, double dist, bool ignoreLights, uint32_t *tests);
+
+#endif // __SPHERE_GRID_H__
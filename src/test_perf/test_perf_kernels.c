@@ -0,0 +1,950 @@
+/**
+ * test_perf_kernels - microbenchmarks of the ray-tracing kernels: the vector.h operations, the random.h generators,
+ * ray_distance_to_sphere(), ray_distance_to_plane(), mesh_intersect(), instances_intersect(), sphere_grid_intersect(),
+ * wide_bvh_intersect(), their any-hit variants (mesh_occluded() etc.), the material hit functions, mat_mirror_reflect() and mat_refract().
+ *
+ * Each kernel is run in a loop over (pre-generated, random) input data. The amount of loop iterations is first calibrated, so that a single
+ * repetition takes at least --min-time-ms, then the kernel is run for a few warm-up repetitions (not measured) and then for --reps measured
+ * repetitions. The reported time per operation is the median of the repetitions, with the median absolute deviation (MAD) as the measure
+ * of noise (both are robust against outliers, e.g. repetitions that got interrupted by the OS).
+ *
+ * The results of every kernel are accumulated and stored into a volatile sink, so that the compiler can not eliminate the benchmarked code.
+ *
+ * Usage: test_perf_kernels [--reps <n>] [--min-time-ms <n>] [--filter <substring>]
+ */
+
+#include <errno.h>
+#include <float.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../material.h"
+#include "../materials/dielectric.h"
+#include "../materials/light.h"
+#include "../materials/metal.h"
+#include "../mesh.h"
+#include "../random.h"
+#include "../ray.h"
+#include "../ray_inline_fns.h"
+#include "../scene.h"
+#include "../vector.h"
+
+
+// The amount of input values of each kind (must be a power of 2). The inputs fit into the L1/L2 cache, so the kernels are measured
+// without memory stalls.
+#define PERF_INPUTS_LENGTH      1024
+#define PERF_INPUTS_MASK        (PERF_INPUTS_LENGTH - 1)
+
+// The amount of spheres that ray_distance_to_sphere() is benchmarked against.
+#define PERF_SPHERES_LENGTH     8
+
+// The amount of planes (infinite planes, disks and rectangles) that ray_distance_to_plane() is benchmarked against.
+#define PERF_PLANES_LENGTH      4
+
+// The tessellation of the (UV sphere) mesh that mesh_intersect() is benchmarked against: PERF_MESH_SEGMENTS * (PERF_MESH_RINGS - 1) * 2
+// triangles (~8k).
+#define PERF_MESH_SEGMENTS      64
+#define PERF_MESH_RINGS         64
+
+// The instances that instances_intersect() is benchmarked against: a PERF_INSTANCES_EDGE^2 grid of instances of a cluster of
+// PERF_INSTANCE_SPHERES spheres.
+#define PERF_INSTANCES_EDGE     16
+#define PERF_INSTANCE_SPHERES   512
+
+// The amount of (small) spheres that sphere_grid_intersect() and wide_bvh_intersect() are benchmarked against.
+#define PERF_GRID_SPHERES       4096
+
+#define PERF_REPS_DEFAULT       21
+#define PERF_WARMUP_REPS        3
+#define PERF_MIN_TIME_MS        20
+#define PERF_ITERATIONS_MIN     256
+
+#define PERF_SEED               1
+
+
+typedef struct PerfKernel_s     PerfKernel;
+typedef struct PerfResult_s     PerfResult;
+
+struct PerfKernel_s {
+    const char *name;
+
+    // Runs the kernel `iterations` times and returns the accumulated results (to be stored into the sink).
+    double (*run)(uint64_t iterations);
+};
+
+struct PerfResult_s {
+    uint64_t    iterations;         // Iterations per repetition.
+    double      medianNs;           // Median time per operation (nanoseconds).
+    double      madNs;              // Median absolute deviation of the time per operation (nanoseconds).
+    double      minNs;              // The fastest repetition's time per operation (nanoseconds).
+};
+
+
+// Inputs of the kernels (filled with random data in init_inputs()).
+static Vector3  inVectors[PERF_INPUTS_LENGTH];
+static Vector3  inUnitVectors[PERF_INPUTS_LENGTH];
+static Ray      inRays[PERF_INPUTS_LENGTH];             // Rays (with unit directions) from around the camera towards `inSpheres`.
+static Vector3  inHitNormals[PERF_INPUTS_LENGTH];       // Unit normals of a surface hit...
+static Vector3  inHitDirections[PERF_INPUTS_LENGTH];    // ... by a ray going in this (unit) direction (i.e. towards the surface).
+static Sphere   inSpheres[PERF_SPHERES_LENGTH];
+static Plane    inPlanes[PERF_PLANES_LENGTH];
+static Mesh     inMesh;
+static Scene    inInstancesScene;
+static Sphere   inGridSpheres[PERF_GRID_SPHERES];
+static SphereGrid inGrid;
+static WideBVH  inWideBVH;
+
+// Spheres of the benchmarked materials and the (empty) scene they are "hit" in. Because the scene is empty, scattered rays don't hit
+// anything, so what is measured is the cost of the material hit function itself (plus a single ray_trace() call of a missed ray).
+static Scene    matScene;
+static Sphere   matSphereMatte;
+static Sphere   matSphereMetal;
+static Sphere   matSphereMetalFuzzy;
+static Sphere   matSphereDielectric;
+static Sphere   matSphereLight;
+static Sphere   matSphereGradientSky;
+static Sphere   matSphereGround;
+static Sphere   matSphereShaded;
+
+// The sink, that the result of every kernel run is stored into.
+volatile double perfSink;
+
+
+static void init_inputs();
+static bool run_kernel(PerfKernel *kernel, uint32_t reps, uint64_t minTimeNs, PerfResult *result);
+static uint64_t time_kernel_ns(PerfKernel *kernel, uint64_t iterations);
+static double median_of_sorted(double *arr, uint32_t length);
+static int compare_doubles(const void *a, const void *b);
+static bool parse_uint(const char *str, uint64_t min, uint64_t max, uint64_t *value);
+static void print_usage(const char *prog);
+
+static void init_uv_sphere_mesh(Mesh *mesh, Vector3 *center, double radius, uint32_t segments, uint32_t rings);
+
+static inline uint64_t time_now_ns();
+static inline double sum_vector(Vector3 *v);
+static inline double sum_color(Color *c);
+static inline double material_hit(Sphere *sphere, uint64_t i);
+
+static double kernel_vector3_length(uint64_t iterations);
+static double kernel_vector3_to_unit(uint64_t iterations);
+static double kernel_vector3_add_to(uint64_t iterations);
+static double kernel_vector3_subtract(uint64_t iterations);
+static double kernel_vector3_dot(uint64_t iterations);
+static double kernel_vector3_cross(uint64_t iterations);
+static double kernel_vector3_multiply(uint64_t iterations);
+static double kernel_vector3_multiply_length(uint64_t iterations);
+static double kernel_vector3_divide_length(uint64_t iterations);
+static double kernel_random_state_next(uint64_t iterations);
+static double kernel_random_state_double_0_1_exc(uint64_t iterations);
+static double kernel_random_double_0_1_exc(uint64_t iterations);
+static double kernel_random_double_0_1_inc(uint64_t iterations);
+static double kernel_random_double_exc(uint64_t iterations);
+static double kernel_random_int_exc(uint64_t iterations);
+static double kernel_random_point_in_unit_sphere__random_algo(uint64_t iterations);
+static double kernel_random_point_in_unit_sphere__trigonometric_algo(uint64_t iterations);
+static double kernel_random_point_in_hemisphere(uint64_t iterations);
+static double kernel_ray_distance_to_sphere(uint64_t iterations);
+static double kernel_ray_distance_to_plane(uint64_t iterations);
+static double kernel_mesh_intersect(uint64_t iterations);
+static double kernel_mesh_occluded(uint64_t iterations);
+static double kernel_instances_intersect(uint64_t iterations);
+static double kernel_instances_occluded(uint64_t iterations);
+static double kernel_sphere_grid_intersect(uint64_t iterations);
+static double kernel_sphere_grid_occluded(uint64_t iterations);
+static double kernel_wide_bvh_intersect(uint64_t iterations);
+static double kernel_wide_bvh_occluded(uint64_t iterations);
+static double kernel_mat_mirror_reflect(uint64_t iterations);
+static double kernel_mat_mirror_reflect_fuzzy(uint64_t iterations);
+static double kernel_mat_refract(uint64_t iterations);
+static double kernel_hit_matte(uint64_t iterations);
+static double kernel_hit_metal(uint64_t iterations);
+static double kernel_hit_metal_fuzzy(uint64_t iterations);
+static double kernel_hit_dielectric(uint64_t iterations);
+static double kernel_hit_light(uint64_t iterations);
+static double kernel_hit_gradient_sky(uint64_t iterations);
+static double kernel_hit_ground(uint64_t iterations);
+static double kernel_hit_shaded(uint64_t iterations);
+
+
+static PerfKernel perfKernels[] = {
+    {.name = "vector3_length",                                  .run = kernel_vector3_length},
+    {.name = "vector3_to_unit",                                 .run = kernel_vector3_to_unit},
+    {.name = "vector3_add_to",                                  .run = kernel_vector3_add_to},
+    {.name = "vector3_subtract",                                .run = kernel_vector3_subtract},
+    {.name = "vector3_dot",                                     .run = kernel_vector3_dot},
+    {.name = "vector3_cross",                                   .run = kernel_vector3_cross},
+    {.name = "vector3_multiply",                                .run = kernel_vector3_multiply},
+    {.name = "vector3_multiply_length",                         .run = kernel_vector3_multiply_length},
+    {.name = "vector3_divide_length",                           .run = kernel_vector3_divide_length},
+    {.name = "random_state_next",                               .run = kernel_random_state_next},
+    {.name = "random_state_double_0_1_exc",                     .run = kernel_random_state_double_0_1_exc},
+    {.name = "random_double_0_1_exc",                           .run = kernel_random_double_0_1_exc},
+    {.name = "random_double_0_1_inc",                           .run = kernel_random_double_0_1_inc},
+    {.name = "random_double_exc",                               .run = kernel_random_double_exc},
+    {.name = "random_int_exc",                                  .run = kernel_random_int_exc},
+    {.name = "random_point_in_unit_sphere__random_algo",        .run = kernel_random_point_in_unit_sphere__random_algo},
+    {.name = "random_point_in_unit_sphere__trigonometric_algo", .run = kernel_random_point_in_unit_sphere__trigonometric_algo},
+    {.name = "random_point_in_hemisphere",                      .run = kernel_random_point_in_hemisphere},
+    {.name = "ray_distance_to_sphere",                          .run = kernel_ray_distance_to_sphere},
+    {.name = "ray_distance_to_plane",                           .run = kernel_ray_distance_to_plane},
+    {.name = "mesh_intersect",                                  .run = kernel_mesh_intersect},
+    {.name = "mesh_occluded",                                   .run = kernel_mesh_occluded},
+    {.name = "instances_intersect",                             .run = kernel_instances_intersect},
+    {.name = "instances_occluded",                              .run = kernel_instances_occluded},
+    {.name = "sphere_grid_intersect",                           .run = kernel_sphere_grid_intersect},
+    {.name = "sphere_grid_occluded",                            .run = kernel_sphere_grid_occluded},
+    {.name = "wide_bvh_intersect",                              .run = kernel_wide_bvh_intersect},
+    {.name = "wide_bvh_occluded",                               .run = kernel_wide_bvh_occluded},
+    {.name = "mat_mirror_reflect",                              .run = kernel_mat_mirror_reflect},
+    {.name = "mat_mirror_reflect (fuzzy)",                      .run = kernel_mat_mirror_reflect_fuzzy},
+    {.name = "mat_refract",                                     .run = kernel_mat_refract},
+    {.name = "hit: matte",                                      .run = kernel_hit_matte},
+    {.name = "hit: metal",                                      .run = kernel_hit_metal},
+    {.name = "hit: metal (fuzzy)",                              .run = kernel_hit_metal_fuzzy},
+    {.name = "hit: dielectric",                                 .run = kernel_hit_dielectric},
+    {.name = "hit: light",                                      .run = kernel_hit_light},
+    {.name = "hit: gradient_sky",                               .run = kernel_hit_gradient_sky},
+    {.name = "hit: ground",                                     .run = kernel_hit_ground},
+    {.name = "hit: shaded",                                     .run = kernel_hit_shaded},
+};
+
+
+int main(int argc, char **argv)
+{
+    uint64_t reps = PERF_REPS_DEFAULT;
+    uint64_t minTimeMs = PERF_MIN_TIME_MS;
+    const char *filter = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        const char *arg = argv[i];
+        const char *value = argv[++i];
+        if (strcmp(arg, "--reps") == 0) {
+            if (! parse_uint(value, 1, 100000, &reps)) {
+                fprintf(stderr, "Invalid repetitions count: %s\n", value);
+                return 1;
+            }
+        } else if (strcmp(arg, "--min-time-ms") == 0) {
+            if (! parse_uint(value, 1, 60000, &minTimeMs)) {
+                fprintf(stderr, "Invalid minimum repetition time: %s\n", value);
+                return 1;
+            }
+        } else if (strcmp(arg, "--filter") == 0) {
+            filter = value;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    init_inputs();
+
+    printf("%-50s %14s %12s %8s %12s %14s\n", "kernel", "median ns/op", "MAD ns/op", "MAD %", "min ns/op", "iterations/rep");
+    for (uint32_t i = 0; i < sizeof(perfKernels) / sizeof(perfKernels[0]); i++) {
+        PerfKernel *kernel = &perfKernels[i];
+        if (filter != NULL && strstr(kernel->name, filter) == NULL) {
+            continue;
+        }
+
+        PerfResult result;
+        if (! run_kernel(kernel, (uint32_t)reps, minTimeMs * 1000000, &result)) {
+            return 1;
+        }
+        printf("%-50s %14.3f %12.3f %7.2f%% %12.3f %14" PRIu64 "\n", kernel->name, result.medianNs, result.madNs,
+            result.medianNs > 0 ? (result.madNs / result.medianNs) * 100 : 0.0, result.minNs, result.iterations);
+    }
+
+    return 0;
+}
+
+/**
+ * Fills the kernel inputs with (reproducible) random data and sets up the spheres of the benchmarked materials.
+ */
+static void init_inputs()
+{
+    random_seed(PERF_SEED);
+
+    for (uint32_t i = 0; i < PERF_INPUTS_LENGTH; i++) {
+        inVectors[i] = (Vector3){.x = random_double_inc(-10, 10), .y = random_double_inc(-10, 10), .z = random_double_inc(-10, 10)};
+
+        random_point_in_unit_sphere(&inUnitVectors[i]);
+        vector3_to_unit(&inUnitVectors[i]);
+
+        // A surface normal and a ray direction towards that surface (on the other side of the surface than the normal).
+        random_point_in_unit_sphere(&inHitNormals[i]);
+        vector3_to_unit(&inHitNormals[i]);
+        random_point_in_hemisphere(&inHitDirections[i], &inHitNormals[i]);
+        vector3_multiply_length(&inHitDirections[i], -1.0);
+        vector3_to_unit(&inHitDirections[i]);
+
+        // Rays from around [0, 0, 0] into the y+ direction (like the scene configurations, see scene.c), that hit `inSpheres` about
+        // half of the time.
+        inRays[i].origin = (Vector3){.x = random_double_inc(-1, 1), .y = random_double_inc(-1, 1), .z = random_double_inc(-1, 1)};
+        inRays[i].direction = (Vector3){.x = random_double_inc(-0.5, 0.5), .y = 1, .z = random_double_inc(-0.5, 0.5)};
+        vector3_to_unit(&inRays[i].direction);
+    }
+
+    for (uint32_t i = 0; i < PERF_SPHERES_LENGTH; i++) {
+        inSpheres[i] = (Sphere){
+            .center = {.x = random_double_inc(-20, 20), .y = random_double_inc(30, 60), .z = random_double_inc(-20, 20)},
+            .radius = random_double_inc(3, 10),
+            .material = &matMatte,
+            .color = COLOR_RED,
+        };
+    }
+
+    // A ground plane and a tilted plane, a disk and a rectangle, in front of the rays.
+    plane_init(&inPlanes[0], &(Vector3){.x = 0, .y = 0, .z = -5}, &(Vector3){.x = 0, .y = 0, .z = 1});
+    plane_disk_init(&inPlanes[1], &(Vector3){.x = 0, .y = 40, .z = 0}, &(Vector3){.x = 0.2, .y = -1, .z = 0.3}, 15);
+    plane_rect_init(&inPlanes[2], &(Vector3){.x = -15, .y = 50, .z = -15}, &(Vector3){.x = 15, .y = 50, .z = 15});
+    plane_init(&inPlanes[3], &(Vector3){.x = 0, .y = 60, .z = 0}, &(Vector3){.x = 1, .y = -1, .z = 0.5});
+
+    // A tessellated sphere in front of the rays, that they hit about half of the time.
+    init_uv_sphere_mesh(&inMesh, &(Vector3){.x = 0, .y = 45, .z = 0}, 15, PERF_MESH_SEGMENTS, PERF_MESH_RINGS);
+
+    // A wall of randomly rotated instances of a cluster of spheres (in a unit cube) in front of the rays.
+    scene_init_empty(&inInstancesScene);
+    Prototype cluster;
+    prototype_init_spheres(&cluster);
+    for (uint32_t i = 0; i < PERF_INSTANCE_SPHERES; i++) {
+        Sphere sphere = {
+            .center = {.x = random_double_inc(-0.5, 0.5), .y = random_double_inc(-0.5, 0.5), .z = random_double_inc(-0.5, 0.5)},
+            .radius = random_double_inc(0.02, 0.06),
+            .material = &matMatte,
+        };
+        prototype_add_sphere(&cluster, &sphere);
+    }
+    uint32_t prototype = scene_add_prototype(&inInstancesScene, &cluster);
+    double cellSize = 40.0 / PERF_INSTANCES_EDGE;
+    for (uint32_t i = 0; i < PERF_INSTANCES_EDGE * PERF_INSTANCES_EDGE; i++) {
+        Vector3 translation = {
+            .x = -20 + cellSize * (i % PERF_INSTANCES_EDGE + 0.5),
+            .y = random_double_inc(40, 50),
+            .z = -20 + cellSize * (i / PERF_INSTANCES_EDGE + 0.5),
+        };
+        Vector3 axis = {.x = random_double_inc(-1, 1), .y = random_double_inc(-1, 1), .z = 1};
+        Transform transform;
+        transform_init(&transform, &translation, &axis, random_double_inc(0, 2 * M_PI), cellSize);
+        scene_add_instance(&inInstancesScene, prototype, &transform);
+    }
+    scene_build_instances_bvh(&inInstancesScene);
+
+    // A cloud of small spheres in front of the rays, in a grid.
+    for (uint32_t i = 0; i < PERF_GRID_SPHERES; i++) {
+        inGridSpheres[i] = (Sphere){
+            .center = {.x = random_double_inc(-20, 20), .y = random_double_inc(30, 60), .z = random_double_inc(-20, 20)},
+            .radius = random_double_inc(0.3, 0.8),
+            .material = &matMatte,
+        };
+    }
+    sphere_grid_init(&inGrid);
+    sphere_grid_build(&inGrid, inGridSpheres, PERF_GRID_SPHERES, NULL);
+    wide_bvh_init(&inWideBVH);
+    wide_bvh_build(&inWideBVH, inGridSpheres, PERF_GRID_SPHERES);
+
+    scene_init_empty(&matScene);
+
+    Sphere unitSphere = {.center = {.x = 0, .y = 0, .z = 0}, .radius = 1, .color = COLOR_HALF_GREEN};
+    matSphereMatte = unitSphere;
+    matSphereMatte.material = &matMatte;
+    matSphereMetal = unitSphere;
+    sphere_metal_init(&matSphereMetal, 0.0);
+    matSphereMetalFuzzy = unitSphere;
+    sphere_metal_init(&matSphereMetalFuzzy, 0.3);
+    matSphereDielectric = unitSphere;
+    sphere_glass_init(&matSphereDielectric);
+    matSphereLight = unitSphere;
+    sphere_light_init(&matSphereLight, (Color)COLOR_LIGHT);
+    matSphereGradientSky = unitSphere;
+    matSphereGradientSky.material = &matGradientSky;
+    matSphereGround = unitSphere;
+    matSphereGround.material = &matGround;
+    matSphereShaded = unitSphere;
+    matSphereShaded.material = &matShaded;
+}
+
+/**
+ * Calibrates, warms up and runs `kernel` for `reps` measured repetitions and stores the statistics in `result`.
+ */
+static bool run_kernel(PerfKernel *kernel, uint32_t reps, uint64_t minTimeNs, PerfResult *result)
+{
+    // Calibrate the amount of iterations, so that a single repetition takes at least `minTimeNs` (this also warms up the caches and the
+    // branch predictors).
+    uint64_t iterations = PERF_ITERATIONS_MIN;
+    while (time_kernel_ns(kernel, iterations) < minTimeNs) {
+        iterations *= 2;
+    }
+
+    for (uint32_t i = 0; i < PERF_WARMUP_REPS; i++) {
+        time_kernel_ns(kernel, iterations);
+    }
+
+    double *opNs = malloc(sizeof(double) * reps);
+    double *deviations = malloc(sizeof(double) * reps);
+    if (opNs == NULL || deviations == NULL) {
+        fprintf(stderr, "Fatal error: could not allocate the repetition times. Out of memory?\n");
+        free(opNs);
+        free(deviations);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < reps; i++) {
+        opNs[i] = (double)time_kernel_ns(kernel, iterations) / iterations;
+    }
+
+    qsort(opNs, reps, sizeof(double), compare_doubles);
+    double median = median_of_sorted(opNs, reps);
+    for (uint32_t i = 0; i < reps; i++) {
+        deviations[i] = fabs(opNs[i] - median);
+    }
+    qsort(deviations, reps, sizeof(double), compare_doubles);
+
+    result->iterations = iterations;
+    result->medianNs = median;
+    result->madNs = median_of_sorted(deviations, reps);
+    result->minNs = opNs[0];
+
+    free(opNs);
+    free(deviations);
+    return true;
+}
+
+/**
+ * Runs `kernel` for `iterations` iterations and returns how long it took (in nanoseconds).
+ */
+static uint64_t time_kernel_ns(PerfKernel *kernel, uint64_t iterations)
+{
+    // Every repetition starts from the same random state, so that the rejection sampling loops take the same amount of iterations.
+    random_seed(PERF_SEED);
+
+    uint64_t start = time_now_ns();
+    double res = kernel->run(iterations);
+    uint64_t end = time_now_ns();
+
+    perfSink += res;
+    return end - start;
+}
+
+static double median_of_sorted(double *arr, uint32_t length)
+{
+    if (length % 2 == 1) {
+        return arr[length / 2];
+    }
+    return (arr[length / 2 - 1] + arr[length / 2]) / 2;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double da = *(const double *)a;
+    double db = *(const double *)b;
+    return (da > db) - (da < db);
+}
+
+static bool parse_uint(const char *str, uint64_t min, uint64_t max, uint64_t *value)
+{
+    char *end;
+    errno = 0;
+    unsigned long long v = strtoull(str, &end, 10);
+    if (errno != 0 || end == str || *end != '\0' || v < min || v > max) {
+        return false;
+    }
+    *value = v;
+    return true;
+}
+
+static void print_usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [--reps <n>] [--min-time-ms <n>] [--filter <substring>]\n", prog);
+}
+
+/**
+ * Initializes `mesh` as a sphere with `center` and `radius`, tessellated into `segments` (around the z axis) and `rings` (from the top to
+ * the bottom), and builds its BVH.
+ */
+static void init_uv_sphere_mesh(Mesh *mesh, Vector3 *center, double radius, uint32_t segments, uint32_t rings)
+{
+    mesh_init(mesh);
+    for (uint32_t r = 0; r <= rings; r++) {
+        double theta = M_PI * r / rings;
+        for (uint32_t s = 0; s < segments; s++) {
+            double phi = 2 * M_PI * s / segments;
+            Vector3 v = {
+                .x = center->x + radius * sin(theta) * cos(phi),
+                .y = center->y + radius * sin(theta) * sin(phi),
+                .z = center->z + radius * cos(theta),
+            };
+            mesh_add_vertex(mesh, &v);
+        }
+    }
+
+    // Counter-clockwise (seen from the outside) triangles between each pair of rings, except the degenerate ones at the poles.
+    for (uint32_t r = 0; r < rings; r++) {
+        for (uint32_t s = 0; s < segments; s++) {
+            uint32_t a = r * segments + s;
+            uint32_t b = r * segments + (s + 1) % segments;
+            uint32_t c = a + segments;
+            uint32_t d = b + segments;
+            if (r > 0) {
+                mesh_add_triangle(mesh, a, c, b);
+            }
+            if (r < rings - 1) {
+                mesh_add_triangle(mesh, b, c, d);
+            }
+        }
+    }
+    mesh_build_bvh(mesh);
+}
+
+static inline uint64_t time_now_ns()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static inline double sum_vector(Vector3 *v)
+{
+    return v->x + v->y + v->z;
+}
+
+static inline double sum_color(Color *c)
+{
+    return c->red + c->green + c->blue;
+}
+
+/**
+ * "Hits" the `sphere` (at [0, 0, 0], radius 1) with the i-th input ray direction and normal and returns the sum of the resulting color.
+ */
+static inline double material_hit(Sphere *sphere, uint64_t i)
+{
+    // The hit functions can modify the ray and the hit position, so they are copied from the inputs.
+    Vector3 pos = inHitNormals[i & PERF_INPUTS_MASK];
+    Ray ray = {.origin = pos, .direction = inHitDirections[i & PERF_INPUTS_MASK]};
+    vector3_subtract_from(&ray.origin, &ray.direction);
+
+    RTContext rtContext;
+    ray_trace_context_init(&rtContext);
+    rtContext.bounces = 1;
+
+    // The position on a unit sphere at [0, 0, 0] is also its normal.
+    Hit hit = {.pos = pos, .normal = pos, .matData = sphere->matData, .color = &sphere->color};
+    Color color = sphere->material->hit(&matScene, &ray, &rtContext, &hit);
+    return sum_color(&color);
+}
+
+
+static double kernel_vector3_length(uint64_t iterations)
+{
+    double acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        acc += vector3_length(&inVectors[i & PERF_INPUTS_MASK]);
+    }
+    return acc;
+}
+
+static double kernel_vector3_to_unit(uint64_t iterations)
+{
+    double acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        Vector3 v = inVectors[i & PERF_INPUTS_MASK];
+        vector3_to_unit(&v);
+        acc += sum_vector(&v);
+    }
+    return acc;
+}
+
+static double kernel_vector3_add_to(uint64_t iterations)
+{
+    double acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        Vector3 res;
+        vector3_add_to(&inVectors[i & PERF_INPUTS_MASK], &inVectors[(i + 1) & PERF_INPUTS_MASK], &res);
+        acc += sum_vector(&res);
+    }
+    return acc;
+}
+
+static double kernel_vector3_subtract(uint64_t iterations)
+{
+    double acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        Vector3 res;
+        vector3_subtract(&inVectors[i & PERF_INPUTS_MASK], &inVectors[(i + 1) & PERF_INPUTS_MASK], &res);
+        acc += sum_vector(&res);
+    }
+    return acc;
+}
+
+static double kernel_vector3_dot(uint64_t iterations)
+{
+    double acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        acc += vector3_dot(&inVectors[i & PERF_INPUTS_MASK], &inVectors[(i + 1) & PERF_INPUTS_MASK]);
+    }
+    return acc;
+}
+
+static double kernel_vector3_cross(uint64_t iterations)
+{
+    double acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        Vector3 res;
+        vector3_cross(&inVectors[i & PERF_INPUTS_MASK], &inVectors[(i + 1) & PERF_INPUTS_MASK], &res);
+        acc += sum_vector(&res);
+    }
+    return acc;
+}
+
+static double kernel_vector3_multiply(uint64_t iterations)
+{
+    double acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        Vector3 res;
+        vector3_multiply(&inVectors[i & PERF_INPUTS_MASK], &inVectors[(i + 1) & PERF_INPUTS_MASK], &res);
+        acc += sum_vector(&res);
+    }
+    return acc;
+}
+
+static double kernel_vector3_multiply_length(uint64_t iterations)
+{
+    double acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        Vector3 v = inVectors[i & PERF_INPUTS_MASK];
+        vector3_multiply_length(&v, inVectors[(i + 1) & PERF_INPUTS_MASK].x);
+        acc += sum_vector(&v);
+    }
+    return acc;
+}
+
+static double kernel_vector3_divide_length(uint64_t iterations)
+{
+    double acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        Vector3 v = inVectors[i & PERF_INPUTS_MASK];
+        vector3_divide_length(&v, inVectors[(i + 1) & PERF_INPUTS_MASK].x);
+        acc += sum_vector(&v);
+    }
+    return acc;
+}
+
+static double kernel_random_state_next(uint64_t iterations)
+{
+    RandomState rs;
+    random_state_seed(&rs, PERF_SEED);
+    uint64_t acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        acc ^= random_state_next(&rs);
+    }
+    return (double)acc;
+}
+
+static double kernel_random_state_double_0_1_exc(uint64_t iterations)
+{
+    RandomState rs;
+    random_state_seed(&rs, PERF_SEED);
+    double acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        acc += random_state_double_0_1_exc(&rs);
+    }
+    return acc;
+}
+
+static double kernel_random_double_0_1_exc(uint64_t iterations)
+{
+    double acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        acc += random_double_0_1_exc();
+    }
+    return acc;
+}
+
+static double kernel_random_double_0_1_inc(uint64_t iterations)
+{
+    double acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        acc += random_double_0_1_inc();
+    }
+    return acc;
+}
+
+static double kernel_random_double_exc(uint64_t iterations)
+{
+    double acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        acc += random_double_exc(-1, 1);
+    }
+    return acc;
+}
+
+static double kernel_random_int_exc(uint64_t iterations)
+{
+    int64_t acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        acc += random_int_exc(0, 1000);
+    }
+    return (double)acc;
+}
+
+static double kernel_random_point_in_unit_sphere__random_algo(uint64_t iterations)
+{
+    double acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        Vector3 p;
+        random_point_in_unit_sphere__random_algo(&p);
+        acc += sum_vector(&p);
+    }
+    return acc;
+}
+
+static double kernel_random_point_in_unit_sphere__trigonometric_algo(uint64_t iterations)
+{
+    double acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        Vector3 p;
+        random_point_in_unit_sphere__trigonometric_algo(&p);
+        acc += sum_vector(&p);
+    }
+    return acc;
+}
+
+static double kernel_random_point_in_hemisphere(uint64_t iterations)
+{
+    double acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        Vector3 p;
+        random_point_in_hemisphere(&p, &inUnitVectors[i & PERF_INPUTS_MASK]);
+        acc += sum_vector(&p);
+    }
+    return acc;
+}
+
+static double kernel_ray_distance_to_sphere(uint64_t iterations)
+{
+    double acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        acc += ray_distance_to_sphere(&inRays[i & PERF_INPUTS_MASK], &inSpheres[i % PERF_SPHERES_LENGTH]);
+    }
+    return acc;
+}
+
+static double kernel_ray_distance_to_plane(uint64_t iterations)
+{
+    double acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        acc += ray_distance_to_plane(&inRays[i & PERF_INPUTS_MASK], &inPlanes[i % PERF_PLANES_LENGTH]);
+    }
+    return acc;
+}
+
+static double kernel_mesh_intersect(uint64_t iterations)
+{
+    double acc = 0;
+    uint32_t tests = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        double dist = DBL_MAX;
+        uint32_t triangle = 0;
+        if (mesh_intersect(&inMesh, &inRays[i & PERF_INPUTS_MASK], &dist, &triangle, &tests)) {
+            acc += dist + triangle;
+        }
+    }
+    return acc + tests;
+}
+
+static double kernel_mesh_occluded(uint64_t iterations)
+{
+    double acc = 0;
+    uint32_t tests = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        acc += mesh_occluded(&inMesh, &inRays[i & PERF_INPUTS_MASK], DBL_MAX, &tests);
+    }
+    return acc + tests;
+}
+
+static double kernel_instances_intersect(uint64_t iterations)
+{
+    double acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        double dist = DBL_MAX;
+        InstanceHit hit;
+        if (instances_intersect(&inInstancesScene, &inRays[i & PERF_INPUTS_MASK], &dist, &hit)) {
+            acc += dist + hit.primitive;
+        }
+        acc += hit.instanceTests + hit.sphereTests;
+    }
+    return acc;
+}
+
+static double kernel_instances_occluded(uint64_t iterations)
+{
+    double acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        InstanceHit stats;
+        acc += instances_occluded(&inInstancesScene, &inRays[i & PERF_INPUTS_MASK], DBL_MAX, false, &stats);
+        acc += stats.instanceTests + stats.sphereTests;
+    }
+    return acc;
+}
+
+static double kernel_sphere_grid_intersect(uint64_t iterations)
+{
+    double acc = 0;
+    uint32_t tests = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        double dist = DBL_MAX;
+        if (sphere_grid_intersect(&inGrid, inGridSpheres, &inRays[i & PERF_INPUTS_MASK], &dist, &tests) != NULL) {
+            acc += dist;
+        }
+    }
+    return acc + tests;
+}
+
+static double kernel_sphere_grid_occluded(uint64_t iterations)
+{
+    double acc = 0;
+    uint32_t tests = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        acc += sphere_grid_occluded(&inGrid, inGridSpheres, &inRays[i & PERF_INPUTS_MASK], DBL_MAX, false, &tests);
+    }
+    return acc + tests;
+}
+
+static double kernel_wide_bvh_intersect(uint64_t iterations)
+{
+    double acc = 0;
+    uint32_t tests = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        double dist = DBL_MAX;
+        if (wide_bvh_intersect(&inWideBVH, inGridSpheres, &inRays[i & PERF_INPUTS_MASK], &dist, &tests) != NULL) {
+            acc += dist;
+        }
+    }
+    return acc + tests;
+}
+
+static double kernel_wide_bvh_occluded(uint64_t iterations)
+{
+    double acc = 0;
+    uint32_t tests = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        acc += wide_bvh_occluded(&inWideBVH, inGridSpheres, &inRays[i & PERF_INPUTS_MASK], DBL_MAX, false, &tests);
+    }
+    return acc + tests;
+}
+
+static double kernel_mat_mirror_reflect(uint64_t iterations)
+{
+    double acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        Vector3 reflected;
+        mat_mirror_reflect(&inHitDirections[i & PERF_INPUTS_MASK], &inHitNormals[i & PERF_INPUTS_MASK], 0.0, &reflected);
+        acc += sum_vector(&reflected);
+    }
+    return acc;
+}
+
+static double kernel_mat_mirror_reflect_fuzzy(uint64_t iterations)
+{
+    double acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        Vector3 reflected;
+        mat_mirror_reflect(&inHitDirections[i & PERF_INPUTS_MASK], &inHitNormals[i & PERF_INPUTS_MASK], 0.3, &reflected);
+        acc += sum_vector(&reflected);
+    }
+    return acc;
+}
+
+static double kernel_mat_refract(uint64_t iterations)
+{
+    double acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        Vector3 *incoming = &inHitDirections[i & PERF_INPUTS_MASK];
+        Vector3 *normal = &inHitNormals[i & PERF_INPUTS_MASK];
+        double cosTheta = -vector3_dot(incoming, normal);
+
+        // Air to glass (refraction is always possible in this direction).
+        Vector3 refracted;
+        mat_refract(incoming, normal, 1.0 / MAT_GLASS_REFRACTION_INDEX, cosTheta, &refracted);
+        acc += sum_vector(&refracted);
+    }
+    return acc;
+}
+
+static double kernel_hit_matte(uint64_t iterations)
+{
+    double acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        acc += material_hit(&matSphereMatte, i);
+    }
+    return acc;
+}
+
+static double kernel_hit_metal(uint64_t iterations)
+{
+    double acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        acc += material_hit(&matSphereMetal, i);
+    }
+    return acc;
+}
+
+static double kernel_hit_metal_fuzzy(uint64_t iterations)
+{
+    double acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        acc += material_hit(&matSphereMetalFuzzy, i);
+    }
+    return acc;
+}
+
+static double kernel_hit_dielectric(uint64_t iterations)
+{
+    double acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        acc += material_hit(&matSphereDielectric, i);
+    }
+    return acc;
+}
+
+static double kernel_hit_light(uint64_t iterations)
+{
+    double acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        acc += material_hit(&matSphereLight, i);
+    }
+    return acc;
+}
+
+static double kernel_hit_gradient_sky(uint64_t iterations)
+{
+    double acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        acc += material_hit(&matSphereGradientSky, i);
+    }
+    return acc;
+}
+
+static double kernel_hit_ground(uint64_t iterations)
+{
+    double acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        acc += material_hit(&matSphereGround, i);
+    }
+    return acc;
+}
+
+static double kernel_hit_shaded(uint64_t iterations)
+{
+    double acc = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        acc += material_hit(&matSphereShaded, i);
+    }
+    return acc;
+}
@@ -0,0 +1,171 @@
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "rtalloc.h"
+#include "rtcommon.h"
+#include "timeline.h"
+
+
+_Static_assert((TIMELINE_RING_EVENTS & (TIMELINE_RING_EVENTS - 1)) == 0, "TIMELINE_RING_EVENTS must be a power of 2");
+
+#define TIMELINE_THREAD_NAME_MAX    32
+
+
+typedef struct TimelineEvent_s      TimelineEvent;
+typedef struct TimelineRing_s       TimelineRing;
+
+struct TimelineEvent_s {
+    const char *name;
+    uint64_t    startNs;
+    uint64_t    durationNs;
+    uint32_t    arg;
+};
+
+// The events of a single thread. Only that thread writes the events, other threads only read them (see timeline_write_chrome_json()).
+struct TimelineRing_s {
+    TimelineRing       *next;                   // The next ring in the list of all rings (see timelineRings).
+    uint32_t            tid;
+    char                threadName[TIMELINE_THREAD_NAME_MAX];
+
+    // The amount of events ever recorded. Event `i` is stored in events[i % TIMELINE_RING_EVENTS].
+    _Atomic uint64_t    written;
+    TimelineEvent       events[TIMELINE_RING_EVENTS];
+};
+
+
+// The rings of all threads that have recorded events (or have set their name), newest first. Rings are only added (with a
+// compare-and-swap), never removed.
+static _Atomic(TimelineRing *) timelineRings = NULL;
+static _Atomic uint32_t timelineNextTid = 1;
+static _Atomic bool timelineRecording = false;
+
+static _Thread_local TimelineRing *timelineThreadRing RT_TLS_MODEL = NULL;
+
+
+static TimelineRing * timeline_thread_ring();
+static void write_json_string(FILE *f, const char *s);
+
+
+void timeline_set_recording(bool recording)
+{
+    atomic_store_explicit(&timelineRecording, recording, memory_order_relaxed);
+}
+
+void timeline_set_thread_name(const char *name)
+{
+    TimelineRing *ring = timeline_thread_ring();
+    snprintf(ring->threadName, TIMELINE_THREAD_NAME_MAX, "%s", name);
+}
+
+void timeline_record(const char *name, uint64_t startNs, uint32_t arg)
+{
+    if (! atomic_load_explicit(&timelineRecording, memory_order_relaxed)) {
+        return;
+    }
+
+    uint64_t endNs = timeline_now();
+    TimelineRing *ring = timeline_thread_ring();
+    uint64_t written = atomic_load_explicit(&ring->written, memory_order_relaxed);
+
+    TimelineEvent *event = &ring->events[written & (TIMELINE_RING_EVENTS - 1)];
+    event->name = name;
+    event->startNs = startNs;
+    event->durationNs = endNs - startNs;
+    event->arg = arg;
+
+    // Publishes the event to the readers.
+    atomic_store_explicit(&ring->written, written + 1, memory_order_release);
+}
+
+bool timeline_write_chrome_json(const char *path)
+{
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        log_err("Could not open timeline file for writing: %s\n", path);
+        return false;
+    }
+
+    TimelineRing *rings = atomic_load_explicit(&timelineRings, memory_order_acquire);
+
+    // Timestamps are written relative to the earliest recorded event, so that they are small numbers.
+    uint64_t epochNs = UINT64_MAX;
+    for (TimelineRing *ring = rings; ring != NULL; ring = ring->next) {
+        uint64_t written = atomic_load_explicit(&ring->written, memory_order_acquire);
+        uint64_t first = written > TIMELINE_RING_EVENTS ? written - TIMELINE_RING_EVENTS : 0;
+        for (uint64_t i = first; i < written; i++) {
+            uint64_t startNs = ring->events[i & (TIMELINE_RING_EVENTS - 1)].startNs;
+            if (startNs < epochNs) {
+                epochNs = startNs;
+            }
+        }
+    }
+
+    fprintf(f, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    bool firstEvent = true;
+    for (TimelineRing *ring = rings; ring != NULL; ring = ring->next) {
+        // The thread name metadata event.
+        fprintf(f, "%s{\"ph\": \"M\", \"pid\": 1, \"tid\": %" PRIu32 ", \"name\": \"thread_name\", \"args\": {\"name\": ",
+            firstEvent ? "" : ",\n", ring->tid);
+        write_json_string(f, ring->threadName);
+        fprintf(f, "}}");
+        firstEvent = false;
+
+        // Complete ("X") events: a start time and a duration (in microseconds).
+        uint64_t written = atomic_load_explicit(&ring->written, memory_order_acquire);
+        uint64_t first = written > TIMELINE_RING_EVENTS ? written - TIMELINE_RING_EVENTS : 0;
+        for (uint64_t i = first; i < written; i++) {
+            TimelineEvent *event = &ring->events[i & (TIMELINE_RING_EVENTS - 1)];
+            fprintf(f, ",\n{\"ph\": \"X\", \"pid\": 1, \"tid\": %" PRIu32 ", \"ts\": %.3f, \"dur\": %.3f, \"name\": ", ring->tid,
+                (event->startNs - epochNs) / 1000.0, event->durationNs / 1000.0);
+            write_json_string(f, event->name);
+            fprintf(f, ", \"args\": {\"arg\": %" PRIu32 "}}", event->arg);
+        }
+    }
+    fprintf(f, "\n]}\n");
+
+    bool ok = ! ferror(f);
+    ok = (fclose(f) == 0) && ok;
+    if (! ok) {
+        log_err("Could not write timeline file: %s\n", path);
+    }
+    return ok;
+}
+
+/**
+ * Returns the ring of the calling thread (allocating and registering it on the first call).
+ */
+static TimelineRing * timeline_thread_ring()
+{
+    if (timelineThreadRing != NULL) {
+        return timelineThreadRing;
+    }
+
+    TimelineRing *ring = rtalloc(sizeof(TimelineRing));
+    ring->tid = atomic_fetch_add_explicit(&timelineNextTid, 1, memory_order_relaxed);
+    snprintf(ring->threadName, TIMELINE_THREAD_NAME_MAX, "thread %" PRIu32, ring->tid);
+    atomic_init(&ring->written, 0);
+
+    ring->next = atomic_load_explicit(&timelineRings, memory_order_relaxed);
+    while (! atomic_compare_exchange_weak_explicit(&timelineRings, &ring->next, ring, memory_order_release, memory_order_relaxed)) {
+        // ring->next was updated to the current list head, try again.
+    }
+
+    timelineThreadRing = ring;
+    return ring;
+}
+
+/**
+ * Writes `s` as a JSON string (quoted, with the quotes and backslashes escaped).
+ */
+static void write_json_string(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s != '\0'; s++) {
+        if (*s == '"' || *s == '\\') {
+            fputc('\\', f);
+        }
+        fputc(*s, f);
+    }
+    fputc('"', f);
+}
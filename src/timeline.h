@@ -0,0 +1,85 @@
+#ifndef __TIMELINE_H__
+#define __TIMELINE_H__
+
+/**
+ * A timeline of what every thread was doing (frames, image rows, pipeline stages), for finding stalls and load imbalance that the
+ * average FPS doesn't show. The recorded events are written in the Chrome trace event format (JSON), which can be viewed in Perfetto
+ * (https://ui.perfetto.dev) or chrome://tracing.
+ *
+ * Each thread records its events into its own ring buffer (allocated on its first event), so recording takes no locks and the threads
+ * never write to the same memory. When a ring buffer is full, the oldest events of that thread are overwritten.
+ *
+ * An event is recorded with a TIMELINE_BEGIN(), TIMELINE_END() pair:
+ *
+ *     TIMELINE_BEGIN(tlBlend);
+ *     blend_frame(...);
+ *     TIMELINE_END(tlBlend, "blend_frame", 0);
+ *
+ * Events are only recorded while recording is on (see timeline_set_recording()). When TIMELINE_ENABLED is 0, the macros expand to
+ * nothing, so the instrumentation has no cost at all.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+
+// #define TIMELINE_ENABLED    1
+#define TIMELINE_ENABLED    0
+
+// The capacity (in events) of each thread's ring buffer. Must be a power of 2.
+#define TIMELINE_RING_EVENTS    (1 << 16)
+
+
+#if TIMELINE_ENABLED
+
+// Declares the variable `var`, holding the start time of an event (that is recorded by a matching TIMELINE_END()).
+#define TIMELINE_BEGIN(var)             uint64_t var = timeline_now()
+
+// Records the event `name` (a string literal), that started at TIMELINE_BEGIN(var) and ends now. `arg` (an unsigned integer, e.g. the
+// frame or the row number) is shown in the event's details.
+#define TIMELINE_END(var, name, arg)    timeline_record((name), (var), (arg))
+
+#else
+
+#define TIMELINE_BEGIN(var)
+#define TIMELINE_END(var, name, arg)    ((void)0)
+
+#endif // TIMELINE_ENABLED
+
+
+/**
+ * Starts (`recording` is true) or stops recording events on all threads.
+ */
+void timeline_set_recording(bool recording);
+
+/**
+ * Sets the name of the calling thread, as shown in the timeline (e.g. "main", "worker 1").
+ */
+void timeline_set_thread_name(const char *name);
+
+/**
+ * Records the event `name` of the calling thread, that started at `startNs` (see timeline_now()) and ends now. Use TIMELINE_END()
+ * instead of calling this directly. Does nothing if recording is off.
+ */
+void timeline_record(const char *name, uint64_t startNs, uint32_t arg);
+
+/**
+ * Writes the recorded events of all threads into `path`, as Chrome trace event JSON. Returns false (and logs the error) if the file
+ * could not be written.
+ *
+ * Must only be called while no thread is recording events (e.g. after timeline_set_recording(false), between frames).
+ */
+bool timeline_write_chrome_json(const char *path);
+
+/**
+ * Returns the current time (in nanoseconds) of the timeline clock.
+ */
+static inline uint64_t timeline_now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+#endif // __TIMELINE_H__
@@ -0,0 +1,234 @@
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif // __SSE2__
+
+#include "tonemap.h"
+
+
+// How many image rows are converted by a single worker task.
+#define TONE_MAP_ROWS_PER_TASK  16
+
+
+typedef struct ToneMapTaskCtx_s     ToneMapTaskCtx;
+
+struct ToneMapTaskCtx_s {
+    ToneMap    *tm;
+    Color      *img;
+    uint32_t    imgHeight;
+    uint32_t    imgWidth;
+    uint8_t    *pixels;
+    int         pitch;
+};
+
+
+static void tonemap_task(void *ctx, uint32_t taskIdx, uint32_t workerIdx);
+static inline void tonemap_row(ToneMap *tm, double *src, uint8_t *dst, uint32_t len);
+static inline __attribute__((always_inline)) void tonemap_row_op(
+    double *src, uint8_t *dst, uint32_t len, ToneMapOperator op, double exposure, bool srgb, uint8_t *srgbLut);
+static inline __attribute__((always_inline)) double tonemap_apply_op(double x, ToneMapOperator op);
+static inline double srgb_encode(double v);
+
+
+void tonemap_init(ToneMap *tm, ToneMapOperator op, double exposure, bool srgb)
+{
+    tm->op = op;
+    tm->exposure = exposure;
+    tm->srgb = srgb;
+
+    for (uint32_t i = 0; i < TONE_MAP_SRGB_LUT_SIZE; i++) {
+        double v = (double)i / (TONE_MAP_SRGB_LUT_SIZE - 1);
+        tm->srgbLut[i] = (uint8_t)(srgb_encode(v) * 255.0 + 0.5);
+    }
+}
+
+void tonemap_rows_to_rgb24(ToneMap *tm, Color *img, uint32_t imgWidth, uint32_t rowFrom, uint32_t rowTo, uint8_t *pixels, int pitch)
+{
+    // Color consists of 3 doubles (without padding), so each row of the image is converted as a flat array of 3*imgWidth doubles into
+    // 3*imgWidth bytes. Every color component is processed in exactly the same way, which makes this easy to vectorise.
+    for (uint32_t row = rowFrom; row < rowTo; row++) {
+        tonemap_row(tm, (double *)&img[row * imgWidth], &pixels[(size_t)row * pitch], imgWidth * 3);
+    }
+}
+
+void tonemap_img_to_rgb24(ToneMap *tm, WorkerPool *workers, Color *img, uint32_t imgHeight, uint32_t imgWidth, uint8_t *pixels, int pitch)
+{
+    ToneMapTaskCtx ctx = {
+        .tm         = tm,
+        .img        = img,
+        .imgHeight  = imgHeight,
+        .imgWidth   = imgWidth,
+        .pixels     = pixels,
+        .pitch      = pitch,
+    };
+
+    uint32_t tasksCount = (imgHeight + TONE_MAP_ROWS_PER_TASK - 1) / TONE_MAP_ROWS_PER_TASK;
+    workers_run(workers, tonemap_task, &ctx, tasksCount);
+}
+
+static void tonemap_task(void *ctx, uint32_t taskIdx, uint32_t workerIdx)
+{
+    (void)(workerIdx);  // Disable gcc -Wextra "unused parameter" errors.
+
+    ToneMapTaskCtx *tctx = ctx;
+    uint32_t rowFrom = taskIdx * TONE_MAP_ROWS_PER_TASK;
+    uint32_t rowTo = rowFrom + TONE_MAP_ROWS_PER_TASK;
+    if (rowTo > tctx->imgHeight) {
+        rowTo = tctx->imgHeight;
+    }
+
+    tonemap_rows_to_rgb24(tctx->tm, tctx->img, tctx->imgWidth, rowFrom, rowTo, tctx->pixels, tctx->pitch);
+}
+
+static inline void tonemap_row(ToneMap *tm, double *src, uint8_t *dst, uint32_t len)
+{
+    // Dispatch once per row, so that each (operator, encoding) combination gets its own specialized (inlined) loop, without any branches
+    // inside of it.
+    double e = tm->exposure;
+    uint8_t *lut = tm->srgbLut;
+    switch (tm->op) {
+        case TM_clamp:
+            if (tm->srgb) { tonemap_row_op(src, dst, len, TM_clamp, e, true, lut); }
+            else          { tonemap_row_op(src, dst, len, TM_clamp, e, false, lut); }
+            break;
+
+        case TM_reinhard:
+            if (tm->srgb) { tonemap_row_op(src, dst, len, TM_reinhard, e, true, lut); }
+            else          { tonemap_row_op(src, dst, len, TM_reinhard, e, false, lut); }
+            break;
+
+        case TM_aces:
+            if (tm->srgb) { tonemap_row_op(src, dst, len, TM_aces, e, true, lut); }
+            else          { tonemap_row_op(src, dst, len, TM_aces, e, false, lut); }
+            break;
+    }
+}
+
+#if defined(__SSE2__)
+static inline __attribute__((always_inline)) __m128d tonemap_apply_op_pd(__m128d x, ToneMapOperator op)
+{
+    __m128d one = _mm_set1_pd(1.0);
+    switch (op) {
+        case TM_clamp:
+            return _mm_min_pd(x, one);
+
+        case TM_reinhard:
+            return _mm_div_pd(x, _mm_add_pd(one, x));
+
+        case TM_aces: {
+            // (x * (2.51x + 0.03)) / (x * (2.43x + 0.59) + 0.14)
+            __m128d num = _mm_mul_pd(x, _mm_add_pd(_mm_mul_pd(x, _mm_set1_pd(2.51)), _mm_set1_pd(0.03)));
+            __m128d den = _mm_add_pd(_mm_mul_pd(x, _mm_add_pd(_mm_mul_pd(x, _mm_set1_pd(2.43)), _mm_set1_pd(0.59))), _mm_set1_pd(0.14));
+            return _mm_min_pd(_mm_div_pd(num, den), one);
+        }
+    }
+    return x;
+}
+
+/**
+ * Converts 2 x 2 color components (`a`, `b`) into 4 integers: tone mapped, scaled to the output range and rounded (but not yet looked up
+ * in the sRGB table).
+ */
+static inline __attribute__((always_inline)) __m128i tonemap_4_pd(__m128d a, __m128d b, ToneMapOperator op, double exposure, bool srgb)
+{
+    __m128d zero = _mm_setzero_pd();
+    __m128d one = _mm_set1_pd(1.0);
+    __m128d exp = _mm_set1_pd(exposure);
+    __m128d half = _mm_set1_pd(0.5);
+
+    // _mm_max_pd() returns its second operand if the first one is NaN, so this also replaces NaNs with 0.
+    a = _mm_max_pd(_mm_mul_pd(a, exp), zero);
+    b = _mm_max_pd(_mm_mul_pd(b, exp), zero);
+
+    // The operators can still produce NaNs (from infinite inputs, e.g. inf / (1 + inf) in Reinhard), which would become out of range
+    // indexes of the sRGB table: clamp their results into [0, 1]. _mm_min_pd() comes first, so those NaNs become 1 (the limit of the
+    // operators at infinity).
+    a = _mm_max_pd(_mm_min_pd(tonemap_apply_op_pd(a, op), one), zero);
+    b = _mm_max_pd(_mm_min_pd(tonemap_apply_op_pd(b, op), one), zero);
+
+    if (srgb) {
+        __m128d scale = _mm_set1_pd(TONE_MAP_SRGB_LUT_SIZE - 1);
+        a = _mm_add_pd(_mm_mul_pd(a, scale), half);
+        b = _mm_add_pd(_mm_mul_pd(b, scale), half);
+    } else {
+        // Same as the scalar version: min(255, round(v * 256)).
+        __m128d scale = _mm_set1_pd(256.0);
+        __m128d maxVal = _mm_set1_pd(255.0);
+        a = _mm_min_pd(_mm_add_pd(_mm_mul_pd(a, scale), half), maxVal);
+        b = _mm_min_pd(_mm_add_pd(_mm_mul_pd(b, scale), half), maxVal);
+    }
+
+    // Truncating conversions (values are non-negative, and we already added 0.5 for rounding).
+    return _mm_unpacklo_epi64(_mm_cvttpd_epi32(a), _mm_cvttpd_epi32(b));
+}
+#endif // __SSE2__
+
+static inline __attribute__((always_inline)) void tonemap_row_op(
+    double *src, uint8_t *dst, uint32_t len, ToneMapOperator op, double exposure, bool srgb, uint8_t *srgbLut)
+{
+    uint32_t i = 0;
+
+#if defined(__SSE2__)
+    for (; i + 4 <= len; i += 4) {
+        __m128i v = tonemap_4_pd(_mm_loadu_pd(&src[i]), _mm_loadu_pd(&src[i + 2]), op, exposure, srgb);
+
+        if (srgb) {
+            uint32_t idx[4];
+            _mm_storeu_si128((__m128i *)idx, v);
+            dst[i]     = srgbLut[idx[0]];
+            dst[i + 1] = srgbLut[idx[1]];
+            dst[i + 2] = srgbLut[idx[2]];
+            dst[i + 3] = srgbLut[idx[3]];
+        } else {
+            // 4 x int32 -> 4 x int16 -> 4 x uint8 (values are already in [0, 255], so the saturating packs don't change them).
+            v = _mm_packs_epi32(v, v);
+            v = _mm_packus_epi16(v, v);
+            uint32_t packed = (uint32_t)_mm_cvtsi128_si32(v);
+            memcpy(&dst[i], &packed, 4);
+        }
+    }
+#endif // __SSE2__
+
+    // Scalar version (for the remaining components, or for all of them if SSE2 is not available).
+    for (; i < len; i++) {
+        double x = src[i] * exposure;
+        x = x > 0.0 ? x : 0.0;      // Also replaces NaNs with 0.
+        x = tonemap_apply_op(x, op);
+        x = x < 1.0 ? x : 1.0;      // Like in tonemap_4_pd(): NaNs (from infinite inputs) become 1.
+        x = x > 0.0 ? x : 0.0;
+
+        if (srgb) {
+            dst[i] = srgbLut[(uint32_t)(x * (TONE_MAP_SRGB_LUT_SIZE - 1) + 0.5)];
+        } else {
+            double v = x * 256.0 + 0.5;
+            dst[i] = (uint8_t)(v < 255.0 ? v : 255.0);
+        }
+    }
+}
+
+static inline __attribute__((always_inline)) double tonemap_apply_op(double x, ToneMapOperator op)
+{
+    switch (op) {
+        case TM_clamp:
+            return x < 1.0 ? x : 1.0;
+
+        case TM_reinhard:
+            return x / (1.0 + x);
+
+        case TM_aces: {
+            double v = (x * (2.51*x + 0.03)) / (x * (2.43*x + 0.59) + 0.14);
+            return v < 1.0 ? v : 1.0;
+        }
+    }
+    return x;
+}
+
+static inline double srgb_encode(double v)
+{
+    if (v <= 0.0031308) {
+        return 12.92 * v;
+    }
+    return 1.055 * pow(v, 1.0 / 2.4) - 0.055;
+}
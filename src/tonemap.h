@@ -0,0 +1,68 @@
+#ifndef __TONEMAP_H__
+#define __TONEMAP_H__
+
+/**
+ * Conversion of rendered images (Color, linear, floating point, unbounded) into displayable 24 bit RGB pixels.
+ *
+ * The conversion is done in this order:
+ * 1. Exposure: each color component is multiplied by `exposure`.
+ * 2. Tone mapping: maps [0, inf) into [0, 1] using the selected ToneMapOperator.
+ * 3. Encoding: either linear (same as we always did: [0, 1] mapped to [0, 255]) or sRGB (gamma encoded, via a lookup table).
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "color.h"
+#include "workers.h"
+
+
+typedef enum {
+    // Simply caps color components at 1.0 (this is what we always did).
+    TM_clamp,
+
+    // Reinhard: x / (1 + x). Never clips, but desaturates and darkens the highlights.
+    TM_reinhard,
+
+    // ACES filmic curve (Krzysztof Narkowicz's fit of the ACES reference rendering transform).
+    TM_aces,
+} ToneMapOperator;
+
+#define TONE_MAP_OPERATOR   TM_clamp
+#define TONE_MAP_EXPOSURE   1.0
+#define TONE_MAP_SRGB       false
+
+// The size of the sRGB encoding lookup table. 4096 entries are enough to never skip an 8 bit output value.
+#define TONE_MAP_SRGB_LUT_SIZE  4096
+
+
+typedef struct ToneMap_s        ToneMap;
+
+
+struct ToneMap_s {
+    ToneMapOperator op;
+    double          exposure;
+    bool            srgb;
+
+    // Maps a tone mapped value v (in [0, 1]) into an sRGB encoded 8 bit value: srgbLut[round(v * (TONE_MAP_SRGB_LUT_SIZE - 1))].
+    uint8_t         srgbLut[TONE_MAP_SRGB_LUT_SIZE];
+};
+
+
+/**
+ * Initializes the tone mapping configuration (and builds the sRGB lookup table).
+ */
+void tonemap_init(ToneMap *tm, ToneMapOperator op, double exposure, bool srgb);
+
+/**
+ * Converts rows [rowFrom, rowTo) of `img` (of `imgWidth` pixels per row) into RGB24 `pixels` (`pitch` bytes per row).
+ * Uses SSE2 (when available) to convert 4 color components at a time.
+ */
+void tonemap_rows_to_rgb24(ToneMap *tm, Color *img, uint32_t imgWidth, uint32_t rowFrom, uint32_t rowTo, uint8_t *pixels, int pitch);
+
+/**
+ * Converts the whole `img` into RGB24 `pixels` (`pitch` bytes per row), splitting the rows between all threads of the `workers` pool.
+ */
+void tonemap_img_to_rgb24(ToneMap *tm, WorkerPool *workers, Color *img, uint32_t imgHeight, uint32_t imgWidth, uint8_t *pixels, int pitch);
+
+#endif // __TONEMAP_H__
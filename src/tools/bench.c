@@ -0,0 +1,677 @@
+/**
+ * bench - renders the built-in scenes with a fixed amount of samples and a fixed seed, with 1..N threads, and reports the performance as
+ * JSON. Optionally compares the results with a stored baseline (the JSON output of a previous run), to make regressions visible.
+ *
+ * Usage: bench [options]
+ *     --samples <n>        Samples (frames) per pixel rendered by each run (default BENCH_SAMPLES).
+ *     --seed <n>           Random number generator seed (default BENCH_SEED).
+ *     --threads <n>        The maximum amount of threads (default: one per CPU core). Runs with 1, 2, 4, ... and <n> threads.
+ *     --size <w>x<h>       Image size (default BENCH_WIDTH x BENCH_HEIGHT).
+ *     --scene <name>       Only run this scene (can be given multiple times).
+ *     --accel <name>       Find the closest sphere with this method (linear, grid or wide_bvh, see SphereAccel), instead of the
+ *                          scene's own.
+ *     --animate <speed>    Move every sphere before each measured frame (in a random direction, constant per sphere, by <speed> times
+ *                          its radius), like particles. Reports the time it took to update the acceleration structures.
+ *     --chunks <n>         Move the spheres of each scene into a (temporary) chunk file, with up to <n> spheres per chunk, and render
+ *                          them out-of-core (see sphere_chunks.h). Renders the same image as in memory. Reports what the chunks cache did.
+ *     --chunk-cache <MiB>  The size of the chunks cache (default BENCH_CHUNK_CACHE_MIB).
+ *     --baseline <file>    Compare rays/sec with the results stored in <file>.
+ *     --tolerance <pct>    How much slower (in %) than the baseline a result can be, before it is a regression (default
+ *                          BENCH_TOLERANCE_PCT).
+ *     --output <file>      Write the JSON results to <file> (instead of stdout). Can be used as a baseline later.
+ *
+ * Rendering is deterministic (sample N of each pixel uses random numbers derived from (seed, pixel, N)), so every run of a scene renders
+ * a bit-identical image, whose hash is reported as "imageHash". Runs of a scene with different amounts of threads are checked to render
+ * the same image.
+ *
+ * Exits with code 2 if any result regressed compared to the baseline, or 3 if any scene rendered different images with different amounts
+ * of threads.
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../envconfig.h"
+#if defined(ENV_LINUX) && ENV_LINUX
+#include <sys/resource.h>
+#else
+#define PSAPI_VERSION 2
+#include <windows.h>
+#include <psapi.h>
+#endif // ENV_LINUX
+
+#include "../camera.h"
+#include "../frame_times.h"
+#include "../perf_counters.h"
+#include "../random.h"
+#include "../ray_stats.h"
+#include "../rtalloc.h"
+#include "../rtcommon.h"
+#include "../scene.h"
+#include "../sphere_chunks.h"
+#include "../tracer.h"
+#include "../workers.h"
+
+
+#define BENCH_SAMPLES           8
+#define BENCH_SEED              1
+#define BENCH_WIDTH             320
+#define BENCH_HEIGHT            240
+#define BENCH_TOLERANCE_PCT     5.0
+#define BENCH_CHUNK_CACHE_MIB   64.0
+#define BENCH_CHUNKS_PATH       "bench_spheres.chunks"     // The temporary chunk file (see --chunks), in the current directory.
+
+#define BENCH_SCENES_MAX        32
+#define BENCH_THREAD_COUNTS_MAX 32
+#define BENCH_BASELINE_MAX      1024
+#define BENCH_LINE_MAX          65536
+
+
+typedef struct BenchConfig_s    BenchConfig;
+typedef struct BenchResult_s    BenchResult;
+typedef struct BaselineEntry_s  BaselineEntry;
+
+struct BenchConfig_s {
+    uint32_t        samples;
+    uint64_t        seed;
+    uint32_t        maxThreads;
+    uint32_t        width;
+    uint32_t        height;
+    const char     *scenes[BENCH_SCENES_MAX];
+    uint32_t        scenesLength;           // 0 means all scenes.
+    int32_t         accel;                  // A SphereAccel, or -1 to use the scene's own.
+    double          animateSpeed;           // How far the spheres move per frame (relative to their radiuses). 0 if they don't.
+    uint32_t        chunkSpheres;           // The spheres per chunk, when rendering the spheres out-of-core. 0 if they are in memory.
+    double          chunkCacheMiB;
+    const char     *baselinePath;
+    double          tolerancePct;
+    const char     *outputPath;
+};
+
+struct BenchResult_s {
+    uint32_t        spheres;
+    SphereAccel     accel;
+    double          accelBuildMs;           // The time it took to build the scene's acceleration structures (before the first frame).
+    double          accelUpdateMs;          // The average time it took to update them after the spheres moved (see --animate).
+    uint32_t        accelPartialRebuilds;   // How many of the updates of the wide BVH rebuilt some of its subtrees (see wide_bvh_refit()).
+    uint32_t        accelRebuilds;          // How many of them rebuilt it all.
+    uint64_t        raysTraced;
+    uint64_t        paths;                  // Camera rays (each is the start of a path of bounced rays).
+    double          seconds;
+    RayStats        rayStats;               // Of the measured frames (all 0, unless RAY_STATS_ENABLED).
+    PerfStats      *perfStats;              // Of the measured frames, one per thread (all 0, unless PERF_COUNTERS_ENABLED).
+    FrameTimes      frameTimes;             // The durations of the measured frames' stages (there is no input, or presenting).
+    uint64_t        imageHash;              // A hash of the rendered (averaged) image's bits.
+
+    // What the chunks cache did during the measured frames, when rendering out-of-core (see --chunks).
+    uint32_t        chunksLength;
+    uint64_t        chunkLoads;
+    uint64_t        chunkHits;
+    uint64_t        chunkEvictions;
+    uint64_t        chunkBytesRead;
+    uint64_t        chunkCachePeakBytes;
+};
+
+struct BaselineEntry_s {
+    char            scene[64];
+    uint32_t        threads;
+    uint64_t        raysTraced;
+    double          raysPerSec;
+};
+
+
+
+static bool parse_args(int argc, char **argv, BenchConfig *config);
+static bool scene_selected(BenchConfig *config, const char *name);
+static uint32_t thread_counts(uint32_t maxThreads, uint32_t *counts);
+static void bench_run(BenchConfig *config, const BenchScene *benchScene, uint32_t threads, BenchResult *result);
+static void move_spheres_to_chunks(Scene *scene, uint32_t chunkSpheres, double cacheMiB);
+static Vector3 * sphere_velocities(Scene *scene, double speed, uint64_t seed);
+static void move_spheres(Scene *scene, Vector3 *velocities);
+static uint64_t image_hash(Color *img, uint32_t pixels);
+static uint64_t peak_rss_kb();
+static uint32_t load_baseline(const char *path, BaselineEntry *entries);
+static BaselineEntry * find_baseline(BaselineEntry *entries, uint32_t length, const char *scene, uint32_t threads);
+static bool json_get_number(const char *line, const char *key, double *value);
+static void print_usage(const char *prog);
+
+
+int main(int argc, char **argv)
+{
+    BenchConfig config = {
+        .samples        = BENCH_SAMPLES,
+        .seed           = BENCH_SEED,
+        .maxThreads     = workers_cpu_count(),
+        .width          = BENCH_WIDTH,
+        .height         = BENCH_HEIGHT,
+        .scenesLength   = 0,
+        .accel          = -1,
+        .animateSpeed   = 0,
+        .chunkSpheres   = 0,
+        .chunkCacheMiB  = BENCH_CHUNK_CACHE_MIB,
+        .baselinePath   = NULL,
+        .tolerancePct   = BENCH_TOLERANCE_PCT,
+        .outputPath     = NULL,
+    };
+    if (! parse_args(argc, argv, &config)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    BaselineEntry *baseline = NULL;
+    uint32_t baselineLength = 0;
+    if (config.baselinePath != NULL) {
+        baseline = rtalloc(sizeof(BaselineEntry) * BENCH_BASELINE_MAX);
+        baselineLength = load_baseline(config.baselinePath, baseline);
+        if (baselineLength == 0) {
+            log_err("Could not load any results from the baseline file \"%s\".\n", config.baselinePath);
+            return 1;
+        }
+    }
+
+    FILE *out = stdout;
+    if (config.outputPath != NULL) {
+        out = fopen(config.outputPath, "w");
+        if (out == NULL) {
+            log_err("Could not open the output file \"%s\".\n", config.outputPath);
+            return 1;
+        }
+    }
+
+    uint32_t counts[BENCH_THREAD_COUNTS_MAX];
+    uint32_t countsLength = thread_counts(config.maxThreads, counts);
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"benchmark\": \"toyraytracer\",\n");
+    fprintf(out, "  \"config\": {\"width\": %" PRIu32 ", \"height\": %" PRIu32 ", \"samples\": %" PRIu32 ", \"seed\": %" PRIu64
+        ", \"maxThreads\": %" PRIu32 ", \"cpus\": %" PRIu32 ", \"antialiasFactor\": %d, \"rayBouncesMax\": %d},\n", config.width,
+        config.height, config.samples, config.seed, config.maxThreads, workers_cpu_count(), ANTIALIAS_FACTOR, RAY_BOUNCES_MAX);
+    fprintf(out, "  \"results\": [\n");
+
+    uint32_t regressions = 0;
+    uint32_t mismatches = 0;
+    bool firstResult = true;
+    for (uint32_t s = 0; s < benchScenesCount; s++) {
+        const BenchScene *benchScene = &benchScenes[s];
+        if (! scene_selected(&config, benchScene->name)) {
+            continue;
+        }
+
+        double singleThreadRaysPerSec = 0;
+        uint64_t firstImageHash = 0;
+        for (uint32_t c = 0; c < countsLength; c++) {
+            uint32_t threads = counts[c];
+            log_err("Running %s with %" PRIu32 " thread(s)...\n", benchScene->name, threads);
+
+            BenchResult result;
+            bench_run(&config, benchScene, threads, &result);
+
+            double raysPerSec = result.raysTraced / result.seconds;
+            if (threads == 1) {
+                singleThreadRaysPerSec = raysPerSec;
+            }
+            // Scaling efficiency: the speedup over the single thread run, divided by the amount of threads (1.0 is perfect scaling).
+            double scalingEfficiency = singleThreadRaysPerSec > 0 ? raysPerSec / (singleThreadRaysPerSec * threads) : 0;
+
+            if (c == 0) {
+                firstImageHash = result.imageHash;
+            } else if (result.imageHash != firstImageHash) {
+                mismatches++;
+                log_err("NONDETERMINISM: %s rendered a different image with %" PRIu32 " thread(s) than with %" PRIu32 " thread(s)\n",
+                    benchScene->name, threads, counts[0]);
+            }
+
+            // Each result is written on a single line (load_baseline() relies on this).
+            fprintf(out, "%s    {\"scene\": \"%s\", \"threads\": %" PRIu32 ", \"spheres\": %" PRIu32 ", \"accel\": \"%s\""
+                ", \"accelBuildMs\": %.3f, \"raysTraced\": %" PRIu64 ", \"paths\": %" PRIu64 ", \"seconds\": %.6f, \"raysPerSec\": %.1f"
+                ", \"nsPerRay\": %.3f, \"pathsPerSec\": %.1f, \"peakRssKb\": %" PRIu64 ", \"scalingEfficiency\": %.4f"
+                ", \"imageHash\": \"%016" PRIx64 "\"", firstResult ? "" : ",\n", benchScene->name, threads, result.spheres,
+                sphere_accel_name(result.accel), result.accelBuildMs, result.raysTraced, result.paths, result.seconds, raysPerSec,
+                result.seconds * 1e9 / result.raysTraced, result.paths / result.seconds, peak_rss_kb(), scalingEfficiency,
+                result.imageHash);
+            if (config.animateSpeed > 0) {
+                fprintf(out, ", \"accelUpdateMs\": %.3f, \"accelPartialRebuilds\": %" PRIu32 ", \"accelRebuilds\": %" PRIu32,
+                    result.accelUpdateMs, result.accelPartialRebuilds, result.accelRebuilds);
+            }
+            if (config.chunkSpheres > 0) {
+                fprintf(out, ", \"chunks\": %" PRIu32 ", \"chunkLoads\": %" PRIu64 ", \"chunkHits\": %" PRIu64
+                    ", \"chunkEvictions\": %" PRIu64 ", \"chunkMBRead\": %.3f, \"chunkCachePeakMB\": %.3f",
+                    result.chunksLength, result.chunkLoads, result.chunkHits, result.chunkEvictions, result.chunkBytesRead / 1048576.0,
+                    result.chunkCachePeakBytes / 1048576.0);
+            }
+            fprintf(out, ", \"frameTimesMs\": ");
+            frame_times_write_json(out, &result.frameTimes);
+            if (RAY_STATS_ENABLED) {
+                fprintf(out, ", \"rayStats\": ");
+                ray_stats_write_json(out, &result.rayStats);
+            }
+            if (PERF_COUNTERS_ENABLED) {
+                PerfStats perfTotal;
+                perf_stats_reset(&perfTotal);
+                fprintf(out, ", \"perfThreads\": [");
+                for (uint32_t t = 0; t < threads; t++) {
+                    fprintf(out, "%s", t > 0 ? ", " : "");
+                    perf_stats_write_json(out, &result.perfStats[t]);
+                    perf_stats_merge(&perfTotal, &result.perfStats[t]);
+                }
+                fprintf(out, "], \"perf\": ");
+                perf_stats_write_json(out, &perfTotal);
+            }
+            rtfree(result.perfStats);
+            firstResult = false;
+
+            BaselineEntry *base = find_baseline(baseline, baselineLength, benchScene->name, threads);
+            if (base != NULL) {
+                double changePct = (raysPerSec - base->raysPerSec) / base->raysPerSec * 100.0;
+                bool regression = changePct < -config.tolerancePct;
+                if (regression) {
+                    regressions++;
+                    log_err("REGRESSION: %s with %" PRIu32 " thread(s): %.1f rays/sec, baseline %.1f rays/sec (%+.2f%%)\n",
+                        benchScene->name, threads, raysPerSec, base->raysPerSec, changePct);
+                }
+                // If the amount of traced rays differs - the workload itself changed (e.g. rendering changes), so the comparison is
+                // not apples to apples.
+                fprintf(out, ", \"baselineRaysPerSec\": %.1f, \"changePct\": %.2f, \"regression\": %s, \"workloadChanged\": %s",
+                    base->raysPerSec, changePct, regression ? "true" : "false", base->raysTraced != result.raysTraced ? "true" : "false");
+            }
+            fprintf(out, "}");
+        }
+    }
+
+    fprintf(out, "\n  ],\n  \"imageMismatches\": %" PRIu32, mismatches);
+    if (baseline != NULL) {
+        fprintf(out, ",\n  \"baseline\": \"%s\",\n  \"tolerancePct\": %.2f,\n  \"regressions\": %" PRIu32, config.baselinePath,
+            config.tolerancePct, regressions);
+    }
+    fprintf(out, "\n}\n");
+
+    if (out != stdout) {
+        fclose(out);
+    }
+    rtfree(baseline);
+
+    return regressions > 0 ? 2 : (mismatches > 0 ? 3 : 0);
+}
+
+static bool parse_args(int argc, char **argv, BenchConfig *config)
+{
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+        if (val == NULL) {
+            log_err("Missing value for argument: %s\n", arg);
+            return false;
+        }
+        i++;
+
+        char *end;
+        if (strcmp(arg, "--samples") == 0) {
+            config->samples = strtoul(val, &end, 10);
+            if (*end != '\0' || config->samples == 0) {
+                return false;
+            }
+        } else if (strcmp(arg, "--seed") == 0) {
+            config->seed = strtoull(val, &end, 10);
+            if (*end != '\0') {
+                return false;
+            }
+        } else if (strcmp(arg, "--threads") == 0) {
+            config->maxThreads = strtoul(val, &end, 10);
+            if (*end != '\0' || config->maxThreads == 0) {
+                return false;
+            }
+        } else if (strcmp(arg, "--size") == 0) {
+            if (sscanf(val, "%" SCNu32 "x%" SCNu32, &config->width, &config->height) != 2 || config->width == 0 || config->height == 0) {
+                return false;
+            }
+        } else if (strcmp(arg, "--scene") == 0) {
+            if (bench_scene_find(val) == NULL || config->scenesLength == BENCH_SCENES_MAX) {
+                log_err("Unknown scene: %s\n", val);
+                return false;
+            }
+            config->scenes[config->scenesLength++] = val;
+        } else if (strcmp(arg, "--accel") == 0) {
+            SphereAccel accel;
+            if (! sphere_accel_by_name(val, &accel)) {
+                log_err("Unknown sphere acceleration method: %s\n", val);
+                return false;
+            }
+            config->accel = accel;
+        } else if (strcmp(arg, "--animate") == 0) {
+            config->animateSpeed = strtod(val, &end);
+            if (*end != '\0' || config->animateSpeed < 0) {
+                return false;
+            }
+        } else if (strcmp(arg, "--chunks") == 0) {
+            config->chunkSpheres = strtoul(val, &end, 10);
+            if (*end != '\0' || config->chunkSpheres == 0) {
+                return false;
+            }
+        } else if (strcmp(arg, "--chunk-cache") == 0) {
+            config->chunkCacheMiB = strtod(val, &end);
+            if (*end != '\0' || ! (config->chunkCacheMiB > 0)) {
+                return false;
+            }
+        } else if (strcmp(arg, "--baseline") == 0) {
+            config->baselinePath = val;
+        } else if (strcmp(arg, "--tolerance") == 0) {
+            config->tolerancePct = strtod(val, &end);
+            if (*end != '\0' || config->tolerancePct < 0) {
+                return false;
+            }
+        } else if (strcmp(arg, "--output") == 0) {
+            config->outputPath = val;
+        } else {
+            log_err("Unknown argument: %s\n", arg);
+            return false;
+        }
+    }
+    if (config->chunkSpheres > 0 && config->animateSpeed > 0) {
+        log_err("Out-of-core spheres (--chunks) can not be animated (--animate).\n");
+        return false;
+    }
+    return true;
+}
+
+static bool scene_selected(BenchConfig *config, const char *name)
+{
+    if (config->scenesLength == 0) {
+        return true;
+    }
+    for (uint32_t i = 0; i < config->scenesLength; i++) {
+        if (strcmp(config->scenes[i], name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Stores the thread counts to benchmark in `counts`: 1, 2, 4, ... (powers of 2 below `maxThreads`) and `maxThreads`.
+ */
+static uint32_t thread_counts(uint32_t maxThreads, uint32_t *counts)
+{
+    uint32_t length = 0;
+    for (uint32_t t = 1; t < maxThreads && length < BENCH_THREAD_COUNTS_MAX - 1; t *= 2) {
+        counts[length++] = t;
+    }
+    counts[length++] = maxThreads;
+    return length;
+}
+
+static void bench_run(BenchConfig *config, const BenchScene *benchScene, uint32_t threads, BenchResult *result)
+{
+    Scene scene;
+    init_scene(&scene, benchScene->scene, SKY_CONFIG);
+
+    Ray camCenterRay;
+    init_camera_ray(benchScene->camera, &camCenterRay);
+    Camera camera;
+    cam_set(&camera, &camCenterRay, config->height, config->width);
+
+    WorkerPool workers;
+    workers_init(&workers, threads);
+
+    uint32_t spheres = scene.spheresLength;
+    if (config->chunkSpheres > 0) {
+        move_spheres_to_chunks(&scene, config->chunkSpheres, config->chunkCacheMiB);
+    }
+
+    // Build the acceleration structures up front (render_frame_img() would build them in the first frame), to time them separately.
+    if (config->accel >= 0) {
+        scene.sphereAccel = config->accel;
+    }
+    struct timespec tbuild;
+    clock_gettime(CLOCK_MONOTONIC, &tbuild);
+    scene_build_instances_bvh(&scene);
+    scene_build_sphere_accel(&scene, &workers);
+    result->accelBuildMs = frame_times_ms_since(&tbuild);
+    result->accel = scene.sphereAccel;
+
+    uint32_t pixels = config->width * config->height;
+    Color *summedFrames = calloc(pixels, sizeof(Color));
+    Color *frameImg = rtalloc(sizeof(Color) * pixels);
+    if (summedFrames == NULL) {
+        log_err("Error: could not allocate heap memory. Exiting.");
+        exit(1);
+    }
+
+    // One warm-up frame (not measured): wakes up the threads and warms up the caches.
+    random_seed(random_hash2(config->seed, 0));
+    render_frame_img(&camera, &scene, &workers, frameImg, config->height, config->width, NULL, NULL, NULL, NULL);
+
+    Vector3 *velocities = config->animateSpeed > 0 ? sphere_velocities(&scene, config->animateSpeed, config->seed) : NULL;
+    double accelUpdateMs = 0;
+    uint32_t partialRebuildsBefore = scene.sphereBVH.partialRebuilds;
+    uint32_t rebuildsBefore = scene.sphereBVH.rebuilds;
+
+    ray_stats_reset(&result->rayStats);
+    result->perfStats = rtalloc(sizeof(PerfStats) * threads);
+    memset(result->perfStats, 0, sizeof(PerfStats) * threads);
+    frame_times_reset(&result->frameTimes);
+    SphereChunks chunksBefore = {0};
+    if (scene.sphereChunks != NULL) {
+        chunksBefore = *scene.sphereChunks;
+    }
+    uint64_t raysTraced = 0;
+    struct timespec tstart, tend;
+    clock_gettime(CLOCK_MONOTONIC, &tstart);
+    for (uint32_t frame = 1; frame <= config->samples; frame++) {
+        struct timespec tframe, tstage;
+        if (velocities != NULL) {
+            // (render_frame_img() would update the acceleration structure itself, this only times the update apart from the tracing.)
+            move_spheres(&scene, velocities);
+            clock_gettime(CLOCK_MONOTONIC, &tstage);
+            scene_build_sphere_accel(&scene, &workers);
+            accelUpdateMs += frame_times_ms_since(&tstage);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &tframe);
+        random_seed(random_hash2(config->seed, frame));
+        if (ANTIALIAS_FACTOR > 1) {
+            raysTraced += render_frame_img_antialiased(&camera, &scene, &workers, frameImg, config->height, config->width,
+                &result->rayStats, result->perfStats, NULL, NULL);
+        } else {
+            raysTraced += render_frame_img(
+                &camera, &scene, &workers, frameImg, config->height, config->width, &result->rayStats, result->perfStats, NULL, NULL);
+        }
+        frame_times_add(&result->frameTimes, FS_trace, frame_times_ms_since(&tframe));
+
+        PERF_PHASE_BEGIN(perfBlend);
+        clock_gettime(CLOCK_MONOTONIC, &tstage);
+        blend_frame(summedFrames, frame, frameImg, frameImg, config->height, config->width);
+        frame_times_add(&result->frameTimes, FS_blend, frame_times_ms_since(&tstage));
+        PERF_PHASE_END(perfBlend, PP_blend);
+        frame_times_add(&result->frameTimes, FS_frame, frame_times_ms_since(&tframe));
+    }
+    perf_stats_collect_thread(&result->perfStats[0]);
+    clock_gettime(CLOCK_MONOTONIC, &tend);
+
+    result->spheres     = spheres;
+    result->raysTraced  = raysTraced;
+    result->paths       = (uint64_t)pixels * ANTIALIAS_FACTOR * ANTIALIAS_FACTOR * config->samples;
+    result->seconds     = (tend.tv_sec - tstart.tv_sec) + ((tend.tv_nsec - tstart.tv_nsec) / 1000000000.0);
+    result->imageHash   = image_hash(frameImg, pixels);
+    result->accelUpdateMs        = accelUpdateMs / config->samples;
+    result->accelPartialRebuilds = scene.sphereBVH.partialRebuilds - partialRebuildsBefore;
+    result->accelRebuilds        = scene.sphereBVH.rebuilds - rebuildsBefore;
+    SphereChunks *chunks = scene.sphereChunks;
+    if (chunks != NULL) {
+        result->chunksLength        = chunks->chunksLength;
+        result->chunkLoads          = chunks->loads - chunksBefore.loads;
+        result->chunkHits           = chunks->hits - chunksBefore.hits;
+        result->chunkEvictions      = chunks->evictions - chunksBefore.evictions;
+        result->chunkBytesRead      = chunks->bytesRead - chunksBefore.bytesRead;
+        result->chunkCachePeakBytes = chunks->peakBytes;
+    }
+
+    rtfree(velocities);
+    rtfree(frameImg);
+    rtfree(summedFrames);
+    workers_destroy(&workers);
+    // The material data of the scene spheres is not freed (it is small and may be shared between spheres).
+    scene_free(&scene);
+    if (config->chunkSpheres > 0) {
+        remove(BENCH_CHUNKS_PATH);
+    }
+}
+
+/**
+ * Moves the spheres of the `scene` into a chunk file (at BENCH_CHUNKS_PATH, with up to `chunkSpheres` spheres per chunk), which the scene
+ * renders out-of-core, through a chunks cache of `cacheMiB` megabytes.
+ */
+static void move_spheres_to_chunks(Scene *scene, uint32_t chunkSpheres, double cacheMiB)
+{
+    SphereChunksWriter writer;
+    if (! sphere_chunks_writer_open(&writer, BENCH_CHUNKS_PATH, chunkSpheres)) {
+        exit(1);
+    }
+    for (uint32_t i = 0; i < scene->spheresLength; i++) {
+        sphere_chunks_writer_add(&writer, &scene->spheres[i]);
+    }
+    if (! sphere_chunks_writer_close(&writer)) {
+        exit(1);
+    }
+
+    // (The acceleration structures of the scene have not been built yet.)
+    scene->spheresLength = 0;
+    if (! scene_set_sphere_chunks(scene, BENCH_CHUNKS_PATH, (uint64_t)(cacheMiB * 1048576.0))) {
+        exit(1);
+    }
+}
+
+/**
+ * Returns the (deterministic, for the `seed`) velocities of the spheres of the `scene`: in random directions, `speed` times the radius
+ * of each sphere (per frame) long.
+ */
+static Vector3 * sphere_velocities(Scene *scene, double speed, uint64_t seed)
+{
+    Vector3 *velocities = rtalloc(sizeof(Vector3) * scene->spheresLength);
+    for (uint32_t i = 0; i < scene->spheresLength; i++) {
+        RandomState rs;
+        random_state_seed(&rs, random_hash2(seed, i));
+        Vector3 *v = &velocities[i];
+        do {
+            v->x = random_state_double_exc(&rs, -1, 1);
+            v->y = random_state_double_exc(&rs, -1, 1);
+            v->z = random_state_double_exc(&rs, -1, 1);
+        } while (vector3_dot(v, v) > 1 || vector3_dot(v, v) == 0);
+        vector3_to_unit(v);
+        vector3_multiply_length(v, speed * scene->spheres[i].radius);
+    }
+    return velocities;
+}
+
+/**
+ * Moves the spheres of the `scene` by their `velocities` (one frame).
+ */
+static void move_spheres(Scene *scene, Vector3 *velocities)
+{
+    for (uint32_t i = 0; i < scene->spheresLength; i++) {
+        vector3_add_to(&scene->spheres[i].center, &velocities[i], &scene->spheres[i].center);
+    }
+    scene_spheres_moved(scene);
+}
+
+/**
+ * Returns the 64 bit FNV-1a hash of the bytes of the `pixels` pixels of `img` (equal only for bit-identical images).
+ */
+static uint64_t image_hash(Color *img, uint32_t pixels)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    const uint8_t *bytes = (const uint8_t *)img;
+    for (size_t i = 0; i < sizeof(Color) * pixels; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/**
+ * Returns the peak resident set size (the maximum physical memory used so far) of the process, in KiB.
+ */
+static uint64_t peak_rss_kb()
+{
+#if defined(ENV_LINUX) && ENV_LINUX
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return usage.ru_maxrss;        // Already in KiB on Linux.
+#else
+    PROCESS_MEMORY_COUNTERS counters;
+    if (! GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return counters.PeakWorkingSetSize / 1024;
+#endif // ENV_LINUX
+}
+
+/**
+ * Loads the results of a previous run (its JSON output) from `path` into `entries`. Returns the amount of loaded results.
+ */
+static uint32_t load_baseline(const char *path, BaselineEntry *entries)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return 0;
+    }
+
+    uint32_t length = 0;
+    char line[BENCH_LINE_MAX];
+    while (fgets(line, sizeof(line), f) != NULL && length < BENCH_BASELINE_MAX) {
+        BaselineEntry *e = &entries[length];
+        const char *scene = strstr(line, "\"scene\": \"");
+        double threads, raysTraced;
+        if (scene == NULL || sscanf(scene, "\"scene\": \"%63[^\"]\"", e->scene) != 1 || ! json_get_number(line, "threads", &threads)
+            || ! json_get_number(line, "raysTraced", &raysTraced) || ! json_get_number(line, "raysPerSec", &e->raysPerSec)) {
+            continue;
+        }
+        e->threads = (uint32_t)threads;
+        e->raysTraced = (uint64_t)raysTraced;
+        length++;
+    }
+
+    fclose(f);
+    return length;
+}
+
+static BaselineEntry * find_baseline(BaselineEntry *entries, uint32_t length, const char *scene, uint32_t threads)
+{
+    for (uint32_t i = 0; i < length; i++) {
+        if (entries[i].threads == threads && strcmp(entries[i].scene, scene) == 0) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Finds `"key": <number>` in a single line JSON object `line` and stores the number in `value`. Returns false if it was not found.
+ */
+static bool json_get_number(const char *line, const char *key, double *value)
+{
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\": ", key);
+    const char *p = strstr(line, pattern);
+    if (p == NULL) {
+        return false;
+    }
+
+    char *end;
+    *value = strtod(p + strlen(pattern), &end);
+    return end != p + strlen(pattern);
+}
+
+static void print_usage(const char *prog)
+{
+    log_err("Usage: %s [--samples <n>] [--seed <n>] [--threads <n>] [--size <w>x<h>] [--scene <name>]... [--accel <name>]"
+        " [--animate <speed>] [--chunks <n>] [--chunk-cache <MiB>] [--baseline <file>] [--tolerance <pct>] [--output <file>]\n", prog);
+    log_err("Scenes:");
+    for (uint32_t s = 0; s < benchScenesCount; s++) {
+        log_err(" %s", benchScenes[s].name);
+    }
+    log_err("\n");
+}
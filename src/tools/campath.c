@@ -0,0 +1,203 @@
+/**
+ * campath - plays back a recorded camera path (see camera_path.h) headless, on a benchmark scene, and reports the interactive performance
+ * as JSON: the frame times, and the samples per pixel (and the estimated noise) that the image reached at each keyframe. Camera paths are
+ * recorded in the app (the R key), and can be played back there too (see CAMERA_PATH_PLAYBACK_PATH).
+ *
+ * Usage: campath --path <file> [options]
+ *     --path <file>            The camera path file to play back.
+ *     --scene <name>           The benchmark scene (default: the first one).
+ *     --size <w>x<h>           Image size (default CAMPATH_WIDTH x CAMPATH_HEIGHT).
+ *     --threads <n>            The amount of threads (default: one per CPU core).
+ *     --seed <n>               Random number generator seed (default CAMPATH_SEED).
+ *     --snapshots <dir>        Save the image reached at each keyframe into <dir> (as PFM images).
+ *     --output <file>          Write the JSON results to <file> (instead of stdout).
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../camera.h"
+#include "../camera_path.h"
+#include "../frame_times.h"
+#include "../random.h"
+#include "../rtalloc.h"
+#include "../rtcommon.h"
+#include "../scene.h"
+#include "../tracer.h"
+#include "../workers.h"
+
+
+#define CAMPATH_WIDTH               320
+#define CAMPATH_HEIGHT              240
+#define CAMPATH_SEED                1
+
+
+typedef struct CampathConfig_s  CampathConfig;
+
+struct CampathConfig_s {
+    const char         *pathFile;
+    const BenchScene   *scene;
+    uint32_t            width;
+    uint32_t            height;
+    uint32_t            threads;
+    uint64_t            seed;
+    const char         *snapshotDir;
+    const char         *outputPath;
+};
+
+
+static bool parse_args(int argc, char **argv, CampathConfig *config);
+static void print_usage(const char *prog);
+
+
+int main(int argc, char **argv)
+{
+    CampathConfig config = {
+        .pathFile       = NULL,
+        .scene          = &benchScenes[0],
+        .width          = CAMPATH_WIDTH,
+        .height         = CAMPATH_HEIGHT,
+        .threads        = workers_cpu_count(),
+        .seed           = CAMPATH_SEED,
+        .snapshotDir    = NULL,
+        .outputPath     = NULL,
+    };
+    if (! parse_args(argc, argv, &config) || config.pathFile == NULL) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    CameraPath path;
+    camera_path_init(&path);
+    if (! camera_path_load(&path, config.pathFile)) {
+        return 1;
+    }
+
+    FILE *out = stdout;
+    if (config.outputPath != NULL) {
+        out = fopen(config.outputPath, "w");
+        if (out == NULL) {
+            log_err("Could not open the output file \"%s\".\n", config.outputPath);
+            return 1;
+        }
+    }
+
+    Scene scene;
+    init_scene(&scene, config.scene->scene, SKY_CONFIG);
+    Ray camCenterRay;
+    init_camera_ray(config.scene->camera, &camCenterRay);
+    Camera camera;
+    cam_set(&camera, &camCenterRay, config.height, config.width);
+    WorkerPool workers;
+    workers_init(&workers, config.threads);
+
+    uint32_t pixels = config.width * config.height;
+    Color *summedFrames = rtalloc(sizeof(Color) * pixels);
+    memset(summedFrames, 0, sizeof(Color) * pixels);
+    Color *frameImg = rtalloc(sizeof(Color) * pixels);
+    Color *blendedImg = rtalloc(sizeof(Color) * pixels);
+
+    CameraPathPlayback playback;
+    camera_path_playback_start(&playback, &path, config.snapshotDir);
+    uint32_t accumulatedFrames = 0;
+    while (true) {
+        bool cameraChanged, reset;
+        if (! camera_path_playback_update(&playback, summedFrames, frameImg, accumulatedFrames, config.height, config.width,
+                &camCenterRay, &cameraChanged, &reset)) {
+            break;
+        }
+        if (cameraChanged) {
+            cam_set(&camera, &camCenterRay, config.height, config.width);
+        }
+        if (reset) {
+            memset(summedFrames, 0, sizeof(Color) * pixels);
+            accumulatedFrames = 0;
+        }
+
+        struct timespec tframe;
+        clock_gettime(CLOCK_MONOTONIC, &tframe);
+        accumulatedFrames++;
+        random_seed(random_hash2(config.seed, accumulatedFrames));
+        if (ANTIALIAS_FACTOR > 1) {
+            render_frame_img_antialiased(&camera, &scene, &workers, frameImg, config.height, config.width, NULL, NULL, NULL, NULL);
+        } else {
+            render_frame_img(&camera, &scene, &workers, frameImg, config.height, config.width, NULL, NULL, NULL, NULL);
+        }
+        blend_frame(summedFrames, accumulatedFrames, frameImg, blendedImg, config.height, config.width);
+        camera_path_playback_add_frame(&playback, frame_times_ms_since(&tframe));
+    }
+
+    camera_path_playback_write_json(&playback, out);
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    camera_path_playback_free(&playback);
+    rtfree(blendedImg);
+    rtfree(frameImg);
+    rtfree(summedFrames);
+    workers_destroy(&workers);
+    scene_free(&scene);
+    camera_path_free(&path);
+    return 0;
+}
+
+static bool parse_args(int argc, char **argv, CampathConfig *config)
+{
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (i + 1 >= argc) {
+            log_err("Missing value of argument: %s\n", arg);
+            return false;
+        }
+        const char *val = argv[++i];
+
+        char *end;
+        if (strcmp(arg, "--path") == 0) {
+            config->pathFile = val;
+        } else if (strcmp(arg, "--scene") == 0) {
+            config->scene = bench_scene_find(val);
+            if (config->scene == NULL) {
+                log_err("Unknown scene: %s\n", val);
+                return false;
+            }
+        } else if (strcmp(arg, "--size") == 0) {
+            if (sscanf(val, "%" SCNu32 "x%" SCNu32, &config->width, &config->height) != 2 || config->width == 0 || config->height == 0) {
+                return false;
+            }
+        } else if (strcmp(arg, "--threads") == 0) {
+            config->threads = strtoul(val, &end, 10);
+            if (*end != '\0' || config->threads == 0) {
+                return false;
+            }
+        } else if (strcmp(arg, "--seed") == 0) {
+            config->seed = strtoull(val, &end, 10);
+            if (*end != '\0') {
+                return false;
+            }
+        } else if (strcmp(arg, "--snapshots") == 0) {
+            config->snapshotDir = val;
+        } else if (strcmp(arg, "--output") == 0) {
+            config->outputPath = val;
+        } else {
+            log_err("Unknown argument: %s\n", arg);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void print_usage(const char *prog)
+{
+    log_err("Usage: %s --path <file> [--scene <name>] [--size <w>x<h>] [--threads <n>] [--seed <n>] [--snapshots <dir>]"
+        " [--output <file>]\n", prog);
+    log_err("Scenes:");
+    for (uint32_t s = 0; s < benchScenesCount; s++) {
+        log_err(" %s", benchScenes[s].name);
+    }
+    log_err("\n");
+}
@@ -0,0 +1,366 @@
+/**
+ * converge - measures how quickly renders of a benchmark scene converge to a reference image (over wall-clock time), and reports the time
+ * it took to reach the error thresholds, as JSON. Unlike rays/sec, this also rewards rendering changes that reduce the noise (e.g.
+ * better sampling) and penalizes ones that trace faster, but produce noisier images.
+ *
+ * The reference image (a render with many samples per pixel) is rendered once and stored as a PFM image in the reference directory, later
+ * runs (with the same scene, size and reference samples) load it from there.
+ *
+ * Usage: converge [options]
+ *     --scene <name>               The benchmark scene (default: the first one).
+ *     --size <w>x<h>               Image size (default CONVERGE_WIDTH x CONVERGE_HEIGHT).
+ *     --threads <n>                The amount of threads (default: one per CPU core).
+ *     --seed <n>                   Random number generator seed (default CONVERGE_SEED).
+ *     --time-limit <seconds>       Stop rendering after this much time (default CONVERGE_TIME_LIMIT).
+ *     --reference-samples <n>      Samples per pixel of the reference image (default CONVERGE_REFERENCE_SAMPLES).
+ *     --reference-dir <dir>        Where reference images are stored (default: the current directory).
+ *     --rmse <threshold>           The RMSE threshold (default CONVERGE_RMSE_THRESHOLD).
+ *     --relmse <threshold>         The relative MSE threshold (default CONVERGE_RELMSE_THRESHOLD).
+ *     --flip <threshold>           The FLIP-like perceptual error threshold (default CONVERGE_FLIP_THRESHOLD).
+ *     --output <file>              Write the JSON results to <file> (instead of stdout).
+ *
+ * Rendering stops once all thresholds are reached, or at the time limit. Exits with code 2 if any threshold was not reached.
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../camera.h"
+#include "../image_metrics.h"
+#include "../pfm.h"
+#include "../random.h"
+#include "../rtalloc.h"
+#include "../rtcommon.h"
+#include "../scene.h"
+#include "../tonemap.h"
+#include "../tracer.h"
+#include "../workers.h"
+
+
+#define CONVERGE_WIDTH              320
+#define CONVERGE_HEIGHT             240
+#define CONVERGE_SEED               1
+#define CONVERGE_TIME_LIMIT         10.0
+#define CONVERGE_REFERENCE_SAMPLES  1024
+
+// The reference is rendered with a seed this far from the measured renders' seed, so that they don't share their noise.
+#define CONVERGE_REFERENCE_SEED_OFFSET  0x5eed0000
+
+#define CONVERGE_RMSE_THRESHOLD     0.05
+#define CONVERGE_RELMSE_THRESHOLD   0.01
+#define CONVERGE_FLIP_THRESHOLD     0.05
+
+#define CONVERGE_PATH_MAX           1024
+
+
+typedef struct ConvergeConfig_s ConvergeConfig;
+
+typedef enum {
+    CE_rmse,
+    CE_rel_mse,
+    CE_flip,
+
+    CONVERGE_ERRORS_COUNT,
+} ConvergeError;
+
+struct ConvergeConfig_s {
+    const BenchScene   *scene;
+    uint32_t            width;
+    uint32_t            height;
+    uint32_t            threads;
+    uint64_t            seed;
+    double              timeLimit;
+    uint32_t            referenceSamples;
+    const char         *referenceDir;
+    double              thresholds[CONVERGE_ERRORS_COUNT];
+    const char         *outputPath;
+};
+
+
+static const char *convergeErrorNames[CONVERGE_ERRORS_COUNT] = {
+    [CE_rmse]       = "rmse",
+    [CE_rel_mse]    = "relMse",
+    [CE_flip]       = "flipLike",
+};
+
+
+static bool parse_args(int argc, char **argv, ConvergeConfig *config);
+static Color * load_or_render_reference(ConvergeConfig *config, Scene *scene, Camera *camera, WorkerPool *workers, bool *rendered,
+    double *seconds);
+static double render_samples(Scene *scene, Camera *camera, WorkerPool *workers, uint64_t seed, Color *summedFrames, Color *img,
+    uint32_t firstSample, uint32_t samples, uint32_t height, uint32_t width);
+static inline double seconds_since(struct timespec *start);
+static void print_usage(const char *prog);
+
+
+int main(int argc, char **argv)
+{
+    ConvergeConfig config = {
+        .scene              = &benchScenes[0],
+        .width              = CONVERGE_WIDTH,
+        .height             = CONVERGE_HEIGHT,
+        .threads            = workers_cpu_count(),
+        .seed               = CONVERGE_SEED,
+        .timeLimit          = CONVERGE_TIME_LIMIT,
+        .referenceSamples   = CONVERGE_REFERENCE_SAMPLES,
+        .referenceDir       = ".",
+        .thresholds         = {
+            [CE_rmse]       = CONVERGE_RMSE_THRESHOLD,
+            [CE_rel_mse]    = CONVERGE_RELMSE_THRESHOLD,
+            [CE_flip]       = CONVERGE_FLIP_THRESHOLD,
+        },
+        .outputPath         = NULL,
+    };
+    if (! parse_args(argc, argv, &config)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    FILE *out = stdout;
+    if (config.outputPath != NULL) {
+        out = fopen(config.outputPath, "w");
+        if (out == NULL) {
+            log_err("Could not open the output file \"%s\".\n", config.outputPath);
+            return 1;
+        }
+    }
+
+    Scene scene;
+    init_scene(&scene, config.scene->scene, SKY_CONFIG);
+    Ray camCenterRay;
+    init_camera_ray(config.scene->camera, &camCenterRay);
+    Camera camera;
+    cam_set(&camera, &camCenterRay, config.height, config.width);
+    WorkerPool workers;
+    workers_init(&workers, config.threads);
+
+    bool referenceRendered;
+    double referenceSeconds;
+    Color *reference = load_or_render_reference(&config, &scene, &camera, &workers, &referenceRendered, &referenceSeconds);
+    if (reference == NULL) {
+        return 1;
+    }
+
+    // The perceptual error compares the images as they are displayed.
+    ToneMap toneMap;
+    tonemap_init(&toneMap, TONE_MAP_OPERATOR, TONE_MAP_EXPOSURE, TONE_MAP_SRGB);
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"tool\": \"converge\",\n");
+    fprintf(out, "  \"config\": {\"scene\": \"%s\", \"width\": %" PRIu32 ", \"height\": %" PRIu32 ", \"threads\": %" PRIu32
+        ", \"seed\": %" PRIu64 ", \"timeLimit\": %.3f},\n", config.scene->name, config.width, config.height, config.threads, config.seed,
+        config.timeLimit);
+    fprintf(out, "  \"reference\": {\"samples\": %" PRIu32 ", \"rendered\": %s, \"seconds\": %.3f},\n", config.referenceSamples,
+        referenceRendered ? "true" : "false", referenceSeconds);
+    fprintf(out, "  \"curve\": [\n");
+
+    // Render one sample per pixel at a time and measure the errors after each one. Only the rendering time is counted.
+    uint32_t pixels = config.width * config.height;
+    Color *summedFrames = rtalloc(sizeof(Color) * pixels);
+    memset(summedFrames, 0, sizeof(Color) * pixels);
+    Color *img = rtalloc(sizeof(Color) * pixels);
+
+    double reachedSeconds[CONVERGE_ERRORS_COUNT];
+    uint32_t reachedSamples[CONVERGE_ERRORS_COUNT] = {0};
+    uint32_t reachedCount = 0;
+    double seconds = 0;
+
+    for (uint32_t samples = 1; seconds < config.timeLimit && reachedCount < CONVERGE_ERRORS_COUNT; samples++) {
+        seconds += render_samples(&scene, &camera, &workers, config.seed, summedFrames, img, samples, 1, config.height, config.width);
+
+        double errors[CONVERGE_ERRORS_COUNT] = {
+            [CE_rmse]       = image_rmse(img, reference, pixels),
+            [CE_rel_mse]    = image_rel_mse(img, reference, pixels),
+            [CE_flip]       = image_flip_like(&toneMap, img, reference, config.height, config.width),
+        };
+        fprintf(out, "%s    {\"samples\": %" PRIu32 ", \"seconds\": %.6f", samples > 1 ? ",\n" : "", samples, seconds);
+        for (uint32_t e = 0; e < CONVERGE_ERRORS_COUNT; e++) {
+            fprintf(out, ", \"%s\": %.6g", convergeErrorNames[e], errors[e]);
+            if (reachedSamples[e] == 0 && errors[e] <= config.thresholds[e]) {
+                reachedSamples[e] = samples;
+                reachedSeconds[e] = seconds;
+                reachedCount++;
+            }
+        }
+        fprintf(out, "}");
+    }
+
+    fprintf(out, "\n  ],\n  \"timeToThreshold\": {");
+    for (uint32_t e = 0; e < CONVERGE_ERRORS_COUNT; e++) {
+        fprintf(out, "%s\"%s\": {\"threshold\": %g, ", e > 0 ? ", " : "", convergeErrorNames[e], config.thresholds[e]);
+        if (reachedSamples[e] > 0) {
+            fprintf(out, "\"seconds\": %.6f, \"samples\": %" PRIu32 "}", reachedSeconds[e], reachedSamples[e]);
+        } else {
+            fprintf(out, "\"seconds\": null, \"samples\": null}");
+        }
+    }
+    fprintf(out, "}\n}\n");
+
+    if (out != stdout) {
+        fclose(out);
+    }
+    rtfree(img);
+    rtfree(summedFrames);
+    rtfree(reference);
+    workers_destroy(&workers);
+    scene_free(&scene);
+
+    if (reachedCount < CONVERGE_ERRORS_COUNT) {
+        log_err("Not all error thresholds were reached within %.1f seconds.\n", config.timeLimit);
+        return 2;
+    }
+    return 0;
+}
+
+static bool parse_args(int argc, char **argv, ConvergeConfig *config)
+{
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (i + 1 >= argc) {
+            log_err("Missing value of argument: %s\n", arg);
+            return false;
+        }
+        const char *val = argv[++i];
+
+        char *end;
+        if (strcmp(arg, "--scene") == 0) {
+            config->scene = bench_scene_find(val);
+            if (config->scene == NULL) {
+                log_err("Unknown scene: %s\n", val);
+                return false;
+            }
+        } else if (strcmp(arg, "--size") == 0) {
+            if (sscanf(val, "%" SCNu32 "x%" SCNu32, &config->width, &config->height) != 2 || config->width == 0 || config->height == 0) {
+                return false;
+            }
+        } else if (strcmp(arg, "--threads") == 0) {
+            config->threads = strtoul(val, &end, 10);
+            if (*end != '\0' || config->threads == 0) {
+                return false;
+            }
+        } else if (strcmp(arg, "--seed") == 0) {
+            config->seed = strtoull(val, &end, 10);
+            if (*end != '\0') {
+                return false;
+            }
+        } else if (strcmp(arg, "--time-limit") == 0) {
+            config->timeLimit = strtod(val, &end);
+            if (*end != '\0' || config->timeLimit <= 0) {
+                return false;
+            }
+        } else if (strcmp(arg, "--reference-samples") == 0) {
+            config->referenceSamples = strtoul(val, &end, 10);
+            if (*end != '\0' || config->referenceSamples == 0) {
+                return false;
+            }
+        } else if (strcmp(arg, "--reference-dir") == 0) {
+            config->referenceDir = val;
+        } else if (strcmp(arg, "--rmse") == 0 || strcmp(arg, "--relmse") == 0 || strcmp(arg, "--flip") == 0) {
+            ConvergeError e = strcmp(arg, "--rmse") == 0 ? CE_rmse : (strcmp(arg, "--relmse") == 0 ? CE_rel_mse : CE_flip);
+            config->thresholds[e] = strtod(val, &end);
+            if (*end != '\0' || config->thresholds[e] < 0) {
+                return false;
+            }
+        } else if (strcmp(arg, "--output") == 0) {
+            config->outputPath = val;
+        } else {
+            log_err("Unknown argument: %s\n", arg);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Loads the reference image of the configured scene and size from the reference directory, or renders it (and stores it there) if it
+ * doesn't exist yet. Sets `rendered` to whether it was rendered, and `seconds` to how long that took. Returns NULL on errors.
+ */
+static Color * load_or_render_reference(ConvergeConfig *config, Scene *scene, Camera *camera, WorkerPool *workers, bool *rendered,
+    double *seconds)
+{
+    char path[CONVERGE_PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s_%" PRIu32 "x%" PRIu32 "_%" PRIu32 "spp.pfm", config->referenceDir, config->scene->name,
+        config->width, config->height, config->referenceSamples);
+
+    *rendered = false;
+    *seconds = 0;
+    if (access(path, F_OK) == 0) {
+        uint32_t width, height;
+        Color *reference = pfm_read_color(path, &width, &height);
+        if (reference != NULL && (width != config->width || height != config->height)) {
+            log_err("The reference image %s is %" PRIu32 "x%" PRIu32 ", expected %" PRIu32 "x%" PRIu32 ".\n", path, width, height,
+                config->width, config->height);
+            rtfree(reference);
+            return NULL;
+        }
+        return reference;
+    }
+
+    log_err("Rendering the reference image %s (%" PRIu32 " samples per pixel)...\n", path, config->referenceSamples);
+    uint32_t pixels = config->width * config->height;
+    Color *summedFrames = rtalloc(sizeof(Color) * pixels);
+    memset(summedFrames, 0, sizeof(Color) * pixels);
+    Color *reference = rtalloc(sizeof(Color) * pixels);
+
+    *seconds = render_samples(scene, camera, workers, config->seed + CONVERGE_REFERENCE_SEED_OFFSET, summedFrames, reference, 1,
+        config->referenceSamples, config->height, config->width);
+    *rendered = true;
+    rtfree(summedFrames);
+
+    if (! pfm_write_color(path, reference, config->width, config->height)) {
+        rtfree(reference);
+        return NULL;
+    }
+    return reference;
+}
+
+/**
+ * Renders `samples` samples per pixel (frames), adding them to `summedFrames` (which already has `firstSample - 1` samples) and storing
+ * the averaged image in `img`. Sample N is rendered with random numbers seeded from (`seed`, N), so the images are reproducible.
+ * Returns the time it took, in seconds.
+ */
+static double render_samples(Scene *scene, Camera *camera, WorkerPool *workers, uint64_t seed, Color *summedFrames, Color *img,
+    uint32_t firstSample, uint32_t samples, uint32_t height, uint32_t width)
+{
+    Color *frameImg = rtalloc(sizeof(Color) * height * width);
+
+    struct timespec tstart;
+    clock_gettime(CLOCK_MONOTONIC, &tstart);
+    for (uint32_t s = firstSample; s < firstSample + samples; s++) {
+        random_seed(random_hash2(seed, s));
+        if (ANTIALIAS_FACTOR > 1) {
+            render_frame_img_antialiased(camera, scene, workers, frameImg, height, width, NULL, NULL, NULL, NULL);
+        } else {
+            render_frame_img(camera, scene, workers, frameImg, height, width, NULL, NULL, NULL, NULL);
+        }
+        blend_frame(summedFrames, s, frameImg, img, height, width);
+    }
+    double seconds = seconds_since(&tstart);
+
+    rtfree(frameImg);
+    return seconds;
+}
+
+static inline double seconds_since(struct timespec *start)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (t.tv_sec - start->tv_sec) + ((t.tv_nsec - start->tv_nsec) / 1000000000.0);
+}
+
+static void print_usage(const char *prog)
+{
+    log_err("Usage: %s [--scene <name>] [--size <w>x<h>] [--threads <n>] [--seed <n>] [--time-limit <seconds>]"
+        " [--reference-samples <n>] [--reference-dir <dir>] [--rmse <threshold>] [--relmse <threshold>] [--flip <threshold>]"
+        " [--output <file>]\n", prog);
+    log_err("Scenes:");
+    for (uint32_t s = 0; s < benchScenesCount; s++) {
+        log_err(" %s", benchScenes[s].name);
+    }
+    log_err("\n");
+}
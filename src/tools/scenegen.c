@@ -0,0 +1,149 @@
+/**
+ * scenegen - generates a large scene (see scene_gen.h) and saves it into a scene file (see scene_file.h).
+ *
+ * Usage: scenegen <generator> <count> <seed> <output_file> [<spheres per chunk> <cache MiB>]
+ *
+ * With the chunk arguments, the spheres are written into a chunk file (see sphere_chunks.h) at <output_file>.chunks instead, and the scene
+ * file gets the planes and a `chunks` line, that renders them out-of-core (through a chunks cache of <cache MiB> megabytes).
+ *
+ * The instanced_clusters generator is not available here: its scenes consist of instances, which scene files can't store (it can be
+ * rendered with `bench --scene gen_instanced_clusters` or through the library instead).
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../scene.h"
+#include "../scene_file.h"
+#include "../scene_gen.h"
+#include "../sphere_chunks.h"
+
+
+#define SCENEGEN_COUNT_MIN  10
+#define SCENEGEN_COUNT_MAX  10000000
+#define SCENEGEN_CHUNK_MIN  16
+
+
+static bool generator_saveable(SceneGenerator generator);
+static bool write_chunks(Scene *scene, const char *path, uint32_t chunkSpheres, double cacheMiB);
+static void print_usage(const char *prog);
+
+
+int main(int argc, char **argv)
+{
+    if (argc != 5 && argc != 7) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    SceneGenerator generator;
+    if (! scene_generator_by_name(argv[1], &generator)) {
+        fprintf(stderr, "Unknown generator: %s\n", argv[1]);
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (! generator_saveable(generator)) {
+        fprintf(stderr, "The %s generator can't be used here: its scenes have instances, which scene files don't support\n", argv[1]);
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    char *end;
+    errno = 0;
+    unsigned long long count = strtoull(argv[2], &end, 10);
+    if (errno != 0 || *end != '\0' || count < SCENEGEN_COUNT_MIN || count > SCENEGEN_COUNT_MAX) {
+        fprintf(stderr, "Invalid sphere count: %s (must be %d..%d)\n", argv[2], SCENEGEN_COUNT_MIN, SCENEGEN_COUNT_MAX);
+        return 1;
+    }
+
+    errno = 0;
+    unsigned long long seed = strtoull(argv[3], &end, 10);
+    if (errno != 0 || *end != '\0') {
+        fprintf(stderr, "Invalid seed: %s\n", argv[3]);
+        return 1;
+    }
+
+    unsigned long long chunkSpheres = 0;
+    double cacheMiB = 0;
+    if (argc == 7) {
+        errno = 0;
+        chunkSpheres = strtoull(argv[5], &end, 10);
+        if (errno != 0 || *end != '\0' || chunkSpheres < SCENEGEN_CHUNK_MIN || chunkSpheres > SCENEGEN_COUNT_MAX) {
+            fprintf(stderr, "Invalid spheres per chunk: %s (must be %d..%d)\n", argv[5], SCENEGEN_CHUNK_MIN, SCENEGEN_COUNT_MAX);
+            return 1;
+        }
+        cacheMiB = strtod(argv[6], &end);
+        if (*end != '\0' || ! (cacheMiB > 0 && cacheMiB < 1e12)) {
+            fprintf(stderr, "Invalid cache size: %s (must be a positive amount of MiB)\n", argv[6]);
+            return 1;
+        }
+    }
+
+    Scene scene;
+    scene_init_empty(&scene);
+    scene_generate(&scene, generator, (uint32_t)count, (uint64_t)seed);
+    uint32_t spheresLength = scene.spheresLength;
+
+    if (chunkSpheres > 0) {
+        char chunksPath[4096];
+        snprintf(chunksPath, sizeof(chunksPath), "%s.chunks", argv[4]);
+        if (! write_chunks(&scene, chunksPath, (uint32_t)chunkSpheres, cacheMiB)) {
+            return 1;
+        }
+    }
+
+    if (! scene_file_save(&scene, argv[4])) {
+        return 1;
+    }
+    printf("Generated %s scene: %" PRIu32 " spheres%s and the ground plane, seed %llu -> %s\n", scene_generator_name(generator),
+        spheresLength, scene.sphereChunks != NULL ? " (in a chunk file)" : "", seed, argv[4]);
+
+    // The material data of the generated spheres is freed on exit.
+    scene_free(&scene);
+    return 0;
+}
+
+/**
+ * Returns true if the scenes of `generator` can be saved into scene files (see scene_file_save()).
+ */
+static bool generator_saveable(SceneGenerator generator)
+{
+    return generator != SG_instanced_clusters;
+}
+
+/**
+ * Moves the spheres of `scene` into a chunk file at `path` (with up to `chunkSpheres` spheres per chunk) and makes the scene render them
+ * from it, with a chunks cache of `cacheMiB` megabytes. Returns false if the chunk file could not be written (or opened again).
+ */
+static bool write_chunks(Scene *scene, const char *path, uint32_t chunkSpheres, double cacheMiB)
+{
+    SphereChunksWriter writer;
+    if (! sphere_chunks_writer_open(&writer, path, chunkSpheres)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < scene->spheresLength; i++) {
+        sphere_chunks_writer_add(&writer, &scene->spheres[i]);
+    }
+    if (! sphere_chunks_writer_close(&writer)) {
+        return false;
+    }
+
+    // The material data of the spheres is freed on exit (the chunk file has copies of their material parameters).
+    scene->spheresLength = 0;
+    return scene_set_sphere_chunks(scene, path, (uint64_t)(cacheMiB * 1048576.0));
+}
+
+static void print_usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s <generator> <count> <seed> <output_file> [<spheres per chunk> <cache MiB>]\n", prog);
+    fprintf(stderr, "Generators:");
+    for (uint32_t i = 0; i < SCENE_GENERATORS_COUNT; i++) {
+        if (generator_saveable(i)) {
+            fprintf(stderr, " %s", scene_generator_name(i));
+        }
+    }
+    fprintf(stderr, "\n");
+}
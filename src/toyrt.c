@@ -0,0 +1,339 @@
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+#include "camera.h"
+#include "cost_map.h"
+#include "image_metrics.h"
+#include "prom_metrics.h"
+#include "random.h"
+#include "ray_stats.h"
+#include "rtalloc.h"
+#include "rtcommon.h"
+#include "scene.h"
+#include "toyrt.h"
+#include "tracer.h"
+#include "vector.h"
+#include "materials/dielectric.h"
+#include "materials/light.h"
+#include "materials/metal.h"
+
+
+#define TOYRT_MATERIALS_INITIAL_CAPACITY    8
+
+
+struct ToyRT_s {
+    uint32_t    width;
+    uint32_t    height;
+
+    Scene       scene;
+    Camera      camera;
+
+    // Materials are stored as sphere "templates": spheres that have all of the material related fields (material, matData, color)
+    // initialized. toyrt_add_sphere() copies a template and sets its center and radius. The matData of templates is owned by ToyRT.
+    Sphere     *materials;
+    uint32_t    materialsLength;
+    uint32_t    materialsCapacity;
+
+    // The sum of all frames rendered since the last reset, and a buffer for rendering a single frame.
+    Color      *summedFrames;
+    Color      *frameImg;
+    uint32_t    frames;
+
+    // Frame N (since the last reset) is rendered with random numbers seeded from (seed, N), see toyrt_seed().
+    uint64_t    seed;
+
+    // The estimated RMSE of the accumulated image (see image_noise_estimate()), measured at the end of each toyrt_render().
+    double      noiseEstimate;
+
+    uint64_t    primaryRays;
+    uint64_t    raysTraced;
+    double      renderSeconds;
+    RayStats    rayStats;
+
+    // The rendering cost of each pixel, summed over the accumulated frames (only measured if costMapEnabled).
+    CostMap     costMap;
+    bool        costMapEnabled;
+};
+
+
+static ToyRTMaterial toyrt_add_material(ToyRT *rt, Sphere *materialTemplate);
+
+
+ToyRT * toyrt_create(uint32_t width, uint32_t height)
+{
+    if (width == 0 || height == 0) {
+        return NULL;
+    }
+
+    ToyRT *rt = rtalloc(sizeof(ToyRT));
+    rt->width = width;
+    rt->height = height;
+
+    scene_init_empty(&rt->scene);
+
+    rt->materials = rtalloc(sizeof(Sphere) * TOYRT_MATERIALS_INITIAL_CAPACITY);
+    rt->materialsLength = 0;
+    rt->materialsCapacity = TOYRT_MATERIALS_INITIAL_CAPACITY;
+
+    rt->summedFrames = rtalloc(sizeof(Color) * width * height);
+    rt->frameImg = rtalloc(sizeof(Color) * width * height);
+    rt->seed = 0;
+    rt->noiseEstimate = NAN;
+
+    rt->primaryRays = 0;
+    rt->raysTraced = 0;
+    ray_stats_reset(&rt->rayStats);
+    rt->renderSeconds = 0;
+
+    cost_map_init(&rt->costMap, CM_time, width, height);
+    rt->costMapEnabled = false;
+
+    toyrt_set_camera(rt, (ToyRTVec3){.x = 0, .y = 0, .z = 0}, (ToyRTVec3){.x = 0, .y = 1, .z = 0});
+
+    return rt;
+}
+
+void toyrt_destroy(ToyRT *rt)
+{
+    for (uint32_t i = 0; i < rt->materialsLength; i++) {
+        rtfree(rt->materials[i].matData);
+    }
+    rtfree(rt->materials);
+
+    scene_free(&rt->scene);
+    rtfree(rt->summedFrames);
+    rtfree(rt->frameImg);
+    cost_map_free(&rt->costMap);
+    rtfree(rt);
+}
+
+void toyrt_seed(ToyRT *rt, uint32_t seed)
+{
+    rt->seed = seed;
+}
+
+ToyRTMaterial toyrt_material_matte(ToyRT *rt, ToyRTColor color)
+{
+    Sphere tmpl = {.material = &matMatte, .matData = NULL, .color = {color.red, color.green, color.blue}};
+    return toyrt_add_material(rt, &tmpl);
+}
+
+ToyRTMaterial toyrt_material_metal(ToyRT *rt, ToyRTColor color, double fuzziness)
+{
+    if (! (fuzziness >= 0.0)) {
+        return -1;
+    }
+
+    Sphere tmpl = {.color = {color.red, color.green, color.blue}};
+    return toyrt_add_material(rt, sphere_metal_init(&tmpl, fuzziness));
+}
+
+ToyRTMaterial toyrt_material_dielectric(ToyRT *rt, double refractionIndex)
+{
+    if (! (refractionIndex > 0.0)) {
+        return -1;
+    }
+
+    Sphere tmpl = {.color = COLOR_WHITE};
+    return toyrt_add_material(rt, sphere_dielectric_init(&tmpl, refractionIndex));
+}
+
+ToyRTMaterial toyrt_material_light(ToyRT *rt, ToyRTColor color)
+{
+    Sphere tmpl = {.color = COLOR_BLACK};
+    return toyrt_add_material(rt, sphere_light_init(&tmpl, (Color){color.red, color.green, color.blue}));
+}
+
+int32_t toyrt_add_sphere(ToyRT *rt, ToyRTVec3 center, double radius, ToyRTMaterial material)
+{
+    if (material < 0 || (uint32_t)material >= rt->materialsLength || ! (radius > 0.0) || rt->scene.spheresLength >= INT32_MAX) {
+        return -1;
+    }
+
+    Sphere sphere = rt->materials[material];
+    sphere.center = (Vector3){.x = center.x, .y = center.y, .z = center.z};
+    sphere.radius = radius;
+    scene_add_sphere(&rt->scene, &sphere);
+
+    toyrt_reset(rt);
+
+    return rt->scene.spheresLength - 1;
+}
+
+int32_t toyrt_add_plane(ToyRT *rt, ToyRTVec3 point, ToyRTVec3 normal, ToyRTMaterial material)
+{
+    Vector3 n = {.x = normal.x, .y = normal.y, .z = normal.z};
+    if (material < 0 || (uint32_t)material >= rt->materialsLength || ! (vector3_length(&n) > 0.0) || rt->scene.planesLength >= INT32_MAX) {
+        return -1;
+    }
+
+    Plane plane;
+    plane_init(&plane, &(Vector3){.x = point.x, .y = point.y, .z = point.z}, &n);
+    plane_set_material(&plane, &rt->materials[material]);
+    scene_add_plane(&rt->scene, &plane);
+
+    toyrt_reset(rt);
+
+    return rt->scene.planesLength - 1;
+}
+
+int32_t toyrt_add_mesh_obj(ToyRT *rt, const char *path, ToyRTMaterial material)
+{
+    if (material < 0 || (uint32_t)material >= rt->materialsLength || path == NULL || rt->scene.meshesLength >= INT32_MAX) {
+        return -1;
+    }
+
+    Mesh mesh;
+    mesh_init(&mesh);
+    if (! mesh_load_obj(&mesh, path)) {
+        mesh_free(&mesh);
+        return -1;
+    }
+    mesh_set_material(&mesh, &rt->materials[material]);
+    scene_add_mesh(&rt->scene, &mesh);
+
+    toyrt_reset(rt);
+
+    return rt->scene.meshesLength - 1;
+}
+
+void toyrt_set_camera(ToyRT *rt, ToyRTVec3 origin, ToyRTVec3 direction)
+{
+    Ray camCenterRay = {
+        .origin     = {.x = origin.x, .y = origin.y, .z = origin.z},
+        .direction  = {.x = direction.x, .y = direction.y, .z = direction.z},
+    };
+
+    if (vector3_length(&camCenterRay.direction) == 0) {
+        log_err("toyrt_set_camera(): camera direction must not be a zero vector.\n");
+        return;
+    }
+    vector3_to_unit(&camCenterRay.direction);     // Camera direction vector must be a unit (normalized to length 1) vector.
+
+    cam_set(&rt->camera, &camCenterRay, rt->height, rt->width);
+
+    toyrt_reset(rt);
+}
+
+void toyrt_reset(ToyRT *rt)
+{
+    memset(rt->summedFrames, 0, sizeof(Color) * rt->width * rt->height);
+    rt->frames = 0;
+    rt->noiseEstimate = NAN;
+    cost_map_reset(&rt->costMap);
+}
+
+void toyrt_render(ToyRT *rt, uint32_t samples, double *rgb)
+{
+    struct timespec tstart, tend;
+    clock_gettime(CLOCK_MONOTONIC, &tstart);
+
+    uint32_t pixels = rt->width * rt->height;
+    for (uint32_t i = 0; i < samples; i++) {
+        random_seed(random_hash2(rt->seed, rt->frames));
+        if (ANTIALIAS_FACTOR > 1) {
+            rt->raysTraced += render_frame_img_antialiased(
+                &rt->camera, &rt->scene, NULL, rt->frameImg, rt->height, rt->width, &rt->rayStats, NULL, NULL, NULL);
+        } else {
+            CostMap *costMap = rt->costMapEnabled ? &rt->costMap : NULL;
+            rt->raysTraced += render_frame_img(
+                &rt->camera, &rt->scene, NULL, rt->frameImg, rt->height, rt->width, &rt->rayStats, NULL, costMap, NULL);
+        }
+        rt->primaryRays += (uint64_t)pixels * ANTIALIAS_FACTOR * ANTIALIAS_FACTOR;
+        rt->frames++;
+
+        // `summedFrames` does not include this frame yet.
+        if (i == samples - 1) {
+            rt->noiseEstimate = image_noise_estimate(rt->frameImg, rt->summedFrames, rt->frames - 1, pixels);
+        }
+
+        // The averaged image is stored back into `frameImg` (blend_frame() reads each pixel of `frameImg` before it overwrites it).
+        blend_frame(rt->summedFrames, rt->frames, rt->frameImg, rt->frameImg, rt->height, rt->width);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &tend);
+    rt->renderSeconds += (tend.tv_sec - tstart.tv_sec) + ((tend.tv_nsec - tstart.tv_nsec) / 1000000000.0);
+
+    if (rgb == NULL) {
+        return;
+    }
+
+    if (samples > 0) {
+        memcpy(rgb, rt->frameImg, sizeof(Color) * pixels);
+    } else {
+        // Nothing was rendered now, so the averaged image has to be calculated from the sums.
+        double div = rt->frames > 0 ? rt->frames : 1;
+        for (uint32_t p = 0; p < pixels; p++) {
+            rgb[p*3]     = rt->summedFrames[p].red / div;
+            rgb[p*3 + 1] = rt->summedFrames[p].green / div;
+            rgb[p*3 + 2] = rt->summedFrames[p].blue / div;
+        }
+    }
+}
+
+void toyrt_get_stats(ToyRT *rt, ToyRTStats *stats)
+{
+    stats->width            = rt->width;
+    stats->height           = rt->height;
+    stats->spheres          = rt->scene.spheresLength;
+    stats->samplesPerPixel  = rt->frames * ANTIALIAS_FACTOR * ANTIALIAS_FACTOR;
+    stats->primaryRays      = rt->primaryRays;
+    stats->raysTraced       = rt->raysTraced;
+    stats->renderSeconds    = rt->renderSeconds;
+    stats->raysPerSecond    = rt->renderSeconds > 0 ? rt->raysTraced / rt->renderSeconds : 0;
+}
+
+void toyrt_set_cost_metric(ToyRT *rt, ToyRTCostMetric metric)
+{
+    static const CostMetric costMetrics[] = {
+        [TOYRT_COST_TIME]               = CM_time,
+        [TOYRT_COST_RAYS]               = CM_rays,
+        [TOYRT_COST_INTERSECTION_TESTS] = CM_intersection_tests,
+    };
+
+    rt->costMapEnabled = metric > TOYRT_COST_NONE && metric <= TOYRT_COST_INTERSECTION_TESTS;
+    cost_map_set_metric(&rt->costMap, rt->costMapEnabled ? costMetrics[metric] : CM_time);
+}
+
+void toyrt_get_cost_map(ToyRT *rt, double *cost)
+{
+    cost_map_get_average(&rt->costMap, cost);
+}
+
+void toyrt_write_ray_stats_json(ToyRT *rt, FILE *f)
+{
+    ray_stats_write_json(f, &rt->rayStats);
+    fprintf(f, "\n");
+}
+
+int32_t toyrt_write_prom_metrics(ToyRT *rt, const char *path)
+{
+    PromMetrics m;
+    prom_metrics_init(&m);
+    m.uptimeSeconds     = rt->renderSeconds;
+    m.frames            = rt->primaryRays / ((uint64_t)rt->width * rt->height * ANTIALIAS_FACTOR * ANTIALIAS_FACTOR);
+    m.samplesPerPixel   = rt->frames * ANTIALIAS_FACTOR * ANTIALIAS_FACTOR;
+    m.raysTraced        = rt->raysTraced;
+    m.raysPerSecond     = rt->renderSeconds > 0 ? rt->raysTraced / rt->renderSeconds : 0;
+    m.stageSeconds[FS_trace] = rt->renderSeconds;   // Including blending, which is not measured separately.
+    m.noiseEstimate     = rt->noiseEstimate;
+
+    return prom_metrics_write(path, &m) ? 0 : -1;
+}
+
+static ToyRTMaterial toyrt_add_material(ToyRT *rt, Sphere *materialTemplate)
+{
+    if (rt->materialsLength >= INT32_MAX) {
+        rtfree(materialTemplate->matData);
+        return -1;
+    }
+
+    if (rt->materialsLength == rt->materialsCapacity) {
+        rt->materialsCapacity *= 2;
+        rt->materials = rtrealloc(rt->materials, sizeof(Sphere) * rt->materialsCapacity);
+    }
+
+    rt->materials[rt->materialsLength] = *materialTemplate;
+    return rt->materialsLength++;
+}
@@ -0,0 +1,175 @@
+#ifndef __TOYRT_H__
+#define __TOYRT_H__
+
+/**
+ * libtoyrt - the ray-tracing core of toyraytracer as an embeddable library.
+ *
+ * This is the public C API of the library. It does not depend on SDL (or any other library), so it can be embedded into other
+ * programs, or used to benchmark the ray-tracer in isolation.
+ *
+ * Typical usage:
+ *
+ *     ToyRT *rt = toyrt_create(640, 480);
+ *     ToyRTMaterial red = toyrt_material_matte(rt, (ToyRTColor){1, 0, 0});
+ *     toyrt_add_sphere(rt, (ToyRTVec3){0, 90, 6}, 10, red);
+ *     toyrt_set_camera(rt, (ToyRTVec3){0, 0, 15}, (ToyRTVec3){0, 1, -0.2});
+ *
+ *     double *img = malloc(sizeof(double) * 3 * 640 * 480);
+ *     toyrt_render(rt, 100, img);      // Renders (another) 100 samples per pixel and stores the averaged image in `img`.
+ *     ...
+ *     toyrt_destroy(rt);
+ *
+ * Coordinates use the same convention as the rest of the ray-tracer: `z` is the height (the "up" axis).
+ *
+ * All objects passed to/returned by the library are owned by the caller, except for ToyRT itself (see toyrt_destroy()).
+ * A ToyRT instance must not be used from multiple threads at the same time.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+
+typedef struct ToyRT_s          ToyRT;
+
+// A handle of a material, created by one of the toyrt_material_*() functions. Negative values mean an error (invalid arguments).
+typedef int32_t                 ToyRTMaterial;
+
+typedef struct ToyRTVec3_s      ToyRTVec3;
+typedef struct ToyRTColor_s     ToyRTColor;
+typedef struct ToyRTStats_s     ToyRTStats;
+
+// What toyrt_get_cost_map() measures for each pixel.
+typedef enum {
+    TOYRT_COST_NONE,                    // Nothing (the default).
+    TOYRT_COST_TIME,                    // Rendering time: CPU cycles on x86, nanoseconds elsewhere.
+    TOYRT_COST_RAYS,                    // Rays traced (every bounce is a ray).
+    TOYRT_COST_INTERSECTION_TESTS,      // Ray-primitive intersection tests.
+} ToyRTCostMetric;
+
+
+struct ToyRTVec3_s {
+    double x;
+    double y;
+    double z;
+};
+
+// Color components are linear and usually in [0, 1] (but may exceed 1.0, e.g. for lights).
+struct ToyRTColor_s {
+    double red;
+    double green;
+    double blue;
+};
+
+struct ToyRTStats_s {
+    uint32_t    width;
+    uint32_t    height;
+
+    uint32_t    spheres;                // The amount of spheres in the scene.
+    uint32_t    samplesPerPixel;        // The amount of samples per pixel accumulated since the last reset.
+
+    uint64_t    primaryRays;            // The amount of camera rays traced (since the ToyRT was created).
+    uint64_t    raysTraced;             // The amount of all rays traced, including every bounce (since the ToyRT was created).
+    double      renderSeconds;          // The total wall-clock time spent in toyrt_render() (since the ToyRT was created).
+    double      raysPerSecond;          // raysTraced / renderSeconds.
+};
+
+
+/**
+ * Creates a new ray-tracer instance with an empty scene, rendering images of `width` x `height` pixels. The camera is placed at
+ * [0, 0, 0], looking towards the y axis. Returns NULL if `width` or `height` is 0.
+ */
+ToyRT * toyrt_create(uint32_t width, uint32_t height);
+
+/**
+ * Destroys the ray-tracer instance, freeing all memory that it owns (the scene, the materials and the accumulated image).
+ */
+void toyrt_destroy(ToyRT *rt);
+
+/**
+ * Seeds the random number generator used for rendering (the default seed is 0). Rendering is deterministic: the random numbers of
+ * sample N (since the last reset) of each pixel are derived from (seed, pixel, N), so the same scene, camera and seed always render
+ * bit-identical images.
+ */
+void toyrt_seed(ToyRT *rt, uint32_t seed);
+
+/**
+ * Material constructors. Each returns a handle that can be passed to toyrt_add_sphere(), toyrt_add_plane() and toyrt_add_mesh_obj() (a
+ * material can be shared between any number of spheres, planes and meshes), or a negative value if the arguments are invalid.
+ */
+ToyRTMaterial toyrt_material_matte(ToyRT *rt, ToyRTColor color);
+ToyRTMaterial toyrt_material_metal(ToyRT *rt, ToyRTColor color, double fuzziness);
+ToyRTMaterial toyrt_material_dielectric(ToyRT *rt, double refractionIndex);
+ToyRTMaterial toyrt_material_light(ToyRT *rt, ToyRTColor color);
+
+/**
+ * Adds a sphere to the scene. Returns the index of the sphere, or a negative value if the arguments are invalid.
+ * Resets the accumulated image.
+ */
+int32_t toyrt_add_sphere(ToyRT *rt, ToyRTVec3 center, double radius, ToyRTMaterial material);
+
+/**
+ * Adds an infinite plane (e.g. the ground) through `point`, perpendicular to `normal` (which does not need to be a unit vector, but must
+ * not be zero), to the scene. Returns the index of the plane, or a negative value if the arguments are invalid.
+ * Resets the accumulated image.
+ */
+int32_t toyrt_add_plane(ToyRT *rt, ToyRTVec3 point, ToyRTVec3 normal, ToyRTMaterial material);
+
+/**
+ * Adds a triangle mesh, loaded from the Wavefront OBJ file at `path` (see mesh_load_obj()), to the scene. Returns the index of the mesh, or
+ * a negative value if the arguments are invalid or the file could not be loaded.
+ * Resets the accumulated image.
+ */
+int32_t toyrt_add_mesh_obj(ToyRT *rt, const char *path, ToyRTMaterial material);
+
+/**
+ * Sets the camera position and the direction it is looking at (`direction` does not need to be a unit vector, but must not be zero).
+ * Resets the accumulated image.
+ */
+void toyrt_set_camera(ToyRT *rt, ToyRTVec3 origin, ToyRTVec3 direction);
+
+/**
+ * Clears the accumulated image (samples rendered so far).
+ */
+void toyrt_reset(ToyRT *rt);
+
+/**
+ * Renders `samples` more samples per pixel (each sample is a full frame) and adds them to the accumulated image.
+ *
+ * If `rgb` is not NULL - stores the averaged accumulated image in it: `width * height` pixels, 3 doubles (red, green, blue) each, rows
+ * from top to bottom. The buffer is owned by the caller.
+ */
+void toyrt_render(ToyRT *rt, uint32_t samples, double *rgb);
+
+/**
+ * Fills `stats` with the current rendering statistics.
+ */
+void toyrt_get_stats(ToyRT *rt, ToyRTStats *stats);
+
+/**
+ * Sets what rendering cost is measured for each pixel (see toyrt_get_cost_map()). Resets the measured costs. Not supported (nothing is
+ * measured) when the library is built with ANTIALIAS_FACTOR > 1.
+ */
+void toyrt_set_cost_metric(ToyRT *rt, ToyRTCostMetric metric);
+
+/**
+ * Stores the average rendering cost per sample of each pixel (accumulated since the last reset) into `cost`: `width * height` doubles,
+ * rows from top to bottom. The buffer is owned by the caller. Can be used to find the expensive regions of the image.
+ */
+void toyrt_get_cost_map(ToyRT *rt, double *cost);
+
+/**
+ * Writes the detailed ray tracing statistics (since the ToyRT was created) into `f`, as a single line JSON object: rays traced, sphere
+ * intersection tests, hits per material, the histogram of the amount of rays per path, how the paths ended, etc. All of them are 0,
+ * unless the library was built with RAY_STATS_ENABLED (see ray_stats.h).
+ */
+void toyrt_write_ray_stats_json(ToyRT *rt, FILE *f);
+
+/**
+ * Writes the rendering progress metrics into the file at `path` in the Prometheus text format (for node_exporter's textfile collector,
+ * see prom_metrics.h), replacing it atomically: frames, samples per pixel, rays traced, rays/sec, render time, resident memory and the
+ * estimated remaining noise of the accumulated image. Meant to be called periodically (e.g. after each toyrt_render()) during long renders.
+ * Returns 0 on success, or a negative value if the file could not be written.
+ */
+int32_t toyrt_write_prom_metrics(ToyRT *rt, const char *path);
+
+#endif // __TOYRT_H__
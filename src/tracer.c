@@ -0,0 +1,463 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "color.h"
+#include "random.h"
+#include "ray_inline_fns.h"
+#include "rtalloc.h"
+#include "rtcommon.h"
+#include "timeline.h"
+#include "tracer.h"
+
+
+typedef struct RenderFrameCtx_s     RenderFrameCtx;
+typedef struct RenderWorkerStats_s  RenderWorkerStats;
+typedef struct RenderPath_s         RenderPath;
+
+// Per-worker statistics, padded to a cache line, so that workers don't write to the same cache line.
+struct RenderWorkerStats_s {
+    uint64_t    raysTraced;
+    uint8_t     _padding[56];
+};
+
+// The shared (read-only) data of a frame that is being rendered by the worker threads, one image row per task.
+struct RenderFrameCtx_s {
+    Camera             *cam;
+    CameraFrameContext *cfc;
+    Scene              *scene;
+    Color              *img;
+    uint32_t            imgHeight;
+    uint32_t            imgWidth;
+    uint64_t            frameSeed;
+    RenderWorkerStats  *workerStats;
+    RayStats           *workerRayStats;     // The ray tracing statistics of each worker (see RAY_STATS_ENABLED).
+    PerfStats          *workerPerfStats;    // The hardware performance counts of each worker (see PERF_COUNTERS_ENABLED).
+    CostMap            *costMap;            // NULL if the cost of each pixel is not measured.
+    uint32_t            batchRows;          // The amount of rows per task, when rendering in batches (see render_batch_task()).
+};
+
+// The path of a pixel that is traced in a batch (see render_batch_task()): a bounce at a time, instead of recursively.
+struct RenderPath_s {
+    Ray                 ray;                // The ray of the next bounce.
+    RTContext           rtContext;
+    RandomState         randomState;        // The random number generator of the pixel (it is swapped in while the path's hits are shaded).
+    RayHit              hit;
+    DeferredRay         deferredRay;
+    uint32_t            pixel;              // The index of the pixel in the image.
+
+    // The colors that the light of the path is multiplied by on its way back to the camera (see mat_trace_scattered_ray()): of each
+    // bounce that has its bit set in `attenuated`.
+    Color               attenuation[RAY_BOUNCES_MAX];
+    uint32_t            attenuated;
+};
+
+
+// static inline Color render_background_pixel(App *app, Ray *ray);
+
+/**
+ * Anti-aliases (larger) `srcImg` into `dstImg`, by averaging ANTIALIAS_FACTOR^2 pixels into 1 pixel (using grid algorithm).
+ */
+static void image_antialias(Color *srcImg, Color *dstImg, uint32_t dstHeight, uint32_t dstWidth);
+
+static void render_row_task(void *ctxPtr, uint32_t row, uint32_t workerIdx);
+static void render_batch_task(void *ctxPtr, uint32_t batch, uint32_t workerIdx);
+static void finish_path(RenderFrameCtx *ctx, RenderPath *path, Color *color);
+static inline double pixel_cost(CostMetric metric, RTContext *rtContext, uint64_t costClockStart);
+
+
+uint64_t render_frame_img_antialiased(Camera *cam, Scene *scene, WorkerPool *workers, Color *img, uint32_t imgHeight, uint32_t imgWidth,
+    RayStats *rayStats, PerfStats *perfStats, CostMap *costMap, uint32_t *tasksCount)
+{
+    uint32_t upsampledImgHeight = imgHeight * ANTIALIAS_FACTOR;
+    uint32_t upsampledImgWidth = imgWidth * ANTIALIAS_FACTOR;
+    Color upsampledImage[upsampledImgHeight * upsampledImgWidth];
+
+    // Produce the (larger) upsampled image.
+    (void)(costMap);    // The cost map is of the final image size (the upsampled pixels are not mapped to it).
+    uint64_t raysTraced = render_frame_img(cam, scene, workers, upsampledImage, upsampledImgHeight, upsampledImgWidth, rayStats, perfStats,
+        NULL, tasksCount);
+
+    // Produce the final image, by anti-aliasing the (larger) upsampled image.
+    image_antialias(upsampledImage, img, imgHeight, imgWidth);
+
+    return raysTraced;
+}
+
+uint64_t render_frame_img(Camera *cam, Scene *scene, WorkerPool *workers, Color *img, uint32_t imgHeight, uint32_t imgWidth,
+    RayStats *rayStats, PerfStats *perfStats, CostMap *costMap, uint32_t *tasksCount)
+{
+    CameraFrameContext cfc;
+    TIMELINE_BEGIN(tlCamInit);
+    PERF_PHASE_BEGIN(perfCamInit);
+    cam_frame_init(cam, &cfc, imgHeight, imgWidth);
+    PERF_PHASE_END(perfCamInit, PP_camera);
+    TIMELINE_END(tlCamInit, "cam_frame_init", 0);
+
+    // (No-ops, unless the scene changed since the last frame.)
+    scene_build_instances_bvh(scene);
+    scene_build_sphere_accel(scene, workers);
+
+    uint32_t threadsCount = workers != NULL ? workers->threadsCount : 1;
+    RenderWorkerStats workerStats[threadsCount];
+    memset(workerStats, 0, sizeof(RenderWorkerStats) * threadsCount);
+    RayStats workerRayStats[threadsCount];
+    memset(workerRayStats, 0, sizeof(RayStats) * threadsCount);
+    PerfStats workerPerfStats[threadsCount];
+    memset(workerPerfStats, 0, sizeof(PerfStats) * threadsCount);
+
+    RenderFrameCtx ctx = {
+        .cam             = cam,
+        .cfc             = &cfc,
+        .scene           = scene,
+        .img             = img,
+        .imgHeight       = imgHeight,
+        .imgWidth        = imgWidth,
+        .frameSeed       = random_state_next(&randomThreadState),
+        .workerStats     = workerStats,
+        .workerRayStats  = workerRayStats,
+        .workerPerfStats = workerPerfStats,
+        .costMap         = costMap,
+        .batchRows       = 1,
+    };
+
+    // Scenes with out-of-core spheres are rendered in batches of rows, so that the rays of a batch are traced through the chunks of the
+    // spheres together (see sphere_chunks_intersect_batch()), instead of loading the chunks for each ray again.
+    WorkerTaskFn taskFn = render_row_task;
+    uint32_t frameTasks = imgHeight;
+    if (scene->sphereChunks != NULL) {
+        taskFn = render_batch_task;
+        ctx.batchRows = imgWidth < SPHERE_CHUNKS_BATCH_RAYS ? SPHERE_CHUNKS_BATCH_RAYS / imgWidth : 1;
+        frameTasks = (imgHeight + ctx.batchRows - 1) / ctx.batchRows;
+    }
+    if (tasksCount != NULL) {
+        *tasksCount = frameTasks;
+    }
+
+    // The pixels reseed the generator of the thread rendering them (including this one), so this thread's generator is restored
+    // afterwards, for the next frame's seed to only depend on this one.
+    RandomState callerRandomState = randomThreadState;
+    if (workers != NULL) {
+        workers_run(workers, taskFn, &ctx, frameTasks);
+    } else {
+        for (uint32_t task = 0; task < frameTasks; task++) {
+            taskFn(&ctx, task, 0);
+        }
+    }
+    randomThreadState = callerRandomState;
+
+    cam_frame_free(&cfc);
+    if (costMap != NULL) {
+        costMap->frames++;
+    }
+
+    uint64_t raysTraced = 0;
+    for (uint32_t i = 0; i < threadsCount; i++) {
+        raysTraced += workerStats[i].raysTraced;
+        if (rayStats != NULL) {
+            ray_stats_merge(rayStats, &workerRayStats[i]);
+        }
+        if (perfStats != NULL) {
+            perf_stats_merge(&perfStats[i], &workerPerfStats[i]);
+        }
+    }
+    if (perfStats != NULL) {
+        perf_stats_collect_thread(&perfStats[0]);     // The camera phase, measured on this thread.
+    }
+    return raysTraced;
+}
+
+/**
+ * Renders a single row of the image (a worker task, see render_frame_img()).
+ */
+static void render_row_task(void *ctxPtr, uint32_t row, uint32_t workerIdx)
+{
+    TIMELINE_BEGIN(tlRow);
+    PERF_PHASE_BEGIN(perfRow);
+    RenderFrameCtx *ctx = ctxPtr;
+    uint32_t imgWidth = ctx->imgWidth;
+    uint32_t imgV = ctx->imgHeight - row - 1;
+    Color *imgRow = &ctx->img[row * imgWidth];
+    double *costRow = ctx->costMap != NULL ? &ctx->costMap->cost[row * imgWidth] : NULL;
+    CostMetric costMetric = ctx->costMap != NULL ? ctx->costMap->metric : CM_time;
+
+    uint64_t raysTraced = 0;
+    Ray ray = {
+        .origin = ctx->cam->camCenterRay.origin,
+        .direction = {.x = 0, .y = 0, .z = 0},
+    };
+
+    for (uint32_t imgU = 0; imgU < imgWidth; imgU++) {
+        // The produced `ray.direction` vector is a unit vector. This is needed for dot product later on, by some materials.
+        // That way those materials don't need to compute the unit vector themselves.
+        cam_frame_get_ray_direction(ctx->cfc, imgU, imgV, &ray.direction);
+
+        // Each pixel gets its own random numbers, derived from the frame's seed and the pixel's index. This way the rendered image does
+        // not depend on which thread renders which pixel (or on the amount of threads, or on how the image is split into tasks).
+        random_seed(random_hash2(ctx->frameSeed, (uint64_t)row * imgWidth + imgU));
+
+        RTContext rtContext;
+        ray_trace_context_init(&rtContext);
+
+        uint64_t costClockStart = (costRow != NULL && costMetric == CM_time) ? cost_clock_now() : 0;
+
+        Color color;
+        if (! ray_trace(&rtContext, ctx->scene, &ray, &color)) {
+            color = (Color)COLOR_BLACK;
+
+            // // Ray didn't hit anything - rendering background instead.
+            // color = render_background_pixel(app, &ray);
+        }
+
+        imgRow[imgU] = color;
+        if (costRow != NULL) {
+            costRow[imgU] += pixel_cost(costMetric, &rtContext, costClockStart);
+        }
+
+        // Every bounce of the ray is a separately traced ray.
+        raysTraced += rtContext.bounces;
+        RAY_STATS_INC(pathBounces[rtContext.bounces]);
+    }
+
+    ctx->workerStats[workerIdx].raysTraced += raysTraced;
+    ray_stats_collect_thread(&ctx->workerRayStats[workerIdx]);
+    PERF_PHASE_END(perfRow, PP_trace);
+    perf_stats_collect_thread(&ctx->workerPerfStats[workerIdx]);
+    TIMELINE_END(tlRow, "row", row);
+}
+
+/**
+ * Renders a batch of ctx->batchRows rows of the image (a worker task, see render_frame_img()): the paths of all of the pixels are traced a
+ * bounce at a time. The closest hits of the rays of a bounce with the in-memory primitives are found first, then with the out-of-core
+ * spheres (for all of the rays at once, see sphere_chunks_intersect_batch()), and then they are shaded. The materials don't trace the
+ * scattered rays recursively (see RTContext.deferredRay), they become the rays of the next bounce.
+ *
+ * Each path has its own random number generator, seeded like in render_row_task(), and its attenuation colors are applied in the same
+ * order as the recursive ray_trace() applies them, so the rendered image is exactly the same as if the spheres were in memory.
+ */
+static void render_batch_task(void *ctxPtr, uint32_t batch, uint32_t workerIdx)
+{
+    TIMELINE_BEGIN(tlBatch);
+    PERF_PHASE_BEGIN(perfBatch);
+    RenderFrameCtx *ctx = ctxPtr;
+    Scene *scene = ctx->scene;
+    uint32_t imgWidth = ctx->imgWidth;
+    uint32_t firstRow = batch * ctx->batchRows;
+    uint32_t endRow = firstRow + ctx->batchRows < ctx->imgHeight ? firstRow + ctx->batchRows : ctx->imgHeight;
+    uint32_t pathsLength = (endRow - firstRow) * imgWidth;
+    uint64_t costClockStart = (ctx->costMap != NULL && ctx->costMap->metric == CM_time) ? cost_clock_now() : 0;
+
+    RenderPath *paths = rtalloc(sizeof(RenderPath) * pathsLength);
+    uint32_t *active = rtalloc(sizeof(uint32_t) * pathsLength);
+    SphereChunksQuery *queries = rtalloc(sizeof(SphereChunksQuery) * pathsLength);
+    uint32_t activeLength = 0;
+    for (uint32_t row = firstRow; row < endRow; row++) {
+        uint32_t imgV = ctx->imgHeight - row - 1;
+        for (uint32_t imgU = 0; imgU < imgWidth; imgU++) {
+            RenderPath *path = &paths[activeLength];
+            path->pixel = row * imgWidth + imgU;
+            path->ray.origin = ctx->cam->camCenterRay.origin;
+            cam_frame_get_ray_direction(ctx->cfc, imgU, imgV, &path->ray.direction);
+            random_state_seed(&path->randomState, random_hash2(ctx->frameSeed, path->pixel));
+            ray_trace_context_init(&path->rtContext);
+            path->rtContext.deferredRay = &path->deferredRay;
+            path->attenuated = 0;
+            active[activeLength] = activeLength;
+            activeLength++;
+        }
+    }
+
+    while (activeLength > 0) {
+        // The closest in-memory primitives hit by the rays of the active paths, then the closest out-of-core spheres (only closer ones).
+        uint32_t nextLength = 0;
+        for (uint32_t i = 0; i < activeLength; i++) {
+            RenderPath *path = &paths[active[i]];
+            if (! ray_trace_find_hit(&path->rtContext, scene, &path->ray, &path->hit)) {
+                finish_path(ctx, path, NULL);
+                continue;
+            }
+            queries[nextLength] = (SphereChunksQuery){.ray = &path->ray, .dist = path->hit.dist, .sphere = &path->hit.chunkSphere};
+            active[nextLength++] = active[i];
+        }
+        activeLength = nextLength;
+        sphere_chunks_intersect_batch(scene->sphereChunks, queries, activeLength);
+
+        // Shade the hits. The paths whose rays scatter stay active, with the scattered rays.
+        nextLength = 0;
+        for (uint32_t i = 0; i < activeLength; i++) {
+            RenderPath *path = &paths[active[i]];
+            SphereChunksQuery *query = &queries[i];
+            if (query->hit) {
+                ray_hit_chunk_sphere(&path->hit, query->dist);
+            }
+            RAY_STATS_ADD(sphereTests, query->tests);
+            path->rtContext.intersectionTests += query->tests;
+
+            randomThreadState = path->randomState;
+            path->deferredRay.pending = false;
+            Color color;
+            bool traced = ray_trace_shade_hit(&path->rtContext, scene, &path->ray, &path->hit, &color);
+            path->randomState = randomThreadState;
+
+            if (! path->deferredRay.pending) {
+                finish_path(ctx, path, traced ? &color : NULL);
+                continue;
+            }
+            uint32_t bounce = path->rtContext.bounces - 1;
+            if (path->deferredRay.attenuate) {
+                path->attenuation[bounce] = path->deferredRay.color;
+                path->attenuated |= 1u << bounce;
+            }
+            path->ray = path->deferredRay.ray;
+            active[nextLength++] = active[i];
+        }
+        activeLength = nextLength;
+    }
+
+    // The time of the batch is split evenly between its pixels.
+    if (costClockStart != 0) {
+        double pixelCost = (double)(cost_clock_now() - costClockStart) / pathsLength;
+        for (uint32_t i = 0; i < pathsLength; i++) {
+            ctx->costMap->cost[paths[i].pixel] += pixelCost;
+        }
+    }
+
+    uint64_t raysTraced = 0;
+    for (uint32_t i = 0; i < pathsLength; i++) {
+        raysTraced += paths[i].rtContext.bounces;
+    }
+    rtfree(queries);
+    rtfree(active);
+    rtfree(paths);
+
+    ctx->workerStats[workerIdx].raysTraced += raysTraced;
+    ray_stats_collect_thread(&ctx->workerRayStats[workerIdx]);
+    PERF_PHASE_END(perfBatch, PP_trace);
+    perf_stats_collect_thread(&ctx->workerPerfStats[workerIdx]);
+    TIMELINE_END(tlBatch, "batch", batch);
+}
+
+/**
+ * Stores the color of the pixel of the finished `path` (of a batch, see render_batch_task()): the light `color` that its last ray brought
+ * (NULL if it didn't bring any, like when ray_trace() returns false), multiplied by the attenuation colors of its bounces, last first.
+ */
+static void finish_path(RenderFrameCtx *ctx, RenderPath *path, Color *color)
+{
+    Color pixel = COLOR_BLACK;
+    if (color != NULL) {
+        pixel = *color;
+        for (int32_t b = RAY_BOUNCES_MAX - 1; b >= 0; b--) {
+            if (path->attenuated & (1u << b)) {
+                pixel.red *= path->attenuation[b].red;
+                pixel.green *= path->attenuation[b].green;
+                pixel.blue *= path->attenuation[b].blue;
+            }
+        }
+    }
+    ctx->img[path->pixel] = pixel;
+
+    if (ctx->costMap != NULL && ctx->costMap->metric != CM_time) {
+        ctx->costMap->cost[path->pixel] += pixel_cost(ctx->costMap->metric, &path->rtContext, 0);
+    }
+    RAY_STATS_INC(pathBounces[path->rtContext.bounces]);
+}
+
+/**
+ * Returns the cost of the pixel that was just traced with `rtContext` (`costClockStart` is the time it started at, for CM_time).
+ */
+static inline double pixel_cost(CostMetric metric, RTContext *rtContext, uint64_t costClockStart)
+{
+    switch (metric) {
+        case CM_time:
+            return (double)(cost_clock_now() - costClockStart);
+        case CM_rays:
+            return rtContext->bounces;
+        case CM_intersection_tests:
+            return rtContext->intersectionTests;
+        default:
+            return 0;
+    }
+}
+
+// static inline Color render_background_pixel(App *app, Ray *ray)
+// {
+//     if (ray->direction.y > app->cameraCenterRay.origin.y) {
+//         // Draw a sky pixel.
+//         return gradient(&skyBottomColor, &skyTopColor, 0, 1, ray->direction.y);
+//     } else {
+//         // Draw a ground pixel.
+//         return (Color)COLOR_WHITE;
+//         // return (Color)COLOR_GROUND;
+//     }
+
+//     // if (ray->direction.y > app->cameraCenterRay.origin.y) {
+//     //     // Draw a sky pixel.
+//     //     return gradient(&skyBottomColor, &skyTopColor, 0, 1, ray->direction.y);
+//     // } else {
+//     //     // Draw a ground pixel.
+//     //     return (Color)COLOR_BLACK;
+//     //     // return (Color)COLOR_GROUND;
+//     // }
+
+//     // // Draw a two-direction gradient background image.
+//     // Color color = {
+//     //     .red = (ray.direction.x + 1) * 128,
+//     //     .green = (ray.direction.y + 1) * 128,
+//     //     .blue = 0,
+//     // };
+//     // SDL_SetRenderDrawColor(app->sdlRenderer, color.red, color.green, color.blue, 255);
+//     // SDL_RenderDrawPoint(app->sdlRenderer, screenX, screenY);
+// }
+
+static void image_antialias(Color *srcImg, Color *dstImg, uint32_t dstHeight, uint32_t dstWidth)
+{
+    uint32_t srcWidth  = dstWidth*ANTIALIAS_FACTOR;
+    uint16_t samplesPerPixel = ANTIALIAS_FACTOR*ANTIALIAS_FACTOR;
+
+    uint32_t srcYBase, srcXBase;
+    srcYBase = 0;
+    for (uint32_t dstY = 0; dstY < dstHeight; dstY++) {
+        srcXBase = 0;
+        for (uint32_t dstX = 0; dstX < dstWidth; dstX++) {
+            // Calculate the antialiased pixel in dstImg from multiple pixels in srcImg.
+            double red = 0, green = 0, blue = 0;
+            for (uint32_t srcY = srcYBase; srcY < srcYBase+ANTIALIAS_FACTOR; srcY++) {
+                uint32_t srcYArrOffset = srcY*srcWidth;
+                for (uint32_t srcX = srcXBase; srcX < srcXBase+ANTIALIAS_FACTOR; srcX++) {
+                    Color *srcColor = &srcImg[srcYArrOffset + srcX];
+                    red     += srcColor->red;
+                    green   += srcColor->green;
+                    blue    += srcColor->blue;
+                }
+            }
+
+            dstImg[dstY*dstWidth + dstX] = (Color){
+                .red = red/samplesPerPixel, .green = green/samplesPerPixel, .blue = blue/samplesPerPixel};
+
+            srcXBase += ANTIALIAS_FACTOR;
+        }
+        srcYBase += ANTIALIAS_FACTOR;
+    }
+}
+
+void blend_frame(Color *summedFrames, uint32_t frameNum, Color *frameImg, Color *resImg, uint32_t imgHeight, uint32_t imgWidth)
+{
+    for (uint32_t y = 0; y < imgHeight; y++) {
+        uint32_t yArrOffset = y * imgWidth;
+        for (uint32_t x = 0; x < imgWidth; x++) {
+            Color *summedPixel = &summedFrames[yArrOffset + x];
+            Color *frameImgPixel = &frameImg[yArrOffset + x];
+
+            // Update sums.
+            summedPixel->red   += frameImgPixel->red;
+            summedPixel->green += frameImgPixel->green;
+            summedPixel->blue  += frameImgPixel->blue;
+
+            // Store resulting image. Note that pixel color component values here may exceed 1.0.
+            // They will be capped later, when drawing to the screen.
+            Color *resImgPixel = &resImg[yArrOffset + x];
+            resImgPixel->red   = summedPixel->red / frameNum;
+            resImgPixel->green = summedPixel->green / frameNum;
+            resImgPixel->blue  = summedPixel->blue / frameNum;
+        }
+    }
+}
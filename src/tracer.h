@@ -0,0 +1,55 @@
+#ifndef __TRACER_H__
+#define __TRACER_H__
+
+/**
+ * Rendering of whole frames (images) and blending them together. This does not depend on SDL or on the App.
+ */
+
+#include <stdint.h>
+
+#include "camera.h"
+#include "color.h"
+#include "cost_map.h"
+#include "perf_counters.h"
+#include "ray_stats.h"
+#include "scene.h"
+#include "workers.h"
+
+
+/**
+ * Similar to render_frame_img(), but renders an anti-aliased image, by averaging ANTIALIAS_FACTOR^2 pixels into 1 (with grid algorithm).
+ * `costMap` is not supported (must be NULL) when anti-aliasing.
+ */
+uint64_t render_frame_img_antialiased(Camera *cam, Scene *scene, WorkerPool *workers, Color *img, uint32_t imgHeight, uint32_t imgWidth,
+    RayStats *rayStats, PerfStats *perfStats, CostMap *costMap, uint32_t *tasksCount);
+
+/**
+ * Renders an image by ray-tracing the `scene`, as seen by the camera `cam`.
+ * Returns the amount of rays that were traced (counting every bounce of every camera ray).
+ *
+ * Image rows are split between the threads of `workers` (or rendered on the calling thread, if `workers` is NULL). The random numbers
+ * of each pixel are derived from a per-frame seed (taken from the calling thread's random number generator, see random_seed()) and the
+ * pixel's index, so the rendered image only depends on how the calling thread's generator was seeded - not on the amount of threads.
+ * Seeding the calling thread's generator with random_hash2(<seed>, <sample index>) before each frame makes the random numbers of every
+ * sample of every pixel a function of (seed, pixel, sample index), which makes renders reproducible (bit-identical).
+ *
+ * If `rayStats` is not NULL, the ray tracing statistics of the frame are added to it (see RAY_STATS_ENABLED).
+ * If `perfStats` is not NULL, the hardware performance counts of the frame's phases are added to it (see PERF_COUNTERS_ENABLED): it is an
+ * array with an entry for each thread of `workers` (1 entry if `workers` is NULL), index 0 being the calling thread.
+ * If `costMap` is not NULL, the cost of rendering each pixel is added to it (it must be of `imgWidth` x `imgHeight` pixels).
+ * If `tasksCount` is not NULL, it is set to the amount of tasks that the frame was split into (image rows, or batches of rows, see below).
+ *
+ * Scenes with out-of-core spheres (see Scene.sphereChunks) are rendered in batches of rows instead, a bounce of all of the paths of a batch
+ * at a time (see render_batch_task() in tracer.c). The image is the same, but the CM_time cost is the average of the pixels of a batch.
+ */
+uint64_t render_frame_img(Camera *cam, Scene *scene, WorkerPool *workers, Color *img, uint32_t imgHeight, uint32_t imgWidth,
+    RayStats *rayStats, PerfStats *perfStats, CostMap *costMap, uint32_t *tasksCount);
+
+/**
+ * Adds each pixel from the image `frameImg` to `summedFrames` summed image, and produces the averaged `resImg` image, by dividing the
+ * pixels in `allFrames` by `frameNum`. `frameNum` must be set by the caller to the amount of total frames rendered, including this frame
+ * (i.e. starting from 1).
+ */
+void blend_frame(Color *summedFrames, uint32_t frameNum, Color *frameImg, Color *resImg, uint32_t imgHeight, uint32_t imgWidth);
+
+#endif // __TRACER_H__
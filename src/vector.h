@@ -9,6 +9,7 @@ typedef struct Vector3_s        Vector3;
 
 
 #include "random.h"
+#include "ray_stats.h"
 
 
 struct Vector3_s {
@@ -278,7 +279,9 @@ static inline void random_point_in_unit_sphere__random_algo(Vector3 *point)
     //
     // Note that the length of the generated point (as a vector) will be (0, 1].
 
+    RAY_STATS_INC(unitSpherePoints);
     while (true) {
+        RAY_STATS_INC(unitSphereIterations);
         *point = (Vector3){.x = random_double_inc(-1, 1), .y = random_double_inc(-1, 1), .z = random_double_inc(-1, 1)};
         double len = vector3_length(point);
         if (len != 0 && len <= 1.0) {
@@ -0,0 +1,1071 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif // __SSE2__
+
+#include "bvh.h"
+#include "material.h"
+#include "rtalloc.h"
+#include "ray_inline_fns.h"
+#include "rtcommon.h"
+#include "wide_bvh.h"
+
+
+// The initial capacities of the WideBVH.nodes and WideBVH.packets arrays, per sphere.
+#define WIDE_BVH_NODES_PER_SPHERE       0.125
+#define WIDE_BVH_PACKETS_PER_SPHERE     0.5
+
+// The largest quantized coordinate of a child box (see WideBVHNode).
+#define WIDE_BVH_QUANT_MAX              255
+
+
+typedef struct WideBuildCtx_s   WideBuildCtx;
+typedef struct WideChild_s      WideChild;
+typedef struct WideRefitCtx_s   WideRefitCtx;
+typedef struct WideRebuild_s    WideRebuild;
+typedef struct WideRay_s        WideRay;
+typedef struct WideStackItem_s  WideStackItem;
+
+// The data of a (sub)tree build (see build_subtree()).
+struct WideBuildCtx_s {
+    WideBVH        *bvh;
+    BVH             binary;         // The binary BVH that is collapsed into the wide one.
+    BVHBounds      *bounds;         // The bounds of the spheres, in the order of the leaves of `binary`.
+    uint32_t       *order;          // The indexes of the spheres, in the order of the leaves of `binary`.
+    uint32_t       *subtreeFirst;   // The first of the spheres of each binary node's subtree (they are consecutive in the leaf order).
+    uint32_t       *subtreeCount;   // The amount of the spheres of each binary node's subtree.
+    Sphere         *spheres;
+};
+
+// A child of a node that is being built or refitted: its bounds and its encoded reference (see WideBVHNode.children).
+struct WideChild_s {
+    float           min[3];
+    float           max[3];
+    uint32_t        ref;
+};
+
+// The data shared by the tasks of a refit of one level of the tree (see refit_task()).
+struct WideRefitCtx_s {
+    WideBVH        *bvh;
+    Sphere         *spheres;
+    uint32_t        first;          // The nodes of the level are levelNodes[first .. last).
+    uint32_t        last;
+};
+
+// A subtree that a refit rebuilds: the root node of the subtree and where its parent refers to it.
+struct WideRebuild_s {
+    uint32_t        nodeIdx;
+    uint32_t        parentIdx;
+    uint32_t        slot;           // The index of the child of the parent.
+};
+
+// A ray, prepared for the node and packet tests.
+struct WideRay_s {
+    double          origin[3];
+    double          direction[3];
+    double          invDir[3];      // Finite (see wide_bvh_intersect()).
+    double          a2;             // 2 * dot(direction, direction) (see ray_distance_to_sphere()).
+    double          a4;             // 4 * dot(direction, direction).
+};
+
+struct WideStackItem_s {
+    uint32_t        ref;
+    double          nearDist;       // The distance where the ray enters the box of the node or leaf.
+};
+
+
+static uint32_t build_subtree(WideBVH *bvh, Sphere *spheres, uint32_t *sphereIdxs, uint32_t count);
+static uint32_t build_node(WideBuildCtx *ctx, uint32_t binIdx);
+static uint32_t emit_leaf(WideBuildCtx *ctx, uint32_t first, uint32_t count);
+static inline bool is_inner(WideBuildCtx *ctx, uint32_t binIdx);
+static void range_bounds(WideBuildCtx *ctx, uint32_t first, uint32_t count, float *min, float *max);
+static uint32_t push_node(WideBVH *bvh);
+static void finish_node(WideBVH *bvh, uint32_t nodeIdx, float *min, float *max, WideChild *children, uint32_t childrenLength);
+static void set_node(WideBVHNode *node, float *min, float *max, WideChild *children, uint32_t childrenLength);
+static void update_levels(WideBVH *bvh);
+static void refit_task(void *ctx, uint32_t taskIdx, uint32_t workerIdx);
+static void refit_leaf(WideBVH *bvh, Sphere *spheres, uint32_t ref, float *min, float *max);
+static bool find_degraded(WideBVH *bvh, uint32_t nodeIdx, uint32_t parentIdx, uint32_t slot, WideRebuild **rebuilds,
+    uint32_t *rebuildsLength, uint32_t *rebuildsCapacity);
+static void rebuild_subtree(WideBVH *bvh, Sphere *spheres, WideRebuild *rebuild);
+static void collect_spheres(WideBVH *bvh, uint32_t nodeIdx, uint32_t *sphereIdxs, uint32_t *count, uint32_t *nodes, uint32_t *packets);
+static void update_cost(WideBVH *bvh, uint32_t nodeIdx);
+static inline bool is_degraded(WideBVHNodeInfo *info);
+static inline uint8_t quantize_down(float origin, float scale, float x);
+static inline uint8_t quantize_up(float origin, float scale, float x);
+static inline float dequantize(float origin, float scale, uint32_t q);
+static inline uint32_t leaf_packets(uint32_t ref);
+static inline uint32_t node_hits(WideBVHNode *node, WideRay *r, double maxDist, double *nearDist);
+static inline bool packet_hits(WideBVHPacket *packet, WideRay *r, Ray *ray, Sphere *spheres, double *dist, uint32_t *sphere);
+static inline bool packet_occluded(WideBVHPacket *packet, WideRay *r, Ray *ray, Sphere *spheres, double dist, bool ignoreLights);
+static inline void wide_ray_init(WideRay *r, Ray *ray);
+
+
+void wide_bvh_init(WideBVH *bvh)
+{
+    bvh->nodes = NULL;
+    bvh->nodeInfos = NULL;
+    bvh->nodesLength = 0;
+    bvh->nodesCapacity = 0;
+    bvh->packets = NULL;
+    bvh->packetsLength = 0;
+    bvh->packetsCapacity = 0;
+    bvh->levelNodes = NULL;
+    bvh->levelFirst = NULL;
+    bvh->levelsLength = 0;
+    bvh->garbageNodes = 0;
+    bvh->garbagePackets = 0;
+    bvh->refits = 0;
+    bvh->partialRebuilds = 0;
+    bvh->rebuilds = 0;
+}
+
+void wide_bvh_free(WideBVH *bvh)
+{
+    rtfree(bvh->nodes);
+    rtfree(bvh->nodeInfos);
+    rtfree(bvh->packets);
+    rtfree(bvh->levelNodes);
+    rtfree(bvh->levelFirst);
+
+    // (The refit counters are kept.)
+    bvh->nodes = NULL;
+    bvh->nodeInfos = NULL;
+    bvh->nodesLength = 0;
+    bvh->nodesCapacity = 0;
+    bvh->packets = NULL;
+    bvh->packetsLength = 0;
+    bvh->packetsCapacity = 0;
+    bvh->levelNodes = NULL;
+    bvh->levelFirst = NULL;
+    bvh->levelsLength = 0;
+    bvh->garbageNodes = 0;
+    bvh->garbagePackets = 0;
+}
+
+void wide_bvh_build(WideBVH *bvh, Sphere *spheres, uint32_t spheresLength)
+{
+    wide_bvh_free(bvh);
+    if (spheresLength == 0) {
+        return;
+    }
+
+    bvh->nodesCapacity = 1 + (uint32_t)(spheresLength * WIDE_BVH_NODES_PER_SPHERE);
+    bvh->nodes = rtalloc(sizeof(WideBVHNode) * bvh->nodesCapacity);
+    bvh->nodeInfos = rtalloc(sizeof(WideBVHNodeInfo) * bvh->nodesCapacity);
+    bvh->packetsCapacity = 1 + (uint32_t)(spheresLength * WIDE_BVH_PACKETS_PER_SPHERE);
+    bvh->packets = rtalloc(sizeof(WideBVHPacket) * bvh->packetsCapacity);
+
+    uint32_t *sphereIdxs = rtalloc(sizeof(uint32_t) * spheresLength);
+    for (uint32_t i = 0; i < spheresLength; i++) {
+        sphereIdxs[i] = i;
+    }
+    build_subtree(bvh, spheres, sphereIdxs, spheresLength);
+    rtfree(sphereIdxs);
+
+    bvh->nodesCapacity = bvh->nodesLength;
+    bvh->nodes = rtrealloc(bvh->nodes, sizeof(WideBVHNode) * bvh->nodesCapacity);
+    bvh->nodeInfos = rtrealloc(bvh->nodeInfos, sizeof(WideBVHNodeInfo) * bvh->nodesCapacity);
+    bvh->packetsCapacity = bvh->packetsLength;
+    bvh->packets = rtrealloc(bvh->packets, sizeof(WideBVHPacket) * bvh->packetsCapacity);
+    update_levels(bvh);
+}
+
+void wide_bvh_refit(WideBVH *bvh, Sphere *spheres, uint32_t spheresLength, WorkerPool *workers)
+{
+    if (bvh->nodesLength == 0) {
+        return;
+    }
+
+    // Refit the levels bottom-up: the nodes of a level only read the boxes of their children (of the level below) and write their own,
+    // and the packets of each leaf are refitted by the node that it is a child of.
+    for (uint32_t d = bvh->levelsLength; d-- > 0; ) {
+        WideRefitCtx ctx = {.bvh = bvh, .spheres = spheres, .first = bvh->levelFirst[d], .last = bvh->levelFirst[d + 1]};
+        uint32_t tasksCount = (ctx.last - ctx.first + WIDE_BVH_REFIT_TASK_SIZE - 1) / WIDE_BVH_REFIT_TASK_SIZE;
+        if (workers != NULL && tasksCount > 1) {
+            workers_run(workers, refit_task, &ctx, tasksCount);
+        } else {
+            for (uint32_t t = 0; t < tasksCount; t++) {
+                refit_task(&ctx, t, 0);
+            }
+        }
+    }
+    bvh->refits++;
+    if (! is_degraded(&bvh->nodeInfos[0])) {
+        return;
+    }
+
+    // Find the (smallest) subtrees that got too much worse. If they are too large, or there is too much garbage - rebuild everything.
+    WideRebuild *rebuilds = NULL;
+    uint32_t rebuildsLength = 0;
+    uint32_t rebuildsCapacity = 0;
+    bool rebuildAll = find_degraded(bvh, 0, UINT32_MAX, 0, &rebuilds, &rebuildsLength, &rebuildsCapacity);
+    uint64_t rebuildSpheres = 0;
+    for (uint32_t i = 0; i < rebuildsLength; i++) {
+        rebuildSpheres += bvh->nodeInfos[rebuilds[i].nodeIdx].spheres;
+    }
+    uint32_t liveNodes = bvh->nodesLength - bvh->garbageNodes;
+    if (rebuildAll || rebuildSpheres > WIDE_BVH_PARTIAL_MAX * spheresLength || bvh->garbageNodes > WIDE_BVH_PARTIAL_MAX * liveNodes) {
+        rtfree(rebuilds);
+        wide_bvh_build(bvh, spheres, spheresLength);
+        bvh->rebuilds++;
+        return;
+    }
+
+    for (uint32_t i = 0; i < rebuildsLength; i++) {
+        rebuild_subtree(bvh, spheres, &rebuilds[i]);
+    }
+    rtfree(rebuilds);
+    update_levels(bvh);
+
+    // The costs of the ancestors of the rebuilt subtrees dropped (the other nodes are updated to the same costs).
+    for (uint32_t i = bvh->levelFirst[bvh->levelsLength]; i-- > 0; ) {
+        update_cost(bvh, bvh->levelNodes[i]);
+    }
+    bvh->partialRebuilds++;
+}
+
+uint64_t wide_bvh_size(WideBVH *bvh)
+{
+    return sizeof(WideBVHNode) * (uint64_t)bvh->nodesLength + sizeof(WideBVHPacket) * (uint64_t)bvh->packetsLength;
+}
+
+bool wide_bvh_valid(WideBVH *bvh, uint32_t spheresLength)
+{
+    for (uint32_t i = 0; i < bvh->packetsLength; i++) {
+        for (uint32_t j = 0; j < WIDE_BVH_WIDTH; j++) {
+            if (bvh->packets[i].spheres[j] >= spheresLength) {
+                return false;
+            }
+        }
+    }
+
+    // The depth of each node (the nodes come after their parents, so a parent's depth is final before its children are visited). The
+    // traversals push up to WIDE_BVH_WIDTH children per node and pop one, so the nodes at depth d need a stack of up to
+    // (d + 1) * (WIDE_BVH_WIDTH - 1) + 1 items.
+    uint32_t depthMax = (WIDE_BVH_STACK_MAX - 1) / (WIDE_BVH_WIDTH - 1) - 1;
+    uint32_t *depths = rtalloc(sizeof(uint32_t) * ((size_t)bvh->nodesLength + 1));
+    memset(depths, 0, sizeof(uint32_t) * ((size_t)bvh->nodesLength + 1));
+    bool valid = true;
+    for (uint32_t i = 0; i < bvh->nodesLength && valid; i++) {
+        valid = depths[i] <= depthMax;
+        for (uint32_t j = 0; j < WIDE_BVH_WIDTH && valid; j++) {
+            uint32_t ref = bvh->nodes[i].children[j];
+            if (ref == WIDE_BVH_EMPTY) {
+                continue;
+            } else if (ref & WIDE_BVH_LEAF) {
+                uint32_t first = ref & (WIDE_BVH_PACKETS_MAX - 1);
+                valid = first < bvh->packetsLength && leaf_packets(ref) <= bvh->packetsLength - first;
+            } else {
+                valid = ref > i && ref < bvh->nodesLength;
+                if (valid) {
+                    depths[ref] = depths[i] + 1 > depths[ref] ? depths[i] + 1 : depths[ref];
+                }
+            }
+        }
+    }
+    rtfree(depths);
+    return valid;
+}
+
+Sphere * wide_bvh_intersect(WideBVH *bvh, Sphere *spheres, Ray *ray, double *dist, uint32_t *tests)
+{
+    if (bvh->nodesLength == 0) {
+        return NULL;
+    }
+
+    WideRay r;
+    wide_ray_init(&r, ray);
+
+    uint32_t minSphere = UINT32_MAX;
+    uint32_t packetTests = 0;
+    WideStackItem stack[WIDE_BVH_STACK_MAX];
+    uint32_t stackLength = 0;
+    stack[stackLength++] = (WideStackItem){.ref = 0, .nearDist = RAY_DISTANCE_MIN};
+    while (stackLength > 0) {
+        WideStackItem item = stack[--stackLength];
+        if (item.nearDist > *dist) {
+            // A closer sphere was found since it was pushed.
+            continue;
+        }
+
+        if (item.ref & WIDE_BVH_LEAF) {
+            uint32_t first = item.ref & (WIDE_BVH_PACKETS_MAX - 1);
+            uint32_t last = first + leaf_packets(item.ref);
+            for (uint32_t i = first; i < last; i++) {
+                packet_hits(&bvh->packets[i], &r, ray, spheres, dist, &minSphere);
+            }
+            packetTests += last - first;
+            continue;
+        }
+
+        WideBVHNode *node = &bvh->nodes[item.ref];
+        double nearDist[WIDE_BVH_WIDTH];
+        uint32_t mask = node_hits(node, &r, *dist, nearDist);
+
+        // Push the children that the ray hits, the farthest first (so that the closest one is visited next).
+        uint32_t first = stackLength;
+        for (uint32_t i = 0; i < WIDE_BVH_WIDTH; i++) {
+            if (! (mask & (1u << i)) || node->children[i] == WIDE_BVH_EMPTY) {
+                continue;
+            }
+            WideStackItem child = {.ref = node->children[i], .nearDist = nearDist[i]};
+            uint32_t j = stackLength++;
+            for (; j > first && stack[j - 1].nearDist < child.nearDist; j--) {
+                stack[j] = stack[j - 1];
+            }
+            stack[j] = child;
+        }
+    }
+
+    *tests += packetTests * WIDE_BVH_WIDTH;
+    return minSphere == UINT32_MAX ? NULL : &spheres[minSphere];
+}
+
+bool wide_bvh_occluded(WideBVH *bvh, Sphere *spheres, Ray *ray, double dist, bool ignoreLights, uint32_t *tests)
+{
+    if (bvh->nodesLength == 0) {
+        return false;
+    }
+
+    WideRay r;
+    wide_ray_init(&r, ray);
+
+    // Any hit will do, so the children are visited in the order of their slots (not closest first) and `dist` never shrinks.
+    bool occluded = false;
+    uint32_t packetTests = 0;
+    uint32_t stack[WIDE_BVH_STACK_MAX];
+    uint32_t stackLength = 0;
+    stack[stackLength++] = 0;
+    while (stackLength > 0 && ! occluded) {
+        uint32_t ref = stack[--stackLength];
+        if (ref & WIDE_BVH_LEAF) {
+            uint32_t first = ref & (WIDE_BVH_PACKETS_MAX - 1);
+            uint32_t last = first + leaf_packets(ref);
+            for (uint32_t i = first; i < last && ! occluded; i++) {
+                occluded = packet_occluded(&bvh->packets[i], &r, ray, spheres, dist, ignoreLights);
+                packetTests++;
+            }
+            continue;
+        }
+
+        WideBVHNode *node = &bvh->nodes[ref];
+        double nearDist[WIDE_BVH_WIDTH];
+        uint32_t mask = node_hits(node, &r, dist, nearDist);
+        for (uint32_t i = WIDE_BVH_WIDTH; i-- > 0; ) {
+            if ((mask & (1u << i)) && node->children[i] != WIDE_BVH_EMPTY) {
+                stack[stackLength++] = node->children[i];
+            }
+        }
+    }
+
+    *tests += packetTests * WIDE_BVH_WIDTH;
+    return occluded;
+}
+
+/**
+ * Appends a subtree over the `count` spheres with the indexes `sphereIdxs` (of `spheres`) to `bvh`, by building a binary BVH over them
+ * and collapsing it. Returns the index of its root node.
+ */
+static uint32_t build_subtree(WideBVH *bvh, Sphere *spheres, uint32_t *sphereIdxs, uint32_t count)
+{
+    WideBuildCtx ctx = {.bvh = bvh, .spheres = spheres};
+    ctx.bounds = rtalloc(sizeof(BVHBounds) * count);
+    ctx.order = rtalloc(sizeof(uint32_t) * count);
+    for (uint32_t i = 0; i < count; i++) {
+        Sphere *sphere = &spheres[sphereIdxs[i]];
+        Vector3 r = {.x = sphere->radius, .y = sphere->radius, .z = sphere->radius};
+        Vector3 min, max;
+        vector3_subtract(&sphere->center, &r, &min);
+        vector3_add_to(&sphere->center, &r, &max);
+        bvh_bounds_set(&ctx.bounds[i], &min, &max);
+        ctx.order[i] = sphereIdxs[i];
+    }
+    bvh_init(&ctx.binary);
+    bvh_build(&ctx.binary, ctx.bounds, ctx.order, count);
+
+    // The children of binary nodes follow their parents, so the subtrees are summed up from the last node to the root.
+    BVHNode *nodes = ctx.binary.nodes;
+    ctx.subtreeFirst = rtalloc(sizeof(uint32_t) * ctx.binary.nodesLength);
+    ctx.subtreeCount = rtalloc(sizeof(uint32_t) * ctx.binary.nodesLength);
+    for (uint32_t i = ctx.binary.nodesLength; i-- > 0; ) {
+        if (nodes[i].count > 0) {
+            ctx.subtreeFirst[i] = nodes[i].first;
+            ctx.subtreeCount[i] = nodes[i].count;
+        } else {
+            ctx.subtreeFirst[i] = ctx.subtreeFirst[nodes[i].first];
+            ctx.subtreeCount[i] = ctx.subtreeCount[nodes[i].first] + ctx.subtreeCount[nodes[i].first + 1];
+        }
+    }
+
+    uint32_t root = build_node(&ctx, 0);
+
+    bvh_free(&ctx.binary);
+    rtfree(ctx.subtreeFirst);
+    rtfree(ctx.subtreeCount);
+    rtfree(ctx.bounds);
+    rtfree(ctx.order);
+    return root;
+}
+
+/**
+ * Appends the wide node collapsed from the binary node `binIdx` (and, recursively, its descendants) to the wide BVH. Returns its index.
+ */
+static uint32_t build_node(WideBuildCtx *ctx, uint32_t binIdx)
+{
+    BVHNode *nodes = ctx->binary.nodes;
+
+    // Start with the children of the binary node and keep replacing the largest inner child with its two children, until there are
+    // WIDE_BVH_WIDTH of them (or only leaves). Subtrees with up to a packet of spheres become leaves (the binary BVH splits down to single
+    // spheres, which would leave the packets mostly empty). A binary leaf or small subtree (only the root can be) becomes the only child.
+    uint32_t kids[WIDE_BVH_WIDTH];
+    uint32_t kidsLength = 0;
+    if (! is_inner(ctx, binIdx)) {
+        kids[kidsLength++] = binIdx;
+    } else {
+        kids[kidsLength++] = nodes[binIdx].first;
+        kids[kidsLength++] = nodes[binIdx].first + 1;
+    }
+    while (kidsLength < WIDE_BVH_WIDTH) {
+        uint32_t largest = UINT32_MAX;
+        double largestArea = -1;
+        for (uint32_t i = 0; i < kidsLength; i++) {
+            BVHNode *kid = &nodes[kids[i]];
+            double area = bvh_box_area(kid->min, kid->max);
+            if (is_inner(ctx, kids[i]) && area > largestArea) {
+                largest = i;
+                largestArea = area;
+            }
+        }
+        if (largest == UINT32_MAX) {
+            break;
+        }
+        uint32_t kidFirst = nodes[kids[largest]].first;
+        kids[largest] = kidFirst;
+        kids[kidsLength++] = kidFirst + 1;
+    }
+
+    uint32_t nodeIdx = push_node(ctx->bvh);
+    WideChild children[WIDE_BVH_WIDTH];
+    for (uint32_t i = 0; i < kidsLength; i++) {
+        BVHNode *kid = &nodes[kids[i]];
+        memcpy(children[i].min, kid->min, sizeof(kid->min));
+        memcpy(children[i].max, kid->max, sizeof(kid->max));
+        children[i].ref = is_inner(ctx, kids[i]) ? build_node(ctx, kids[i])
+            : emit_leaf(ctx, ctx->subtreeFirst[kids[i]], ctx->subtreeCount[kids[i]]);
+    }
+    finish_node(ctx->bvh, nodeIdx, nodes[binIdx].min, nodes[binIdx].max, children, kidsLength);
+    ctx->bvh->nodeInfos[nodeIdx].spheres = ctx->subtreeCount[binIdx];
+    return nodeIdx;
+}
+
+/**
+ * Appends the packets of the spheres [first, first + count) (of the leaf order) to the wide BVH. Returns the encoded reference of the
+ * leaf, or of a node over several leaves, if there are more than WIDE_BVH_LEAF_PACKETS packets (binary leaves are only that large at
+ * BVH_DEPTH_MAX).
+ */
+static uint32_t emit_leaf(WideBuildCtx *ctx, uint32_t first, uint32_t count)
+{
+    WideBVH *bvh = ctx->bvh;
+    uint32_t packetsCount = (count + WIDE_BVH_WIDTH - 1) / WIDE_BVH_WIDTH;
+    if (packetsCount > WIDE_BVH_LEAF_PACKETS) {
+        uint32_t nodeIdx = push_node(bvh);
+        WideChild children[WIDE_BVH_WIDTH];
+        uint32_t part = (packetsCount + WIDE_BVH_WIDTH - 1) / WIDE_BVH_WIDTH * WIDE_BVH_WIDTH;
+        uint32_t childrenLength = 0;
+        for (uint32_t i = 0; i < count; i += part) {
+            uint32_t partCount = count - i < part ? count - i : part;
+            WideChild *child = &children[childrenLength++];
+            range_bounds(ctx, first + i, partCount, child->min, child->max);
+            child->ref = emit_leaf(ctx, first + i, partCount);
+        }
+        float min[3], max[3];
+        range_bounds(ctx, first, count, min, max);
+        finish_node(bvh, nodeIdx, min, max, children, childrenLength);
+        bvh->nodeInfos[nodeIdx].spheres = count;
+        return nodeIdx;
+    }
+
+    if (bvh->packetsLength + packetsCount > WIDE_BVH_PACKETS_MAX) {
+        log_err("Too many spheres for a wide BVH (%u packets at most)\n", WIDE_BVH_PACKETS_MAX);
+        exit(1);
+    }
+    uint32_t firstPacket = bvh->packetsLength;
+    while (bvh->packetsLength + packetsCount > bvh->packetsCapacity) {
+        bvh->packetsCapacity *= 2;
+        bvh->packets = rtrealloc(bvh->packets, sizeof(WideBVHPacket) * bvh->packetsCapacity);
+    }
+    bvh->packetsLength += packetsCount;
+
+    for (uint32_t p = 0; p < packetsCount; p++) {
+        WideBVHPacket *packet = &bvh->packets[firstPacket + p];
+        for (uint32_t i = 0; i < WIDE_BVH_WIDTH; i++) {
+            uint32_t idx = p * WIDE_BVH_WIDTH + i;
+            uint32_t sphereIdx = ctx->order[first + (idx < count ? idx : count - 1)];
+            Sphere *sphere = &ctx->spheres[sphereIdx];
+            packet->centerX[i] = sphere->center.x;
+            packet->centerY[i] = sphere->center.y;
+            packet->centerZ[i] = sphere->center.z;
+            packet->radius[i] = sphere->radius;
+            packet->spheres[i] = sphereIdx;
+        }
+    }
+    return WIDE_BVH_LEAF | ((packetsCount - 1) << WIDE_BVH_LEAF_SHIFT) | firstPacket;
+}
+
+/**
+ * Returns true if the binary node `binIdx` becomes an inner node of the wide BVH: if it is an inner node with more than a packet of
+ * spheres.
+ */
+static inline bool is_inner(WideBuildCtx *ctx, uint32_t binIdx)
+{
+    return ctx->binary.nodes[binIdx].count == 0 && ctx->subtreeCount[binIdx] > WIDE_BVH_WIDTH;
+}
+
+/**
+ * Sets `min`, `max` to the union of the bounds of the spheres [first, first + count) (of the leaf order).
+ */
+static void range_bounds(WideBuildCtx *ctx, uint32_t first, uint32_t count, float *min, float *max)
+{
+    for (uint32_t a = 0; a < 3; a++) {
+        min[a] = INFINITY;
+        max[a] = -INFINITY;
+    }
+    for (uint32_t i = first; i < first + count; i++) {
+        for (uint32_t a = 0; a < 3; a++) {
+            min[a] = fminf(min[a], ctx->bounds[i].min[a]);
+            max[a] = fmaxf(max[a], ctx->bounds[i].max[a]);
+        }
+    }
+}
+
+/**
+ * Appends an (uninitialized) node to `bvh`. Returns its index.
+ */
+static uint32_t push_node(WideBVH *bvh)
+{
+    if (bvh->nodesLength == bvh->nodesCapacity) {
+        bvh->nodesCapacity *= 2;
+        bvh->nodes = rtrealloc(bvh->nodes, sizeof(WideBVHNode) * bvh->nodesCapacity);
+        bvh->nodeInfos = rtrealloc(bvh->nodeInfos, sizeof(WideBVHNodeInfo) * bvh->nodesCapacity);
+    }
+    return bvh->nodesLength++;
+}
+
+/**
+ * Sets the node `nodeIdx` of a new subtree to the box [min, max] with the `childrenLength` `children` (see set_node()) and stores its
+ * box and SAH cost (as both the current and the build cost) in its info (the caller sets the amount of its spheres).
+ */
+static void finish_node(WideBVH *bvh, uint32_t nodeIdx, float *min, float *max, WideChild *children, uint32_t childrenLength)
+{
+    set_node(&bvh->nodes[nodeIdx], min, max, children, childrenLength);
+    WideBVHNodeInfo *info = &bvh->nodeInfos[nodeIdx];
+    memcpy(info->min, min, sizeof(info->min));
+    memcpy(info->max, max, sizeof(info->max));
+    update_cost(bvh, nodeIdx);
+    info->buildCost = info->cost;
+}
+
+/**
+ * Sets `node` to the box [min, max] with the `childrenLength` `children`, quantizing their boxes.
+ */
+static void set_node(WideBVHNode *node, float *min, float *max, WideChild *children, uint32_t childrenLength)
+{
+    for (uint32_t a = 0; a < 3; a++) {
+        // The quantized box must reach `max` (the float computations of the node tests may round the steps down).
+        float origin = min[a];
+        float scale = bvh_float_up(((double)max[a] - (double)min[a]) / WIDE_BVH_QUANT_MAX);
+        while (dequantize(origin, scale, WIDE_BVH_QUANT_MAX) < max[a]) {
+            scale = nextafterf(scale, INFINITY);
+        }
+        node->origin[a] = origin;
+        node->scale[a] = scale;
+
+        for (uint32_t i = 0; i < WIDE_BVH_WIDTH; i++) {
+            if (i < childrenLength) {
+                node->qmin[a][i] = quantize_down(origin, scale, children[i].min[a]);
+                node->qmax[a][i] = quantize_up(origin, scale, children[i].max[a]);
+            } else {
+                node->qmin[a][i] = WIDE_BVH_QUANT_MAX;
+                node->qmax[a][i] = 0;
+            }
+        }
+    }
+    for (uint32_t i = 0; i < WIDE_BVH_WIDTH; i++) {
+        node->children[i] = i < childrenLength ? children[i].ref : WIDE_BVH_EMPTY;
+    }
+}
+
+/**
+ * Fills the levels of `bvh` (see WideBVH.levelNodes), by a breadth-first walk from the root.
+ */
+static void update_levels(WideBVH *bvh)
+{
+    uint32_t liveNodes = bvh->nodesLength - bvh->garbageNodes;
+    bvh->levelNodes = rtrealloc(bvh->levelNodes, sizeof(uint32_t) * liveNodes);
+    bvh->levelNodes[0] = 0;
+    uint32_t levelNodesLength = 1;
+    uint32_t levelFirstCapacity = 0;
+    bvh->levelsLength = 0;
+    for (uint32_t first = 0; first < levelNodesLength; ) {
+        if (bvh->levelsLength + 2 > levelFirstCapacity) {
+            levelFirstCapacity = 2 * (bvh->levelsLength + 2);
+            bvh->levelFirst = rtrealloc(bvh->levelFirst, sizeof(uint32_t) * levelFirstCapacity);
+        }
+        bvh->levelFirst[bvh->levelsLength++] = first;
+
+        uint32_t last = levelNodesLength;
+        for (uint32_t i = first; i < last; i++) {
+            WideBVHNode *node = &bvh->nodes[bvh->levelNodes[i]];
+            for (uint32_t c = 0; c < WIDE_BVH_WIDTH; c++) {
+                uint32_t ref = node->children[c];
+                if (ref != WIDE_BVH_EMPTY && ! (ref & WIDE_BVH_LEAF)) {
+                    bvh->levelNodes[levelNodesLength++] = ref;
+                }
+            }
+        }
+        first = last;
+    }
+    bvh->levelFirst[bvh->levelsLength] = levelNodesLength;
+}
+
+static void refit_task(void *ctx, uint32_t taskIdx, uint32_t workerIdx)
+{
+    (void)(workerIdx); // Disable gcc -Wextra "unused parameter" errors.
+
+    WideRefitCtx *rc = ctx;
+    WideBVH *bvh = rc->bvh;
+    uint32_t first = rc->first + taskIdx * WIDE_BVH_REFIT_TASK_SIZE;
+    uint32_t last = first + WIDE_BVH_REFIT_TASK_SIZE < rc->last ? first + WIDE_BVH_REFIT_TASK_SIZE : rc->last;
+    for (uint32_t i = first; i < last; i++) {
+        uint32_t nodeIdx = bvh->levelNodes[i];
+        WideBVHNode *node = &bvh->nodes[nodeIdx];
+        WideBVHNodeInfo *info = &bvh->nodeInfos[nodeIdx];
+
+        // The children of a node are always the first ones.
+        WideChild children[WIDE_BVH_WIDTH];
+        uint32_t childrenLength = 0;
+        float min[3] = {INFINITY, INFINITY, INFINITY};
+        float max[3] = {-INFINITY, -INFINITY, -INFINITY};
+        for (; childrenLength < WIDE_BVH_WIDTH && node->children[childrenLength] != WIDE_BVH_EMPTY; childrenLength++) {
+            WideChild *child = &children[childrenLength];
+            child->ref = node->children[childrenLength];
+            if (child->ref & WIDE_BVH_LEAF) {
+                refit_leaf(bvh, rc->spheres, child->ref, child->min, child->max);
+            } else {
+                memcpy(child->min, bvh->nodeInfos[child->ref].min, sizeof(child->min));
+                memcpy(child->max, bvh->nodeInfos[child->ref].max, sizeof(child->max));
+            }
+            for (uint32_t a = 0; a < 3; a++) {
+                min[a] = fminf(min[a], child->min[a]);
+                max[a] = fmaxf(max[a], child->max[a]);
+            }
+        }
+
+        set_node(node, min, max, children, childrenLength);
+        memcpy(info->min, min, sizeof(info->min));
+        memcpy(info->max, max, sizeof(info->max));
+        update_cost(bvh, nodeIdx);
+    }
+}
+
+/**
+ * Copies the current centers and radiuses of the spheres of the leaf `ref` into its packets and sets `min`, `max` to their bounds.
+ */
+static void refit_leaf(WideBVH *bvh, Sphere *spheres, uint32_t ref, float *min, float *max)
+{
+    double dmin[3] = {INFINITY, INFINITY, INFINITY};
+    double dmax[3] = {-INFINITY, -INFINITY, -INFINITY};
+    uint32_t first = ref & (WIDE_BVH_PACKETS_MAX - 1);
+    uint32_t last = first + leaf_packets(ref);
+    for (uint32_t p = first; p < last; p++) {
+        WideBVHPacket *packet = &bvh->packets[p];
+        for (uint32_t i = 0; i < WIDE_BVH_WIDTH; i++) {
+            Sphere *sphere = &spheres[packet->spheres[i]];
+            packet->centerX[i] = sphere->center.x;
+            packet->centerY[i] = sphere->center.y;
+            packet->centerZ[i] = sphere->center.z;
+            packet->radius[i] = sphere->radius;
+
+            double center[3] = {sphere->center.x, sphere->center.y, sphere->center.z};
+            for (uint32_t a = 0; a < 3; a++) {
+                dmin[a] = fmin(dmin[a], center[a] - sphere->radius);
+                dmax[a] = fmax(dmax[a], center[a] + sphere->radius);
+            }
+        }
+    }
+    for (uint32_t a = 0; a < 3; a++) {
+        min[a] = bvh_float_down(dmin[a]);
+        max[a] = bvh_float_up(dmax[a]);
+    }
+}
+
+/**
+ * Adds the subtrees under (and including) the degraded node `nodeIdx` that need to be rebuilt to `rebuilds`: the node itself, if at least
+ * half of its inner children are degraded too (the spheres moved all over it) or none of them is (its own children's boxes got worse),
+ * otherwise its degraded inner children (recursively). Returns true if that is the root (so the whole BVH has to be rebuilt).
+ */
+static bool find_degraded(WideBVH *bvh, uint32_t nodeIdx, uint32_t parentIdx, uint32_t slot, WideRebuild **rebuilds,
+    uint32_t *rebuildsLength, uint32_t *rebuildsCapacity)
+{
+    WideBVHNode *node = &bvh->nodes[nodeIdx];
+    uint32_t innerChildren = 0;
+    uint32_t degradedChildren = 0;
+    for (uint32_t i = 0; i < WIDE_BVH_WIDTH; i++) {
+        uint32_t ref = node->children[i];
+        if (ref != WIDE_BVH_EMPTY && ! (ref & WIDE_BVH_LEAF)) {
+            innerChildren++;
+            degradedChildren += is_degraded(&bvh->nodeInfos[ref]);
+        }
+    }
+
+    if (degradedChildren > 0 && 2 * degradedChildren < innerChildren) {
+        for (uint32_t i = 0; i < WIDE_BVH_WIDTH; i++) {
+            uint32_t ref = node->children[i];
+            if (ref != WIDE_BVH_EMPTY && ! (ref & WIDE_BVH_LEAF) && is_degraded(&bvh->nodeInfos[ref])) {
+                find_degraded(bvh, ref, nodeIdx, i, rebuilds, rebuildsLength, rebuildsCapacity);
+            }
+        }
+        return false;
+    }
+    if (parentIdx == UINT32_MAX) {
+        return true;
+    }
+
+    if (*rebuildsLength == *rebuildsCapacity) {
+        *rebuildsCapacity = *rebuildsCapacity == 0 ? 16 : 2 * *rebuildsCapacity;
+        *rebuilds = rtrealloc(*rebuilds, sizeof(WideRebuild) * *rebuildsCapacity);
+    }
+    (*rebuilds)[(*rebuildsLength)++] = (WideRebuild){.nodeIdx = nodeIdx, .parentIdx = parentIdx, .slot = slot};
+    return false;
+}
+
+/**
+ * Builds a new subtree over the spheres of the subtree `rebuild` (appended to `bvh`) and makes its parent refer to it instead. The old
+ * subtree becomes garbage. (The box of the subtree stays the same, so the parent's quantized box of it doesn't change.)
+ */
+static void rebuild_subtree(WideBVH *bvh, Sphere *spheres, WideRebuild *rebuild)
+{
+    WideBVHNodeInfo *info = &bvh->nodeInfos[rebuild->nodeIdx];
+    uint32_t *sphereIdxs = rtalloc(sizeof(uint32_t) * info->spheres);
+    uint32_t count = 0;
+    uint32_t oldNodes = 0;
+    uint32_t oldPackets = 0;
+    collect_spheres(bvh, rebuild->nodeIdx, sphereIdxs, &count, &oldNodes, &oldPackets);
+
+    uint32_t root = build_subtree(bvh, spheres, sphereIdxs, count);
+    bvh->nodes[rebuild->parentIdx].children[rebuild->slot] = root;
+    bvh->garbageNodes += oldNodes;
+    bvh->garbagePackets += oldPackets;
+    rtfree(sphereIdxs);
+}
+
+/**
+ * Appends the indexes of the spheres of the subtree `nodeIdx` to `sphereIdxs` (`*count` of them) and adds the amounts of its nodes and
+ * packets to `*nodes`, `*packets`. (Each sphere of a subtree is in one packet lane, except for the lanes that repeat the last sphere of
+ * a packet.)
+ */
+static void collect_spheres(WideBVH *bvh, uint32_t nodeIdx, uint32_t *sphereIdxs, uint32_t *count, uint32_t *nodes, uint32_t *packets)
+{
+    WideBVHNode *node = &bvh->nodes[nodeIdx];
+    (*nodes)++;
+    for (uint32_t c = 0; c < WIDE_BVH_WIDTH; c++) {
+        uint32_t ref = node->children[c];
+        if (ref == WIDE_BVH_EMPTY) {
+            continue;
+        } else if (! (ref & WIDE_BVH_LEAF)) {
+            collect_spheres(bvh, ref, sphereIdxs, count, nodes, packets);
+            continue;
+        }
+        uint32_t first = ref & (WIDE_BVH_PACKETS_MAX - 1);
+        uint32_t last = first + leaf_packets(ref);
+        *packets += last - first;
+        for (uint32_t p = first; p < last; p++) {
+            WideBVHPacket *packet = &bvh->packets[p];
+            for (uint32_t i = 0; i < WIDE_BVH_WIDTH; i++) {
+                if (i == 0 || packet->spheres[i] != packet->spheres[i - 1]) {
+                    sphereIdxs[(*count)++] = packet->spheres[i];
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Sets the current SAH cost of the node `nodeIdx` (see WideBVHNodeInfo.cost) from its box and its children (whose costs must be
+ * current).
+ */
+static void update_cost(WideBVH *bvh, uint32_t nodeIdx)
+{
+    WideBVHNode *node = &bvh->nodes[nodeIdx];
+    WideBVHNodeInfo *info = &bvh->nodeInfos[nodeIdx];
+    double cost = WIDE_BVH_NODE_COST * bvh_box_area(info->min, info->max);
+    for (uint32_t c = 0; c < WIDE_BVH_WIDTH; c++) {
+        uint32_t ref = node->children[c];
+        if (ref == WIDE_BVH_EMPTY) {
+            continue;
+        }
+
+        // The boxes of the children are approximated by their quantized boxes (which are what the rays are tested against).
+        float min[3], max[3];
+        for (uint32_t a = 0; a < 3; a++) {
+            min[a] = dequantize(node->origin[a], node->scale[a], node->qmin[a][c]);
+            max[a] = dequantize(node->origin[a], node->scale[a], node->qmax[a][c]);
+        }
+        double area = bvh_box_area(min, max);
+        if (ref & WIDE_BVH_LEAF) {
+            cost += area * WIDE_BVH_PACKET_COST * leaf_packets(ref);
+        } else {
+            WideBVHNodeInfo *childInfo = &bvh->nodeInfos[ref];
+            double childArea = bvh_box_area(childInfo->min, childInfo->max);
+            cost += childArea > 0 ? childInfo->cost * (area / childArea) : childInfo->cost;
+        }
+    }
+    info->cost = cost;
+}
+
+/**
+ * Returns true if the SAH cost of the node with `info` grew by more than WIDE_BVH_REBUILD_COST since it was built.
+ */
+static inline bool is_degraded(WideBVHNodeInfo *info)
+{
+    return info->cost > WIDE_BVH_REBUILD_COST * info->buildCost;
+}
+
+/**
+ * Returns the largest quantized coordinate that is dequantized to <= `x` (quantize_up(): the smallest one that is dequantized to >= `x`),
+ * so that the quantized boxes never shrink.
+ */
+static inline uint8_t quantize_down(float origin, float scale, float x)
+{
+    if (scale == 0) {
+        return 0;
+    }
+    double q = floor(((double)x - origin) / scale);
+    int32_t qi = q < 0 ? 0 : (q > WIDE_BVH_QUANT_MAX ? WIDE_BVH_QUANT_MAX : (int32_t)q);
+    while (qi > 0 && dequantize(origin, scale, qi) > x) {
+        qi--;
+    }
+    return (uint8_t)qi;
+}
+
+static inline uint8_t quantize_up(float origin, float scale, float x)
+{
+    if (scale == 0) {
+        return 0;
+    }
+    double q = ceil(((double)x - origin) / scale);
+    int32_t qi = q < 0 ? 0 : (q > WIDE_BVH_QUANT_MAX ? WIDE_BVH_QUANT_MAX : (int32_t)q);
+    while (qi < WIDE_BVH_QUANT_MAX && dequantize(origin, scale, qi) < x) {
+        qi++;
+    }
+    return (uint8_t)qi;
+}
+
+/**
+ * Returns the coordinate of the quantized coordinate `q`: exactly what the node tests compute (in floats).
+ */
+static inline float dequantize(float origin, float scale, uint32_t q)
+{
+    return origin + (float)q * scale;
+}
+
+/**
+ * Returns the amount of packets of the leaf `ref`.
+ */
+static inline uint32_t leaf_packets(uint32_t ref)
+{
+    return ((ref & ~WIDE_BVH_LEAF) >> WIDE_BVH_LEAF_SHIFT) + 1;
+}
+
+/**
+ * Tests the ray against the boxes of the children of `node`. Returns a bit mask of the children whose boxes it hits at a distance
+ * [RAY_DISTANCE_MIN, maxDist] (bit i for child i, including the empty children) and stores the distances where it enters them in
+ * `nearDist`.
+ *
+ * The boxes are dequantized in floats, but the ray is tested against them in doubles (like bvh_ray_hits_node() does).
+ */
+static inline uint32_t node_hits(WideBVHNode *node, WideRay *r, double maxDist, double *nearDist)
+{
+#if defined(__SSE2__)
+    // Lanes 0, 1 and 2, 3 of the children (2 doubles per register).
+    __m128d near01 = _mm_set1_pd(RAY_DISTANCE_MIN);
+    __m128d near23 = near01;
+    __m128d far01 = _mm_set1_pd(maxDist);
+    __m128d far23 = far01;
+    __m128i zero = _mm_setzero_si128();
+    for (uint32_t a = 0; a < 3; a++) {
+        __m128 origin = _mm_set1_ps(node->origin[a]);
+        __m128 scale = _mm_set1_ps(node->scale[a]);
+        int32_t qmin, qmax;
+        memcpy(&qmin, node->qmin[a], sizeof(qmin));
+        memcpy(&qmax, node->qmax[a], sizeof(qmax));
+        __m128i qmin32 = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(qmin), zero), zero);
+        __m128i qmax32 = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(qmax), zero), zero);
+        __m128 lo = _mm_add_ps(origin, _mm_mul_ps(_mm_cvtepi32_ps(qmin32), scale));
+        __m128 hi = _mm_add_ps(origin, _mm_mul_ps(_mm_cvtepi32_ps(qmax32), scale));
+
+        __m128d rayOrigin = _mm_set1_pd(r->origin[a]);
+        __m128d invDir = _mm_set1_pd(r->invDir[a]);
+        __m128d t0 = _mm_mul_pd(_mm_sub_pd(_mm_cvtps_pd(lo), rayOrigin), invDir);
+        __m128d t1 = _mm_mul_pd(_mm_sub_pd(_mm_cvtps_pd(hi), rayOrigin), invDir);
+        near01 = _mm_max_pd(_mm_min_pd(t0, t1), near01);
+        far01 = _mm_min_pd(_mm_max_pd(t0, t1), far01);
+        t0 = _mm_mul_pd(_mm_sub_pd(_mm_cvtps_pd(_mm_movehl_ps(lo, lo)), rayOrigin), invDir);
+        t1 = _mm_mul_pd(_mm_sub_pd(_mm_cvtps_pd(_mm_movehl_ps(hi, hi)), rayOrigin), invDir);
+        near23 = _mm_max_pd(_mm_min_pd(t0, t1), near23);
+        far23 = _mm_min_pd(_mm_max_pd(t0, t1), far23);
+    }
+    _mm_storeu_pd(&nearDist[0], near01);
+    _mm_storeu_pd(&nearDist[2], near23);
+    return (uint32_t)_mm_movemask_pd(_mm_cmple_pd(near01, far01)) | ((uint32_t)_mm_movemask_pd(_mm_cmple_pd(near23, far23)) << 2);
+#else
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < WIDE_BVH_WIDTH; i++) {
+        double tNear = RAY_DISTANCE_MIN;
+        double tFar = maxDist;
+        for (uint32_t a = 0; a < 3; a++) {
+            double lo = dequantize(node->origin[a], node->scale[a], node->qmin[a][i]);
+            double hi = dequantize(node->origin[a], node->scale[a], node->qmax[a][i]);
+            double t0 = (lo - r->origin[a]) * r->invDir[a];
+            double t1 = (hi - r->origin[a]) * r->invDir[a];
+            double tEnter = t0 < t1 ? t0 : t1;
+            double tExit = t0 > t1 ? t0 : t1;
+            tNear = tEnter > tNear ? tEnter : tNear;
+            tFar = tExit < tFar ? tExit : tFar;
+        }
+        nearDist[i] = tNear;
+        mask |= (uint32_t)(tNear <= tFar) << i;
+    }
+    return mask;
+#endif // __SSE2__
+}
+
+/**
+ * Tests the ray against the spheres of `packet`. If it hits one closer than `*dist` - stores the distance to it in `*dist` and its index
+ * in `*sphere` and returns true.
+ *
+ * The distances are computed with exactly the same operations as ray_distance_to_sphere() does (with 2 spheres per SSE2 instruction), so
+ * they are the same as with the other sphere accelerators.
+ */
+/**
+ * Returns true if `ray` (and `r`, the same ray prepared for the traversal) hits any of the spheres of `packet` closer than `dist`, skipping
+ * the ones that emit light if `ignoreLights`.
+ */
+static inline bool packet_occluded(WideBVHPacket *packet, WideRay *r, Ray *ray, Sphere *spheres, double dist, bool ignoreLights)
+{
+    double d = dist;
+    uint32_t sphere;
+    if (! packet_hits(packet, r, ray, spheres, &d, &sphere)) {
+        return false;
+    }
+    if (! ignoreLights || ! mat_is_emitter(spheres[sphere].material)) {
+        return true;
+    }
+
+    // The closest sphere of the packet emits light, but another one may be hit as well (packet_hits() computes the same distances as
+    // ray_distance_to_sphere()).
+    for (uint32_t i = 0; i < WIDE_BVH_WIDTH; i++) {
+        Sphere *s = &spheres[packet->spheres[i]];
+        if (mat_is_emitter(s->material)) {
+            continue;
+        }
+        d = calc_ray_distance_to_sphere(ray, s);
+        if (d >= RAY_DISTANCE_MIN && d < dist) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Prepares `r` for tracing `ray` through a wide BVH.
+ */
+static inline void wide_ray_init(WideRay *r, Ray *ray)
+{
+    r->origin[0] = ray->origin.x;
+    r->origin[1] = ray->origin.y;
+    r->origin[2] = ray->origin.z;
+    r->direction[0] = ray->direction.x;
+    r->direction[1] = ray->direction.y;
+    r->direction[2] = ray->direction.z;
+    for (uint32_t a = 0; a < 3; a++) {
+        // A ray that is parallel to a slab gets a huge (instead of an infinite) inverted direction, so that the node tests don't need a
+        // special case for it: (bound - origin) * invDir is then 0 for an origin on the boundary (instead of NaN) and huge elsewhere.
+        double d = r->direction[a];
+        r->invDir[a] = fabs(d) * DBL_MAX < 1.0 ? copysign(DBL_MAX, d) : 1.0 / d;
+    }
+    double a = vector3_dot(&ray->direction, &ray->direction);
+    r->a2 = 2.0 * a;
+    r->a4 = 4 * a;
+}
+
+static inline bool packet_hits(WideBVHPacket *packet, WideRay *r, Ray *ray, Sphere *spheres, double *dist, uint32_t *sphere)
+{
+    bool hit = false;
+#if defined(__SSE2__)
+    (void)(ray);        // Disable gcc -Wextra "unused parameter" errors.
+    (void)(spheres);
+
+    __m128d originX = _mm_set1_pd(r->origin[0]);
+    __m128d originY = _mm_set1_pd(r->origin[1]);
+    __m128d originZ = _mm_set1_pd(r->origin[2]);
+    __m128d dirX = _mm_set1_pd(r->direction[0]);
+    __m128d dirY = _mm_set1_pd(r->direction[1]);
+    __m128d dirZ = _mm_set1_pd(r->direction[2]);
+    __m128d a2 = _mm_set1_pd(r->a2);
+    __m128d a4 = _mm_set1_pd(r->a4);
+    __m128d two = _mm_set1_pd(2.0);
+    __m128d distMin = _mm_set1_pd(RAY_DISTANCE_MIN);
+    __m128d signBit = _mm_set1_pd(-0.0);
+    for (uint32_t i = 0; i < WIDE_BVH_WIDTH; i += 2) {
+        __m128d ocX = _mm_sub_pd(originX, _mm_loadu_pd(&packet->centerX[i]));
+        __m128d ocY = _mm_sub_pd(originY, _mm_loadu_pd(&packet->centerY[i]));
+        __m128d ocZ = _mm_sub_pd(originZ, _mm_loadu_pd(&packet->centerZ[i]));
+        __m128d radius = _mm_loadu_pd(&packet->radius[i]);
+
+        __m128d dirDotOc = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dirX, ocX), _mm_mul_pd(dirY, ocY)), _mm_mul_pd(dirZ, ocZ));
+        __m128d ocDotOc = _mm_add_pd(_mm_add_pd(_mm_mul_pd(ocX, ocX), _mm_mul_pd(ocY, ocY)), _mm_mul_pd(ocZ, ocZ));
+        __m128d b = _mm_mul_pd(two, dirDotOc);
+        __m128d c = _mm_sub_pd(ocDotOc, _mm_mul_pd(radius, radius));
+        __m128d discriminant = _mm_sub_pd(_mm_mul_pd(b, b), _mm_mul_pd(a4, c));
+
+        // A negative discriminant gives a NaN distance, which fails the comparisons below (a miss).
+        __m128d sqrtDiscriminant = _mm_sqrt_pd(discriminant);
+        __m128d negB = _mm_xor_pd(b, signBit);
+        __m128d distLarger = _mm_div_pd(_mm_add_pd(negB, sqrtDiscriminant), a2);
+        __m128d distSmaller = _mm_div_pd(_mm_sub_pd(negB, sqrtDiscriminant), a2);
+        __m128d useLarger = _mm_cmplt_pd(distSmaller, distMin);
+        __m128d d = _mm_or_pd(_mm_and_pd(useLarger, distLarger), _mm_andnot_pd(useLarger, distSmaller));
+
+        __m128d closer = _mm_and_pd(_mm_cmpge_pd(d, distMin), _mm_cmplt_pd(d, _mm_set1_pd(*dist)));
+        if (_mm_movemask_pd(closer) == 0) {
+            continue;
+        }
+        double lanes[2];
+        _mm_storeu_pd(lanes, d);
+        for (uint32_t j = 0; j < 2; j++) {
+            if (lanes[j] >= RAY_DISTANCE_MIN && lanes[j] < *dist) {
+                *dist = lanes[j];
+                *sphere = packet->spheres[i + j];
+                hit = true;
+            }
+        }
+    }
+#else
+    (void)(r);          // Disable gcc -Wextra "unused parameter" errors.
+
+    for (uint32_t i = 0; i < WIDE_BVH_WIDTH; i++) {
+        double d = calc_ray_distance_to_sphere(ray, &spheres[packet->spheres[i]]);
+        if (d >= RAY_DISTANCE_MIN && d < *dist) {
+            *dist = d;
+            *sphere = packet->spheres[i];
+            hit = true;
+        }
+    }
+#endif // __SSE2__
+    return hit;
+}
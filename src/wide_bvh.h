@@ -0,0 +1,177 @@
+#ifndef __WIDE_BVH_H__
+#define __WIDE_BVH_H__
+
+/**
+ * A wide (4-ary) BVH over the spheres of a scene (see Scene.sphereAccel), with compressed nodes: for scenes with so many spheres (10^6
+ * and more) that neither the spheres nor a binary BVH over them (see bvh.h) fit into the CPU caches, and tracing a ray is mostly waiting
+ * for memory.
+ *
+ * It is built by collapsing a binary SAH BVH (see bvh_build()): each node gets the (up to) 4 grandchildren/children with the largest
+ * surface areas. A node is a single cache line (64 bytes): the boxes of its children are stored as 8-bit offsets from the box of the node
+ * itself (see WideBVHNode), rounded outwards, so they never miss a part of a child. A ray is tested against all 4 boxes of a node at once,
+ * with SSE2 instructions (if the CPU has them, otherwise with plain C code that computes exactly the same).
+ *
+ * The leaves are packets of 4 spheres (WideBVHPacket), stored as arrays of each coordinate (instead of an array of Spheres), so a ray is
+ * tested against 4 spheres at once as well. The packets keep copies of the centers and radiuses of the spheres (the hits are computed
+ * exactly like ray_distance_to_sphere() does), so the traversal never reads the (much larger) Sphere structs, only the one that is hit.
+ *
+ * When spheres move (or change their radiuses), the BVH doesn't have to be rebuilt: wide_bvh_refit() updates the packets and the boxes
+ * of the nodes bottom-up, one level of the tree at a time (in parallel), keeping its structure. The quality of the tree (its SAH cost)
+ * degrades as the spheres get away from the spheres they were grouped with, so the refit also compares the cost of each subtree with its
+ * cost when it was built, and rebuilds the subtrees that got too much worse (or the whole BVH, if they are too large).
+ */
+
+typedef struct WideBVH_s        WideBVH;
+typedef struct WideBVHNode_s    WideBVHNode;
+typedef struct WideBVHPacket_s  WideBVHPacket;
+typedef struct WideBVHNodeInfo_s WideBVHNodeInfo;
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+// The amount of children of a node and of spheres of a packet.
+#define WIDE_BVH_WIDTH          4
+
+// The maximum amount of packets of a leaf (leaves with more spheres are split, see emit_leaf() in wide_bvh.c).
+#define WIDE_BVH_LEAF_PACKETS   16
+
+// The children of nodes (WideBVHNode.children) are encoded as: WIDE_BVH_EMPTY for no child, the index of the child node or
+// WIDE_BVH_LEAF | ((amount of packets - 1) << WIDE_BVH_LEAF_SHIFT) | the index of the first packet, for a leaf.
+#define WIDE_BVH_EMPTY          UINT32_MAX
+#define WIDE_BVH_LEAF           0x80000000u
+#define WIDE_BVH_LEAF_SHIFT     27
+#define WIDE_BVH_PACKETS_MAX    (1u << WIDE_BVH_LEAF_SHIFT)
+
+// The maximum amount of nodes (or leaves) that a traversal has to come back to.
+#define WIDE_BVH_STACK_MAX      256
+
+// The SAH costs of testing a ray against the boxes of a node and against the spheres of a packet (see WideBVHNodeInfo.cost).
+#define WIDE_BVH_NODE_COST      1.0
+#define WIDE_BVH_PACKET_COST    1.0
+
+// A refit rebuilds a subtree whose SAH cost grew by more than this factor since it was built (see wide_bvh_refit()).
+#define WIDE_BVH_REBUILD_COST   1.5
+
+// If the subtrees that need to be rebuilt have more than this fraction of the spheres (or the nodes of the old rebuilt subtrees take up
+// more memory than the live ones), the whole BVH is rebuilt instead.
+#define WIDE_BVH_PARTIAL_MAX    0.5
+
+// The amount of nodes per task, when refitting with worker threads.
+#define WIDE_BVH_REFIT_TASK_SIZE    1024
+
+
+struct WideBVHNode_s {
+    // The lower corner of the box of the node and the size of one step of the quantized coordinates along each axis: the boxes of the
+    // children are [origin + qmin * scale, origin + qmax * scale] (computed in floats, qmin/qmax are 0 .. 255).
+    float           origin[3];
+    float           scale[3];
+    uint8_t         qmin[3][WIDE_BVH_WIDTH];    // By axis, then by child (so the 4 children of an axis are loaded at once).
+    uint8_t         qmax[3][WIDE_BVH_WIDTH];
+    uint32_t        children[WIDE_BVH_WIDTH];
+};
+
+struct WideBVHPacket_s {
+    double          centerX[WIDE_BVH_WIDTH];
+    double          centerY[WIDE_BVH_WIDTH];
+    double          centerZ[WIDE_BVH_WIDTH];
+    double          radius[WIDE_BVH_WIDTH];
+
+    // The indexes of the spheres (of Scene.spheres). Packets of leaves with fewer spheres are padded by repeating the last sphere.
+    uint32_t        spheres[WIDE_BVH_WIDTH];
+};
+
+// The data of a node that only the refits use (see wide_bvh_refit()), kept apart from the nodes, so the traversal doesn't load it.
+struct WideBVHNodeInfo_s {
+    float           min[3];             // The box of the node (the quantized boxes of the node's parent only approximate it).
+    float           max[3];
+
+    // The SAH cost of the subtree of the node after the last refit, and when the subtree was built: the sum of the WIDE_BVH_NODE_COST of
+    // each node and the WIDE_BVH_PACKET_COST of each packet, times the surface area of its box. (Not divided by the area of the subtree's
+    // own box: when spheres move away, the box grows and the other children take a smaller fraction of it, hiding the growth.)
+    float           cost;
+    float           buildCost;
+    uint32_t        spheres;            // The amount of spheres in the subtree.
+};
+
+struct WideBVH_s {
+    WideBVHNode    *nodes;              // NULL if the BVH is empty. nodes[0] is the root.
+    WideBVHNodeInfo *nodeInfos;         // One per node.
+    uint32_t        nodesLength;
+    uint32_t        nodesCapacity;
+    WideBVHPacket  *packets;
+    uint32_t        packetsLength;
+    uint32_t        packetsCapacity;
+
+    // The nodes that can be reached from the root, by their depth: the nodes of depth d are levelNodes[levelFirst[d] ..
+    // levelFirst[d + 1]), for d < levelsLength. Subtrees that were rebuilt by a refit leave their old nodes and packets unreachable (in
+    // `garbageNodes`, `garbagePackets`), until the next full rebuild.
+    uint32_t       *levelNodes;
+    uint32_t       *levelFirst;
+    uint32_t        levelsLength;
+    uint32_t        garbageNodes;
+    uint32_t        garbagePackets;
+
+    // What the refits did, since the BVH was initialized.
+    uint32_t        refits;
+    uint32_t        partialRebuilds;    // Refits that rebuilt some of the subtrees.
+    uint32_t        rebuilds;           // Refits that rebuilt the whole BVH.
+};
+
+
+// Included after the structs: ray.h includes scene.h, which needs the complete WideBVH type.
+#include "ray.h"
+#include "sphere.h"
+#include "workers.h"
+
+
+/**
+ * Initializes `bvh` as an empty BVH.
+ */
+void wide_bvh_init(WideBVH *bvh);
+
+/**
+ * Frees the nodes and packets of `bvh` (it becomes empty).
+ */
+void wide_bvh_free(WideBVH *bvh);
+
+/**
+ * (Re-)builds `bvh` over the `spheresLength` `spheres`.
+ */
+void wide_bvh_build(WideBVH *bvh, Sphere *spheres, uint32_t spheresLength);
+
+/**
+ * Updates `bvh` after the centers and/or radiuses of its `spheres` changed (but not their amount or order, otherwise it has to be built
+ * again with wide_bvh_build()): refits the boxes of its nodes and packets (using the threads of `workers`, if not NULL) and rebuilds the
+ * subtrees whose SAH cost grew by more than WIDE_BVH_REBUILD_COST (or the whole BVH, see WIDE_BVH_PARTIAL_MAX).
+ */
+void wide_bvh_refit(WideBVH *bvh, Sphere *spheres, uint32_t spheresLength, WorkerPool *workers);
+
+/**
+ * Returns the amount of memory used by the nodes and packets of `bvh`, in bytes.
+ */
+uint64_t wide_bvh_size(WideBVH *bvh);
+
+/**
+ * Returns true if the nodes and packets of `bvh` (e.g. read from a file) can be traversed safely over `spheresLength` spheres: every
+ * child of a node is an existing node that comes after it (so there are no cycles) or a leaf of existing packets, the packets refer to
+ * existing spheres and the tree is not deeper than WIDE_BVH_STACK_MAX allows.
+ */
+bool wide_bvh_valid(WideBVH *bvh, uint32_t spheresLength);
+
+/**
+ * Finds the closest of the `spheres` (that `bvh` was built over) that `ray` hits closer than `*dist` (and not closer than
+ * RAY_DISTANCE_MIN). If there is one - stores the distance to it in `*dist` and returns it. Otherwise returns NULL. Adds the amount of
+ * the ray-sphere tests done to `*tests` (WIDE_BVH_WIDTH per packet, including the padding).
+ */
+Sphere * wide_bvh_intersect(WideBVH *bvh, Sphere *spheres, Ray *ray, double *dist, uint32_t *tests);
+
+/**
+ * Returns true if `ray` hits any of the `spheres` (that `bvh` was built over) closer than `dist` (and not closer than RAY_DISTANCE_MIN),
+ * skipping the spheres that emit light (see mat_is_emitter()) if `ignoreLights`: stops at the first packet with a hit, without ordering
+ * the children of the nodes by distance. Adds the amount of the ray-sphere tests done to `*tests` (like wide_bvh_intersect()).
+ */
+bool wide_bvh_occluded(WideBVH *bvh, Sphere *spheres, Ray *ray, double dist, bool ignoreLights, uint32_t *tests);
+
+#endif // __WIDE_BVH_H__
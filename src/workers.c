@@ -0,0 +1,214 @@
+#include "../envconfig.h"
+#if defined(ENV_LINUX) && ENV_LINUX
+#include <unistd.h>
+#else
+#include <windows.h>
+#endif // ENV_LINUX
+
+#include "rtalloc.h"
+#include "perf_counters.h"
+#include "rtcommon.h"
+#include "timeline.h"
+#include "workers.h"
+
+
+typedef struct WorkerThreadArg_s    WorkerThreadArg;
+
+struct WorkerThreadArg_s {
+    WorkerPool *pool;
+    uint32_t    workerIdx;
+};
+
+
+static void * worker_thread_main(void *arg);
+static inline void workers_run_tasks(WorkerPool *pool, uint32_t workerIdx);
+static inline double seconds_since(struct timespec *start);
+
+
+uint32_t workers_cpu_count()
+{
+#if defined(ENV_LINUX) && ENV_LINUX
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#else
+    SYSTEM_INFO sysInfo;
+    GetSystemInfo(&sysInfo);
+    long cpus = sysInfo.dwNumberOfProcessors;
+#endif // ENV_LINUX
+
+    return cpus < 1 ? 1 : (uint32_t)cpus;
+}
+
+void workers_init(WorkerPool *pool, uint32_t threadsCount)
+{
+    if (threadsCount == 0) {
+        threadsCount = workers_cpu_count();
+    }
+
+    pool->threadsCount  = threadsCount;
+    pool->threads       = rtalloc(sizeof(pthread_t) * threadsCount);
+    pool->fn            = NULL;
+    pool->ctx           = NULL;
+    pool->tasksCount    = 0;
+    pool->batch         = 0;
+    pool->threadsBusy   = 0;
+    pool->shutdown      = false;
+    pool->runSeconds    = 0;
+    pool->busySeconds   = rtalloc(sizeof(double) * threadsCount);
+    for (uint32_t i = 0; i < threadsCount; i++) {
+        pool->busySeconds[i] = 0;
+    }
+    atomic_init(&pool->nextTask, 0);
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->workCond, NULL);
+    pthread_cond_init(&pool->doneCond, NULL);
+
+    // Worker 0 is the thread calling workers_run(), so we only need to start the other ones.
+    for (uint32_t i = 1; i < threadsCount; i++) {
+        WorkerThreadArg *arg = rtalloc(sizeof(WorkerThreadArg));
+        arg->pool = pool;
+        arg->workerIdx = i;
+
+        int status = pthread_create(&pool->threads[i], NULL, worker_thread_main, arg);
+        if (status != 0) {
+            log_err("Fatal error: could not create a worker thread (error %d)", status);
+            exit(1);
+        }
+    }
+}
+
+void workers_run(WorkerPool *pool, WorkerTaskFn fn, void *ctx, uint32_t tasksCount)
+{
+    struct timespec tstart;
+    clock_gettime(CLOCK_MONOTONIC, &tstart);
+
+    if (pool->threadsCount == 1) {
+        pool->tasksCount = tasksCount;
+        for (uint32_t i = 0; i < tasksCount; i++) {
+            fn(ctx, i, 0);
+        }
+        double seconds = seconds_since(&tstart);
+        pool->runSeconds += seconds;
+        pool->busySeconds[0] += seconds;
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->fn            = fn;
+    pool->ctx           = ctx;
+    pool->tasksCount    = tasksCount;
+    pool->threadsBusy   = pool->threadsCount - 1;
+    atomic_store_explicit(&pool->nextTask, 0, memory_order_relaxed);
+    pool->batch++;
+    pthread_cond_broadcast(&pool->workCond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    workers_run_tasks(pool, 0);
+
+    // Wait for the background threads to finish their last tasks.
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->threadsBusy > 0) {
+        pthread_cond_wait(&pool->doneCond, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    pool->runSeconds += seconds_since(&tstart);
+}
+
+double workers_utilization(WorkerPool *pool, int32_t workerIdx)
+{
+    if (pool->runSeconds <= 0) {
+        return 0;
+    }
+    if (workerIdx >= 0) {
+        return pool->busySeconds[workerIdx] / pool->runSeconds;
+    }
+
+    double busy = 0;
+    for (uint32_t i = 0; i < pool->threadsCount; i++) {
+        busy += pool->busySeconds[i];
+    }
+    return busy / (pool->runSeconds * pool->threadsCount);
+}
+
+void workers_destroy(WorkerPool *pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->workCond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (uint32_t i = 1; i < pool->threadsCount; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&pool->doneCond);
+    pthread_cond_destroy(&pool->workCond);
+    pthread_mutex_destroy(&pool->mutex);
+    rtfree(pool->threads);
+    pool->threads = NULL;
+    rtfree(pool->busySeconds);
+    pool->busySeconds = NULL;
+}
+
+static void * worker_thread_main(void *arg)
+{
+    WorkerThreadArg *threadArg = arg;
+    WorkerPool *pool = threadArg->pool;
+    uint32_t workerIdx = threadArg->workerIdx;
+    rtfree(threadArg);
+
+    if (TIMELINE_ENABLED) {
+        char name[32];
+        snprintf(name, sizeof(name), "worker %u", workerIdx);
+        timeline_set_thread_name(name);
+    }
+
+    uint64_t lastBatch = 0;
+    while (true) {
+        pthread_mutex_lock(&pool->mutex);
+        while (! pool->shutdown && pool->batch == lastBatch) {
+            pthread_cond_wait(&pool->workCond, &pool->mutex);
+        }
+        if (pool->shutdown) {
+            pthread_mutex_unlock(&pool->mutex);
+            perf_counters_close_thread();
+            return NULL;
+        }
+        lastBatch = pool->batch;
+        pthread_mutex_unlock(&pool->mutex);
+
+        workers_run_tasks(pool, workerIdx);
+
+        pthread_mutex_lock(&pool->mutex);
+        pool->threadsBusy--;
+        if (pool->threadsBusy == 0) {
+            pthread_cond_signal(&pool->doneCond);
+        }
+        pthread_mutex_unlock(&pool->mutex);
+    }
+}
+
+static inline void workers_run_tasks(WorkerPool *pool, uint32_t workerIdx)
+{
+    WorkerTaskFn fn = pool->fn;
+    void *ctx = pool->ctx;
+    uint32_t tasksCount = pool->tasksCount;
+
+    struct timespec tstart;
+    clock_gettime(CLOCK_MONOTONIC, &tstart);
+    while (true) {
+        uint32_t taskIdx = atomic_fetch_add_explicit(&pool->nextTask, 1, memory_order_relaxed);
+        if (taskIdx >= tasksCount) {
+            break;
+        }
+        fn(ctx, taskIdx, workerIdx);
+    }
+    pool->busySeconds[workerIdx] += seconds_since(&tstart);
+}
+
+static inline double seconds_since(struct timespec *start)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (t.tv_sec - start->tv_sec) + (t.tv_nsec - start->tv_nsec) / 1000000000.0;
+}
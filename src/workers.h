@@ -0,0 +1,82 @@
+#ifndef __WORKERS_H__
+#define __WORKERS_H__
+
+/**
+ * A small pool of persistent worker threads, for splitting per-frame work (e.g. image rows) across CPU cores.
+ *
+ * The threads are created once (during startup) and then sleep until workers_run() gives them some work. The thread calling
+ * workers_run() also works on the tasks (it is worker 0), so a pool of 1 thread doesn't create any additional threads at all.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+
+typedef struct WorkerPool_s     WorkerPool;
+
+/**
+ * A task function. Called once for each `taskIdx` in [0, tasksCount) (see workers_run()), from any of the pool's threads.
+ * `workerIdx` is the index [0, threadsCount) of the thread that is running the task (can be used for per-thread data).
+ */
+typedef void (*WorkerTaskFn)(void *ctx, uint32_t taskIdx, uint32_t workerIdx);
+
+
+struct WorkerPool_s {
+    uint32_t            threadsCount;       // Including the thread calling workers_run().
+    pthread_t          *threads;            // (threadsCount - 1) background threads.
+
+    pthread_mutex_t     mutex;
+    pthread_cond_t      workCond;           // Signalled when a new batch of tasks is available (or on shutdown).
+    pthread_cond_t      doneCond;           // Signalled when the last background thread finishes the current batch.
+
+    // The current batch of tasks. Only modified by workers_run(), while all background threads are idle.
+    WorkerTaskFn        fn;
+    void               *ctx;
+    uint32_t            tasksCount;
+    _Atomic uint32_t    nextTask;
+
+    uint64_t            batch;              // Incremented for every batch, so that threads can tell a new batch from a spurious wakeup.
+    uint32_t            threadsBusy;        // How many background threads are still working on the current batch.
+    bool                shutdown;
+
+    // Utilization accounting (see workers_utilization()): the total time spent in workers_run(), and the time each thread spent
+    // running tasks. Each thread only adds to its own busySeconds, and only reads them between batches.
+    double              runSeconds;
+    double             *busySeconds;
+};
+
+
+/**
+ * Returns the amount of CPU cores (logical processors) that are available.
+ */
+uint32_t workers_cpu_count();
+
+/**
+ * Initializes the pool and starts its threads. If `threadsCount` is 0 - uses one thread per CPU core.
+ */
+void workers_init(WorkerPool *pool, uint32_t threadsCount);
+
+/**
+ * Runs `fn` for each task in [0, tasksCount) on all threads of the pool (including the calling thread) and returns once all tasks are
+ * done. Tasks are handed out dynamically (one at a time, in increasing order), so tasks may take different amounts of time.
+ *
+ * Must not be called concurrently, or from within a task.
+ */
+void workers_run(WorkerPool *pool, WorkerTaskFn fn, void *ctx, uint32_t tasksCount);
+
+/**
+ * Returns the fraction [0, 1] of the time spent in workers_run() (since the pool was initialized) that thread `workerIdx` spent running
+ * tasks (the rest it spent waiting for the other threads to finish theirs, or for a batch to start). If `workerIdx` is -1, returns the
+ * average of all threads. Must not be called during workers_run().
+ */
+double workers_utilization(WorkerPool *pool, int32_t workerIdx);
+
+/**
+ * Stops and joins the pool's threads.
+ */
+void workers_destroy(WorkerPool *pool);
+
+#endif // __WORKERS_H__